@@ -1,20 +1,42 @@
 #version 450 core
 
+struct Particle {
+    vec4 position;
+    vec4 velocity;
+    vec4 color;
+};
+
 layout(push_constant) uniform ShaderData {
     mat4x4 g_proj_matrix;
     mat4x4 g_view_matrix;
 };
 
+layout (std430, binding = 0) readonly buffer Particles {
+    Particle particles[];
+};
+
+layout (std430, binding = 1) readonly buffer AliveList {
+    uint aliveList[];
+};
+
+// the Counters block of particles.comp, aliveOffset points at the alive list written this frame
+layout (std430, binding = 2) readonly buffer Counters {
+    uint counters[];
+};
+
+// index of aliveOffset inside the Counters block, in uints
+const uint kAliveOffsetIndex = 15;
+
 layout (location = 0) in vec3 in_vertex_position;
-layout (location = 1) in vec3 in_position;
-layout (location = 2) in vec4 in_color;
 
 layout (location = 0) out vec4 vs_color;
 
 void main() {
-    vec4 clip_pos = g_view_matrix * vec4(in_position, 1) + vec4(in_vertex_position, 0);
+    Particle particle = particles[aliveList[counters[kAliveOffsetIndex] + gl_InstanceIndex]];
+
+    vec4 clip_pos = g_view_matrix * vec4(particle.position.xyz, 1) + vec4(in_vertex_position, 0);
 
     gl_Position = g_proj_matrix * clip_pos;
 
-    vs_color = in_color;
-}
\ No newline at end of file
+    vs_color = particle.color;
+}
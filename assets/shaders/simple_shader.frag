@@ -1,7 +1,8 @@
 #version 450
 
-#define COUNT_VOXELS 8
-#define COUNT_STEPS 32
+// specialized by the application, Volume holds at most 8x8x8 voxels
+layout(constant_id = 0) const int COUNT_VOXELS = 8;
+layout(constant_id = 1) const int COUNT_STEPS = 32;
 
 layout(location = 0) in vec3 fragVertexColor;
 layout(location = 1) in vec3 fragOrigin;
@@ -0,0 +1,95 @@
+#include "gfx/PipelineStateKey.hpp"
+
+#include <map>
+#include <bit>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdio>
+#include <limits>
+#include <algorithm>
+
+// Measures what a draw pays to find its pipeline variant: the packed key lookup in the open
+// addressing map against the previous hash-combined key in a std::map. No device is needed,
+// the pipelines are fake handles.
+
+static constexpr size_t kDrawCount = 1'000'000;
+static constexpr size_t kRepeatCount = 8;
+
+static auto makeKey(std::mt19937_64& random) -> gfx::PipelineStateKey {
+    std::uniform_int_distribution<uint32_t> ids(1, 64);
+    std::uniform_int_distribution<uint32_t> bits(0, 0xFF);
+    std::uniform_real_distribution<float> biases(0.0F, 4.0F);
+
+    gfx::PipelineStateKey key = {};
+    key.words[0] = static_cast<uint64_t>(ids(random)) | static_cast<uint64_t>(bits(random)) << 32;
+    key.words[1] = static_cast<uint64_t>(std::bit_cast<uint32_t>(1.0F)) | static_cast<uint64_t>(std::bit_cast<uint32_t>(biases(random))) << 32;
+    key.words[2] = static_cast<uint64_t>(std::bit_cast<uint32_t>(biases(random))) << 32;
+    return key;
+}
+
+// the key as it was hashed before, VULKAN_HPP_HASH_COMBINE over every field
+static auto combine(gfx::PipelineStateKey const& key) -> size_t {
+    size_t seed = 0;
+    for (auto word : key.words) {
+        seed ^= std::hash<uint64_t>{}(word) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+    return seed;
+}
+
+template<typename Fn>
+static auto measure(Fn&& fn) -> double {
+    auto best = std::numeric_limits<double>::max();
+    for (size_t i = 0; i < kRepeatCount; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, elapsed / static_cast<double>(kDrawCount));
+    }
+    return best;
+}
+
+auto main() -> int {
+    std::printf("%8s %16s %16s\n", "variants", "PipelineMap", "std::map");
+
+    for (size_t variantCount : {1, 4, 16, 64, 256, 1024}) {
+        std::mt19937_64 random(variantCount);
+
+        std::vector<gfx::PipelineStateKey> keys = {};
+        gfx::PipelineMap packed = {};
+        std::map<size_t, vk::Pipeline> combined = {};
+        while (keys.size() < variantCount) {
+            auto key = makeKey(random);
+            auto pipeline = std::bit_cast<VkPipeline>(static_cast<uintptr_t>(keys.size() + 1));
+            if (packed.emplace(key, pipeline).second) {
+                combined.emplace(combine(key), pipeline);
+                keys.emplace_back(key);
+            }
+        }
+
+        // draws mostly repeat the previous variant, like consecutive draws of one material
+        std::vector<uint32_t> draws(kDrawCount);
+        std::uniform_int_distribution<size_t> pick(0, variantCount - 1);
+        for (size_t i = 0; i < kDrawCount; ++i) {
+            draws[i] = static_cast<uint32_t>(i % 8 == 0 ? pick(random) : draws[i - 1]);
+        }
+
+        uint64_t sink = 0;
+        auto packedNs = measure([&] {
+            for (auto draw : draws) {
+                sink += reinterpret_cast<uint64_t>(static_cast<VkPipeline>(*packed.find(keys[draw])));
+            }
+        });
+        auto combinedNs = measure([&] {
+            for (auto draw : draws) {
+                sink += reinterpret_cast<uint64_t>(static_cast<VkPipeline>(combined.find(combine(keys[draw]))->second));
+            }
+        });
+
+        std::printf("%8zu %13.2f ns %13.2f ns\n", variantCount, packedNs, combinedNs);
+        if (sink == 0) {
+            std::printf("\n");
+        }
+    }
+    return 0;
+}
@@ -36,6 +36,7 @@ public:
 
     void render() override {
         auto drawable = swapchain->nextDrawable();
+        commandBuffer->waitForDrawable(drawable);
         auto drawableSize = swapchain->drawableSize();
 
         vk::Rect2D rendering_area = {};
@@ -57,7 +58,7 @@ public:
         rendering_info.colorAttachments[0].storeOp = vk::AttachmentStoreOp::eStore;
 
         commandBuffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
-        commandBuffer->setImageLayout(drawable->texture, vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal, vk::PipelineStageFlagBits2::eTopOfPipe, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2{}, vk::AccessFlagBits2::eColorAttachmentWrite);
+        commandBuffer->setImageLayout(drawable->texture, vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2{}, vk::AccessFlagBits2::eColorAttachmentWrite);
 
         auto ctx = rc<Canvas>::init(imgui->drawList());
 
@@ -67,14 +68,13 @@ public:
         auto encoder = commandBuffer->newRenderCommandEncoder(rendering_info);
         encoder->setScissor(0, rendering_area);
         encoder->setViewport(0, rendering_viewport);
-        imgui->draw(encoder);
+        imgui->draw(frameContext, encoder);
         encoder->endEncoding();
 
-        commandBuffer->setImageLayout(drawable->texture, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::ePresentSrcKHR, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::PipelineStageFlagBits2::eBottomOfPipe, vk::AccessFlagBits2::eColorAttachmentWrite, vk::AccessFlagBits2{});
+        commandBuffer->setImageLayout(drawable->texture, vk::ImageLayout::eColorAttachmentOptimal, drawable->presentLayout(), vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::PipelineStageFlagBits2::eBottomOfPipe, vk::AccessFlagBits2::eColorAttachmentWrite, vk::AccessFlagBits2{});
         commandBuffer->end();
         commandBuffer->submit();
         commandBuffer->present(drawable);
-        commandBuffer->waitUntilCompleted();
     }
 
 private:
@@ -8,6 +8,16 @@
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
+#include <span>
+#include <cstdio>
+#include <numeric>
+#include <fstream>
+#include <optional>
+#include <algorithm>
+#include <filesystem>
+
+#include <spdlog/spdlog.h>
+
 #include <SDL_video.h>
 #include <SDL_vulkan.h>
 #include <SDL_events.h>
@@ -17,13 +27,18 @@ struct ShaderData {
     alignas(16) glm::mat4x4 g_view_matrix;
 };
 
+// When headless no window is created and every size query reports the fixed size it was created with.
 class WindowPlatform : public ManagedObject {
 public:
-    explicit WindowPlatform(const char* title, uint32_t width, uint32_t height) {
-        window = SDL_CreateWindow(title, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 800, 600, SDL_WINDOW_VULKAN | SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_RESIZABLE);
+    explicit WindowPlatform(const char* title, uint32_t width, uint32_t height, bool headless = false) : width(width), height(height) {
+        if (!headless) {
+            window = SDL_CreateWindow(title, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 800, 600, SDL_WINDOW_VULKAN | SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_RESIZABLE);
+        }
     }
     ~WindowPlatform() override {
-        SDL_DestroyWindow(window);
+        if (window != nullptr) {
+            SDL_DestroyWindow(window);
+        }
     }
 
 public:
@@ -34,17 +49,16 @@ public:
     }
 
     auto getAspectRatio() -> float {
-        int32_t width;
-        int32_t height;
-        SDL_GetWindowSize(window, &width, &height);
-
-        return static_cast<float>(width) / static_cast<float>(height);
+        auto size = getWindowSize();
+        return static_cast<float>(size.width) / static_cast<float>(size.height);
     }
 
     auto getWindowSize() -> vk::Extent2D {
-        int32_t width;
-        int32_t height;
-        SDL_GetWindowSize(window, &width, &height);
+        int32_t width = static_cast<int32_t>(this->width);
+        int32_t height = static_cast<int32_t>(this->height);
+        if (window != nullptr) {
+            SDL_GetWindowSize(window, &width, &height);
+        }
 
         vk::Extent2D size;
         size.setWidth(width);
@@ -53,9 +67,11 @@ public:
     }
 
     auto getDrawableSize() -> vk::Extent2D {
-        int width;
-        int height;
-        SDL_Vulkan_GetDrawableSize(window, &width, &height);
+        int width = static_cast<int>(this->width);
+        int height = static_cast<int>(this->height);
+        if (window != nullptr) {
+            SDL_Vulkan_GetDrawableSize(window, &width, &height);
+        }
 
         vk::Extent2D size;
         size.setWidth(width);
@@ -65,15 +81,98 @@ public:
 
 private:
     SDL_Window* window = nullptr;
+    uint32_t    width  = {};
+    uint32_t    height = {};
+};
+
+// Headless runs render a fixed number of frames into offscreen drawables with a fixed time step and
+// write the measured frame times as JSON, so that every example doubles as a reproducible benchmark.
+// GFX_HEADLESS_FRAMES  - number of frames to render, setting it enables the headless mode
+// GFX_HEADLESS_SIZE    - drawable size as WIDTHxHEIGHT, 800x600 by default
+// GFX_HEADLESS_OUTPUT  - where to write the frame times, "-" for stdout, <title>.frametimes.json by default
+struct HeadlessConfiguration {
+    uint32_t                frameCount  = {};
+    vk::Extent2D            extent      = {};
+    float_t                 timeStep    = {};
+    std::filesystem::path   output      = {};
+
+    static auto fromEnvironment(const char* title) -> std::optional<HeadlessConfiguration> {
+        auto frames = std::getenv("GFX_HEADLESS_FRAMES");
+        if (frames == nullptr) {
+            return std::nullopt;
+        }
+
+        HeadlessConfiguration config = {};
+        config.frameCount = static_cast<uint32_t>(std::max(std::atoi(frames), 1));
+        config.extent = vk::Extent2D().setWidth(800).setHeight(600);
+        config.timeStep = 1.0F / 60.0F;
+        config.output = std::string(title) + ".frametimes.json";
+
+        if (auto size = std::getenv("GFX_HEADLESS_SIZE")) {
+            uint32_t width;
+            uint32_t height;
+            if (std::sscanf(size, "%ux%u", &width, &height) == 2 && width != 0 && height != 0) {
+                config.extent = vk::Extent2D().setWidth(width).setHeight(height);
+            }
+        }
+        if (auto output = std::getenv("GFX_HEADLESS_OUTPUT")) {
+            config.output = output;
+        }
+        return config;
+    }
+};
+
+// Presentation knobs, the defaults are what the examples were tuned with.
+// GFX_PRESENT_MODE       - fifo, fifo-relaxed, mailbox or immediate, unsupported modes fall back to the closest one
+// GFX_MAX_FRAME_LATENCY  - frames the CPU may record ahead of the GPU, the frames in flight of the application by default
+struct PresentConfiguration {
+    vk::PresentModeKHR  presentMode     = vk::PresentModeKHR::eFifo;
+    uint32_t            maxFrameLatency = {};
+
+    static auto fromEnvironment(uint32_t framesInFlight) -> PresentConfiguration {
+        PresentConfiguration config = {};
+        config.maxFrameLatency = framesInFlight;
+
+        if (auto mode = std::getenv("GFX_PRESENT_MODE")) {
+            auto name = std::string_view(mode);
+            if (name == "fifo") {
+                config.presentMode = vk::PresentModeKHR::eFifo;
+            } else if (name == "fifo-relaxed") {
+                config.presentMode = vk::PresentModeKHR::eFifoRelaxed;
+            } else if (name == "mailbox") {
+                config.presentMode = vk::PresentModeKHR::eMailbox;
+            } else if (name == "immediate") {
+                config.presentMode = vk::PresentModeKHR::eImmediate;
+            } else {
+                spdlog::warn("Unknown present mode {}, using fifo", name);
+            }
+        }
+        if (auto latency = std::getenv("GFX_MAX_FRAME_LATENCY")) {
+            config.maxFrameLatency = static_cast<uint32_t>(std::max(std::atoi(latency), 1));
+        }
+        return config;
+    }
+};
+
+struct FrameTiming {
+    double cpu      = {}; // update and render, until the frame is submitted
+    double frame    = {}; // since the previous frame was submitted, includes waiting for the GPU to retire older frames
 };
 
 struct Application {
 public:
-    explicit Application(const char* title) {
-        platform = rc<WindowPlatform>::init(title, 800, 600);
+    explicit Application(const char* title, uint32_t framesInFlight = 2) : title(title) {
+        headless = HeadlessConfiguration::fromEnvironment(title);
+        present = PresentConfiguration::fromEnvironment(framesInFlight);
+        if (headless) {
+            platform = rc<WindowPlatform>::init(title, headless->extent.width, headless->extent.height, true);
+        } else {
+            platform = rc<WindowPlatform>::init(title, 800, 600);
+        }
         instance = gfx::createInstance(gfx::InstanceConfiguration{
             .name = title,
-            .version = 1
+            .version = 1,
+            .headless = headless.has_value()
         });
         adapter = instance->enumerateAdapters().front();
 
@@ -81,83 +180,187 @@ public:
             auto queue_priorities = std::array{
                 1.0F
             };
-            auto queue_create_infos = std::array{
+            auto queue_create_infos = std::vector{
                 vk::DeviceQueueCreateInfo()
                     .setQueueFamilyIndex(0)
                     .setQueuePriorities(queue_priorities)
             };
-            auto extensions = std::array{
-                VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+            auto queue_families = adapter->handle.getQueueFamilyProperties(instance->dispatcher);
+            for (uint32_t i = 0; i < queue_families.size(); ++i) {
+                auto flags = queue_families[i].queueFlags;
+                if ((flags & vk::QueueFlagBits::eTransfer) && !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute))) {
+                    queue_create_infos.emplace_back(vk::DeviceQueueCreateInfo()
+                        .setQueueFamilyIndex(i)
+                        .setQueuePriorities(queue_priorities));
+                    break;
+                }
+            }
+            auto extensions = std::vector<const char*>{
                 VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+            };
+            if (!headless) {
+                extensions.emplace_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+            }
+            auto optional_extensions = std::array{
                 VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME,
+                VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME,
+                VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME,
+                VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME,
+                VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME,
+                VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
+                VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME,
+                VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
             };
+            auto available_extensions = adapter->handle.enumerateDeviceExtensionProperties(nullptr, instance->dispatcher);
+            for (auto extension : optional_extensions) {
+                auto supported = std::ranges::any_of(available_extensions, [extension](const vk::ExtensionProperties& properties) {
+                    return std::string_view(properties.extensionName.data()) == extension;
+                });
+                if (supported) {
+                    extensions.emplace_back(extension);
+                }
+            }
             auto synchronization_2_features = vk::PhysicalDeviceSynchronization2Features()
                 .setSynchronization2(VK_TRUE);
             auto portability_subset_features = vk::PhysicalDevicePortabilitySubsetFeaturesKHR()
                 .setPNext(&synchronization_2_features)
                 .setImageViewFormatSwizzle(VK_TRUE);
+            auto portability_subset = std::ranges::find(extensions, std::string_view(VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME)) != extensions.end();
             auto timeline_semaphore_features = vk::PhysicalDeviceTimelineSemaphoreFeatures()
-                .setPNext(&portability_subset_features)
+                .setPNext(portability_subset ? static_cast<void*>(&portability_subset_features) : static_cast<void*>(&synchronization_2_features))
                 .setTimelineSemaphore(VK_TRUE);
             auto dynamic_rendering_features = vk::PhysicalDeviceDynamicRenderingFeatures()
                 .setPNext(&timeline_semaphore_features)
                 .setDynamicRendering(VK_TRUE);
+
+            // extended dynamic state and pipeline libraries are optional, only what the device supports is enabled
+            auto has_extension = [&extensions](std::string_view name) {
+                return std::ranges::find(extensions, name) != extensions.end();
+            };
+            auto supported_optional_features = adapter->handle.getFeatures2<
+                vk::PhysicalDeviceFeatures2,
+                vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT,
+                vk::PhysicalDeviceExtendedDynamicState2FeaturesEXT,
+                vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT,
+                vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT,
+                vk::PhysicalDeviceUniformBufferStandardLayoutFeatures
+            >(instance->dispatcher);
+            void* features_next = &dynamic_rendering_features;
+            auto extended_dynamic_state_features = vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT()
+                .setExtendedDynamicState(supported_optional_features.get<vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT>().extendedDynamicState);
+            if (has_extension(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME)) {
+                features_next = &extended_dynamic_state_features.setPNext(features_next);
+            }
+            auto extended_dynamic_state_2_features = vk::PhysicalDeviceExtendedDynamicState2FeaturesEXT()
+                .setExtendedDynamicState2(supported_optional_features.get<vk::PhysicalDeviceExtendedDynamicState2FeaturesEXT>().extendedDynamicState2);
+            if (has_extension(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME)) {
+                features_next = &extended_dynamic_state_2_features.setPNext(features_next);
+            }
+            auto extended_dynamic_state_3_features = vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT()
+                .setExtendedDynamicState3DepthClampEnable(supported_optional_features.get<vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT>().extendedDynamicState3DepthClampEnable)
+                .setExtendedDynamicState3PolygonMode(supported_optional_features.get<vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT>().extendedDynamicState3PolygonMode);
+            if (has_extension(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME)) {
+                features_next = &extended_dynamic_state_3_features.setPNext(features_next);
+            }
+            auto graphics_pipeline_library_features = vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT()
+                .setGraphicsPipelineLibrary(supported_optional_features.get<vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT>().graphicsPipelineLibrary);
+            if (has_extension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) && has_extension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+                features_next = &graphics_pipeline_library_features.setPNext(features_next);
+            }
+            // lets push constant blocks that are spilled to a uniform buffer keep their layout
+            auto uniform_buffer_standard_layout_features = vk::PhysicalDeviceUniformBufferStandardLayoutFeatures()
+                .setPNext(features_next)
+                .setUniformBufferStandardLayout(supported_optional_features.get<vk::PhysicalDeviceUniformBufferStandardLayoutFeatures>().uniformBufferStandardLayout);
+            features_next = &uniform_buffer_standard_layout_features;
+
+            auto supported_features = adapter->handle.getFeatures(instance->dispatcher);
+            auto features = vk::PhysicalDeviceFeatures()
+                .setPipelineStatisticsQuery(supported_features.pipelineStatisticsQuery)
+                .setImageCubeArray(supported_features.imageCubeArray)
+                .setInheritedQueries(supported_features.inheritedQueries);
             auto features_2 = vk::PhysicalDeviceFeatures2()
-                .setPNext(&dynamic_rendering_features);
+                .setPNext(features_next)
+                .setFeatures(features);
             auto create_info = vk::DeviceCreateInfo()
                 .setPNext(&features_2)
                 .setQueueCreateInfos(queue_create_infos)
                 .setPEnabledExtensionNames(extensions);
             device = adapter->createDevice(create_info);
+
+            // GFX_PROFILE_TRACE - where to write a Chrome trace of the GPU time spent in every encoder and debug group
+            if (auto trace = std::getenv("GFX_PROFILE_TRACE")) {
+                profileTracePath = trace;
+                profiler = device->newProfiler(gfx::ProfilerConfiguration{
+                    .pipelineStatistics = device->inheritedQueries && supported_features.pipelineStatisticsQuery == VK_TRUE
+                });
+            }
         }
 
+        // GFX_PIPELINE_VARIANT_STATISTICS - count the pipeline variants dynamic state saved, off by default as it locks at every dirty draw
+        device->pipelineVariantStatistics = std::getenv("GFX_PIPELINE_VARIANT_STATISTICS") != nullptr;
 
+        pipelineCachePath = std::filesystem::temp_directory_path() / (std::string(title) + ".pipelinecache");
+        device->loadPipelineCache(pipelineCachePath);
 
-        surface = platform->createSurface(instance);
-        swapchain = device->createSwapchain(surface);
+        if (headless) {
+            swapchain = device->createOffscreenSwapchain(headless->extent);
+        } else {
+            surface = platform->createSurface(instance);
+            swapchain = device->createSwapchain(surface);
+        }
 
-        gfx::SurfaceConfiguration surface_config = {};
-        surface_config.format = vk::Format::eB8G8R8A8Unorm;
-        surface_config.color_space = vk::ColorSpaceKHR::eSrgbNonlinear;
-        surface_config.image_count = 3;
-        surface_config.present_mode = vk::PresentModeKHR::eFifo;
-        surface_config.clipped = true;
-        swapchain->configure(surface_config);
+        swapchain->configure(_surfaceConfiguration());
 
         commandQueue = device->newCommandQueue();
-        commandBuffer = commandQueue->newCommandBuffer();
+        commandQueue->setProfiler(profiler);
+        uploadQueue = device->newUploadQueue();
+        frameContextRing = rc<gfx::FrameContextRing>::init(commandQueue, present.maxFrameLatency);
+        renderGraph = rc<gfx::RenderGraph>::init(device, present.maxFrameLatency);
 
-        imgui = rc<ImGuiBackend>::init(device);
+        imgui = rc<ImGuiBackend>::init(device, uploadQueue);
         canvas = rc<Canvas>::init(imgui->drawList());
     }
 
 public:
     void run() {
-        auto previous = std::chrono::steady_clock::now();
+        if (headless) {
+            _runHeadless();
+        } else {
+            _runInteractive();
+        }
 
-        while (true) {
-            using seconds = std::chrono::duration<float, std::chrono::seconds::period>;
+        frameContextRing->waitUntilCompleted();
+        device->savePipelineCache(pipelineCachePath);
 
-            auto current = std::chrono::steady_clock::now();
-            auto elapsed = seconds(current - previous).count();
-            previous = current;
+        if (profiler) {
+            profiler->writeChromeTrace(profileTracePath);
+            spdlog::info("GPU trace with {} scopes written to {}", profiler->copySamples().size(), profileTracePath.string());
+        }
 
-            accumulateTotal -= accumulate[accumulateIndex];
-            accumulate[accumulateIndex] = elapsed;
-            accumulateTotal += accumulate[accumulateIndex];
-            accumulateIndex = (accumulateIndex + 1) % static_cast<int32_t>(std::size(accumulate));
-            accumulateCount = std::min(accumulateCount + 1, static_cast<int32_t>(std::size(accumulate)));
-            average = accumulateTotal / static_cast<float>(accumulateCount);
+        auto statistics = device->pipelineCacheStatistics();
+        spdlog::info("Pipeline cache: {} hits, {} misses, {:.3f} ms compiling", statistics.hits, statistics.misses, std::chrono::duration<double, std::milli>(statistics.compileTime).count());
+        if (device->pipelineVariantStatistics) {
+            spdlog::info("Dynamic state: {} pipeline variants avoided", statistics.variantsAvoided);
+        }
 
-            if (_pollEvents()) {
-                break;
+        gfx::DescriptorAllocatorStatistics descriptors = {};
+        for (auto& context : frameContextRing->frameContexts) {
+            auto& frame = context->commandBuffer->descriptorAllocator->statistics;
+            for (uint32_t i = 0; i < gfx::kDescriptorTypeCount; ++i) {
+                descriptors.peakDescriptors.counts[i] = std::max(descriptors.peakDescriptors.counts[i], frame.peakDescriptors.counts[i]);
             }
+            descriptors.peakSets = std::max(descriptors.peakSets, frame.peakSets);
+            descriptors.poolCount = std::max(descriptors.poolCount, frame.poolCount);
+        }
+        spdlog::info("Descriptors: peak {} sets per frame in {} pools", descriptors.peakSets, descriptors.poolCount);
 
-            imgui->setCurrentContext();
-            imgui->setScreenSize(getUISize(platform->getWindowSize()));
+        for (auto& pool_size : descriptors.peakDescriptors.poolSizes()) {
+            spdlog::info("  {}: {}", vk::to_string(pool_size.type), pool_size.descriptorCount);
+        }
 
-            update(elapsed);
-            render();
+        auto memory = device->memoryStatistics();
+        for (uint32_t i = 0; i < memory.heaps.size(); ++i) {
+            spdlog::info("Memory heap {}: {:.1f} of {:.1f} MiB", i, double(memory.heaps[i].usage) / (1024.0 * 1024.0), double(memory.heaps[i].budget) / (1024.0 * 1024.0));
         }
     }
 
@@ -172,17 +375,123 @@ public:
     virtual void mouseWheel(SDL_MouseWheelEvent* event) {}
     virtual void performClose(uint32_t windowId) {}
     virtual void performResize(uint32_t windowId) {
+        frameContextRing->waitUntilCompleted();
+        swapchain->configure(_surfaceConfiguration());
+    }
+
+protected:
+    auto _surfaceConfiguration() const -> gfx::SurfaceConfiguration {
         gfx::SurfaceConfiguration config;
         config.format = vk::Format::eB8G8R8A8Unorm;
         config.color_space = vk::ColorSpaceKHR::eSrgbNonlinear;
         config.image_count = 3;
-        config.present_mode = vk::PresentModeKHR::eFifo;
+        config.present_mode = present.presentMode;
         config.clipped = true;
+        config.max_frame_latency = present.maxFrameLatency;
+        return config;
+    }
+
+    void _runInteractive() {
+        auto previous = std::chrono::steady_clock::now();
+
+        while (true) {
+            using seconds = std::chrono::duration<float, std::chrono::seconds::period>;
+
+            auto current = std::chrono::steady_clock::now();
+            auto elapsed = seconds(current - previous).count();
+            previous = current;
+
+            if (_pollEvents()) {
+                break;
+            }
+            _frame(elapsed);
+        }
+    }
+
+    // the application sees the same time step every frame, so two runs of the same example record the same work
+    void _runHeadless() {
+        using milliseconds = std::chrono::duration<double, std::chrono::milliseconds::period>;
+
+        std::vector<FrameTiming> timings = {};
+        timings.reserve(headless->frameCount);
+
+        auto start = std::chrono::steady_clock::now();
+        auto previous = start;
+        for (uint32_t i = 0; i < headless->frameCount; ++i) {
+            auto begin = std::chrono::steady_clock::now();
+            _frame(headless->timeStep);
+            auto end = std::chrono::steady_clock::now();
+
+            timings.emplace_back(FrameTiming{
+                .cpu = milliseconds(end - begin).count(),
+                .frame = milliseconds(end - previous).count()
+            });
+            previous = end;
+        }
+        frameContextRing->waitUntilCompleted();
 
-        swapchain->configure(config);
+        _writeFrameTimings(timings, milliseconds(std::chrono::steady_clock::now() - start).count());
+    }
+
+    void _frame(float elapsed) {
+        accumulateTotal -= accumulate[accumulateIndex];
+        accumulate[accumulateIndex] = elapsed;
+        accumulateTotal += accumulate[accumulateIndex];
+        accumulateIndex = (accumulateIndex + 1) % static_cast<int32_t>(std::size(accumulate));
+        accumulateCount = std::min(accumulateCount + 1, static_cast<int32_t>(std::size(accumulate)));
+        average = accumulateTotal / static_cast<float>(accumulateCount);
+
+        imgui->setCurrentContext();
+        imgui->setScreenSize(getUISize(platform->getWindowSize()));
+
+        frameContext = frameContextRing->nextFrameContext();
+        commandBuffer = frameContext->commandBuffer;
+        renderGraph->reset();
+
+        update(elapsed);
+
+        // the frame only waits on the GPU side, uploads recorded during update are not blocking
+        auto uploadValue = uploadQueue->flush();
+        if (uploadValue != 0) {
+            commandBuffer->encodeWait(uploadQueue->semaphore, uploadValue, vk::PipelineStageFlagBits::eAllCommands);
+        }
+        render();
+    }
+
+    void _writeFrameTimings(std::span<const FrameTiming> timings, double total) {
+        auto summary = [&](double FrameTiming::* member) -> std::string {
+            std::vector<double> values = {};
+            values.reserve(timings.size());
+            for (auto& timing : timings) {
+                values.emplace_back(timing.*member);
+            }
+            std::ranges::sort(values);
+
+            auto percentile = [&](double p) {
+                return values[std::min(values.size() - 1, static_cast<size_t>(p * static_cast<double>(values.size())))];
+            };
+            auto mean = std::accumulate(values.begin(), values.end(), 0.0) / static_cast<double>(values.size());
+            return fmt::format(R"({{"mean": {:.4f}, "min": {:.4f}, "p50": {:.4f}, "p95": {:.4f}, "p99": {:.4f}, "max": {:.4f}}})", mean, values.front(), percentile(0.50), percentile(0.95), percentile(0.99), values.back());
+        };
+
+        std::string json = {};
+        json += fmt::format(R"({{"name": "{}", "width": {}, "height": {}, "frames": {}, "timeStep": {:.6f}, "totalMs": {:.4f},)", title, headless->extent.width, headless->extent.height, timings.size(), headless->timeStep, total);
+        json += fmt::format(R"( "cpuMs": {}, "frameMs": {}, "samples": [)", summary(&FrameTiming::cpu), summary(&FrameTiming::frame));
+        for (size_t i = 0; i < timings.size(); ++i) {
+            json += fmt::format(R"({}{{"cpuMs": {:.4f}, "frameMs": {:.4f}}})", i == 0 ? "" : ", ", timings[i].cpu, timings[i].frame);
+        }
+        json += "]}\n";
+
+        if (headless->output == "-") {
+            std::fwrite(json.data(), 1, json.size(), stdout);
+            return;
+        }
+
+        std::ofstream file(headless->output, std::ios::binary);
+        file.write(json.data(), static_cast<std::streamsize>(json.size()));
+        spdlog::info("Frame times for {} frames written to {}", timings.size(), headless->output.string());
     }
 
-protected:
     auto _pollEvents() -> bool {
         bool quit = false;
         SDL_Event event;
@@ -278,12 +587,17 @@ public:
 
 //todo: make this private
 protected:
+    std::string                         title           = {};
+    std::optional<HeadlessConfiguration> headless       = {};
+    PresentConfiguration                present         = {};
     rc<WindowPlatform>       platform        = {};
     float_t                             average         = {};
     float_t                             accumulate[60]  = {};
     float_t                             accumulateTotal = {};
     int32_t                             accumulateCount = {};
     int32_t                             accumulateIndex = {};
+    std::filesystem::path               pipelineCachePath = {};
+    std::filesystem::path               profileTracePath = {};
 
     rc<gfx::Adapter>         adapter         = {};
     rc<gfx::Device>          device          = {};
@@ -292,6 +606,11 @@ protected:
 
     rc<gfx::Swapchain>       swapchain       = {};
     rc<gfx::CommandQueue>    commandQueue    = {};
+    rc<gfx::UploadQueue>     uploadQueue     = {};
+    rc<gfx::Profiler>        profiler        = {};
+    rc<gfx::FrameContextRing> frameContextRing = {};
+    rc<gfx::FrameContext>    frameContext    = {};
+    rc<gfx::RenderGraph>     renderGraph     = {};
     rc<gfx::CommandBuffer>   commandBuffer   = {};
 
     rc<Canvas>               canvas;
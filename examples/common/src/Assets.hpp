@@ -1,5 +1,7 @@
 #pragma once
 
+#include "gfx/ShaderArchive.hpp"
+
 #include <vector>
 #include <fstream>
 #include <filesystem>
@@ -9,4 +11,10 @@ struct Assets {
         std::ifstream file{path};
         return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
     }
+
+    // every shader of the examples, built by target_compile_shaders(common ...)
+    static auto shaderArchive() -> rc<gfx::ShaderArchive> const& {
+        static auto archive = rc<gfx::ShaderArchive>::init("shaders/common.shaderarchive");
+        return archive;
+    }
 };
\ No newline at end of file
@@ -9,15 +9,14 @@ struct GuiShaderData {
     simd::float2 scale;
 };
 
-ImGuiBackend::ImGuiBackend(const rc<gfx::Device>& device) : device(device) {
-    buildFonts();
+ImGuiBackend::ImGuiBackend(const rc<gfx::Device>& device, const rc<gfx::UploadQueue>& uploadQueue) : device(device) {
+    buildFonts(uploadQueue);
     buildShaders();
-    buildBuffers();
 
     im_shared_data.CurveTessellationTol = 0.10F;
 }
 
-void ImGuiBackend::buildFonts() {
+void ImGuiBackend::buildFonts(const rc<gfx::UploadQueue>& uploadQueue) {
     ImFontConfig font_cfg = {};
     font_cfg.SizePixels = 72.0F;
 
@@ -36,7 +35,7 @@ void ImGuiBackend::buildFonts() {
     font_texture_description.format = vk::Format::eR8G8B8A8Unorm;
     font_texture_description.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
     font_texture = device->newTexture(font_texture_description);
-    font_texture->replaceRegion(pixels.data(), pixels.size() * sizeof(uint32_t));
+    uploadQueue->replaceRegion(font_texture, pixels.data(), pixels.size() * sizeof(uint32_t));
 
     vk::SamplerCreateInfo font_sampler_description = {};
     font_sampler_description.setMagFilter(vk::Filter::eLinear);
@@ -55,8 +54,8 @@ void ImGuiBackend::buildFonts() {
 }
 
 void ImGuiBackend::buildShaders() {
-    auto vert_library = device->newLibrary(Assets::readFile("shaders/gui.vert.spv"));
-    auto frag_library = device->newLibrary(Assets::readFile("shaders/gui.frag.spv"));
+    auto vert_library = device->newLibraryFromArchive(Assets::shaderArchive(), "gui.vert");
+    auto frag_library = device->newLibraryFromArchive(Assets::shaderArchive(), "gui.frag");
 
     auto vertex_input_state = rc<gfx::VertexInputState>::init();
     vertex_input_state->bindings = {
@@ -81,17 +80,7 @@ void ImGuiBackend::buildShaders() {
     render_pipeline_state = device->newRenderPipelineState(description);
 }
 
-void ImGuiBackend::buildBuffers() {
-    dynamic_buffer = device->newBuffer(
-        vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eVertexBuffer,
-        5ULL * 1024ULL * 1024ULL,
-        gfx::StorageMode::eShared,
-        0);
-}
-
 void ImGuiBackend::resetForNewFrame() {
-    dynamic_buffer_offset = 0;
-
     im_draw_list._ResetForNewFrame();
     im_draw_list.PushClipRect(ImVec2(0, 0), ImVec2(screen_size.width, screen_size.height));
     im_draw_list.PushTextureID(im_font_atlas.TexID);
@@ -105,7 +94,7 @@ auto ImGuiBackend::drawList() -> ImDrawList* {
     return &im_draw_list;
 }
 
-void ImGuiBackend::draw(const rc<gfx::RenderCommandEncoder>& encoder) {
+void ImGuiBackend::draw(const rc<gfx::FrameContext>& frameContext, const rc<gfx::RenderCommandEncoder>& encoder) {
     if (im_draw_list.IdxBuffer.Size == 0) {
         return;
     }
@@ -139,20 +128,15 @@ void ImGuiBackend::draw(const rc<gfx::RenderCommandEncoder>& encoder) {
 
     device->handle.updateDescriptorSets(writes, {}, device->dispatcher);
 
-    vk::DeviceSize vertex_buffer_offset = dynamic_buffer_offset;
-    dynamic_buffer_offset += im_draw_list.VtxBuffer.Size * sizeof(ImDrawVert);
-
-    vk::DeviceSize index_buffer_offset  = dynamic_buffer_offset;
-    dynamic_buffer_offset += im_draw_list.IdxBuffer.Size * sizeof(ImDrawIdx);
-
-    std::memcpy(static_cast<std::byte*>(dynamic_buffer->contents()) + vertex_buffer_offset, im_draw_list.VtxBuffer.Data, im_draw_list.VtxBuffer.Size * sizeof(ImDrawVert));
-    std::memcpy(static_cast<std::byte*>(dynamic_buffer->contents()) + index_buffer_offset, im_draw_list.IdxBuffer.Data, im_draw_list.IdxBuffer.Size * sizeof(ImDrawIdx));
+    // slices of the partition of the frame being recorded, the GPU is not reading them anymore
+    auto vertices = frameContext->transientAllocator->allocate(std::span<ImDrawVert const>(im_draw_list.VtxBuffer.Data, im_draw_list.VtxBuffer.Size));
+    auto indices = frameContext->transientAllocator->allocate(std::span<ImDrawIdx const>(im_draw_list.IdxBuffer.Data, im_draw_list.IdxBuffer.Size));
 
     encoder->setRenderPipelineState(render_pipeline_state);
     encoder->bindDescriptorSet(descriptor_set, 0);
     encoder->pushConstants(vk::ShaderStageFlagBits::eVertex, 0, sizeof(GuiShaderData), &gui_shader_data);
-    encoder->bindVertexBuffer(0, dynamic_buffer, vertex_buffer_offset);
-    encoder->bindIndexBuffer(dynamic_buffer, index_buffer_offset, vk::IndexType::eUint16);
+    encoder->bindVertexBuffer(0, vertices);
+    encoder->bindIndexBuffer(indices, vk::IndexType::eUint16);
 
     for (auto& drawCmd : std::span(im_draw_list.CmdBuffer.Data, im_draw_list.CmdBuffer.Size)) {
         encoder->drawIndexed(drawCmd.ElemCount, 1, drawCmd.IdxOffset, static_cast<int32_t>(drawCmd.VtxOffset), 0);
@@ -6,19 +6,18 @@
 
 struct ImGuiBackend : public ManagedObject {
 public:
-    explicit ImGuiBackend(const rc<gfx::Device>& device);
+    explicit ImGuiBackend(const rc<gfx::Device>& device, const rc<gfx::UploadQueue>& uploadQueue);
 
 private:
-    void buildFonts();
+    void buildFonts(const rc<gfx::UploadQueue>& uploadQueue);
     void buildShaders();
-    void buildBuffers();
 
 public:
     void resetForNewFrame();
     void setCurrentContext();
 
     auto drawList() -> ImDrawList*;
-    void draw(const rc<gfx::RenderCommandEncoder>& encoder);
+    void draw(const rc<gfx::FrameContext>& frameContext, const rc<gfx::RenderCommandEncoder>& encoder);
     void setScreenSize(const Size& size);
 
 private:
@@ -32,7 +31,5 @@ private:
     rc<gfx::Device>              device                  = {};
     rc<gfx::Texture>             font_texture            = {};
     rc<gfx::Sampler>             font_sampler            = {};
-    rc<gfx::Buffer>              dynamic_buffer          = {};
-    vk::DeviceSize                          dynamic_buffer_offset   = {};
     rc<gfx::RenderPipelineState> render_pipeline_state   = {};
 };
\ No newline at end of file
@@ -64,16 +64,16 @@ public:
     }
 
 public:
-    void uploadMeshData(const rc<gfx::Device>& device) {
+    void uploadMeshData(const rc<gfx::UploadQueue>& uploadQueue) {
         if (indices_.empty()) {
             index_buffer_ = {};
         } else {
-            index_buffer_ = device->newBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indices_.data(), indices_.size() * sizeof(uint32_t), gfx::StorageMode::eShared);
+            index_buffer_ = uploadQueue->newBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indices_.data(), indices_.size() * sizeof(uint32_t));
         }
         if (vertices_.empty()) {
             vertex_buffer_ = {};
         } else {
-            vertex_buffer_ = device->newBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertices_.data(), vertices_.size() * sizeof(Vertex), gfx::StorageMode::eShared);
+            vertex_buffer_ = uploadQueue->newBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertices_.data(), vertices_.size() * sizeof(Vertex));
         }
     }
 
@@ -10,8 +10,8 @@ public:
 
 private:
     void buildShaders() {
-        auto vertexLibrary = device->newLibrary(Assets::readFile("shaders/geometry.vert.spv"));
-        auto fragmentLibrary = device->newLibrary(Assets::readFile("shaders/geometry.frag.spv"));
+        auto vertexLibrary = device->newLibraryFromArchive(Assets::shaderArchive(), "geometry.vert");
+        auto fragmentLibrary = device->newLibraryFromArchive(Assets::shaderArchive(), "geometry.frag");
 
         gfx::DepthStencilStateDescription depthStencilStateDescription;
         depthStencilState = device->newDepthStencilState(depthStencilStateDescription);
@@ -36,27 +36,47 @@ private:
         render_pipeline_state = device->newRenderPipelineState(renderPipelineStateDescription);
         sampler = device->newSampler(vk::SamplerCreateInfo{
             .magFilter = vk::Filter::eNearest,
-            .minFilter = vk::Filter::eNearest,
+            .minFilter = vk::Filter::eLinear,
             .mipmapMode = vk::SamplerMipmapMode::eLinear,
             .addressModeU = vk::SamplerAddressMode::eRepeat,
             .addressModeV = vk::SamplerAddressMode::eRepeat,
             .addressModeW = vk::SamplerAddressMode::eRepeat,
+            .maxLod = VK_LOD_CLAMP_NONE,
         });
+        // an orange and white checker whose mipmaps blend towards a flat pale orange with the distance
         texture = device->newTexture(gfx::TextureDescription{
-            .width = 1,
-            .height = 1,
+            .width = 16,
+            .height = 16,
+            .mipLevelCount = 5,
             .format = vk::Format::eR8G8B8A8Unorm,
-            .usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+            .usage = vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
         });
 
-        std::array<uint8_t, 4> orange = {255, 127, 0, 255};
-        texture->replaceRegion(orange.data(), sizeof(orange));
+        std::array<uint32_t, 16 * 16> pixels = {};
+        for (uint32_t y = 0; y < 16; ++y) {
+            for (uint32_t x = 0; x < 16; ++x) {
+                pixels[y * 16 + x] = ((x / 4 + y / 4) % 2) != 0 ? 0xFF007FFFU : 0xFFFFFFFFU;
+            }
+        }
+        textureStaging = device->newBuffer(vk::BufferUsageFlagBits::eTransferSrc, pixels.data(), sizeof(pixels), gfx::StorageMode::eShared);
+    }
+
+    // the base level and its mipmaps are recorded into the first frame
+    void encodeTexture() {
+        auto blit = commandBuffer->newBlitCommandEncoder("albedo");
+        blit->imageBarrier(texture, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone, vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite);
+        blit->copyBufferToTexture(textureStaging, 0, texture);
+        blit->generateMipmaps(texture);
+        blit->endEncoding();
+
+        // the staging buffer is read by this frame, it goes away once the frame completed
+        commandBuffer->addCompletedHandler([staging = std::exchange(textureStaging, {})] {});
     }
 
     void buildBuffers() {
         gltf_bundle = GltfBundle::open("models/Fox.glb");
         for (auto& mesh : gltf_bundle.meshes) {
-            mesh->uploadMeshData(device);
+            mesh->uploadMeshData(uploadQueue);
         }
     }
 
@@ -70,6 +90,7 @@ public:
 
     void render() override {
         auto drawable = swapchain->nextDrawable();
+        commandBuffer->waitForDrawable(drawable);
         auto drawableSize = swapchain->drawableSize();
 
         vk::Rect2D rendering_area = {};
@@ -95,6 +116,9 @@ public:
         shader_data.g_view_matrix = world_to_camera_matrix;
 
         commandBuffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+        if (textureStaging) {
+            encodeTexture();
+        }
 
         auto descriptorSet = commandBuffer->newDescriptorSet(render_pipeline_state, 0);
 
@@ -122,23 +146,29 @@ public:
 
         device->handle.updateDescriptorSets(2, writes, 0, nullptr, device->dispatcher);
 
-        commandBuffer->setImageLayout(drawable->texture, vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal, vk::PipelineStageFlagBits2::eTopOfPipe, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2{}, vk::AccessFlagBits2::eColorAttachmentWrite);
-
-        auto encoder = commandBuffer->newRenderCommandEncoder(rendering_info);
-        encoder->setDepthStencilState(depthStencilState);
-        encoder->setRenderPipelineState(render_pipeline_state);
-        encoder->bindDescriptorSet(descriptorSet, 0);
-        encoder->pushConstants(vk::ShaderStageFlagBits::eVertex, 0, sizeof(ShaderData), &shader_data);
-        encoder->setScissor(0, rendering_area);
-        encoder->setViewport(0, rendering_viewport);
-        gltf_bundle.meshes.front()->draw(encoder);
-        encoder->endEncoding();
+        auto backbuffer = renderGraph->importTexture("backbuffer", drawable->texture, vk::ImageLayout::eUndefined, drawable->presentLayout(), vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2::eNone);
+        // generateMipmaps of the first frame already made the texture visible to every later read
+        auto albedo = renderGraph->importTexture("albedo", texture, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eNone);
+
+        renderGraph->addPass("geometry", gfx::RenderGraphPassType::eRender)
+            .read(albedo, gfx::TextureUsage::eSampled)
+            .write(backbuffer, gfx::TextureUsage::eColorAttachment)
+            .execute([&](gfx::RenderGraphContext& context) {
+                auto encoder = context.commandBuffer->newRenderCommandEncoder(rendering_info);
+                encoder->setDepthStencilState(depthStencilState);
+                encoder->setRenderPipelineState(render_pipeline_state);
+                encoder->bindDescriptorSet(descriptorSet, 0);
+                encoder->pushConstants(vk::ShaderStageFlagBits::eVertex, 0, sizeof(ShaderData), &shader_data);
+                encoder->setScissor(0, rendering_area);
+                encoder->setViewport(0, rendering_viewport);
+                gltf_bundle.meshes.front()->draw(encoder);
+                encoder->endEncoding();
+            });
+        renderGraph->execute(commandBuffer);
 
-        commandBuffer->setImageLayout(drawable->texture, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::ePresentSrcKHR, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::PipelineStageFlagBits2::eBottomOfPipe, vk::AccessFlagBits2::eColorAttachmentWrite, vk::AccessFlagBits2{});
         commandBuffer->end();
         commandBuffer->submit();
         commandBuffer->present(drawable);
-        commandBuffer->waitUntilCompleted();
     }
 
 private:
@@ -150,6 +180,7 @@ private:
 
     rc<gfx::Sampler>             sampler;
     rc<gfx::Texture>             texture;
+    rc<gfx::Buffer>              textureStaging;
     rc<gfx::DepthStencilState>   depthStencilState;
     rc<gfx::RenderPipelineState> render_pipeline_state;
 };
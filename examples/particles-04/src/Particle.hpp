@@ -1,12 +1,55 @@
 #pragma once
 
+#include "Graphics.hpp"
+
+#include <limits>
 #include <glm/glm.hpp>
 
+// Layouts below mirror assets/shaders/particles.comp
+
 struct Particle {
-    glm::vec3 position = {};
-    glm::vec3 velocity = {};
+    glm::vec4 position = {};    // w - remaining lifetime
+    glm::vec4 velocity = {};    // w - initial lifetime
+    glm::vec4 color = {};
+};
+
+struct ParticleEmitRequest {
+    glm::vec4 position = {};
+    glm::vec4 velocity = {};
+    glm::vec4 spread = {};
     glm::vec4 color = {};
+    float lifetimeMin = 0.0F;
+    float lifetimeMax = 0.0F;
+    uint32_t count = 0;
+    uint32_t seed = 0;
+};
+
+struct ParticleCounters {
+    vk::DrawIndexedIndirectCommand draw = {};
+    vk::DispatchIndirectCommand emitGroups = {};
+    vk::DispatchIndirectCommand simulateGroups = {};
+    int32_t deadCount = 0;
+    uint32_t aliveCount = 0;
+    uint32_t requestCount = 0;
+    uint32_t emitRequestCount = 0;
+    uint32_t aliveOffset = 0;
+};
+
+// Particles spawned into a child system, either every frame for each live particle or once when it dies.
+struct ParticleSpawn {
+    glm::vec4 velocity = {};
+    glm::vec4 spread = {};
+    float lifetimeMin = 0.0F;
+    float lifetimeMax = 0.0F;
+    uint32_t count = 0;
+    uint32_t keepAlpha = 0;
+};
 
-    float lifetime = 0.0F;
-    float time = 0.0F;
+struct ParticleBehaviour {
+    float gravity = 0.0F;
+    float minVelocityY = -std::numeric_limits<float>::max();
+    uint32_t capacity = 0;
+    uint32_t maxRequests = 0;
+    ParticleSpawn onUpdate = {};
+    ParticleSpawn onDeath = {};
 };
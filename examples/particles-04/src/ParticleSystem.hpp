@@ -2,39 +2,61 @@
 
 #include "Object.hpp"
 #include "Assets.hpp"
-#include "Signal.hpp"
 #include "Particle.hpp"
 #include "Graphics.hpp"
 
+#include <numeric>
+
+// Particle pool that lives entirely on the GPU. The CPU only records emit requests, emission, integration,
+// aging, dead list compaction and spawning into child systems run in assets/shaders/particles.comp, and
+// the number of instances to draw is written by the GPU into the indirect draw arguments.
 struct ParticleSystem : public ManagedObject {
 private:
-    struct Instance {
-        glm::vec3 position;
-        glm::vec4 color;
+    enum Stage : uint32_t {
+        ePrepare    = 0,
+        eEmit       = 1,
+        eSimulate   = 2,
+    };
+
+    struct Constants {
+        float dt;
+        uint32_t parity;
+        uint32_t stage;
+        uint32_t hostRequestCount;
+        uint32_t seed;
     };
 
+    static constexpr uint32_t kMaxRequests = 4096;
+
 private:
     rc<gfx::Device> mDevice;
+    rc<gfx::UploadQueue> mUploadQueue;
     rc<gfx::Buffer> mQuadIndexBuffer;
     rc<gfx::Buffer> mQuadVertexBuffer;
-    rc<gfx::Buffer> mInstanceVertexBuffer;
     rc<gfx::DepthStencilState> mDepthStencilState;
     rc<gfx::RenderPipelineState> mRenderPipelineState;
+    rc<gfx::ComputePipelineState> mComputePipelineState;
 
-    size_t mInstanceCount = {};
-    std::vector<Particle> mParticles = {};
-    std::vector<Instance> mInstances = {};
+    rc<gfx::Buffer> mParticles;
+    rc<gfx::Buffer> mDeadList;
+    rc<gfx::Buffer> mAliveList;
+    rc<gfx::Buffer> mCounters;
+    rc<gfx::Buffer> mRequests;
+    rc<gfx::Buffer> mBehaviour;
 
-    Signal<void(Particle&)> mParticleDeathEvent = {};
-    Signal<void(Particle&, float)> mParticleUpdateEvent = {};
+    rc<ParticleSystem> mUpdateChild = {};
+    rc<ParticleSystem> mDeathChild = {};
 
-public:
-    explicit ParticleSystem(rc<gfx::Device> device, size_t capacity) : mDevice(std::move(device)) {
-        mParticles.resize(capacity);
-        mInstances.resize(capacity);
+    uint32_t mCapacity = {};
+    uint32_t mFrameIndex = {};
+    std::vector<ParticleEmitRequest> mHostRequests = {};
 
+public:
+    explicit ParticleSystem(rc<gfx::Device> device, rc<gfx::UploadQueue> uploadQueue, uint32_t capacity)
+        : mDevice(std::move(device)), mUploadQueue(std::move(uploadQueue)), mCapacity(capacity) {
         buildShaders();
         buildBuffers();
+        setBehaviour({}, {}, {});
     }
 
 private:
@@ -44,18 +66,16 @@ private:
 
         mDepthStencilState = mDevice->newDepthStencilState(depthStencilStateDescription);
 
-        auto vertexLibrary = mDevice->newLibrary(Assets::readFile("shaders/particles.vert.spv"));
-        auto fragmentLibrary = mDevice->newLibrary(Assets::readFile("shaders/particles.frag.spv"));
+        auto vertexLibrary = mDevice->newLibraryFromArchive(Assets::shaderArchive(), "particles.vert");
+        auto fragmentLibrary = mDevice->newLibraryFromArchive(Assets::shaderArchive(), "particles.frag");
+        auto computeLibrary = mDevice->newLibraryFromArchive(Assets::shaderArchive(), "particles.comp");
 
         auto vertexInputState = rc<gfx::VertexInputState>::init();
         vertexInputState->bindings = {
             vk::VertexInputBindingDescription{0, sizeof(glm::vec3), vk::VertexInputRate::eVertex},
-            vk::VertexInputBindingDescription{1, sizeof(Instance), vk::VertexInputRate::eInstance}
         };
         vertexInputState->attributes = {
             vk::VertexInputAttributeDescription{0, 0, vk::Format::eR32G32B32Sfloat, 0},
-            vk::VertexInputAttributeDescription{1, 1, vk::Format::eR32G32B32Sfloat, offsetof(Instance, position)},
-            vk::VertexInputAttributeDescription{2, 1, vk::Format::eR32G32B32A32Sfloat, offsetof(Instance, color)},
         };
 
         auto renderPipelineStateDescription = gfx::RenderPipelineStateDescription::init();
@@ -73,6 +93,7 @@ private:
         renderPipelineStateDescription->colorBlendAttachments()[0].setDstColorBlendFactor(vk::BlendFactor::eOneMinusSrcAlpha);
 
         mRenderPipelineState = mDevice->newRenderPipelineState(renderPipelineStateDescription);
+        mComputePipelineState = mDevice->newComputePipelineState(computeLibrary->newFunction("main"));
     }
 
     void buildBuffers() {
@@ -88,82 +109,157 @@ private:
             0, 2, 3
         };
 
-        mQuadIndexBuffer = mDevice->newBuffer(vk::BufferUsageFlagBits::eIndexBuffer, quadIndices.data(), quadIndices.size() * sizeof(uint32_t), gfx::StorageMode::eShared);
-        mQuadVertexBuffer = mDevice->newBuffer(vk::BufferUsageFlagBits::eVertexBuffer, quadVertices.data(), quadVertices.size() * sizeof(glm::vec3), gfx::StorageMode::eShared);
-        mInstanceVertexBuffer = mDevice->newBuffer(vk::BufferUsageFlagBits::eVertexBuffer, mInstances.size() * sizeof(Instance), gfx::StorageMode::eShared);
-    }
-
-public:
-    void update(float dt, bool flag) {
-        mInstanceCount = 0;
-        for (auto& particle : mParticles) {
-            if (particle.lifetime <= 0.0F) {
-                continue;
-            }
+        mQuadIndexBuffer = mUploadQueue->newBuffer(vk::BufferUsageFlagBits::eIndexBuffer, quadIndices.data(), quadIndices.size() * sizeof(uint32_t));
+        mQuadVertexBuffer = mUploadQueue->newBuffer(vk::BufferUsageFlagBits::eVertexBuffer, quadVertices.data(), quadVertices.size() * sizeof(glm::vec3));
 
-            particle.lifetime -= dt;
-            particle.position += particle.velocity * dt;
+        // every particle starts on the dead list
+        std::vector<uint32_t> deadList(mCapacity);
+        std::iota(deadList.begin(), deadList.end(), 0U);
 
-            mParticleUpdateEvent(particle, dt);
+        ParticleCounters counters = {};
+        counters.deadCount = static_cast<int32_t>(mCapacity);
 
-            if (particle.lifetime <= 0.0F) {
-                mParticleDeathEvent(particle);
-            }
+        mParticles = mDevice->newBuffer(vk::BufferUsageFlagBits::eStorageBuffer, mCapacity * sizeof(Particle), gfx::StorageMode::ePrivate);
+        mAliveList = mDevice->newBuffer(vk::BufferUsageFlagBits::eStorageBuffer, 2 * mCapacity * sizeof(uint32_t), gfx::StorageMode::ePrivate);
+        mRequests = mDevice->newBuffer(vk::BufferUsageFlagBits::eStorageBuffer, kMaxRequests * sizeof(ParticleEmitRequest), gfx::StorageMode::ePrivate);
+        mBehaviour = mDevice->newBuffer(vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst, sizeof(ParticleBehaviour), gfx::StorageMode::ePrivate);
+        mDeadList = mUploadQueue->newBuffer(vk::BufferUsageFlagBits::eStorageBuffer, deadList.data(), deadList.size() * sizeof(uint32_t));
+        mCounters = mUploadQueue->newBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, &counters, sizeof(ParticleCounters));
+    }
 
-            mInstances.at(mInstanceCount).position = particle.position;
-            mInstances.at(mInstanceCount).color = particle.color;
-            mInstanceCount += 1;
+public:
+    // The behaviour buffer lives as long as the system, a new behaviour is uploaded into it in place.
+    void setBehaviour(ParticleBehaviour behaviour, rc<ParticleSystem> updateChild, rc<ParticleSystem> deathChild) {
+        behaviour.capacity = mCapacity;
+        behaviour.maxRequests = kMaxRequests;
+        if (!updateChild) {
+            behaviour.onUpdate.count = 0;
         }
-
-        if (mInstanceCount > 0) {
-            std::memcpy(mInstanceVertexBuffer->contents(), mInstances.data(), mInstanceCount * sizeof(Instance));
-            mInstanceVertexBuffer->didModifyRange(0, mInstanceCount * sizeof(Instance));
+        if (!deathChild) {
+            behaviour.onDeath.count = 0;
         }
+
+        mUpdateChild = std::move(updateChild);
+        mDeathChild = std::move(deathChild);
+        mUploadQueue->replaceRegion(mBehaviour, 0, &behaviour, sizeof(ParticleBehaviour));
     }
 
     auto getRenderPipelineState() -> rc<gfx::RenderPipelineState> {
         return mRenderPipelineState;
     }
 
+    // Parents have to be simulated before their children, requests appended by the parent are consumed by the child in the same frame.
+    void simulate(const rc<gfx::FrameContext>& frameContext, const rc<gfx::ComputeCommandEncoder>& encoder, float dt) {
+        auto hostRequestsSize = std::max(mHostRequests.size(), size_t(1)) * sizeof(ParticleEmitRequest);
+        auto hostRequests = frameContext->transientAllocator->allocateStorage(hostRequestsSize);
+        std::memcpy(hostRequests.contents, mHostRequests.data(), mHostRequests.size() * sizeof(ParticleEmitRequest));
+
+        // without a child the spawn count is zero and its bindings are never written, bind our own buffers instead
+        auto updateChild = mUpdateChild ? mUpdateChild : shared_from_this();
+        auto deathChild = mDeathChild ? mDeathChild : shared_from_this();
+
+        std::array buffers = {
+            mParticles->descriptorInfo(),
+            mDeadList->descriptorInfo(),
+            mAliveList->descriptorInfo(),
+            mCounters->descriptorInfo(),
+            mRequests->descriptorInfo(),
+            hostRequests.descriptorInfo(),
+            updateChild->mCounters->descriptorInfo(),
+            updateChild->mRequests->descriptorInfo(),
+            deathChild->mCounters->descriptorInfo(),
+            deathChild->mRequests->descriptorInfo(),
+            mBehaviour->descriptorInfo(),
+        };
+
+        auto descriptorSet = encoder->getCommandBuffer()->newDescriptorSet(mComputePipelineState, 0);
+
+        std::array<vk::WriteDescriptorSet, buffers.size()> writes = {};
+        for (uint32_t i = 0; i < buffers.size(); ++i) {
+            writes[i].setDstSet(descriptorSet);
+            writes[i].setDstBinding(i);
+            writes[i].setDstArrayElement(0);
+            writes[i].setDescriptorType(i == buffers.size() - 1 ? vk::DescriptorType::eUniformBuffer : vk::DescriptorType::eStorageBuffer);
+            writes[i].setDescriptorCount(1);
+            writes[i].setPBufferInfo(&buffers[i]);
+        }
+        mDevice->handle.updateDescriptorSets(writes, {}, mDevice->dispatcher);
+
+        Constants constants = {};
+        constants.dt = dt;
+        constants.parity = mFrameIndex & 1;
+        constants.hostRequestCount = static_cast<uint32_t>(mHostRequests.size());
+        constants.seed = mFrameIndex * 0x9E3779B9U;
+
+        auto barrier = [&] {
+            encoder->memoryBarrier(
+                vk::PipelineStageFlagBits2::eComputeShader,
+                vk::AccessFlagBits2::eShaderStorageWrite,
+                vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eDrawIndirect | vk::PipelineStageFlagBits2::eVertexShader,
+                vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite | vk::AccessFlagBits2::eIndirectCommandRead
+            );
+        };
+
+        encoder->setComputePipelineState(mComputePipelineState);
+        encoder->bindDescriptorSet(descriptorSet, 0);
+
+        constants.stage = ePrepare;
+        encoder->pushConstants(vk::ShaderStageFlagBits::eCompute, 0, sizeof(Constants), &constants);
+        encoder->dispatch(1, 1, 1);
+        barrier();
+
+        constants.stage = eEmit;
+        encoder->pushConstants(vk::ShaderStageFlagBits::eCompute, 0, sizeof(Constants), &constants);
+        encoder->dispatchIndirect(mCounters, offsetof(ParticleCounters, emitGroups));
+        barrier();
+
+        constants.stage = eSimulate;
+        encoder->pushConstants(vk::ShaderStageFlagBits::eCompute, 0, sizeof(Constants), &constants);
+        encoder->dispatchIndirect(mCounters, offsetof(ParticleCounters, simulateGroups));
+        barrier();
+
+        mHostRequests.clear();
+        mFrameIndex += 1;
+    }
+
     void draw(const rc<gfx::RenderCommandEncoder>& encoder, const ShaderData& shader_data) {
-        if (mInstanceCount == 0) {
-            return;
+        std::array buffers = {
+            mParticles->descriptorInfo(),
+            mAliveList->descriptorInfo(),
+            mCounters->descriptorInfo(),
+        };
+
+        auto descriptorSet = encoder->getCommandBuffer()->newDescriptorSet(mRenderPipelineState, 0);
+
+        std::array<vk::WriteDescriptorSet, buffers.size()> writes = {};
+        for (uint32_t i = 0; i < buffers.size(); ++i) {
+            writes[i].setDstSet(descriptorSet);
+            writes[i].setDstBinding(i);
+            writes[i].setDstArrayElement(0);
+            writes[i].setDescriptorType(vk::DescriptorType::eStorageBuffer);
+            writes[i].setDescriptorCount(1);
+            writes[i].setPBufferInfo(&buffers[i]);
         }
+        mDevice->handle.updateDescriptorSets(writes, {}, mDevice->dispatcher);
 
         encoder->setDepthStencilState(mDepthStencilState);
         encoder->setRenderPipelineState(mRenderPipelineState);
         encoder->pushConstants(vk::ShaderStageFlagBits::eVertex, 0, sizeof(ShaderData), &shader_data);
+        encoder->bindDescriptorSet(descriptorSet, 0);
 
         encoder->bindIndexBuffer(mQuadIndexBuffer, 0, vk::IndexType::eUint32);
         encoder->bindVertexBuffer(0, mQuadVertexBuffer, 0);
-        encoder->bindVertexBuffer(1, mInstanceVertexBuffer, 0);
-        encoder->drawIndexed(6, mInstanceCount, 0, 0, 0);
+        encoder->drawIndexedIndirect(mCounters, offsetof(ParticleCounters, draw), 1, sizeof(vk::DrawIndexedIndirectCommand));
     }
 
     void emit(const glm::vec3 &position, const glm::vec4 &color, const glm::vec3 &velocity, float lifetime) {
-        int32_t index = -1;
-        for (int32_t i = 0; i < mParticles.size(); ++i) {
-            if (mParticles[i].lifetime <= 0.0F) {
-                index = i;
-                break;
-            }
-        }
-        if (index == -1) {
-            return;
-        }
-
-        mParticles[index].position = position;
-        mParticles[index].velocity = velocity;
-        mParticles[index].color = color;
-        mParticles[index].lifetime = lifetime;
-        mParticles[index].time = lifetime;
-    }
-
-    auto deathEvent() -> Signal<void(Particle&)>& {
-        return mParticleDeathEvent;
-    }
-
-    auto updateEvent() -> Signal<void(Particle&, float)>& {
-        return mParticleUpdateEvent;
+        ParticleEmitRequest request = {};
+        request.position = glm::vec4(position, 0.0F);
+        request.velocity = glm::vec4(velocity, 0.0F);
+        request.color = color;
+        request.lifetimeMin = lifetime;
+        request.lifetimeMax = lifetime;
+        request.count = 1;
+        mHostRequests.emplace_back(request);
     }
 };
@@ -7,15 +7,31 @@
 struct Game : Application {
 public:
     Game() : Application("Particles-04") {
-        explosionParticleSystem = rc<ParticleSystem>::init(device, 1000);
-        explosionParticleSystem->updateEvent().connect<&Game::onExplosionParticleUpdate>(this);
-
-        sparkleParticleSystem = rc<ParticleSystem>::init(device, 1000);
-        sparkleParticleSystem->updateEvent().connect<&Game::onSparkleParticleUpdate>(this);
-
-        rocketParticleSystem = rc<ParticleSystem>::init(device, 1000);
-        rocketParticleSystem->updateEvent().connect<&Game::onRocketParticleUpdate>(this);
-        rocketParticleSystem->deathEvent().connect<&Game::onRocketParticleDeath>(this);
+        explosionParticleSystem = rc<ParticleSystem>::init(device, uploadQueue, 262144);
+
+        sparkleParticleSystem = rc<ParticleSystem>::init(device, uploadQueue, 65536);
+        sparkleParticleSystem->setBehaviour(ParticleBehaviour{
+            .gravity = 9.8F,
+            .minVelocityY = -1.0F,
+        }, {}, {});
+
+        rocketParticleSystem = rc<ParticleSystem>::init(device, uploadQueue, 1024);
+        rocketParticleSystem->setBehaviour(ParticleBehaviour{
+            .onUpdate = ParticleSpawn{
+                .spread = glm::vec4(0.5F, 0.0F, 0.5F, 0.0F),
+                .lifetimeMin = 0.0F,
+                .lifetimeMax = 1.0F,
+                .count = 1,
+                .keepAlpha = 1,
+            },
+            .onDeath = ParticleSpawn{
+                .spread = glm::vec4(5.0F, 5.0F, 5.0F, 0.0F),
+                .lifetimeMin = 1.0F,
+                .lifetimeMax = 1.0F,
+                .count = 250,
+                .keepAlpha = 0,
+            },
+        }, sparkleParticleSystem, explosionParticleSystem);
         rocketParticleEmitter = rc<RocketParticleEmitter>::init(rocketParticleSystem, 2.5F);
     }
 
@@ -25,13 +41,12 @@ public:
         world_to_camera_matrix = glm::lookAtLH(glm::vec3(25.0F, 10.0F, 0.0F), glm::vec3(0.0F, 10.0F, 0.0F), glm::vec3(0, 1, 0));
 
         rocketParticleEmitter->update(dt);
-        rocketParticleSystem->update(dt, false);
-        sparkleParticleSystem->update(dt, false);
-        explosionParticleSystem->update(dt, true);
+        deltaTime = dt;
     }
 
     void render() override {
         auto drawable = swapchain->nextDrawable();
+        commandBuffer->waitForDrawable(drawable);
         auto drawableSize = swapchain->drawableSize();
 
         vk::Rect2D rendering_area = {};
@@ -57,61 +72,33 @@ public:
         shader_data.g_view_matrix = world_to_camera_matrix;
 
         commandBuffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
-        commandBuffer->setImageLayout(drawable->texture, vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal, vk::PipelineStageFlagBits2::eTopOfPipe, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2{}, vk::AccessFlagBits2::eColorAttachmentWrite);
-
-        auto encoder = commandBuffer->newRenderCommandEncoder(rendering_info);
-        encoder->setScissor(0, rendering_area);
-        encoder->setViewport(0, rendering_viewport);
 
-        rocketParticleSystem->draw(encoder, shader_data);
-        sparkleParticleSystem->draw(encoder, shader_data);
-        explosionParticleSystem->draw(encoder, shader_data);
-
-        encoder->endEncoding();
+        auto compute = commandBuffer->newComputeCommandEncoder();
+        // the previous frame may still be drawing from the particle buffers
+        compute->memoryBarrier(vk::PipelineStageFlagBits2::eVertexShader | vk::PipelineStageFlagBits2::eDrawIndirect, {}, vk::PipelineStageFlagBits2::eComputeShader, {});
+        rocketParticleSystem->simulate(frameContext, compute, deltaTime);
+        sparkleParticleSystem->simulate(frameContext, compute, deltaTime);
+        explosionParticleSystem->simulate(frameContext, compute, deltaTime);
+        compute->memoryBarrier(vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageWrite, vk::PipelineStageFlagBits2::eVertexShader | vk::PipelineStageFlagBits2::eDrawIndirect, vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eIndirectCommandRead);
+        compute->endEncoding();
+
+        commandBuffer->setImageLayout(drawable->texture, vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2{}, vk::AccessFlagBits2::eColorAttachmentWrite);
+
+        // one sub-encoder per system, each one starts without viewport and scissor
+        auto parallelEncoder = commandBuffer->newParallelRenderCommandEncoder(rendering_info);
+        for (auto& particleSystem : {rocketParticleSystem, sparkleParticleSystem, explosionParticleSystem}) {
+            auto encoder = parallelEncoder->renderCommandEncoder();
+            encoder->setScissor(0, rendering_area);
+            encoder->setViewport(0, rendering_viewport);
+            particleSystem->draw(encoder, shader_data);
+            encoder->endEncoding();
+        }
+        parallelEncoder->endEncoding();
 
-        commandBuffer->setImageLayout(drawable->texture, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::ePresentSrcKHR, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::PipelineStageFlagBits2::eBottomOfPipe, vk::AccessFlagBits2::eColorAttachmentWrite, vk::AccessFlagBits2{});
+        commandBuffer->setImageLayout(drawable->texture, vk::ImageLayout::eColorAttachmentOptimal, drawable->presentLayout(), vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::PipelineStageFlagBits2::eBottomOfPipe, vk::AccessFlagBits2::eColorAttachmentWrite, vk::AccessFlagBits2{});
         commandBuffer->end();
         commandBuffer->submit();
         commandBuffer->present(drawable);
-        commandBuffer->waitUntilCompleted();
-    }
-
-public:
-    void onRocketParticleUpdate(Particle& particle, float dt) {
-        particle.color.a = std::clamp(particle.lifetime / particle.time, 0.0F, 1.0F);
-
-        glm::vec3 velocity = {};
-        velocity.x = std::uniform_real_distribution(-1.0F, 1.0F)(random_engine) * 0.5F;
-        velocity.y = 0.0F;
-        velocity.z = std::uniform_real_distribution(-1.0F, 1.0F)(random_engine) * 0.5F;
-
-        float lifetime = std::uniform_real_distribution(0.0F, 1.0F)(random_engine);
-
-        sparkleParticleSystem->emit(particle.position, particle.color, velocity, lifetime);
-    }
-
-    void onRocketParticleDeath(Particle& particle) {
-        for (int i = 0; i < 250; ++i) {
-            glm::vec3 velocity = {};
-            velocity.x = std::uniform_real_distribution(-1.0F, 1.0F)(random_engine);
-            velocity.y = std::uniform_real_distribution(-1.0F, 1.0F)(random_engine);
-            velocity.z = std::uniform_real_distribution(-1.0F, 1.0F)(random_engine);
-
-            glm::vec4 color = particle.color;
-            color.a = 1.0F;
-
-            explosionParticleSystem->emit(particle.position, color, velocity * 5.0F, 1.0F);
-        }
-    }
-
-    void onSparkleParticleUpdate(Particle& particle, float dt) {
-        particle.color.a = std::clamp(particle.lifetime / particle.time, 0.0F, 1.0F);
-        particle.velocity.y -= 9.8f * dt;
-        particle.velocity.y = std::max(particle.velocity.y, -1.0F);
-    }
-
-    void onExplosionParticleUpdate(Particle& particle, float dt) {
-        particle.color.a = std::clamp(particle.lifetime / particle.time, 0.0F, 1.0F);
     }
 
 private:
@@ -123,7 +110,7 @@ private:
     rc<ParticleSystem> explosionParticleSystem = {};
     rc<ParticleEmitter> rocketParticleEmitter = {};
 
-    std::default_random_engine random_engine = {};
+    float deltaTime = {};
 };
 
 auto main(int argc, char** argv) -> int32_t {
@@ -39,8 +39,8 @@ public:
 
 private:
     void buildShaders() {
-        auto vert_library = device->newLibrary(Assets::readFile("shaders/simple_shader.vert.spv"));
-        auto frag_library = device->newLibrary(Assets::readFile("shaders/simple_shader.frag.spv"));
+        auto vert_library = device->newLibraryFromArchive(Assets::shaderArchive(), "simple_shader.vert");
+        auto frag_library = device->newLibraryFromArchive(Assets::shaderArchive(), "simple_shader.frag");
 
         auto vertex_input_state = rc<gfx::VertexInputState>::init();
         vertex_input_state->bindings = {
@@ -53,7 +53,12 @@ private:
 
         auto description = gfx::RenderPipelineStateDescription::init();
         description->setVertexFunction(vert_library->newFunction("main"));
-        description->setFragmentFunction(frag_library->newFunction("main"));
+        // the loop bounds are constant folded into the pipeline
+        gfx::FunctionConstantValues constant_values = {};
+        constant_values.setConstantValue(0, int32_t(8));  // COUNT_VOXELS
+        constant_values.setConstantValue(1, int32_t(32)); // COUNT_STEPS
+
+        description->setFragmentFunction(frag_library->newFunction("main", constant_values));
         description->setVertexInputState(vertex_input_state);
         description->colorAttachmentFormats()[0] = vk::Format::eB8G8R8A8Unorm;
         description->colorBlendAttachments()[0].setBlendEnable(false);
@@ -118,7 +123,7 @@ private:
         cube = rc<Mesh>::init();
         cube->setVertices(vertices);
         cube->setPrimitives(primitives);
-        cube->uploadMeshData(device);
+        cube->uploadMeshData(uploadQueue);
     }
 
 public:
@@ -145,6 +150,7 @@ public:
 
     void render() override {
         auto drawable = swapchain->nextDrawable();
+        commandBuffer->waitForDrawable(drawable);
         auto drawableSize = swapchain->drawableSize();
 
         vk::Rect2D rendering_area = {};
@@ -177,7 +183,7 @@ public:
         fillVolume(shader_data.Volume);
 
         commandBuffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
-        commandBuffer->setImageLayout(drawable->texture, vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal, vk::PipelineStageFlagBits2::eTopOfPipe, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2{}, vk::AccessFlagBits2::eColorAttachmentWrite);
+        commandBuffer->setImageLayout(drawable->texture, vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2{}, vk::AccessFlagBits2::eColorAttachmentWrite);
 
         auto encoder = commandBuffer->newRenderCommandEncoder(rendering_info);
         encoder->setRenderPipelineState(render_pipeline_state);
@@ -188,11 +194,10 @@ public:
         cube->draw(encoder);
         encoder->endEncoding();
 
-        commandBuffer->setImageLayout(drawable->texture, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::ePresentSrcKHR, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::PipelineStageFlagBits2::eBottomOfPipe, vk::AccessFlagBits2::eColorAttachmentWrite, vk::AccessFlagBits2{});
+        commandBuffer->setImageLayout(drawable->texture, vk::ImageLayout::eColorAttachmentOptimal, drawable->presentLayout(), vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::PipelineStageFlagBits2::eBottomOfPipe, vk::AccessFlagBits2::eColorAttachmentWrite, vk::AccessFlagBits2{});
         commandBuffer->end();
         commandBuffer->submit();
         commandBuffer->present(drawable);
-        commandBuffer->waitUntilCompleted();
     }
 
     void keyDown(SDL_KeyboardEvent *event) override {
@@ -13,6 +13,7 @@ public:
 
     void render() override {
         auto drawable = swapchain->nextDrawable();
+        commandBuffer->waitForDrawable(drawable);
         auto drawableSize = swapchain->drawableSize();
 
         vk::Rect2D rendering_area = {};
@@ -34,7 +35,6 @@ public:
         rendering_info.colorAttachments[0].storeOp = vk::AttachmentStoreOp::eStore;
 
         commandBuffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
-        commandBuffer->setImageLayout(drawable->texture, vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal, vk::PipelineStageFlagBits2::eTopOfPipe, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2{}, vk::AccessFlagBits2::eColorAttachmentWrite);
 
         auto descriptor_set = commandBuffer->newDescriptorSet(render_pipeline_state, 0);
         auto descriptor_info = vertexBuffer->descriptorInfo();
@@ -48,25 +48,32 @@ public:
         buffer_write_info.setPBufferInfo(&descriptor_info);
         device->handle.updateDescriptorSets({buffer_write_info}, {}, device->dispatcher);
 
-        auto encoder = commandBuffer->newRenderCommandEncoder(rendering_info);
-        encoder->setRenderPipelineState(render_pipeline_state);
-        encoder->bindDescriptorSet(descriptor_set, 0);
-        encoder->setScissor(0, rendering_area);
-        encoder->setViewport(0, rendering_viewport);
-        encoder->draw(3, 1, 0, 0);
-        encoder->endEncoding();
+        auto backbuffer = renderGraph->importTexture("backbuffer", drawable->texture, vk::ImageLayout::eUndefined, drawable->presentLayout(), vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2::eNone);
+        auto vertices = renderGraph->importBuffer("vertices", vertexBuffer, vk::PipelineStageFlagBits2::eHost, vk::AccessFlagBits2::eHostWrite);
+
+        renderGraph->addPass("triangle", gfx::RenderGraphPassType::eRender)
+            .read(vertices, gfx::BufferUsage::eStorageRead)
+            .write(backbuffer, gfx::TextureUsage::eColorAttachment)
+            .execute([&](gfx::RenderGraphContext& context) {
+                auto encoder = context.commandBuffer->newRenderCommandEncoder(rendering_info);
+                encoder->setRenderPipelineState(render_pipeline_state);
+                encoder->bindDescriptorSet(descriptor_set, 0);
+                encoder->setScissor(0, rendering_area);
+                encoder->setViewport(0, rendering_viewport);
+                encoder->draw(3, 1, 0, 0);
+                encoder->endEncoding();
+            });
+        renderGraph->execute(commandBuffer);
 
-        commandBuffer->setImageLayout(drawable->texture, vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::ePresentSrcKHR, vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::PipelineStageFlagBits2::eBottomOfPipe, vk::AccessFlagBits2::eColorAttachmentWrite, vk::AccessFlagBits2{});
         commandBuffer->end();
         commandBuffer->submit();
         commandBuffer->present(drawable);
-        commandBuffer->waitUntilCompleted();
     }
 
 private:
     void buildShaders() {
-        auto vertexLibrary = device->newLibrary(Assets::readFile("shaders/default.vert.spv"));
-        auto fragmentLibrary = device->newLibrary(Assets::readFile("shaders/default.frag.spv"));
+        auto vertexLibrary = device->newLibraryFromArchive(Assets::shaderArchive(), "default.vert");
+        auto fragmentLibrary = device->newLibraryFromArchive(Assets::shaderArchive(), "default.frag");
 
         auto description = gfx::RenderPipelineStateDescription::init();
         description->setVertexFunction(vertexLibrary->newFunction("main"));
@@ -10,6 +10,10 @@ auto gfx::Adapter::getSurfaceCapabilities(this Adapter& self, rc<Surface> const&
     return self.handle.getSurfaceCapabilitiesKHR(surface->handle, self.instance->dispatcher);
 }
 
+auto gfx::Adapter::getSurfacePresentModes(this Adapter& self, rc<Surface> const& surface) -> std::vector<vk::PresentModeKHR> {
+    return self.handle.getSurfacePresentModesKHR(surface->handle, self.instance->dispatcher);
+}
+
 auto gfx::Adapter::createDevice(this Adapter& self, vk::DeviceCreateInfo const& create_info) -> rc<Device> {
     return rc<Device>(new Device(self.shared_from_this(), create_info));
 }
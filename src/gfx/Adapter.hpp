@@ -10,6 +10,7 @@ namespace gfx {
         explicit Adapter(rc<Instance> instance, vk::PhysicalDevice handle);
 
         auto getSurfaceCapabilities(this Adapter& self, rc<Surface> const& surface) -> vk::SurfaceCapabilitiesKHR;
+        auto getSurfacePresentModes(this Adapter& self, rc<Surface> const& surface) -> std::vector<vk::PresentModeKHR>;
         auto createDevice(this Adapter& self, vk::DeviceCreateInfo const& create_info) -> rc<Device>;
     };
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 
 gfx::Buffer::Buffer(rc<Device> device, vk::Buffer handle, VmaAllocation allocation) : device(std::move(device)), handle(handle), allocation(allocation) {}
 gfx::Buffer::~Buffer() {
+    device->_untrackAllocation(allocation);
     vmaDestroyBuffer(device->allocator, handle, allocation);
 }
 
@@ -29,6 +30,7 @@ void gfx::Buffer::setLabel(std::string const& name) {
     info.setPObjectName(name.c_str());
 
     device->handle.debugMarkerSetObjectNameEXT(info, device->dispatcher);
+    device->_labelAllocation(allocation, name);
 }
 
 auto gfx::Buffer::descriptorInfo() const -> vk::DescriptorBufferInfo {
@@ -1,39 +1,31 @@
 #include "Device.hpp"
 #include "Buffer.hpp"
+#include "Adapter.hpp"
 #include "Texture.hpp"
 #include "Drawable.hpp"
+#include "Profiler.hpp"
 #include "Swapchain.hpp"
 #include "CommandQueue.hpp"
+#include "UniformRing.hpp"
 #include "CommandBuffer.hpp"
+#include "TransientAllocator.hpp"
+#include "DescriptorAllocator.hpp"
 #include "RenderPipelineState.hpp"
 #include "ComputePipelineState.hpp"
 
 #include "spdlog/spdlog.h"
 
-#include "vulkan/vulkan_hash.hpp"
+#include <array>
+#include <cstring>
+#include <algorithm>
 
-template<typename Fn>
-struct Lazy : Fn {
-    using Fn::operator();
-
-    operator auto() {
-        return (*this)();
-    }
-};
-
-template<typename Fn>
-Lazy(Fn) -> Lazy<Fn>;
-
-gfx::CommandBuffer::CommandBuffer(rc<Device> const& device, rc<CommandQueue> const& queue) : device(device), queue(queue) {
+gfx::CommandBuffer::CommandBuffer(rc<Device> const& device, rc<CommandQueue> const& queue) : device(device), queue(queue), descriptorAllocator(rc<DescriptorAllocator>::init(device)) {
     vk::CommandBufferAllocateInfo allocate_info = {};
     allocate_info.setCommandPool(queue->handle);
     allocate_info.setLevel(vk::CommandBufferLevel::ePrimary);
     allocate_info.setCommandBufferCount(1);
     vk::resultCheck(device->handle.allocateCommandBuffers(&allocate_info, &handle, device->dispatcher), "Failed to allocate command buffer");
 
-    vk::FenceCreateInfo fence_create_info = {};
-    vk::resultCheck(device->handle.createFence(&fence_create_info, nullptr, &fence, device->dispatcher), "Failed to create fence");
-
     vk::SemaphoreCreateInfo semaphore_create_info = {};
     vk::resultCheck(device->handle.createSemaphore(&semaphore_create_info, nullptr, &semaphore, device->dispatcher), "Failed to create semaphore");
 
@@ -43,56 +35,226 @@ gfx::CommandBuffer::CommandBuffer(rc<Device> const& device, rc<CommandQueue> con
 //    auto pool = raii.handle.createDescriptorPool(pool_create_info, VK_NULL_HANDLE, raii.dispatcher);
 }
 
-gfx::CommandBuffer::~CommandBuffer() {
-    device->handle.destroySemaphore(semaphore, nullptr, device->dispatcher);
-    device->handle.destroyFence(fence, nullptr, device->dispatcher);
+gfx::CommandBuffer::CommandBuffer(rc<Device> const& device, rc<CommandQueue> const& queue, rc<CommandBufferPool> pool, CommandBufferResources&& resources, uint32_t poolPage)
+: device(device)
+, queue(queue)
+, handle(resources.handle)
+, semaphore(resources.semaphore)
+, pool(std::move(pool))
+, poolPage(poolPage)
+, level(resources.level)
+, descriptorAllocator(std::move(resources.descriptorAllocator))
+, uniformRing(std::move(resources.uniformRing))
+, queryRecorder(std::move(resources.queryRecorder)) {}
 
-    for (auto& value : descriptor_pools) {
-        device->handle.destroyDescriptorPool(value, nullptr, device->dispatcher);
+gfx::CommandBuffer::~CommandBuffer() {
+    _endUseRenderPipelineStates(0);
+    if (pool) {
+        pool->release(CommandBufferResources{
+            .level = level,
+            .handle = handle,
+            .semaphore = semaphore,
+            .descriptorAllocator = std::move(descriptorAllocator),
+            .uniformRing = std::move(uniformRing),
+            .queryRecorder = std::move(queryRecorder),
+            .submittedValue = submittedValue,
+            .semaphoreSignaled = presentPending
+        }, poolPage);
+        return;
     }
+    device->handle.destroySemaphore(semaphore, nullptr, device->dispatcher);
 }
 
 void gfx::CommandBuffer::begin(vk::CommandBufferBeginInfo const& begin_info) {
     handle.begin(begin_info, device->dispatcher);
 
-    for (auto& value : descriptor_pools) {
-        device->handle.resetDescriptorPool(value, {}, device->dispatcher);
+    // recorded again without having been submitted
+    _endUseRenderPipelineStates(0);
+    submittedValue = 0;
+    descriptorAllocator->reset();
+    if (uniformRing) {
+        uniformRing->reset();
+    }
+
+    if (queryRecorder && queryRecorder->profiler != queue->profiler) {
+        queryRecorder->resolve();
+        queryRecorder = {};
+    }
+    if (!queryRecorder && queue->profiler) {
+        queryRecorder = queue->profiler->newQueryRecorder();
+    }
+    if (queryRecorder) {
+        queryRecorder->begin(handle);
     }
 }
 
 void gfx::CommandBuffer::end() {
+    if (queryRecorder) {
+        queryRecorder->end(handle);
+    }
     handle.end(device->dispatcher);
 }
 
+void gfx::CommandBuffer::encodeWait(vk::Semaphore semaphore, uint64_t value, vk::PipelineStageFlags stageMask) {
+    waitSemaphores.emplace_back(semaphore);
+    waitValues.emplace_back(value);
+    waitStages.emplace_back(stageMask);
+}
+
+// only color attachment output waits for the image, everything recorded before it runs while the image is still presented
+void gfx::CommandBuffer::waitForDrawable(rc<Drawable> const& drawable) {
+    if (!drawable->acquireSemaphore) {
+        return;
+    }
+    encodeWait(drawable->acquireSemaphore, 0, vk::PipelineStageFlagBits::eColorAttachmentOutput);
+    drawable->acquireSemaphore = VK_NULL_HANDLE;
+}
+
 void gfx::CommandBuffer::submit() {
+    std::array signal_semaphores = {semaphore, queue->semaphore};
+    std::array<uint64_t, 2> signal_values = {0, 0};
+
+    vk::TimelineSemaphoreSubmitInfo timeline_submit_info = {};
+    timeline_submit_info.setWaitSemaphoreValues(waitValues);
+    timeline_submit_info.setSignalSemaphoreValues(signal_values);
+
     vk::SubmitInfo submit_info = {};
+    submit_info.setPNext(&timeline_submit_info);
+    submit_info.setWaitSemaphores(waitSemaphores);
+    submit_info.setWaitDstStageMask(waitStages);
     submit_info.setCommandBufferCount(1);
     submit_info.setPCommandBuffers(&handle);
-    submit_info.setSignalSemaphoreCount(1);
-    submit_info.setPSignalSemaphores(&semaphore);
+    submit_info.setSignalSemaphores(signal_semaphores);
+
+    {
+        std::lock_guard lock(device->queueMutex);
+
+        // the value is taken under the queue lock, so the queue semaphore only ever increases
+        auto value = queue->_nextValue();
+        signal_values[1] = value;
+
+        // a value that is never signaled would stall the completion thread of the queue forever
+        try {
+            device->handle.getQueue(queue->queueFamilyIndex, 0, device->dispatcher).submit(submit_info, VK_NULL_HANDLE, device->dispatcher);
+        } catch (...) {
+            queue->_rollbackValue(value);
+            throw;
+        }
+        submittedValue = value;
+    }
 
-    vk::resultCheck(device->handle.resetFences(1, &fence, device->dispatcher), "Failed to reset fence");
+    presentPending = true;
+    queue->_enqueueHandlers(submittedValue, std::move(completedHandlers));
+    _endUseRenderPipelineStates(submittedValue);
 
-    // todo: get valid device for submit
-    device->handle.getQueue(0, 0, device->dispatcher).submit(submit_info, fence, device->dispatcher);
+    // secondary command buffers go back to their pools once this submission has completed
+    for (auto& secondaryCommandBuffer : secondaryCommandBuffers) {
+        secondaryCommandBuffer->submittedValue = submittedValue;
+        secondaryCommandBuffer->_endUseRenderPipelineStates(submittedValue);
+    }
+    secondaryCommandBuffers.clear();
+    completedHandlers.clear();
+
+    waitSemaphores.clear();
+    waitValues.clear();
+    waitStages.clear();
 }
 
 void gfx::CommandBuffer::present(rc<gfx::Drawable> const& drawable) {
+    presentPending = false;
+
+    // offscreen drawables are never shown, but the semaphore signaled by submit still has to be waited on before the next one
+    if (!drawable->swapchain) {
+        vk::PipelineStageFlags wait_stage = vk::PipelineStageFlagBits::eAllCommands;
+
+        vk::SubmitInfo submit_info = {};
+        submit_info.setWaitSemaphoreCount(1);
+        submit_info.setPWaitSemaphores(&semaphore);
+        submit_info.setPWaitDstStageMask(&wait_stage);
+
+        std::lock_guard lock(device->queueMutex);
+        device->handle.getQueue(queue->queueFamilyIndex, 0, device->dispatcher).submit(submit_info, VK_NULL_HANDLE, device->dispatcher);
+        return;
+    }
+
     vk::PresentInfoKHR present_info = {};
     present_info.setWaitSemaphores(semaphore);
     present_info.setSwapchainCount(1);
     present_info.setPSwapchains(&drawable->swapchain);
     present_info.setPImageIndices(&drawable->drawableIndex);
 
-    // todo: get valid device for present
-    auto result = device->handle.getQueue(0, 0, device->dispatcher).presentKHR(present_info, device->dispatcher);
+    std::unique_lock lock(device->queueMutex);
+
+    auto result = device->handle.getQueue(queue->queueFamilyIndex, 0, device->dispatcher).presentKHR(present_info, device->dispatcher);
+    lock.unlock();
+
     if (result != vk::Result::eErrorOutOfDateKHR && result != vk::Result::eSuboptimalKHR && result != vk::Result::eSuccess) {
         throw std::runtime_error(vk::to_string(result));
     }
 }
 
+// a command buffer that was never submitted has nothing to wait for
 void gfx::CommandBuffer::waitUntilCompleted() {
-    vk::resultCheck(device->handle.waitForFences(fence, VK_TRUE, std::numeric_limits<uint64_t>::max(), device->dispatcher), "Failed to wait for fence");
+    if (submittedValue != 0) {
+        queue->waitUntilCompleted(submittedValue);
+    }
+
+    // the queries are complete once the queue semaphore has reached the value, reading them back does not wait any further
+    if (queryRecorder) {
+        queryRecorder->resolve();
+    }
+}
+
+// handlers added after submit belong to the next submission of this command buffer
+void gfx::CommandBuffer::addCompletedHandler(CommandBufferHandler handler) {
+    completedHandlers.emplace_back(std::move(handler));
+}
+
+// polls the queue semaphore, never blocks
+auto gfx::CommandBuffer::status() -> CommandBufferStatus {
+    if (submittedValue == 0) {
+        return CommandBufferStatus::eNotEnqueued;
+    }
+    if (queue->completedValue() >= submittedValue) {
+        return CommandBufferStatus::eCompleted;
+    }
+    return CommandBufferStatus::eCommitted;
+}
+
+void gfx::CommandBuffer::pushDebugGroup(std::string const& name) {
+    if (device->dispatcher.vkCmdBeginDebugUtilsLabelEXT != nullptr) {
+        vk::DebugUtilsLabelEXT label = {};
+        label.setPLabelName(name.c_str());
+        handle.beginDebugUtilsLabelEXT(label, device->dispatcher);
+    }
+    if (queryRecorder) {
+        queryRecorder->pushScope(handle, name);
+    }
+}
+
+void gfx::CommandBuffer::popDebugGroup() {
+    if (queryRecorder) {
+        queryRecorder->popScope(handle);
+    }
+    if (device->dispatcher.vkCmdEndDebugUtilsLabelEXT != nullptr) {
+        handle.endDebugUtilsLabelEXT(device->dispatcher);
+    }
+}
+
+// retired pipelines of the state are kept until the submit of this command buffer completes
+void gfx::CommandBuffer::_useRenderPipelineState(const rc<RenderPipelineState>& renderPipelineState) {
+    if (std::ranges::find(renderPipelineStates, renderPipelineState) != renderPipelineStates.end()) {
+        return;
+    }
+    renderPipelineState->_beginUse();
+    renderPipelineStates.emplace_back(renderPipelineState);
+}
+
+void gfx::CommandBuffer::_endUseRenderPipelineStates(uint64_t value) {
+    for (auto& renderPipelineState : renderPipelineStates) {
+        renderPipelineState->_endUse(queue, value);
+    }
+    renderPipelineStates.clear();
 }
 
 void gfx::CommandBuffer::setImageLayout(const rc<Texture>& texture, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::PipelineStageFlags2 srcStageMask, vk::PipelineStageFlags2 dstStageMask, vk::AccessFlagBits2 srcAccessMask, vk::AccessFlagBits2 dstAccessMask) {
@@ -116,65 +278,43 @@ void gfx::CommandBuffer::setImageLayout(const rc<Texture>& texture, vk::ImageLay
 }
 
 auto gfx::CommandBuffer::newDescriptorSet(const rc<RenderPipelineState>& render_pipeline_state, uint32_t index) -> vk::DescriptorSet {
-    for (auto pool : descriptor_pools) {
-        vk::DescriptorSetAllocateInfo allocate_info = {};
-        allocate_info.setDescriptorPool(pool);
-        allocate_info.setDescriptorSetCount(1);
-        allocate_info.setPSetLayouts(&render_pipeline_state->descriptorSetLayouts[index]);
-
-        vk::DescriptorSet descriptor_set = VK_NULL_HANDLE;
-        vk::Result result = device->handle.allocateDescriptorSets(&allocate_info, &descriptor_set, device->dispatcher);
-        if (result == vk::Result::eSuccess) {
-            return descriptor_set;
-        }
-    }
-
-    // todo: reduce pool sizes, check is there is enough space for the new descriptor set
-    auto pool_sizes = std::array{
-        vk::DescriptorPoolSize{vk::DescriptorType::eSampler                  , 1024},
-        vk::DescriptorPoolSize{vk::DescriptorType::eSampledImage             , 1024},
-        vk::DescriptorPoolSize{vk::DescriptorType::eCombinedImageSampler     , 1024},
-        vk::DescriptorPoolSize{vk::DescriptorType::eStorageImage             , 1024},
-        vk::DescriptorPoolSize{vk::DescriptorType::eUniformTexelBuffer       , 1024},
-        vk::DescriptorPoolSize{vk::DescriptorType::eStorageTexelBuffer       , 1024},
-        vk::DescriptorPoolSize{vk::DescriptorType::eUniformBuffer            , 1024},
-        vk::DescriptorPoolSize{vk::DescriptorType::eStorageBuffer            , 1024},
-        vk::DescriptorPoolSize{vk::DescriptorType::eUniformBufferDynamic     , 1024},
-        vk::DescriptorPoolSize{vk::DescriptorType::eStorageBufferDynamic     , 1024}
-    };
-
-    vk::DescriptorPoolCreateInfo pool_create_info = {};
-    pool_create_info.setMaxSets(1024);
-    pool_create_info.setPoolSizes(pool_sizes);
-
-    auto pool = device->handle.createDescriptorPool(pool_create_info, VK_NULL_HANDLE, device->dispatcher);
-    descriptor_pools.push_back(pool);
-
-    vk::DescriptorSetAllocateInfo allocate_info = {};
-    allocate_info.setDescriptorPool(pool);
-    allocate_info.setDescriptorSetCount(1);
-    allocate_info.setPSetLayouts(&render_pipeline_state->descriptorSetLayouts[index]);
+    return descriptorAllocator->allocate(render_pipeline_state->descriptorSetLayouts[index], render_pipeline_state->descriptorSetCounts[index]);
+}
 
-    vk::DescriptorSet descriptor_set = VK_NULL_HANDLE;
-    vk::Result result = device->handle.allocateDescriptorSets(&allocate_info, &descriptor_set, device->dispatcher);
-    if (result == vk::Result::eSuccess) {
-        return descriptor_set;
-    }
-    return VK_NULL_HANDLE;
+auto gfx::CommandBuffer::newDescriptorSet(const rc<ComputePipelineState>& compute_pipeline_state, uint32_t index) -> vk::DescriptorSet {
+    return descriptorAllocator->allocate(compute_pipeline_state->descriptor_set_layouts[index], compute_pipeline_state->descriptor_set_counts[index]);
 }
 
 auto gfx::CommandBuffer::newRenderCommandEncoder(const RenderingInfo& info) -> rc<RenderCommandEncoder> {
+    // every encoder is a debug group of its own, so that passes show up in captures and profiles without any extra calls
+    pushDebugGroup(info.label.empty() ? "RenderCommandEncoder" : info.label);
+
     auto encoder = rc<RenderCommandEncoder>(new RenderCommandEncoder(shared_from_this()));
     encoder->_beginRendering(info);
     return encoder;
 }
 
-auto gfx::CommandBuffer::newComputeCommandEncoder() -> rc<ComputeCommandEncoder> {
-    // todo: create compute command encoder
-    return {};
+auto gfx::CommandBuffer::newParallelRenderCommandEncoder(const RenderingInfo& info) -> rc<ParallelRenderCommandEncoder> {
+    pushDebugGroup(info.label.empty() ? "ParallelRenderCommandEncoder" : info.label);
+
+    return rc<ParallelRenderCommandEncoder>(new ParallelRenderCommandEncoder(shared_from_this(), info));
+}
+
+auto gfx::CommandBuffer::newComputeCommandEncoder(std::string const& label) -> rc<ComputeCommandEncoder> {
+    pushDebugGroup(label.empty() ? "ComputeCommandEncoder" : label);
+
+    return rc<ComputeCommandEncoder>(new ComputeCommandEncoder(shared_from_this()));
+}
+
+auto gfx::CommandBuffer::newBlitCommandEncoder(std::string const& label) -> rc<BlitCommandEncoder> {
+    pushDebugGroup(label.empty() ? "BlitCommandEncoder" : label);
+
+    return rc<BlitCommandEncoder>(new BlitCommandEncoder(shared_from_this()));
 }
 
 gfx::RenderCommandEncoder::RenderCommandEncoder(const rc<CommandBuffer>& commandBuffer) : commandBuffer(commandBuffer) {
+    // dynamic state is undefined in a new command buffer, set all of it before the first draw
+    flags_                      = RenderCommandEncoderDynamicState;
     depthClampEnable_           = false;
     rasterizerDiscardEnable_    = false;
     polygonMode_                = vk::PolygonMode::eFill;
@@ -187,7 +327,7 @@ gfx::RenderCommandEncoder::RenderCommandEncoder(const rc<CommandBuffer>& command
     depthBiasSlopeFactor_       = 0.0F;
 }
 
-void gfx::RenderCommandEncoder::_beginRendering(const RenderingInfo& info) {
+static void beginRendering(gfx::CommandBuffer& commandBuffer, const gfx::RenderingInfo& info, vk::RenderingFlags flags) {
     vk::RenderingAttachmentInfo depthAttachment = {};
     vk::RenderingAttachmentInfo stencilAttachment = {};
     std::vector<vk::RenderingAttachmentInfo> colorAttachments = {};
@@ -219,6 +359,7 @@ void gfx::RenderCommandEncoder::_beginRendering(const RenderingInfo& info) {
     }
 
     vk::RenderingInfo rendering_info = {};
+    rendering_info.setFlags(flags);
     rendering_info.setRenderArea(info.renderArea);
     rendering_info.setLayerCount(info.layerCount);
     rendering_info.setViewMask(info.viewMask);
@@ -264,162 +405,124 @@ void gfx::RenderCommandEncoder::_beginRendering(const RenderingInfo& info) {
         rendering_info.setPStencilAttachment(&stencilAttachment);
     }
 
-    commandBuffer->handle.beginRendering(rendering_info, commandBuffer->device->dispatcher);
+    commandBuffer.handle.beginRendering(rendering_info, commandBuffer.device->dispatcher);
+}
+
+void gfx::RenderCommandEncoder::_beginRendering(const RenderingInfo& info, vk::RenderingFlags flags) {
+    beginRendering(*commandBuffer, info, flags);
 }
 
 void gfx::RenderCommandEncoder::_endRendering() {
     commandBuffer->handle.endRendering(commandBuffer->device->dispatcher);
 }
 
-void gfx::RenderCommandEncoder::_setup() {
-    if ((flags_ & RenderCommandEncoderPipeline) != RenderCommandEncoderPipeline) {
-        return;
+auto gfx::RenderCommandEncoder::_setup() -> bool {
+    if ((flags_ & (RenderCommandEncoderPipeline | RenderCommandEncoderDynamicState | RenderCommandEncoderPushConstants)) == 0) {
+        return true;
     }
-    flags_ &= ~RenderCommandEncoderPipeline;
-
-    std::size_t key = 0;
-    VULKAN_HPP_HASH_COMBINE(key, depthStencilState_.get());
-    VULKAN_HPP_HASH_COMBINE(key, renderPipelineState_.get());
-    VULKAN_HPP_HASH_COMBINE(key, depthClampEnable_);
-    VULKAN_HPP_HASH_COMBINE(key, rasterizerDiscardEnable_);
-    VULKAN_HPP_HASH_COMBINE(key, polygonMode_);
-    VULKAN_HPP_HASH_COMBINE(key, lineWidth_);
-    VULKAN_HPP_HASH_COMBINE(key, cullMode_);
-    VULKAN_HPP_HASH_COMBINE(key, frontFace_);
-    VULKAN_HPP_HASH_COMBINE(key, depthBiasEnable_);
-    VULKAN_HPP_HASH_COMBINE(key, depthBiasConstantFactor_);
-    VULKAN_HPP_HASH_COMBINE(key, depthBiasClamp_);
-    VULKAN_HPP_HASH_COMBINE(key, depthBiasSlopeFactor_);
-
-    auto it = renderPipelineState_->pipelines.emplace(key, Lazy{[&] -> vk::Pipeline {
-        auto renderPipelineStateDescription = renderPipelineState_->description;
-        vk::GraphicsPipelineCreateInfo graphicsPipelineCreateInfo = {};
-
-        vk::PipelineViewportStateCreateInfo pipelineViewportStateCreateInfo = {};
-        pipelineViewportStateCreateInfo.setViewportCount(1);
-        pipelineViewportStateCreateInfo.setScissorCount(1);
-        graphicsPipelineCreateInfo.setPViewportState(&pipelineViewportStateCreateInfo);
-
-        vk::PipelineRenderingCreateInfo pipelineRenderingCreateInfo = {};
-        pipelineRenderingCreateInfo.setViewMask(renderPipelineStateDescription->getViewMask());
-        pipelineRenderingCreateInfo.setColorAttachmentFormats(renderPipelineStateDescription->colorAttachmentFormats().elements);
-        pipelineRenderingCreateInfo.setDepthAttachmentFormat(renderPipelineStateDescription->getDepthAttachmentFormat());
-        pipelineRenderingCreateInfo.setStencilAttachmentFormat(renderPipelineStateDescription->getStencilAttachmentFormat());
-        graphicsPipelineCreateInfo.setPNext(&pipelineRenderingCreateInfo);
-
-        vk::PipelineInputAssemblyStateCreateInfo pipelineInputAssemblyStateCreateInfo = {};
-        pipelineInputAssemblyStateCreateInfo.setTopology(renderPipelineStateDescription->getInputPrimitiveTopology());
-        pipelineInputAssemblyStateCreateInfo.setPrimitiveRestartEnable(renderPipelineStateDescription->getPrimitiveRestartEnable());
-        graphicsPipelineCreateInfo.setPInputAssemblyState(&pipelineInputAssemblyStateCreateInfo);
-
-        vk::PipelineRasterizationStateCreateInfo rasterization_state = {};
-        rasterization_state.setDepthClampEnable(depthClampEnable_);
-        rasterization_state.setRasterizerDiscardEnable(rasterizerDiscardEnable_);
-        rasterization_state.setPolygonMode(polygonMode_);
-        rasterization_state.setLineWidth(lineWidth_);
-        rasterization_state.setCullMode(cullMode_);
-        rasterization_state.setFrontFace(frontFace_);
-        rasterization_state.setDepthBiasEnable(depthBiasEnable_);
-        rasterization_state.setDepthBiasConstantFactor(depthBiasConstantFactor_);
-        rasterization_state.setDepthBiasClamp(depthBiasClamp_);
-        rasterization_state.setDepthBiasSlopeFactor(depthBiasSlopeFactor_);
-
-        vk::PipelineTessellationStateCreateInfo tessellation_state = {};
-        if (auto tesselationState = renderPipelineStateDescription->getTessellationState()) {
-            tessellation_state.setPatchControlPoints(tesselationState->patch_control_points);
-        }
-
-        auto rasterization_samples = [&renderPipelineStateDescription] {
-            switch (renderPipelineStateDescription->getRasterSampleCount()) {
-                case 1: return vk::SampleCountFlagBits::e1;
-                case 2: return vk::SampleCountFlagBits::e2;
-                case 4: return vk::SampleCountFlagBits::e4;
-                case 8: return vk::SampleCountFlagBits::e8;
-                case 16: return vk::SampleCountFlagBits::e16;
-                case 32: return vk::SampleCountFlagBits::e32;
-                case 64: return vk::SampleCountFlagBits::e64;
-                default: return vk::SampleCountFlagBits{};
-            }
-        }();
-
-        vk::PipelineMultisampleStateCreateInfo pipelineMultisampleStateCreateInfo = {};
-        pipelineMultisampleStateCreateInfo.setRasterizationSamples(rasterization_samples);
-        if (auto multisampleState = renderPipelineStateDescription->getMultisampleState()) {
-            pipelineMultisampleStateCreateInfo.setSampleShadingEnable(multisampleState->sample_shading_enable);
-            pipelineMultisampleStateCreateInfo.setMinSampleShading(multisampleState->min_sample_shading);
-            pipelineMultisampleStateCreateInfo.setPSampleMask(multisampleState->sample_mask);
-        }
-        pipelineMultisampleStateCreateInfo.setAlphaToCoverageEnable(renderPipelineStateDescription->getIsAlphaToCoverageEnabled());
-        pipelineMultisampleStateCreateInfo.setAlphaToOneEnable(renderPipelineStateDescription->getIsAlphaToOneEnabled());
-        graphicsPipelineCreateInfo.setPMultisampleState(&pipelineMultisampleStateCreateInfo);
 
-        vk::PipelineDepthStencilStateCreateInfo pipelineDepthStencilStateCreateInfo = {};
+    auto key = PipelineVariantKey{
+        .depthStencilState          = depthStencilState_,
+        .depthClampEnable           = depthClampEnable_,
+        .rasterizerDiscardEnable    = rasterizerDiscardEnable_,
+        .polygonMode                = polygonMode_,
+        .lineWidth                  = lineWidth_,
+        .cullMode                   = cullMode_,
+        .frontFace                  = frontFace_,
+        .depthBiasEnable            = depthBiasEnable_,
+        .depthBiasConstantFactor    = depthBiasConstantFactor_,
+        .depthBiasClamp             = depthBiasClamp_,
+        .depthBiasSlopeFactor       = depthBiasSlopeFactor_,
+    };
 
-        auto dynamicStates = std::array{
-            vk::DynamicState::eViewport,
-            vk::DynamicState::eScissor
-        };
+    // before the lookup, so the variant that compiles a pipeline is not counted as avoided
+    if (commandBuffer->device->pipelineVariantStatistics) {
+        renderPipelineState_->_recordVariant(key);
+    }
 
-        vk::PipelineDynamicStateCreateInfo pipelineDynamicStateCreateInfo = {};
-        pipelineDynamicStateCreateInfo.setDynamicStates(dynamicStates);
-        graphicsPipelineCreateInfo.setPDynamicState(&pipelineDynamicStateCreateInfo);
-
-        std::vector<vk::PipelineShaderStageCreateInfo> pipelineShaderStageCreateInfos = {};
-        if (auto vertexFunction = renderPipelineStateDescription->getVertexFunction()) {
-            vk::PipelineShaderStageCreateInfo pipelineShaderStageCreateInfo = {};
-            pipelineShaderStageCreateInfo.setStage(vk::ShaderStageFlagBits::eVertex);
-            pipelineShaderStageCreateInfo.setModule(vertexFunction->library->handle);
-            pipelineShaderStageCreateInfo.setPName(vertexFunction->name.c_str());
-            pipelineShaderStageCreateInfos.emplace_back(pipelineShaderStageCreateInfo);
+    if ((flags_ & RenderCommandEncoderPipeline) == RenderCommandEncoderPipeline) {
+        vk::Pipeline pipeline;
+        if (drawPolicy_ == DrawPolicy::eSkipUntilReady) {
+            pipeline = renderPipelineState_->_getPipelineIfReady(key);
+        } else {
+            pipeline = renderPipelineState_->_getPipeline(key);
         }
-        if (auto fragmentFunction = renderPipelineStateDescription->getFragmentFunction()) {
-            vk::PipelineShaderStageCreateInfo pipelineShaderStageCreateInfo = {};
-            pipelineShaderStageCreateInfo.setStage(vk::ShaderStageFlagBits::eFragment);
-            pipelineShaderStageCreateInfo.setModule(fragmentFunction->library->handle);
-            pipelineShaderStageCreateInfo.setPName(fragmentFunction->name.c_str());
-            pipelineShaderStageCreateInfos.emplace_back(pipelineShaderStageCreateInfo);
+        if (!pipeline) {
+            // keep the pipeline dirty so the next draw asks again
+            return false;
         }
-        graphicsPipelineCreateInfo.setStages(pipelineShaderStageCreateInfos);
 
-        vk::PipelineVertexInputStateCreateInfo pipelineVertexInputStateCreateInfo = {};
-        if (auto vertexInputState = renderPipelineStateDescription->getVertexInputState()) {
-            pipelineVertexInputStateCreateInfo.setVertexBindingDescriptions(vertexInputState->bindings);
-            pipelineVertexInputStateCreateInfo.setVertexAttributeDescriptions(vertexInputState->attributes);
-        }
-        graphicsPipelineCreateInfo.setPVertexInputState(&pipelineVertexInputStateCreateInfo);
-
-        vk::PipelineColorBlendStateCreateInfo pipelineColorBlendStateCreateInfo = {};
-        pipelineColorBlendStateCreateInfo.setAttachments(renderPipelineStateDescription->colorBlendAttachments().elements);
-        graphicsPipelineCreateInfo.setPColorBlendState(&pipelineColorBlendStateCreateInfo);
-
-        graphicsPipelineCreateInfo.setPRasterizationState(&rasterization_state);
-        graphicsPipelineCreateInfo.setPTessellationState(&tessellation_state);
-
-        if (depthStencilState_) {
-            pipelineDepthStencilStateCreateInfo.setDepthTestEnable(depthStencilState_->isDepthTestEnabled);
-            pipelineDepthStencilStateCreateInfo.setDepthWriteEnable(depthStencilState_->isDepthWriteEnabled);
-            pipelineDepthStencilStateCreateInfo.setDepthCompareOp(depthStencilState_->depthCompareFunction);
-            pipelineDepthStencilStateCreateInfo.setDepthBoundsTestEnable(depthStencilState_->isDepthBoundsTestEnabled);
-            pipelineDepthStencilStateCreateInfo.setMinDepthBounds(depthStencilState_->minDepthBounds);
-            pipelineDepthStencilStateCreateInfo.setMaxDepthBounds(depthStencilState_->maxDepthBounds);
-            pipelineDepthStencilStateCreateInfo.setStencilTestEnable(depthStencilState_->isStencilTestEnabled);
-            pipelineDepthStencilStateCreateInfo.setFront(depthStencilState_->frontFaceStencil);
-            pipelineDepthStencilStateCreateInfo.setBack(depthStencilState_->backFaceStencil);
-
-            graphicsPipelineCreateInfo.setPDepthStencilState(&pipelineDepthStencilStateCreateInfo);
-        }
+        flags_ &= ~RenderCommandEncoderPipeline;
+        commandBuffer->handle.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline, commandBuffer->device->dispatcher);
+        commandBuffer->_useRenderPipelineState(renderPipelineState_);
+    }
 
-        graphicsPipelineCreateInfo.setLayout(renderPipelineState_->pipelineLayout);
-        graphicsPipelineCreateInfo.setRenderPass(nullptr);
-        graphicsPipelineCreateInfo.setSubpass(0);
-        graphicsPipelineCreateInfo.setBasePipelineHandle(nullptr);
-        graphicsPipelineCreateInfo.setBasePipelineIndex(0);
+    // every pipeline of the device has the same dynamic states, so binding another one keeps them
+    if ((flags_ & RenderCommandEncoderDynamicState) == RenderCommandEncoderDynamicState) {
+        flags_ &= ~RenderCommandEncoderDynamicState;
+        _setDynamicState();
+    }
 
-        vk::Pipeline pipeline;
-        vk::resultCheck(commandBuffer->device->handle.createGraphicsPipelines(renderPipelineState_->pipelineCache, 1, &graphicsPipelineCreateInfo, nullptr, &pipeline, commandBuffer->device->dispatcher), "Failed to create graphics pipeline");
-        return pipeline;
-    }});
-    commandBuffer->handle.bindPipeline(vk::PipelineBindPoint::eGraphics, it.first->second, commandBuffer->device->dispatcher);
+    if ((flags_ & RenderCommandEncoderPushConstants) == RenderCommandEncoderPushConstants) {
+        flags_ &= ~RenderCommandEncoderPushConstants;
+        _bindSpilledPushConstants();
+    }
+    return true;
+}
+
+void gfx::RenderCommandEncoder::_invalidate(bool dynamic) {
+    flags_ |= dynamic ? RenderCommandEncoderDynamicState : RenderCommandEncoderPipeline;
+}
+
+void gfx::RenderCommandEncoder::_setDynamicState() {
+    auto& handle = commandBuffer->handle;
+    auto& dispatcher = commandBuffer->device->dispatcher;
+    auto& dynamicState = commandBuffer->device->dynamicState;
+
+    handle.setLineWidth(lineWidth_, dispatcher);
+    handle.setDepthBias(depthBiasConstantFactor_, depthBiasClamp_, depthBiasSlopeFactor_, dispatcher);
+
+    if (dynamicState.extendedDynamicState) {
+        handle.setCullModeEXT(cullMode_, dispatcher);
+        handle.setFrontFaceEXT(frontFace_, dispatcher);
+
+        // without a depth stencil state every test is disabled, as in a baked pipeline
+        if (auto state = depthStencilState_.get()) {
+            handle.setDepthTestEnableEXT(state->isDepthTestEnabled, dispatcher);
+            handle.setDepthWriteEnableEXT(state->isDepthWriteEnabled, dispatcher);
+            handle.setDepthCompareOpEXT(state->depthCompareFunction, dispatcher);
+            handle.setDepthBoundsTestEnableEXT(state->isDepthBoundsTestEnabled, dispatcher);
+            handle.setDepthBounds(state->minDepthBounds, state->maxDepthBounds, dispatcher);
+            handle.setStencilTestEnableEXT(state->isStencilTestEnabled, dispatcher);
+
+            auto faces = std::array{
+                std::pair{vk::StencilFaceFlagBits::eFront, &state->frontFaceStencil},
+                std::pair{vk::StencilFaceFlagBits::eBack, &state->backFaceStencil}
+            };
+            for (auto [face, stencil] : faces) {
+                handle.setStencilOpEXT(face, stencil->failOp, stencil->passOp, stencil->depthFailOp, stencil->compareOp, dispatcher);
+                handle.setStencilCompareMask(face, stencil->compareMask, dispatcher);
+                handle.setStencilWriteMask(face, stencil->writeMask, dispatcher);
+                handle.setStencilReference(face, stencil->reference, dispatcher);
+            }
+        } else {
+            handle.setDepthTestEnableEXT(VK_FALSE, dispatcher);
+            handle.setDepthWriteEnableEXT(VK_FALSE, dispatcher);
+            handle.setDepthBoundsTestEnableEXT(VK_FALSE, dispatcher);
+            handle.setStencilTestEnableEXT(VK_FALSE, dispatcher);
+        }
+    }
+
+    if (dynamicState.extendedDynamicState2) {
+        handle.setDepthBiasEnableEXT(depthBiasEnable_, dispatcher);
+        handle.setRasterizerDiscardEnableEXT(rasterizerDiscardEnable_, dispatcher);
+    }
+    if (dynamicState.depthClampEnable) {
+        handle.setDepthClampEnableEXT(depthClampEnable_, dispatcher);
+    }
+    if (dynamicState.polygonMode) {
+        handle.setPolygonModeEXT(polygonMode_, dispatcher);
+    }
 }
 
 auto gfx::RenderCommandEncoder::getCommandBuffer() -> rc<CommandBuffer> {
@@ -427,82 +530,92 @@ auto gfx::RenderCommandEncoder::getCommandBuffer() -> rc<CommandBuffer> {
 }
 
 void gfx::RenderCommandEncoder::endEncoding() {
+    if (inheritsRendering_) {
+        commandBuffer->popDebugGroup();
+        commandBuffer->end();
+        return;
+    }
     _endRendering();
+    commandBuffer->popDebugGroup();
+}
+
+void gfx::RenderCommandEncoder::setDrawPolicy(DrawPolicy drawPolicy) {
+    drawPolicy_ = drawPolicy;
 }
 
 void gfx::RenderCommandEncoder::setDepthClampEnable(bool depthClampEnable) {
     if (depthClampEnable_ != depthClampEnable) {
-        flags_ |= RenderCommandEncoderPipeline;
+        _invalidate(commandBuffer->device->dynamicState.depthClampEnable);
         depthClampEnable_ = depthClampEnable;
     }
 }
 
 void gfx::RenderCommandEncoder::setRasterizerDiscardEnable(bool rasterizerDiscardEnable) {
     if (rasterizerDiscardEnable_ != rasterizerDiscardEnable) {
-        flags_ |= RenderCommandEncoderPipeline;
+        _invalidate(commandBuffer->device->dynamicState.extendedDynamicState2);
         rasterizerDiscardEnable_ = rasterizerDiscardEnable;
     }
 }
 
 void gfx::RenderCommandEncoder::setPolygonMode(vk::PolygonMode polygonMode) {
     if (polygonMode_ != polygonMode) {
-        flags_ |= RenderCommandEncoderPipeline;
+        _invalidate(commandBuffer->device->dynamicState.polygonMode);
         polygonMode_ = polygonMode;
     }
 }
 
 void gfx::RenderCommandEncoder::setLineWidth(float lineWidth) {
     if (lineWidth_ != lineWidth) {
-        flags_ |= RenderCommandEncoderPipeline;
+        _invalidate(true);
         lineWidth_ = lineWidth;
     }
 }
 
 void gfx::RenderCommandEncoder::setCullMode(vk::CullModeFlagBits cullMode) {
     if (cullMode_ != cullMode) {
-        flags_ |= RenderCommandEncoderPipeline;
+        _invalidate(commandBuffer->device->dynamicState.extendedDynamicState);
         cullMode_ = cullMode;
     }
 }
 
 void gfx::RenderCommandEncoder::setFrontFace(vk::FrontFace frontFace) {
     if (frontFace_ != frontFace) {
-        flags_ |= RenderCommandEncoderPipeline;
+        _invalidate(commandBuffer->device->dynamicState.extendedDynamicState);
         frontFace_ = frontFace;
     }
 }
 
 void gfx::RenderCommandEncoder::setDepthBiasEnable(bool depthBiasEnable) {
     if (depthBiasEnable_ != depthBiasEnable) {
-        flags_ |= RenderCommandEncoderPipeline;
+        _invalidate(commandBuffer->device->dynamicState.extendedDynamicState2);
         depthBiasEnable_ = depthBiasEnable;
     }
 }
 
 void gfx::RenderCommandEncoder::setDepthBiasConstantFactor(float depthBiasConstantFactor) {
     if (depthBiasConstantFactor_ != depthBiasConstantFactor) {
-        flags_ |= RenderCommandEncoderPipeline;
+        _invalidate(true);
         depthBiasConstantFactor_ = depthBiasConstantFactor;
     }
 }
 
 void gfx::RenderCommandEncoder::setDepthBiasClamp(float depthBiasClamp) {
     if (depthBiasClamp_ != depthBiasClamp) {
-        flags_ |= RenderCommandEncoderPipeline;
+        _invalidate(true);
         depthBiasClamp_ = depthBiasClamp;
     }
 }
 
 void gfx::RenderCommandEncoder::setDepthBiasSlopeFactor(float depthBiasSlopeFactor) {
     if (depthBiasSlopeFactor_ != depthBiasSlopeFactor) {
-        flags_ |= RenderCommandEncoderPipeline;
+        _invalidate(true);
         depthBiasSlopeFactor_ = depthBiasSlopeFactor;
     }
 }
 
 void gfx::RenderCommandEncoder::setDepthStencilState(rc<DepthStencilState> depthStencilState) {
     if (depthStencilState_ != depthStencilState) {
-        flags_ |= RenderCommandEncoderPipeline;
+        _invalidate(commandBuffer->device->dynamicState.extendedDynamicState);
         depthStencilState_ = std::move(depthStencilState);
     }
 }
@@ -511,6 +624,13 @@ void gfx::RenderCommandEncoder::setRenderPipelineState(rc<RenderPipelineState> r
     if (renderPipelineState_ != renderPipelineState) {
         flags_ |= RenderCommandEncoderPipeline;
         renderPipelineState_ = std::move(renderPipelineState);
+        if (renderPipelineState_ && renderPipelineState_->pushConstantSpillStages) {
+            // like push constants, the spilled block is kept across pipelines, it is only bound again for another layout or size
+            auto& state = *renderPipelineState_;
+            if (state.pipelineLayout != spillPipelineLayout_ || state.pushConstantSpillSize != spillSize_) {
+                flags_ |= RenderCommandEncoderPushConstants;
+            }
+        }
     }
 }
 
@@ -530,25 +650,222 @@ void gfx::RenderCommandEncoder::bindVertexBuffer(int firstBinding, const rc<Buff
     commandBuffer->handle.bindVertexBuffers(firstBinding, 1, &buffer->handle, &offset, commandBuffer->device->dispatcher);
 }
 
+void gfx::RenderCommandEncoder::bindIndexBuffer(const TransientSlice& slice, vk::IndexType indexType) {
+    commandBuffer->handle.bindIndexBuffer(slice.buffer->handle, slice.offset, indexType, commandBuffer->device->dispatcher);
+}
+
+void gfx::RenderCommandEncoder::bindVertexBuffer(int firstBinding, const TransientSlice& slice) {
+    commandBuffer->handle.bindVertexBuffers(firstBinding, 1, &slice.buffer->handle, &slice.offset, commandBuffer->device->dispatcher);
+}
+
+void gfx::RenderCommandEncoder::bindUniformBuffer(uint32_t slot, TransientAllocator& allocator, const TransientSlice& slice) {
+    if (slot >= 32 || (renderPipelineState_->uniformBufferSets & (1U << slot)) == 0) {
+        throw std::runtime_error("Set " + std::to_string(slot) + " of the pipeline is not marked in setDynamicUniformBufferSets or does not hold a single uniform buffer at binding 0");
+    }
+
+    // the set is shared by every slice of the same chunk and size, only the dynamic offset changes
+    auto descriptor_set = allocator.uniformDescriptorSet(slice, renderPipelineState_->descriptorSetLayouts[slot]);
+    auto dynamic_offset = static_cast<uint32_t>(slice.offset);
+    commandBuffer->handle.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, renderPipelineState_->pipelineLayout, slot, 1, &descriptor_set, 1, &dynamic_offset, commandBuffer->device->dispatcher);
+    _invalidateSpilledPushConstants();
+}
+
 void gfx::RenderCommandEncoder::draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) {
-    _setup();
+    if (!_setup()) {
+        return;
+    }
     commandBuffer->handle.draw(vertexCount, instanceCount, firstVertex, firstInstance, commandBuffer->device->dispatcher);
 }
 
 void gfx::RenderCommandEncoder::drawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance) {
-    _setup();
+    if (!_setup()) {
+        return;
+    }
     commandBuffer->handle.drawIndexed(indexCount, instanceCount, firstIndex, vertexOffset, firstInstance, commandBuffer->device->dispatcher);
 }
 
+void gfx::RenderCommandEncoder::drawIndirect(const rc<Buffer>& indirectBuffer, vk::DeviceSize offset, uint32_t drawCount, uint32_t stride) {
+    if (!_setup()) {
+        return;
+    }
+    commandBuffer->handle.drawIndirect(indirectBuffer->handle, offset, drawCount, stride, commandBuffer->device->dispatcher);
+}
+
+void gfx::RenderCommandEncoder::drawIndexedIndirect(const rc<Buffer>& indirectBuffer, vk::DeviceSize offset, uint32_t drawCount, uint32_t stride) {
+    if (!_setup()) {
+        return;
+    }
+    commandBuffer->handle.drawIndexedIndirect(indirectBuffer->handle, offset, drawCount, stride, commandBuffer->device->dispatcher);
+}
+
 void gfx::RenderCommandEncoder::bindDescriptorSet(vk::DescriptorSet descriptorSet, uint32_t slot) {
     commandBuffer->handle.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, renderPipelineState_->pipelineLayout, slot, 1, &descriptorSet, 0, nullptr, commandBuffer->device->dispatcher);
+    _invalidateSpilledPushConstants();
 }
 
 void gfx::RenderCommandEncoder::pushConstants(vk::ShaderStageFlags stageFlags, uint32_t offset, uint32_t size, const void* data) {
-    commandBuffer->handle.pushConstants(renderPipelineState_->pipelineLayout, stageFlags, offset, size, data, commandBuffer->device->dispatcher);
+    // stages whose block does not fit the device limit read it from a uniform buffer written at the next draw
+    auto spilled = stageFlags & renderPipelineState_->pushConstantSpillStages;
+    if (spilled) {
+        // bytes past the end of the block are never read by the shaders, e.g. the padding of a host struct
+        auto end = std::min(offset + size, renderPipelineState_->pushConstantSpillSize);
+        if (pushConstantData_.size() < renderPipelineState_->pushConstantSpillSize) {
+            pushConstantData_.resize(renderPipelineState_->pushConstantSpillSize);
+        }
+        if (offset < end) {
+            std::memcpy(pushConstantData_.data() + offset, data, end - offset);
+        }
+        flags_ |= RenderCommandEncoderPushConstants;
+    }
+    if (auto pushed = stageFlags & ~spilled) {
+        commandBuffer->handle.pushConstants(renderPipelineState_->pipelineLayout, pushed, offset, size, data, commandBuffer->device->dispatcher);
+    }
+}
+
+// sets bound with another layout may disturb the set the spilled block was bound to
+void gfx::RenderCommandEncoder::_invalidateSpilledPushConstants() {
+    if (renderPipelineState_->pipelineLayout != spillPipelineLayout_) {
+        spillPipelineLayout_ = VK_NULL_HANDLE;
+    }
+}
+
+void gfx::RenderCommandEncoder::_bindSpilledPushConstants() {
+    auto& state = *renderPipelineState_;
+    if (!state.pushConstantSpillStages) {
+        return;
+    }
+    if (!commandBuffer->uniformRing) {
+        commandBuffer->uniformRing = rc<UniformRing>::init(commandBuffer->device);
+    }
+
+    if (pushConstantData_.size() < state.pushConstantSpillSize) {
+        pushConstantData_.resize(state.pushConstantSpillSize);
+    }
+    auto data = std::span(pushConstantData_).first(state.pushConstantSpillSize);
+    auto allocation = commandBuffer->uniformRing->allocate(*commandBuffer->descriptorAllocator, state.descriptorSetLayouts[state.pushConstantSpillSet], std::as_bytes(data));
+    commandBuffer->handle.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, state.pipelineLayout, state.pushConstantSpillSet, 1, &allocation.descriptorSet, 1, &allocation.dynamicOffset, commandBuffer->device->dispatcher);
+    spillPipelineLayout_ = state.pipelineLayout;
+    spillSize_ = state.pushConstantSpillSize;
+}
+
+void gfx::RenderCommandEncoder::pushDebugGroup(std::string const& name) {
+    commandBuffer->pushDebugGroup(name);
+}
+
+void gfx::RenderCommandEncoder::popDebugGroup() {
+    commandBuffer->popDebugGroup();
+}
+
+gfx::ParallelRenderCommandEncoder::ParallelRenderCommandEncoder(const rc<CommandBuffer>& commandBuffer, const RenderingInfo& info)
+: commandBuffer(commandBuffer)
+, label(info.label.empty() ? "ParallelRenderCommandEncoder" : info.label)
+, colorFormats()
+, depthFormat(vk::Format::eUndefined)
+, stencilFormat(vk::Format::eUndefined)
+, viewMask(info.viewMask)
+, rasterizationSamples(info.rasterizationSamples)
+, pipelineStatistics()
+, mutex()
+, secondaryCommandBuffers() {
+    if (commandBuffer->queryRecorder && commandBuffer->queryRecorder->statisticsActive) {
+        if (!commandBuffer->device->inheritedQueries) {
+            throw std::runtime_error("Pipeline statistics around a parallel render encoder require the inheritedQueries feature");
+        }
+        pipelineStatistics = profilerPipelineStatisticFlags();
+    }
+
+    colorFormats.resize(info.colorAttachments.elements.size(), vk::Format::eUndefined);
+    for (size_t i = 0; i < info.colorAttachments.elements.size(); ++i) {
+        if (info.colorAttachments.elements[i].texture) {
+            colorFormats[i] = info.colorAttachments.elements[i].texture->format;
+        }
+    }
+    if (info.depthAttachment.texture) {
+        depthFormat = info.depthAttachment.texture->format;
+    }
+    if (info.stencilAttachment.texture) {
+        stencilFormat = info.stencilAttachment.texture->format;
+    }
+
+    beginRendering(*commandBuffer, info, vk::RenderingFlagBits::eContentsSecondaryCommandBuffers);
+}
+
+auto gfx::ParallelRenderCommandEncoder::getCommandBuffer() -> rc<CommandBuffer> {
+    return commandBuffer;
+}
+
+auto gfx::ParallelRenderCommandEncoder::renderCommandEncoder() -> rc<RenderCommandEncoder> {
+    auto secondaryCommandBuffer = commandBuffer->queue->commandBuffer(vk::CommandBufferLevel::eSecondary);
+
+    vk::CommandBufferInheritanceRenderingInfo inheritance_rendering_info = {};
+    inheritance_rendering_info.setViewMask(viewMask);
+    inheritance_rendering_info.setColorAttachmentFormats(colorFormats);
+    inheritance_rendering_info.setDepthAttachmentFormat(depthFormat);
+    inheritance_rendering_info.setStencilAttachmentFormat(stencilFormat);
+    inheritance_rendering_info.setRasterizationSamples(rasterizationSamples);
+
+    vk::CommandBufferInheritanceInfo inheritance_info = {};
+    inheritance_info.setPNext(&inheritance_rendering_info);
+    inheritance_info.setPipelineStatistics(pipelineStatistics);
+
+    vk::CommandBufferBeginInfo begin_info = {};
+    begin_info.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue);
+    begin_info.setPInheritanceInfo(&inheritance_info);
+
+    // no profiler scopes here, query pools can not be reset inside a render pass
+    secondaryCommandBuffer->handle.begin(begin_info, secondaryCommandBuffer->device->dispatcher);
+    secondaryCommandBuffer->submittedValue = 0;
+    secondaryCommandBuffer->descriptorAllocator->reset();
+    if (secondaryCommandBuffer->uniformRing) {
+        secondaryCommandBuffer->uniformRing->reset();
+    }
+    secondaryCommandBuffer->pushDebugGroup(label);
+
+    {
+        std::lock_guard lock(mutex);
+        secondaryCommandBuffers.emplace_back(secondaryCommandBuffer);
+    }
+
+    auto encoder = rc<RenderCommandEncoder>(new RenderCommandEncoder(secondaryCommandBuffer));
+    encoder->inheritsRendering_ = true;
+    return encoder;
+}
+
+void gfx::ParallelRenderCommandEncoder::endEncoding() {
+    std::lock_guard lock(mutex);
+
+    std::vector<vk::CommandBuffer> handles = {};
+    handles.reserve(secondaryCommandBuffers.size());
+    for (auto& secondaryCommandBuffer : secondaryCommandBuffers) {
+        handles.emplace_back(secondaryCommandBuffer->handle);
+    }
+    if (!handles.empty()) {
+        commandBuffer->handle.executeCommands(handles, commandBuffer->device->dispatcher);
+    }
+
+    commandBuffer->handle.endRendering(commandBuffer->device->dispatcher);
+    commandBuffer->popDebugGroup();
+
+    commandBuffer->secondaryCommandBuffers.insert(commandBuffer->secondaryCommandBuffers.end(), secondaryCommandBuffers.begin(), secondaryCommandBuffers.end());
+    secondaryCommandBuffers.clear();
+}
+
+gfx::ComputeCommandEncoder::ComputeCommandEncoder(const rc<CommandBuffer>& commandBuffer) : commandBuffer(commandBuffer) {}
+
+auto gfx::ComputeCommandEncoder::getCommandBuffer() -> rc<CommandBuffer> {
+    return commandBuffer;
+}
+
+void gfx::ComputeCommandEncoder::endEncoding() {
+    currentPipelineState = {};
+    commandBuffer->popDebugGroup();
 }
 
 void gfx::ComputeCommandEncoder::setComputePipelineState(const rc<ComputePipelineState>& state) {
+    if (currentPipelineState == state) {
+        return;
+    }
+    currentPipelineState = state;
     commandBuffer->handle.bindPipeline(vk::PipelineBindPoint::eCompute, state->pipeline, commandBuffer->device->dispatcher);
 }
 
@@ -560,6 +877,287 @@ void gfx::ComputeCommandEncoder::pushConstants(vk::ShaderStageFlags stageFlags,
     commandBuffer->handle.pushConstants(currentPipelineState->pipeline_layout, stageFlags, offset, size, data, commandBuffer->device->dispatcher);
 }
 
+void gfx::ComputeCommandEncoder::pushDebugGroup(std::string const& name) {
+    commandBuffer->pushDebugGroup(name);
+}
+
+void gfx::ComputeCommandEncoder::popDebugGroup() {
+    commandBuffer->popDebugGroup();
+}
+
 void gfx::ComputeCommandEncoder::dispatch(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
     commandBuffer->handle.dispatch(groupCountX, groupCountY, groupCountZ, commandBuffer->device->dispatcher);
-}
\ No newline at end of file
+}
+
+void gfx::ComputeCommandEncoder::dispatchIndirect(const rc<Buffer>& indirectBuffer, vk::DeviceSize offset) {
+    commandBuffer->handle.dispatchIndirect(indirectBuffer->handle, offset, commandBuffer->device->dispatcher);
+}
+
+void gfx::ComputeCommandEncoder::memoryBarrier(vk::PipelineStageFlags2 srcStageMask, vk::AccessFlags2 srcAccessMask, vk::PipelineStageFlags2 dstStageMask, vk::AccessFlags2 dstAccessMask) {
+    vk::MemoryBarrier2 barrier = {};
+    barrier.setSrcStageMask(srcStageMask);
+    barrier.setSrcAccessMask(srcAccessMask);
+    barrier.setDstStageMask(dstStageMask);
+    barrier.setDstAccessMask(dstAccessMask);
+
+    vk::DependencyInfo dependency_info = {};
+    dependency_info.setMemoryBarrierCount(1);
+    dependency_info.setPMemoryBarriers(&barrier);
+
+    commandBuffer->handle.pipelineBarrier2(dependency_info, commandBuffer->device->dispatcher);
+}
+
+void gfx::ComputeCommandEncoder::bufferBarrier(const rc<Buffer>& buffer, vk::PipelineStageFlags2 srcStageMask, vk::AccessFlags2 srcAccessMask, vk::PipelineStageFlags2 dstStageMask, vk::AccessFlags2 dstAccessMask) {
+    vk::BufferMemoryBarrier2 barrier = {};
+    barrier.setSrcStageMask(srcStageMask);
+    barrier.setSrcAccessMask(srcAccessMask);
+    barrier.setDstStageMask(dstStageMask);
+    barrier.setDstAccessMask(dstAccessMask);
+    barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+    barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+    barrier.setBuffer(buffer->handle);
+    barrier.setOffset(0);
+    barrier.setSize(VK_WHOLE_SIZE);
+
+    vk::DependencyInfo dependency_info = {};
+    dependency_info.setBufferMemoryBarrierCount(1);
+    dependency_info.setPBufferMemoryBarriers(&barrier);
+
+    commandBuffer->handle.pipelineBarrier2(dependency_info, commandBuffer->device->dispatcher);
+}
+
+void gfx::ComputeCommandEncoder::imageBarrier(const rc<Texture>& texture, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::PipelineStageFlags2 srcStageMask, vk::AccessFlags2 srcAccessMask, vk::PipelineStageFlags2 dstStageMask, vk::AccessFlags2 dstAccessMask) {
+    vk::ImageMemoryBarrier2 barrier = {};
+    barrier.setSrcStageMask(srcStageMask);
+    barrier.setSrcAccessMask(srcAccessMask);
+    barrier.setDstStageMask(dstStageMask);
+    barrier.setDstAccessMask(dstAccessMask);
+    barrier.setOldLayout(oldLayout);
+    barrier.setNewLayout(newLayout);
+    barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+    barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+    barrier.setImage(texture->image);
+    barrier.setSubresourceRange(texture->subresource);
+
+    vk::DependencyInfo dependency_info = {};
+    dependency_info.setImageMemoryBarrierCount(1);
+    dependency_info.setPImageMemoryBarriers(&barrier);
+
+    commandBuffer->handle.pipelineBarrier2(dependency_info, commandBuffer->device->dispatcher);
+}
+
+gfx::BlitCommandEncoder::BlitCommandEncoder(const rc<CommandBuffer>& commandBuffer) : commandBuffer(commandBuffer), memoryBarriers(), bufferBarriers(), imageBarriers() {}
+
+auto gfx::BlitCommandEncoder::getCommandBuffer() -> rc<CommandBuffer> {
+    return commandBuffer;
+}
+
+void gfx::BlitCommandEncoder::endEncoding() {
+    _flushBarriers();
+    commandBuffer->popDebugGroup();
+}
+
+void gfx::BlitCommandEncoder::copyBuffer(const rc<Buffer>& source, vk::DeviceSize sourceOffset, const rc<Buffer>& destination, vk::DeviceSize destinationOffset, vk::DeviceSize size) {
+    _flushBarriers();
+
+    vk::BufferCopy buffer_copy = {};
+    buffer_copy.setSrcOffset(sourceOffset);
+    buffer_copy.setDstOffset(destinationOffset);
+    buffer_copy.setSize(size);
+
+    commandBuffer->handle.copyBuffer(source->handle, destination->handle, 1, &buffer_copy, commandBuffer->device->dispatcher);
+}
+
+void gfx::BlitCommandEncoder::copyBufferToTexture(const rc<Buffer>& source, vk::DeviceSize sourceOffset, const rc<Texture>& destination, uint32_t mipLevel) {
+    _flushBarriers();
+
+    // tightly packed, every layer of the level one after the other
+    vk::BufferImageCopy buffer_image_copy = {};
+    buffer_image_copy.setBufferOffset(sourceOffset);
+    buffer_image_copy.setImageExtent(destination->mipExtent(mipLevel));
+    buffer_image_copy.imageSubresource.setAspectMask(destination->subresource.aspectMask);
+    buffer_image_copy.imageSubresource.setMipLevel(destination->subresource.baseMipLevel + mipLevel);
+    buffer_image_copy.imageSubresource.setBaseArrayLayer(destination->subresource.baseArrayLayer);
+    buffer_image_copy.imageSubresource.setLayerCount(destination->subresource.layerCount);
+
+    commandBuffer->handle.copyBufferToImage(source->handle, destination->image, vk::ImageLayout::eTransferDstOptimal, 1, &buffer_image_copy, commandBuffer->device->dispatcher);
+}
+
+void gfx::BlitCommandEncoder::copyTextureToBuffer(const rc<Texture>& source, const rc<Buffer>& destination, vk::DeviceSize destinationOffset, uint32_t mipLevel) {
+    _flushBarriers();
+
+    vk::BufferImageCopy buffer_image_copy = {};
+    buffer_image_copy.setBufferOffset(destinationOffset);
+    buffer_image_copy.setImageExtent(source->mipExtent(mipLevel));
+    buffer_image_copy.imageSubresource.setAspectMask(source->subresource.aspectMask);
+    buffer_image_copy.imageSubresource.setMipLevel(source->subresource.baseMipLevel + mipLevel);
+    buffer_image_copy.imageSubresource.setBaseArrayLayer(source->subresource.baseArrayLayer);
+    buffer_image_copy.imageSubresource.setLayerCount(source->subresource.layerCount);
+
+    commandBuffer->handle.copyImageToBuffer(source->image, vk::ImageLayout::eTransferSrcOptimal, destination->handle, 1, &buffer_image_copy, commandBuffer->device->dispatcher);
+}
+
+void gfx::BlitCommandEncoder::copyTexture(const rc<Texture>& source, const rc<Texture>& destination) {
+    _flushBarriers();
+
+    auto levelCount = std::min(source->subresource.levelCount, destination->subresource.levelCount);
+    auto layerCount = std::min(source->subresource.layerCount, destination->subresource.layerCount);
+
+    std::vector<vk::ImageCopy> image_copies = {};
+    image_copies.reserve(levelCount);
+
+    for (uint32_t level = 0; level < levelCount; ++level) {
+        auto source_extent = source->mipExtent(level);
+        auto destination_extent = destination->mipExtent(level);
+
+        vk::ImageCopy image_copy = {};
+        image_copy.srcSubresource.setAspectMask(source->subresource.aspectMask);
+        image_copy.srcSubresource.setMipLevel(source->subresource.baseMipLevel + level);
+        image_copy.srcSubresource.setBaseArrayLayer(source->subresource.baseArrayLayer);
+        image_copy.srcSubresource.setLayerCount(layerCount);
+        image_copy.dstSubresource.setAspectMask(destination->subresource.aspectMask);
+        image_copy.dstSubresource.setMipLevel(destination->subresource.baseMipLevel + level);
+        image_copy.dstSubresource.setBaseArrayLayer(destination->subresource.baseArrayLayer);
+        image_copy.dstSubresource.setLayerCount(layerCount);
+        image_copy.setExtent(vk::Extent3D{
+            .width = std::min(source_extent.width, destination_extent.width),
+            .height = std::min(source_extent.height, destination_extent.height),
+            .depth = std::min(source_extent.depth, destination_extent.depth)
+        });
+        image_copies.emplace_back(image_copy);
+    }
+
+    commandBuffer->handle.copyImage(source->image, vk::ImageLayout::eTransferSrcOptimal, destination->image, vk::ImageLayout::eTransferDstOptimal, image_copies, commandBuffer->device->dispatcher);
+}
+
+void gfx::BlitCommandEncoder::fillBuffer(const rc<Buffer>& buffer, vk::DeviceSize offset, vk::DeviceSize size, uint32_t value) {
+    _flushBarriers();
+
+    commandBuffer->handle.fillBuffer(buffer->handle, offset, size, value, commandBuffer->device->dispatcher);
+}
+
+void gfx::BlitCommandEncoder::generateMipmaps(const rc<Texture>& texture, vk::ImageLayout finalLayout) {
+    auto baseMipLevel = texture->subresource.baseMipLevel;
+    auto levelCount = texture->subresource.levelCount;
+
+    vk::ImageSubresourceRange range = texture->subresource;
+    range.setLevelCount(1);
+
+    auto filter = vk::Filter::eLinear;
+    if (levelCount > 1) {
+        auto& adapter = commandBuffer->device->adapter;
+        auto features = adapter->handle.getFormatProperties(texture->format, adapter->instance->dispatcher).optimalTilingFeatures;
+        if (!(features & vk::FormatFeatureFlagBits::eBlitSrc) || !(features & vk::FormatFeatureFlagBits::eBlitDst)) {
+            throw std::runtime_error("Format " + vk::to_string(texture->format) + " does not support blits, its mipmaps can not be generated");
+        }
+        if (!(features & vk::FormatFeatureFlagBits::eSampledImageFilterLinear)) {
+            filter = vk::Filter::eNearest;
+        }
+    }
+
+    // every level is written once and read once, so each step only waits for the blit into its source level
+    for (uint32_t level = 1; level < levelCount; ++level) {
+        range.setBaseMipLevel(baseMipLevel + level - 1);
+        _imageBarrier(texture, range, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal, vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite, vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferRead);
+        _flushBarriers();
+
+        auto source_extent = texture->mipExtent(level - 1);
+        auto destination_extent = texture->mipExtent(level);
+
+        vk::ImageBlit image_blit = {};
+        image_blit.srcSubresource.setAspectMask(texture->subresource.aspectMask);
+        image_blit.srcSubresource.setMipLevel(baseMipLevel + level - 1);
+        image_blit.srcSubresource.setBaseArrayLayer(texture->subresource.baseArrayLayer);
+        image_blit.srcSubresource.setLayerCount(texture->subresource.layerCount);
+        image_blit.srcOffsets[1] = vk::Offset3D{static_cast<int32_t>(source_extent.width), static_cast<int32_t>(source_extent.height), static_cast<int32_t>(source_extent.depth)};
+        image_blit.dstSubresource.setAspectMask(texture->subresource.aspectMask);
+        image_blit.dstSubresource.setMipLevel(baseMipLevel + level);
+        image_blit.dstSubresource.setBaseArrayLayer(texture->subresource.baseArrayLayer);
+        image_blit.dstSubresource.setLayerCount(texture->subresource.layerCount);
+        image_blit.dstOffsets[1] = vk::Offset3D{static_cast<int32_t>(destination_extent.width), static_cast<int32_t>(destination_extent.height), static_cast<int32_t>(destination_extent.depth)};
+
+        commandBuffer->handle.blitImage(texture->image, vk::ImageLayout::eTransferSrcOptimal, texture->image, vk::ImageLayout::eTransferDstOptimal, 1, &image_blit, filter, commandBuffer->device->dispatcher);
+    }
+
+    // all but the last level were read by the chain, the last one was only written
+    if (levelCount > 1) {
+        range.setBaseMipLevel(baseMipLevel);
+        range.setLevelCount(levelCount - 1);
+        _imageBarrier(texture, range, vk::ImageLayout::eTransferSrcOptimal, finalLayout, vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferRead, vk::PipelineStageFlagBits2::eAllCommands, vk::AccessFlagBits2::eMemoryRead);
+    }
+    range.setBaseMipLevel(baseMipLevel + levelCount - 1);
+    range.setLevelCount(1);
+    _imageBarrier(texture, range, vk::ImageLayout::eTransferDstOptimal, finalLayout, vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite, vk::PipelineStageFlagBits2::eAllCommands, vk::AccessFlagBits2::eMemoryRead);
+}
+
+void gfx::BlitCommandEncoder::memoryBarrier(vk::PipelineStageFlags2 srcStageMask, vk::AccessFlags2 srcAccessMask, vk::PipelineStageFlags2 dstStageMask, vk::AccessFlags2 dstAccessMask) {
+    vk::MemoryBarrier2 barrier = {};
+    barrier.setSrcStageMask(srcStageMask);
+    barrier.setSrcAccessMask(srcAccessMask);
+    barrier.setDstStageMask(dstStageMask);
+    barrier.setDstAccessMask(dstAccessMask);
+
+    memoryBarriers.emplace_back(barrier);
+}
+
+void gfx::BlitCommandEncoder::bufferBarrier(const rc<Buffer>& buffer, vk::PipelineStageFlags2 srcStageMask, vk::AccessFlags2 srcAccessMask, vk::PipelineStageFlags2 dstStageMask, vk::AccessFlags2 dstAccessMask) {
+    vk::BufferMemoryBarrier2 barrier = {};
+    barrier.setSrcStageMask(srcStageMask);
+    barrier.setSrcAccessMask(srcAccessMask);
+    barrier.setDstStageMask(dstStageMask);
+    barrier.setDstAccessMask(dstAccessMask);
+    barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+    barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+    barrier.setBuffer(buffer->handle);
+    barrier.setOffset(0);
+    barrier.setSize(VK_WHOLE_SIZE);
+
+    bufferBarriers.emplace_back(barrier);
+}
+
+void gfx::BlitCommandEncoder::imageBarrier(const rc<Texture>& texture, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::PipelineStageFlags2 srcStageMask, vk::AccessFlags2 srcAccessMask, vk::PipelineStageFlags2 dstStageMask, vk::AccessFlags2 dstAccessMask) {
+    _imageBarrier(texture, texture->subresource, oldLayout, newLayout, srcStageMask, srcAccessMask, dstStageMask, dstAccessMask);
+}
+
+void gfx::BlitCommandEncoder::pushDebugGroup(std::string const& name) {
+    _flushBarriers();
+    commandBuffer->pushDebugGroup(name);
+}
+
+void gfx::BlitCommandEncoder::popDebugGroup() {
+    _flushBarriers();
+    commandBuffer->popDebugGroup();
+}
+
+void gfx::BlitCommandEncoder::_imageBarrier(const rc<Texture>& texture, vk::ImageSubresourceRange const& range, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::PipelineStageFlags2 srcStageMask, vk::AccessFlags2 srcAccessMask, vk::PipelineStageFlags2 dstStageMask, vk::AccessFlags2 dstAccessMask) {
+    vk::ImageMemoryBarrier2 barrier = {};
+    barrier.setSrcStageMask(srcStageMask);
+    barrier.setSrcAccessMask(srcAccessMask);
+    barrier.setDstStageMask(dstStageMask);
+    barrier.setDstAccessMask(dstAccessMask);
+    barrier.setOldLayout(oldLayout);
+    barrier.setNewLayout(newLayout);
+    barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+    barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+    barrier.setImage(texture->image);
+    barrier.setSubresourceRange(range);
+
+    imageBarriers.emplace_back(barrier);
+}
+
+void gfx::BlitCommandEncoder::_flushBarriers() {
+    if (memoryBarriers.empty() && bufferBarriers.empty() && imageBarriers.empty()) {
+        return;
+    }
+
+    vk::DependencyInfo dependency_info = {};
+    dependency_info.setMemoryBarriers(memoryBarriers);
+    dependency_info.setBufferMemoryBarriers(bufferBarriers);
+    dependency_info.setImageMemoryBarriers(imageBarriers);
+
+    commandBuffer->handle.pipelineBarrier2(dependency_info, commandBuffer->device->dispatcher);
+
+    memoryBarriers.clear();
+    bufferBarriers.clear();
+    imageBarriers.clear();
+}
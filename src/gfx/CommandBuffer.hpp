@@ -13,11 +13,23 @@ namespace gfx {
     struct Buffer;
     struct Texture;
     struct Drawable;
+    struct UniformRing;
+    struct QueryRecorder;
+    struct TransientSlice;
+    struct TransientAllocator;
+    struct DescriptorAllocator;
     struct CommandBuffer;
     struct RenderPipelineState;
     struct RenderCommandEncoder;
+    struct ParallelRenderCommandEncoder;
     struct ComputePipelineState;
 
+    enum class CommandBufferStatus {
+        eNotEnqueued,   // recording, or never submitted
+        eCommitted,     // submitted, the GPU has not finished it yet
+        eCompleted
+    };
+
     struct RenderingColorAttachmentInfo {
         rc<Texture>  texture            = {};
         vk::ImageLayout         imageLayout        = vk::ImageLayout::eUndefined;
@@ -63,21 +75,33 @@ namespace gfx {
     };
 
     struct RenderingInfo {
-        uint32_t                          viewMask          = {};
-        uint32_t                          layerCount        = {};
-        vk::Rect2D                        renderArea        = {};
-        RenderingDepthAttachmentInfo      depthAttachment   = {};
-        RenderingStencilAttachmentInfo    stencilAttachment = {};
-        RenderingColorAttachmentInfoArray colorAttachments  = {};
+        std::string                       label                = {};
+        uint32_t                          viewMask             = {};
+        uint32_t                          layerCount           = {};
+        vk::Rect2D                        renderArea           = {};
+        vk::SampleCountFlagBits           rasterizationSamples = vk::SampleCountFlagBits::e1; // of the attachments and of the pipelines drawing into them
+        RenderingDepthAttachmentInfo      depthAttachment      = {};
+        RenderingStencilAttachmentInfo    stencilAttachment    = {};
+        RenderingColorAttachmentInfoArray colorAttachments     = {};
+    };
+
+    // What a draw does when its pipeline variant has not been compiled yet.
+    enum class DrawPolicy {
+        eWaitForPipeline,   // compile on the recording thread, or wait for a background compile
+        eSkipUntilReady     // drop the draw and compile in the background
     };
 
     struct RenderCommandEncoder : public ManagedObject {
         enum : uint32_t {
-            RenderCommandEncoderPipeline    = 1 << 0
+            RenderCommandEncoderPipeline        = 1 << 0,
+            RenderCommandEncoderDynamicState    = 1 << 1,
+            RenderCommandEncoderPushConstants   = 1 << 2  // spilled push constants changed since the last draw
         };
 
         uint32_t                            flags_                      = {};
+        DrawPolicy                          drawPolicy_                 = DrawPolicy::eWaitForPipeline;
         rc<CommandBuffer>                   commandBuffer               = {};
+        bool                                inheritsRendering_          = {}; // records into a secondary command buffer of a ParallelRenderCommandEncoder
         rc<DepthStencilState>               depthStencilState_          = {};
         rc<RenderPipelineState>             renderPipelineState_        = {};
         bool                                depthClampEnable_           = {};
@@ -90,15 +114,23 @@ namespace gfx {
         float                               depthBiasConstantFactor_    = {};
         float                               depthBiasClamp_             = {};
         float                               depthBiasSlopeFactor_       = {};
+        std::vector<std::byte>              pushConstantData_           = {}; // push constants of the stages the pipeline spilled
+        vk::PipelineLayout                  spillPipelineLayout_        = {}; // layout the spilled block was last bound with
+        uint32_t                            spillSize_                  = {}; // size of the spilled block last bound
 
         RenderCommandEncoder(const rc<CommandBuffer>& commandBuffer);
 
-        void _beginRendering(const RenderingInfo& info);
+        void _beginRendering(const RenderingInfo& info, vk::RenderingFlags flags = {});
         void _endRendering();
-        void _setup();
+        auto _setup() -> bool;
+        void _invalidate(bool dynamic);
+        void _setDynamicState();
+        void _bindSpilledPushConstants();
+        void _invalidateSpilledPushConstants();
 
         auto getCommandBuffer() -> rc<CommandBuffer>;
         void endEncoding();
+        void setDrawPolicy(DrawPolicy drawPolicy);
         void setDepthClampEnable(bool depthClampEnable);
         void setRasterizerDiscardEnable(bool rasterizerDiscardEnable);
         void setPolygonMode(vk::PolygonMode polygonMode);
@@ -115,10 +147,44 @@ namespace gfx {
         void setViewport(uint32_t firstViewport, const vk::Viewport& viewport);
         void bindIndexBuffer(const rc<Buffer>& buffer, vk::DeviceSize offset, vk::IndexType indexType);
         void bindVertexBuffer(int firstBinding, const rc<Buffer>& buffer, vk::DeviceSize offset);
+        void bindIndexBuffer(const TransientSlice& slice, vk::IndexType indexType);
+        void bindVertexBuffer(int firstBinding, const TransientSlice& slice);
+        void bindUniformBuffer(uint32_t slot, TransientAllocator& allocator, const TransientSlice& slice);
         void draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance);
         void drawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance);
+        void drawIndirect(const rc<Buffer>& indirectBuffer, vk::DeviceSize offset, uint32_t drawCount, uint32_t stride);
+        void drawIndexedIndirect(const rc<Buffer>& indirectBuffer, vk::DeviceSize offset, uint32_t drawCount, uint32_t stride);
         void bindDescriptorSet(vk::DescriptorSet descriptorSet, uint32_t slot);
         void pushConstants(vk::ShaderStageFlags stageFlags, uint32_t offset, uint32_t size, const void* data);
+        void pushDebugGroup(std::string const& name);
+        void popDebugGroup();
+    };
+
+    // Splits a single render pass across threads, like its Metal namesake. Every renderCommandEncoder()
+    // records into a secondary command buffer from the pool of the calling thread, and a command pool
+    // must not be recorded from two threads at once. So unlike Metal, where sub-encoders are usually
+    // created up front and handed to workers, each worker has to create the sub-encoder it records, and
+    // a sub-encoder must never be recorded on another thread than the one that created it.
+    // The secondary command buffers are executed in the order their encoders were created once
+    // endEncoding() is called, after every sub-encoder has ended. Sub-encoders start without any state,
+    // viewport and scissor included.
+    struct ParallelRenderCommandEncoder : public ManagedObject {
+        rc<CommandBuffer>                   commandBuffer;
+        std::string                         label;
+        std::vector<vk::Format>             colorFormats;
+        vk::Format                          depthFormat;
+        vk::Format                          stencilFormat;
+        uint32_t                            viewMask;
+        vk::SampleCountFlagBits             rasterizationSamples;
+        vk::QueryPipelineStatisticFlags     pipelineStatistics; // of the profiler query active around the pass, inherited by the secondaries
+        std::mutex                          mutex;
+        std::vector<rc<CommandBuffer>>      secondaryCommandBuffers;
+
+        explicit ParallelRenderCommandEncoder(const rc<CommandBuffer>& commandBuffer, const RenderingInfo& info);
+
+        auto getCommandBuffer() -> rc<CommandBuffer>;
+        auto renderCommandEncoder() -> rc<RenderCommandEncoder>;
+        void endEncoding();
     };
 
     struct ComputeCommandEncoder : public ManagedObject {
@@ -127,32 +193,96 @@ namespace gfx {
 
         ComputeCommandEncoder(const rc<CommandBuffer>& commandBuffer);
 
+        auto getCommandBuffer() -> rc<CommandBuffer>;
+        void endEncoding();
         void setComputePipelineState(const rc<ComputePipelineState>& pipelineState);
         void bindDescriptorSet(vk::DescriptorSet descriptorSet, uint32_t slot);
         void pushConstants(vk::ShaderStageFlags stageFlags, uint32_t offset, uint32_t size, const void* data);
         void dispatch(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ);
+        void dispatchIndirect(const rc<Buffer>& indirectBuffer, vk::DeviceSize offset);
+        void memoryBarrier(vk::PipelineStageFlags2 srcStageMask, vk::AccessFlags2 srcAccessMask, vk::PipelineStageFlags2 dstStageMask, vk::AccessFlags2 dstAccessMask);
+        void bufferBarrier(const rc<Buffer>& buffer, vk::PipelineStageFlags2 srcStageMask, vk::AccessFlags2 srcAccessMask, vk::PipelineStageFlags2 dstStageMask, vk::AccessFlags2 dstAccessMask);
+        void imageBarrier(const rc<Texture>& texture, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::PipelineStageFlags2 srcStageMask, vk::AccessFlags2 srcAccessMask, vk::PipelineStageFlags2 dstStageMask, vk::AccessFlags2 dstAccessMask);
+        void pushDebugGroup(std::string const& name);
+        void popDebugGroup();
+    };
+
+    // Records transfer commands into the command buffer, like its Metal namesake. Barriers are
+    // queued and recorded as a single pipelineBarrier2 before the next command, or by endEncoding().
+    // Layouts are not tracked: copies into a texture expect eTransferDstOptimal, copies out of it
+    // eTransferSrcOptimal, and generateMipmaps() expects every level in eTransferDstOptimal. It throws
+    // for formats that can not be blitted and filters with eNearest where linear filtering is unsupported.
+    // Mip levels and layers are relative to the range a texture covers, use views to select a subrange.
+    struct BlitCommandEncoder : public ManagedObject {
+        rc<CommandBuffer>                       commandBuffer;
+        std::vector<vk::MemoryBarrier2>         memoryBarriers;
+        std::vector<vk::BufferMemoryBarrier2>   bufferBarriers;
+        std::vector<vk::ImageMemoryBarrier2>    imageBarriers;
+
+        explicit BlitCommandEncoder(const rc<CommandBuffer>& commandBuffer);
+
+        auto getCommandBuffer() -> rc<CommandBuffer>;
+        void endEncoding();
+        void copyBuffer(const rc<Buffer>& source, vk::DeviceSize sourceOffset, const rc<Buffer>& destination, vk::DeviceSize destinationOffset, vk::DeviceSize size);
+        void copyBufferToTexture(const rc<Buffer>& source, vk::DeviceSize sourceOffset, const rc<Texture>& destination, uint32_t mipLevel = 0);
+        void copyTextureToBuffer(const rc<Texture>& source, const rc<Buffer>& destination, vk::DeviceSize destinationOffset, uint32_t mipLevel = 0);
+        void copyTexture(const rc<Texture>& source, const rc<Texture>& destination);
+        void fillBuffer(const rc<Buffer>& buffer, vk::DeviceSize offset, vk::DeviceSize size, uint32_t value);
+        void generateMipmaps(const rc<Texture>& texture, vk::ImageLayout finalLayout = vk::ImageLayout::eShaderReadOnlyOptimal);
+        void memoryBarrier(vk::PipelineStageFlags2 srcStageMask, vk::AccessFlags2 srcAccessMask, vk::PipelineStageFlags2 dstStageMask, vk::AccessFlags2 dstAccessMask);
+        void bufferBarrier(const rc<Buffer>& buffer, vk::PipelineStageFlags2 srcStageMask, vk::AccessFlags2 srcAccessMask, vk::PipelineStageFlags2 dstStageMask, vk::AccessFlags2 dstAccessMask);
+        void imageBarrier(const rc<Texture>& texture, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::PipelineStageFlags2 srcStageMask, vk::AccessFlags2 srcAccessMask, vk::PipelineStageFlags2 dstStageMask, vk::AccessFlags2 dstAccessMask);
+        void pushDebugGroup(std::string const& name);
+        void popDebugGroup();
+
+        void _imageBarrier(const rc<Texture>& texture, vk::ImageSubresourceRange const& range, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::PipelineStageFlags2 srcStageMask, vk::AccessFlags2 srcAccessMask, vk::PipelineStageFlags2 dstStageMask, vk::AccessFlags2 dstAccessMask);
+        void _flushBarriers();
     };
 
     struct CommandBuffer : public ManagedObject {
-        rc<Device>                      device              = {};
-        rc<CommandQueue>                queue               = {};
-        vk::CommandBuffer               handle              = {};
-        vk::Fence                       fence               = {};
-        vk::Semaphore                   semaphore           = {};
-        std::vector<vk::DescriptorPool> descriptor_pools    = {};
+        rc<Device>                          device              = {};
+        rc<CommandQueue>                    queue               = {};
+        vk::CommandBuffer                   handle              = {};
+        vk::Semaphore                       semaphore           = {};
+        uint64_t                            submittedValue      = {}; // value of the queue semaphore signaled by the last submit
+        bool                                presentPending      = {}; // the semaphore is signaled and nothing waits on it yet
+        std::vector<CommandBufferHandler>   completedHandlers   = {};
+        rc<CommandBufferPool>               pool                = {}; // set for one-shot command buffers of CommandQueue::commandBuffer
+        uint32_t                            poolPage            = {};
+        vk::CommandBufferLevel              level               = vk::CommandBufferLevel::ePrimary;
+        std::vector<rc<CommandBuffer>>      secondaryCommandBuffers = {}; // executed by this command buffer, kept until it is submitted
+        std::vector<rc<RenderPipelineState>> renderPipelineStates = {}; // whose pipelines were bound, told which submit may still use them
+        rc<DescriptorAllocator>             descriptorAllocator = {};
+        rc<UniformRing>                     uniformRing         = {}; // created by the first draw that spills push constants
+        rc<QueryRecorder>                   queryRecorder       = {};
+        std::vector<vk::Semaphore>          waitSemaphores      = {};
+        std::vector<uint64_t>               waitValues          = {};
+        std::vector<vk::PipelineStageFlags> waitStages          = {};
 
         explicit CommandBuffer(const rc<Device>& device, const rc<CommandQueue>& queue);
+        explicit CommandBuffer(const rc<Device>& device, const rc<CommandQueue>& queue, rc<CommandBufferPool> pool, CommandBufferResources&& resources, uint32_t poolPage);
         ~CommandBuffer() override;
 
         void begin(const vk::CommandBufferBeginInfo& begin_info);
         void end();
+        void encodeWait(vk::Semaphore semaphore, uint64_t value, vk::PipelineStageFlags stageMask);
+        void waitForDrawable(rc<Drawable> const& drawable);
         void submit();
         void present(rc<gfx::Drawable> const& drawable);
         void waitUntilCompleted();
+        void addCompletedHandler(CommandBufferHandler handler);
+        auto status() -> CommandBufferStatus;
         void setImageLayout(const rc<Texture>& texture, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::PipelineStageFlags2 srcStageMask, vk::PipelineStageFlags2 dstStageMask, vk::AccessFlagBits2 srcAccessMask, vk::AccessFlagBits2 dstAccessMask);
+        void pushDebugGroup(std::string const& name);
+        void popDebugGroup();
+        void _useRenderPipelineState(const rc<RenderPipelineState>& renderPipelineState);
+        void _endUseRenderPipelineStates(uint64_t value);
 
         auto newDescriptorSet(const rc<RenderPipelineState>& render_pipeline_state, uint32_t index) -> vk::DescriptorSet;
+        auto newDescriptorSet(const rc<ComputePipelineState>& compute_pipeline_state, uint32_t index) -> vk::DescriptorSet;
         auto newRenderCommandEncoder(const RenderingInfo& info) -> rc<RenderCommandEncoder>;
-        auto newComputeCommandEncoder() -> rc<ComputeCommandEncoder>;
+        auto newParallelRenderCommandEncoder(const RenderingInfo& info) -> rc<ParallelRenderCommandEncoder>;
+        auto newComputeCommandEncoder(std::string const& label = {}) -> rc<ComputeCommandEncoder>;
+        auto newBlitCommandEncoder(std::string const& label = {}) -> rc<BlitCommandEncoder>;
     };
 }
\ No newline at end of file
@@ -1,13 +1,359 @@
+#include "Profiler.hpp"
 #include "CommandQueue.hpp"
 #include "CommandBuffer.hpp"
+#include "DescriptorAllocator.hpp"
 #include "ComputePipelineState.hpp"
 
-gfx::CommandQueue::CommandQueue(rc<Device> device, vk::CommandPool handle) : device(std::move(device)), handle(handle) {}
+#include "spdlog/spdlog.h"
+
+// set when a completed handler drops the last reference to its queue, the completion thread must not touch the queue afterwards
+static thread_local bool completionQueueDestroyed = false;
+
+// takes the pools of a thread out of their queues when the thread exits
+struct ThreadCommandBufferPools {
+    std::vector<std::weak_ptr<gfx::CommandBufferPoolRegistry>> registries = {};
+
+    ~ThreadCommandBufferPools() {
+        auto id = std::this_thread::get_id();
+        for (auto& registry : registries) {
+            if (auto pools = registry.lock()) {
+                std::lock_guard lock(pools->mutex);
+                pools->pools.erase(id);
+            }
+        }
+    }
+};
+
+static thread_local ThreadCommandBufferPools threadCommandBufferPools;
+
+gfx::CommandQueueTimeline::CommandQueueTimeline(rc<Device> device)
+: device(std::move(device))
+, semaphore() {
+    vk::SemaphoreTypeCreateInfo semaphore_type_create_info = {};
+    semaphore_type_create_info.setSemaphoreType(vk::SemaphoreType::eTimeline);
+    semaphore_type_create_info.setInitialValue(0);
+
+    vk::SemaphoreCreateInfo semaphore_create_info = {};
+    semaphore_create_info.setPNext(&semaphore_type_create_info);
+    vk::resultCheck(this->device->handle.createSemaphore(&semaphore_create_info, nullptr, &semaphore, this->device->dispatcher), "Failed to create semaphore");
+}
+
+gfx::CommandQueueTimeline::~CommandQueueTimeline() {
+    device->handle.destroySemaphore(semaphore, nullptr, device->dispatcher);
+}
+
+auto gfx::CommandQueueTimeline::completedValue(this CommandQueueTimeline const& self) -> uint64_t {
+    return self.device->handle.getSemaphoreCounterValue(self.semaphore, self.device->dispatcher);
+}
+
+gfx::CommandQueue::CommandQueue(rc<Device> device, vk::CommandPool handle, uint32_t queueFamilyIndex)
+: device(std::move(device))
+, handle(handle)
+, queueFamilyIndex(queueFamilyIndex)
+, profiler()
+, timeline(std::make_shared<CommandQueueTimeline>(this->device))
+, semaphore(timeline->semaphore)
+, submittedValue(0)
+, mutex()
+, condition()
+, handlers()
+, completionThread()
+, stopping(false)
+, pools(std::make_shared<CommandBufferPoolRegistry>()) {
+    completionThread = std::thread([this] { _runCompletionThread(); });
+}
 
 gfx::CommandQueue::~CommandQueue() {
-    this->device->handle.destroyCommandPool(handle, nullptr, device->dispatcher);
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+
+    // a thread cannot join itself, the completion thread returns as soon as the handler that destroyed the queue does
+    if (std::this_thread::get_id() == completionThread.get_id()) {
+        completionQueueDestroyed = true;
+        completionThread.detach();
+    } else {
+        completionThread.join();
+    }
+    {
+        // under the registry lock, a thread that exits right now destroys its pool before the semaphore goes away
+        std::lock_guard lock(pools->mutex);
+        pools->pools.clear();
+    }
+
+    device->handle.destroyCommandPool(handle, nullptr, device->dispatcher);
 }
 
 auto gfx::CommandQueue::newCommandBuffer(this CommandQueue& self) -> rc<CommandBuffer> {
     return rc<CommandBuffer>::init(self.device, self.shared_from_this());
-}
\ No newline at end of file
+}
+
+auto gfx::CommandQueue::commandBuffer(this CommandQueue& self, vk::CommandBufferLevel level) -> rc<CommandBuffer> {
+    rc<CommandBufferPool> pool;
+    {
+        std::lock_guard lock(self.pools->mutex);
+        auto& slot = self.pools->pools[std::this_thread::get_id()];
+        if (!slot) {
+            slot = rc<CommandBufferPool>::init(self.device, self.queueFamilyIndex, self.semaphore);
+
+            auto& registries = threadCommandBufferPools.registries;
+            std::erase_if(registries, [](auto& registry) { return registry.expired(); });
+            registries.emplace_back(self.pools);
+        }
+        pool = slot;
+    }
+
+    auto [resources, page] = pool->acquire(self.completedValue(), level);
+    return rc<CommandBuffer>::init(self.device, self.shared_from_this(), std::move(pool), std::move(resources), page);
+}
+
+auto gfx::CommandQueue::poolStatistics(this CommandQueue& self) -> CommandBufferPoolStatistics {
+    std::lock_guard lock(self.pools->mutex);
+
+    CommandBufferPoolStatistics statistics = {};
+    for (auto& [id, pool] : self.pools->pools) {
+        std::lock_guard pool_lock(pool->mutex);
+        statistics.allocations += pool->statistics.allocations;
+        statistics.reuses += pool->statistics.reuses;
+        statistics.resets += pool->statistics.resets;
+    }
+    return statistics;
+}
+
+// takes effect for command buffers of this queue the next time they begin recording
+void gfx::CommandQueue::setProfiler(this CommandQueue& self, rc<Profiler> profiler) {
+    if (profiler) {
+        profiler->_attach(self.queueFamilyIndex);
+    }
+    self.profiler = std::move(profiler);
+}
+
+auto gfx::CommandQueue::completedValue(this CommandQueue& self) -> uint64_t {
+    return self.timeline->completedValue();
+}
+
+void gfx::CommandQueue::waitUntilCompleted(this CommandQueue& self, uint64_t value) {
+    vk::SemaphoreWaitInfo wait_info = {};
+    wait_info.setSemaphoreCount(1);
+    wait_info.setPSemaphores(&self.semaphore);
+    wait_info.setPValues(&value);
+    vk::resultCheck(self.device->handle.waitSemaphores(wait_info, std::numeric_limits<uint64_t>::max(), self.device->dispatcher), "Failed to wait for semaphore");
+}
+
+// called with Device::queueMutex held, so values are signaled in the order they are handed out
+auto gfx::CommandQueue::_nextValue(this CommandQueue& self) -> uint64_t {
+    std::lock_guard lock(self.mutex);
+    self.submittedValue += 1;
+    return self.submittedValue;
+}
+
+// hands back a value whose submit failed, still under Device::queueMutex so no later value has been taken
+void gfx::CommandQueue::_rollbackValue(this CommandQueue& self, uint64_t value) {
+    std::lock_guard lock(self.mutex);
+    if (self.submittedValue == value) {
+        self.submittedValue -= 1;
+    }
+}
+
+void gfx::CommandQueue::_enqueueHandlers(this CommandQueue& self, uint64_t value, std::vector<CommandBufferHandler>&& handlers) {
+    if (handlers.empty()) {
+        return;
+    }
+
+    {
+        std::lock_guard lock(self.mutex);
+        for (auto& handler : handlers) {
+            self.handlers.emplace_back(value, std::move(handler));
+        }
+    }
+    self.condition.notify_one();
+}
+
+// pending handlers are still called when the queue is destroyed, their command buffers have been submitted and will complete
+void gfx::CommandQueue::_runCompletionThread(this CommandQueue& self) {
+    while (true) {
+        if (completionQueueDestroyed) {
+            return;
+        }
+
+        uint64_t value;
+        {
+            std::unique_lock lock(self.mutex);
+            self.condition.wait(lock, [&self] { return self.stopping || !self.handlers.empty(); });
+            if (self.handlers.empty()) {
+                return;
+            }
+            value = self.handlers.front().first;
+        }
+
+        bool reached = true;
+        try {
+            self.waitUntilCompleted(value);
+        } catch (std::exception const& e) {
+            spdlog::error("Failed to wait for command buffers of the queue, dropping their completed handlers: {}", e.what());
+            reached = false;
+        }
+
+        std::vector<CommandBufferHandler> completed = {};
+        {
+            std::lock_guard lock(self.mutex);
+            while (!self.handlers.empty() && self.handlers.front().first <= value) {
+                completed.emplace_back(std::move(self.handlers.front().second));
+                self.handlers.pop_front();
+            }
+        }
+
+        for (auto& handler : completed) {
+            if (!reached) {
+                break;
+            }
+            try {
+                handler();
+            } catch (std::exception const& e) {
+                spdlog::error("Completed handler failed: {}", e.what());
+            }
+        }
+    }
+}
+
+gfx::CommandBufferPool::CommandBufferPool(rc<Device> device, uint32_t queueFamilyIndex, vk::Semaphore timeline)
+: device(std::move(device))
+, queueFamilyIndex(queueFamilyIndex)
+, timeline(timeline)
+, mutex()
+, pages()
+, current(0)
+, statistics() {
+    for (auto& page : pages) {
+        vk::CommandPoolCreateInfo create_info = {};
+        create_info.setFlags(vk::CommandPoolCreateFlagBits::eTransient);
+        create_info.setQueueFamilyIndex(queueFamilyIndex);
+        vk::resultCheck(this->device->handle.createCommandPool(&create_info, nullptr, &page.handle, this->device->dispatcher), "Failed to create command pool");
+    }
+}
+
+// released command buffers may still be pending when the last reference to the pool goes away, only those are waited for
+gfx::CommandBufferPool::~CommandBufferPool() {
+    uint64_t value = 0;
+    for (auto& page : pages) {
+        for (auto& resources : page.released) {
+            value = std::max(value, resources.submittedValue);
+        }
+    }
+    if (value != 0) {
+        vk::SemaphoreWaitInfo wait_info = {};
+        wait_info.setSemaphoreCount(1);
+        wait_info.setPSemaphores(&timeline);
+        wait_info.setPValues(&value);
+        try {
+            vk::resultCheck(device->handle.waitSemaphores(wait_info, std::numeric_limits<uint64_t>::max(), device->dispatcher), "Failed to wait for semaphore");
+        } catch (std::exception const& e) {
+            spdlog::error("Failed to wait for command buffers of the pool: {}", e.what());
+        }
+    }
+
+    for (auto& page : pages) {
+        for (auto& resources : page.available) {
+            device->handle.destroySemaphore(resources.semaphore, nullptr, device->dispatcher);
+        }
+        for (auto& resources : page.released) {
+            device->handle.destroySemaphore(resources.semaphore, nullptr, device->dispatcher);
+        }
+        device->handle.destroyCommandPool(page.handle, nullptr, device->dispatcher);
+    }
+}
+
+auto gfx::CommandBufferPool::acquire(this CommandBufferPool& self, uint64_t completedValue, vk::CommandBufferLevel level) -> std::pair<CommandBufferResources, uint32_t> {
+    std::lock_guard lock(self.mutex);
+
+    auto index = self.current;
+    auto resources = self._takeAvailable(index, level);
+    if (!resources) {
+        if (self._tryReset(1 - index, completedValue)) {
+            index = 1 - index;
+            self.current = index;
+        } else {
+            self._tryReset(index, completedValue);
+        }
+        resources = self._takeAvailable(index, level);
+    }
+
+    self.pages[index].outstanding += 1;
+    if (!resources) {
+        self.statistics.allocations += 1;
+        return {self._allocate(index, level), index};
+    }
+
+    self.statistics.reuses += 1;
+    return {std::move(*resources), index};
+}
+
+void gfx::CommandBufferPool::release(this CommandBufferPool& self, CommandBufferResources&& resources, uint32_t page) {
+    std::lock_guard lock(self.mutex);
+    self.pages[page].released.emplace_back(std::move(resources));
+    self.pages[page].outstanding -= 1;
+}
+
+auto gfx::CommandBufferPool::_tryReset(this CommandBufferPool& self, uint32_t index, uint64_t completedValue) -> bool {
+    auto& page = self.pages[index];
+    if (page.released.empty() || page.outstanding != 0) {
+        return false;
+    }
+    for (auto& resources : page.released) {
+        if (resources.submittedValue > completedValue) {
+            return false;
+        }
+    }
+
+    self.device->handle.resetCommandPool(page.handle, {}, self.device->dispatcher);
+    for (auto& resources : page.released) {
+        // a binary semaphore can only be unsignaled by waiting on it, a fresh one is cheaper than a submit
+        if (resources.semaphoreSignaled) {
+            self.device->handle.destroySemaphore(resources.semaphore, nullptr, self.device->dispatcher);
+
+            vk::SemaphoreCreateInfo semaphore_create_info = {};
+            vk::resultCheck(self.device->handle.createSemaphore(&semaphore_create_info, nullptr, &resources.semaphore, self.device->dispatcher), "Failed to create semaphore");
+        }
+        resources.submittedValue = 0;
+        resources.semaphoreSignaled = false;
+        page.available.emplace_back(std::move(resources));
+    }
+    page.released.clear();
+    self.statistics.resets += 1;
+    return true;
+}
+
+auto gfx::CommandBufferPool::_allocate(this CommandBufferPool& self, uint32_t index, vk::CommandBufferLevel level) -> CommandBufferResources {
+    CommandBufferResources resources = {};
+    resources.level = level;
+
+    vk::CommandBufferAllocateInfo allocate_info = {};
+    allocate_info.setCommandPool(self.pages[index].handle);
+    allocate_info.setLevel(level);
+    allocate_info.setCommandBufferCount(1);
+    vk::resultCheck(self.device->handle.allocateCommandBuffers(&allocate_info, &resources.handle, self.device->dispatcher), "Failed to allocate command buffer");
+
+    // secondary command buffers are never submitted on their own
+    if (level == vk::CommandBufferLevel::ePrimary) {
+        vk::SemaphoreCreateInfo semaphore_create_info = {};
+        vk::resultCheck(self.device->handle.createSemaphore(&semaphore_create_info, nullptr, &resources.semaphore, self.device->dispatcher), "Failed to create semaphore");
+    }
+
+    resources.descriptorAllocator = rc<DescriptorAllocator>::init(self.device);
+    return resources;
+}
+
+auto gfx::CommandBufferPool::_takeAvailable(this CommandBufferPool& self, uint32_t index, vk::CommandBufferLevel level) -> std::optional<CommandBufferResources> {
+    auto& available = self.pages[index].available;
+    for (size_t i = available.size(); i > 0; --i) {
+        if (available[i - 1].level != level) {
+            continue;
+        }
+        auto resources = std::move(available[i - 1]);
+        available.erase(available.begin() + static_cast<ptrdiff_t>(i - 1));
+        return resources;
+    }
+    return std::nullopt;
+}
@@ -3,15 +3,127 @@
 #include "Device.hpp"
 #include "ManagedObject.hpp"
 
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <optional>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+
 namespace gfx {
+    struct Profiler;
     struct CommandBuffer;
-    struct CommandQueue : public ManagedObject {
+    struct UniformRing;
+    struct QueryRecorder;
+    struct DescriptorAllocator;
+
+    using CommandBufferHandler = std::function<void()>;
+
+    // The Vulkan objects behind a pooled CommandBuffer, handed back to the pool when it is released.
+    struct CommandBufferResources {
+        vk::CommandBufferLevel  level               = vk::CommandBufferLevel::ePrimary;
+        vk::CommandBuffer       handle              = {};
+        vk::Semaphore           semaphore           = {};
+        rc<DescriptorAllocator> descriptorAllocator = {};
+        rc<UniformRing>         uniformRing         = {};
+        rc<QueryRecorder>       queryRecorder       = {};
+        uint64_t                submittedValue      = {};
+        bool                    semaphoreSignaled   = {}; // submitted without a present waiting on the semaphore
+    };
+
+    struct CommandBufferPoolStatistics {
+        uint64_t allocations    = {}; // command buffers created because none could be reused
+        uint64_t reuses         = {};
+        uint64_t resets         = {}; // command pools reset in bulk
+    };
+
+    // Command buffers of a single recording thread. They come from two command pools which take turns:
+    // when the active pool has nothing left to hand out and every command buffer of the other one has
+    // been released and completed, the other pool is reset with a single resetCommandPool and becomes
+    // the active one. Command buffers which are released but still pending wait for the next turn.
+    struct CommandBufferPool : public ManagedObject {
+        struct Page {
+            vk::CommandPool                     handle      = {};
+            std::vector<CommandBufferResources> available   = {}; // reset and ready to record
+            std::vector<CommandBufferResources> released    = {}; // waiting for the page to be reset
+            uint32_t                            outstanding = {}; // handed out and not released yet
+        };
+
+        rc<Device>                  device;
+        uint32_t                    queueFamilyIndex;
+        vk::Semaphore               timeline;   // semaphore of the queue, signaled with the submitted values
+        std::mutex                  mutex;
+        Page                        pages[2];
+        uint32_t                    current;
+        CommandBufferPoolStatistics statistics;
+
+        explicit CommandBufferPool(rc<Device> device, uint32_t queueFamilyIndex, vk::Semaphore timeline);
+        ~CommandBufferPool() override;
+
+        auto acquire(this CommandBufferPool& self, uint64_t completedValue, vk::CommandBufferLevel level) -> std::pair<CommandBufferResources, uint32_t>;
+        void release(this CommandBufferPool& self, CommandBufferResources&& resources, uint32_t page);
+
+        auto _tryReset(this CommandBufferPool& self, uint32_t page, uint64_t completedValue) -> bool;
+        auto _allocate(this CommandBufferPool& self, uint32_t page, vk::CommandBufferLevel level) -> CommandBufferResources;
+        auto _takeAvailable(this CommandBufferPool& self, uint32_t page, vk::CommandBufferLevel level) -> std::optional<CommandBufferResources>;
+    };
+
+    // The timeline semaphore of a queue. Shared with whoever waits for values of the queue without
+    // keeping the queue and its completion thread alive, the semaphore goes away with the last owner.
+    struct CommandQueueTimeline {
         rc<Device>      device;
-        vk::CommandPool handle;
+        vk::Semaphore   semaphore;
+
+        explicit CommandQueueTimeline(rc<Device> device);
+        ~CommandQueueTimeline();
+
+        auto completedValue(this CommandQueueTimeline const& self) -> uint64_t;
+    };
 
-        explicit CommandQueue(rc<Device> device, vk::CommandPool handle);
+    // Pools of the threads recording command buffers of a queue. A thread that asks for a pooled command
+    // buffer removes its pool again when it exits, the queue clears the remaining ones when it is destroyed.
+    struct CommandBufferPoolRegistry {
+        std::mutex                                                  mutex = {};
+        std::unordered_map<std::thread::id, rc<CommandBufferPool>>  pools = {};
+    };
+
+    // Command buffers either belong to the queue for their whole lifetime (newCommandBuffer) or are
+    // one-shot and recycled through a pool of the thread that asked for them (commandBuffer); a pooled
+    // command buffer has to be recorded on that thread and goes back to the pool once released.
+    //
+    // Every submit of a command buffer of this queue signals the next value of a timeline semaphore.
+    // Completed handlers are called in submission order on a thread of the queue once the GPU has
+    // reached the value of their command buffer; they must not block for long and must not submit.
+    struct CommandQueue : public ManagedObject {
+        rc<Device>                                              device;
+        vk::CommandPool                                         handle;
+        uint32_t                                                queueFamilyIndex;
+        rc<Profiler>                                            profiler;
+        std::shared_ptr<CommandQueueTimeline>                   timeline;
+        vk::Semaphore                                           semaphore;  // of the timeline
+        uint64_t                                                submittedValue;
+        std::mutex                                              mutex;
+        std::condition_variable                                 condition;
+        std::deque<std::pair<uint64_t, CommandBufferHandler>>   handlers;
+        std::thread                                             completionThread;
+        bool                                                    stopping;
+        std::shared_ptr<CommandBufferPoolRegistry>              pools;
+
+        explicit CommandQueue(rc<Device> device, vk::CommandPool handle, uint32_t queueFamilyIndex);
         ~CommandQueue() override;
 
         auto newCommandBuffer(this CommandQueue& self) -> rc<CommandBuffer>;
+        auto commandBuffer(this CommandQueue& self, vk::CommandBufferLevel level = vk::CommandBufferLevel::ePrimary) -> rc<CommandBuffer>;
+        auto poolStatistics(this CommandQueue& self) -> CommandBufferPoolStatistics;
+        void setProfiler(this CommandQueue& self, rc<Profiler> profiler);
+        auto completedValue(this CommandQueue& self) -> uint64_t;
+        void waitUntilCompleted(this CommandQueue& self, uint64_t value);
+
+        auto _nextValue(this CommandQueue& self) -> uint64_t;
+        void _rollbackValue(this CommandQueue& self, uint64_t value);
+        void _enqueueHandlers(this CommandQueue& self, uint64_t value, std::vector<CommandBufferHandler>&& handlers);
+        void _runCompletionThread(this CommandQueue& self);
     };
-}
\ No newline at end of file
+}
@@ -1,14 +1,16 @@
 #pragma once
 
 #include "Device.hpp"
+#include "DescriptorAllocator.hpp"
 
 namespace gfx {
     struct Device;
     struct ComputePipelineState : public ManagedObject {
         rc<Device>                              device;
         vk::Pipeline                            pipeline;
-        vk::PipelineLayout                      pipeline_layout;
-        std::vector<vk::DescriptorSetLayout>    descriptor_set_layouts;
+        vk::PipelineLayout                      pipeline_layout;        // owned by the device
+        std::vector<vk::DescriptorSetLayout>    descriptor_set_layouts; // owned by the device
+        std::vector<DescriptorCounts>           descriptor_set_counts;
 
         explicit ComputePipelineState(rc<Device> device);
         ~ComputePipelineState() override;
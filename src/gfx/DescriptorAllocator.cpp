@@ -0,0 +1,200 @@
+#include "Buffer.hpp"
+#include "DescriptorAllocator.hpp"
+
+#include <algorithm>
+
+void gfx::DescriptorCounts::add(vk::DescriptorType type, uint32_t count) {
+    auto index = static_cast<uint32_t>(type);
+    if (index >= kDescriptorTypeCount) {
+        throw std::runtime_error("Unsupported descriptor type " + vk::to_string(type));
+    }
+    counts[index] += count;
+}
+
+auto gfx::DescriptorCounts::contains(DescriptorCounts const& other) const -> bool {
+    for (uint32_t i = 0; i < kDescriptorTypeCount; ++i) {
+        if (counts[i] < other.counts[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+auto gfx::DescriptorCounts::empty() const -> bool {
+    return std::ranges::all_of(counts, [](uint32_t count) { return count == 0; });
+}
+
+auto gfx::DescriptorCounts::poolSizes() const -> std::vector<vk::DescriptorPoolSize> {
+    std::vector<vk::DescriptorPoolSize> pool_sizes = {};
+    for (uint32_t i = 0; i < kDescriptorTypeCount; ++i) {
+        if (counts[i] != 0) {
+            pool_sizes.emplace_back(vk::DescriptorPoolSize{static_cast<vk::DescriptorType>(i), counts[i]});
+        }
+    }
+    return pool_sizes;
+}
+
+gfx::DescriptorAllocator::DescriptorAllocator(rc<Device> device)
+: device(std::move(device))
+, chunks()
+, current(0)
+, usedDescriptors()
+, usedSets(0)
+, statistics()
+, emptyPools()
+, emptyRemainingSets(0)
+, emptySets() {}
+
+gfx::DescriptorAllocator::~DescriptorAllocator() {
+    for (auto& chunk : chunks) {
+        device->handle.destroyDescriptorPool(chunk.pool, nullptr, device->dispatcher);
+    }
+    for (auto pool : emptyPools) {
+        device->handle.destroyDescriptorPool(pool, nullptr, device->dispatcher);
+    }
+}
+
+void gfx::DescriptorAllocator::reset(this DescriptorAllocator& self) {
+    if (self.chunks.size() > 1) {
+        for (auto& chunk : self.chunks) {
+            self.device->handle.destroyDescriptorPool(chunk.pool, nullptr, self.device->dispatcher);
+        }
+        self.chunks.clear();
+        self.chunks.emplace_back(self._newChunk(self.statistics.peakDescriptors, self.statistics.peakSets));
+    } else {
+        for (auto& chunk : self.chunks) {
+            self.device->handle.resetDescriptorPool(chunk.pool, {}, self.device->dispatcher);
+            chunk.remaining = chunk.capacity;
+            chunk.remainingSets = chunk.capacitySets;
+        }
+    }
+
+    self.current = 0;
+    self.usedDescriptors = {};
+    self.usedSets = 0;
+    self.statistics.poolCount = static_cast<uint32_t>(self.chunks.size());
+}
+
+auto gfx::DescriptorAllocator::allocate(this DescriptorAllocator& self, vk::DescriptorSetLayout layout, DescriptorCounts const& counts) -> vk::DescriptorSet {
+    // there is nothing to size a pool from, and nothing in the set that could change between frames
+    if (counts.empty()) {
+        return self._emptySet(layout);
+    }
+
+    while (true) {
+        if (self.current == self.chunks.size()) {
+            DescriptorCounts capacity = {};
+            for (uint32_t i = 0; i < kDescriptorTypeCount; ++i) {
+                capacity.counts[i] = std::max(counts.counts[i] * kSetsPerChunk, self.statistics.peakDescriptors.counts[i]);
+            }
+            self.chunks.emplace_back(self._newChunk(capacity, std::max(kSetsPerChunk, self.statistics.peakSets)));
+            self.statistics.poolCount = std::max(self.statistics.poolCount, static_cast<uint32_t>(self.chunks.size()));
+        }
+
+        auto& chunk = self.chunks[self.current];
+        if (chunk.remainingSets != 0 && chunk.remaining.contains(counts)) {
+            vk::DescriptorSetAllocateInfo allocate_info = {};
+            allocate_info.setDescriptorPool(chunk.pool);
+            allocate_info.setDescriptorSetCount(1);
+            allocate_info.setPSetLayouts(&layout);
+
+            vk::DescriptorSet descriptor_set = VK_NULL_HANDLE;
+            if (self.device->handle.allocateDescriptorSets(&allocate_info, &descriptor_set, self.device->dispatcher) == vk::Result::eSuccess) {
+                chunk.remainingSets -= 1;
+                for (uint32_t i = 0; i < kDescriptorTypeCount; ++i) {
+                    chunk.remaining.counts[i] -= counts.counts[i];
+                    self.usedDescriptors.counts[i] += counts.counts[i];
+                    self.statistics.peakDescriptors.counts[i] = std::max(self.statistics.peakDescriptors.counts[i], self.usedDescriptors.counts[i]);
+                }
+                self.usedSets += 1;
+                self.statistics.peakSets = std::max(self.statistics.peakSets, self.usedSets);
+                return descriptor_set;
+            }
+            if (chunk.remainingSets == chunk.capacitySets) {
+                throw std::runtime_error("Failed to allocate descriptor set");
+            }
+        }
+
+        // exhausted for this frame, it is not probed again until the next reset
+        self.current += 1;
+    }
+}
+
+auto gfx::DescriptorAllocator::_newChunk(this DescriptorAllocator& self, DescriptorCounts const& capacity, uint32_t sets) -> DescriptorPoolChunk {
+    auto pool_sizes = capacity.poolSizes();
+
+    vk::DescriptorPoolCreateInfo pool_create_info = {};
+    pool_create_info.setMaxSets(std::max(sets, 1U));
+    pool_create_info.setPoolSizes(pool_sizes);
+
+    DescriptorPoolChunk chunk = {};
+    vk::resultCheck(self.device->handle.createDescriptorPool(&pool_create_info, nullptr, &chunk.pool, self.device->dispatcher), "Failed to create descriptor pool");
+    chunk.capacity = capacity;
+    chunk.remaining = capacity;
+    chunk.capacitySets = std::max(sets, 1U);
+    chunk.remainingSets = chunk.capacitySets;
+    return chunk;
+}
+
+auto gfx::DescriptorAllocator::_emptySet(this DescriptorAllocator& self, vk::DescriptorSetLayout layout) -> vk::DescriptorSet {
+    if (auto it = self.emptySets.find(static_cast<VkDescriptorSetLayout>(layout)); it != self.emptySets.end()) {
+        return it->second;
+    }
+
+    if (self.emptyRemainingSets == 0) {
+        // a pool needs at least one pool size even if none of its sets use it
+        auto pool_size = vk::DescriptorPoolSize{vk::DescriptorType::eSampler, 1};
+
+        vk::DescriptorPoolCreateInfo pool_create_info = {};
+        pool_create_info.setMaxSets(kSetsPerChunk);
+        pool_create_info.setPoolSizeCount(1);
+        pool_create_info.setPPoolSizes(&pool_size);
+
+        vk::DescriptorPool pool = {};
+        vk::resultCheck(self.device->handle.createDescriptorPool(&pool_create_info, nullptr, &pool, self.device->dispatcher), "Failed to create descriptor pool");
+        self.emptyPools.emplace_back(pool);
+        self.emptyRemainingSets = kSetsPerChunk;
+    }
+
+    vk::DescriptorSetAllocateInfo allocate_info = {};
+    allocate_info.setDescriptorPool(self.emptyPools.back());
+    allocate_info.setDescriptorSetCount(1);
+    allocate_info.setPSetLayouts(&layout);
+
+    vk::DescriptorSet descriptor_set = VK_NULL_HANDLE;
+    vk::resultCheck(self.device->handle.allocateDescriptorSets(&allocate_info, &descriptor_set, self.device->dispatcher), "Failed to allocate descriptor set");
+    self.emptyRemainingSets -= 1;
+    self.emptySets.emplace(static_cast<VkDescriptorSetLayout>(layout), descriptor_set);
+    return descriptor_set;
+}
+
+auto gfx::DynamicUniformBufferSets::get(this DynamicUniformBufferSets& self, DescriptorAllocator& descriptorAllocator, Buffer const& buffer, vk::DescriptorSetLayout layout, uint32_t range) -> vk::DescriptorSet {
+    for (auto& [set_layout, set_range, descriptor_set] : self.sets) {
+        if (set_layout == layout && set_range == range) {
+            return descriptor_set;
+        }
+    }
+
+    DescriptorCounts counts = {};
+    counts.add(vk::DescriptorType::eUniformBufferDynamic, 1);
+    auto descriptor_set = descriptorAllocator.allocate(layout, counts);
+
+    vk::DescriptorBufferInfo buffer_info = {};
+    buffer_info.setBuffer(buffer.handle);
+    buffer_info.setOffset(0);
+    buffer_info.setRange(range);
+
+    vk::WriteDescriptorSet write = {};
+    write.setDstSet(descriptor_set);
+    write.setDstBinding(0);
+    write.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic);
+    write.setBufferInfo(buffer_info);
+    descriptorAllocator.device->handle.updateDescriptorSets(write, {}, descriptorAllocator.device->dispatcher);
+
+    self.sets.emplace_back(layout, range, descriptor_set);
+    return descriptor_set;
+}
+
+void gfx::DynamicUniformBufferSets::clear(this DynamicUniformBufferSets& self) {
+    self.sets.clear();
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Device.hpp"
+#include "ManagedObject.hpp"
+
+#include <array>
+#include <tuple>
+#include <unordered_map>
+
+namespace gfx {
+    struct Buffer;
+
+    // eSampler ... eInputAttachment, indexed by their vk::DescriptorType value
+    inline constexpr uint32_t kDescriptorTypeCount = 11;
+
+    struct DescriptorCounts {
+        std::array<uint32_t, kDescriptorTypeCount> counts = {};
+
+        void add(vk::DescriptorType type, uint32_t count);
+        auto contains(DescriptorCounts const& other) const -> bool;
+        auto empty() const -> bool;
+        auto poolSizes() const -> std::vector<vk::DescriptorPoolSize>;
+    };
+
+    struct DescriptorAllocatorStatistics {
+        DescriptorCounts    peakDescriptors = {};
+        uint32_t            peakSets        = {};
+        uint32_t            poolCount       = {};
+    };
+
+    struct DescriptorPoolChunk {
+        vk::DescriptorPool  pool            = {};
+        DescriptorCounts    capacity        = {};
+        DescriptorCounts    remaining       = {};
+        uint32_t            capacitySets    = {};
+        uint32_t            remainingSets   = {};
+    };
+
+    // Linear allocator for descriptor sets that live for a single frame. Sets are bumped out of the
+    // current pool until it can not hold the next one, then the allocator moves on to the next pool
+    // and never looks back until reset(). Pools are sized from the reflected set layouts and, once
+    // a frame needed more than one pool, are merged into a single pool sized to the observed peak.
+    // Layouts without bindings get one set each from a separate pool, such sets are never reset.
+    struct DescriptorAllocator : public ManagedObject {
+        static constexpr uint32_t kSetsPerChunk = 64;
+
+        rc<Device>                          device;
+        std::vector<DescriptorPoolChunk>    chunks;
+        size_t                              current;
+        DescriptorCounts                    usedDescriptors;
+        uint32_t                            usedSets;
+        DescriptorAllocatorStatistics       statistics;
+        std::vector<vk::DescriptorPool>     emptyPools;
+        uint32_t                            emptyRemainingSets;
+        std::unordered_map<VkDescriptorSetLayout, vk::DescriptorSet> emptySets;
+
+        explicit DescriptorAllocator(rc<Device> device);
+        ~DescriptorAllocator() override;
+
+        void reset(this DescriptorAllocator& self);
+        auto allocate(this DescriptorAllocator& self, vk::DescriptorSetLayout layout, DescriptorCounts const& counts) -> vk::DescriptorSet;
+
+        auto _newChunk(this DescriptorAllocator& self, DescriptorCounts const& capacity, uint32_t sets) -> DescriptorPoolChunk;
+        auto _emptySet(this DescriptorAllocator& self, vk::DescriptorSetLayout layout) -> vk::DescriptorSet;
+    };
+
+    // Sets with a single dynamic uniform buffer at binding 0 reading one buffer, by layout and range.
+    // They come from a DescriptorAllocator and have to be cleared whenever it is reset.
+    struct DynamicUniformBufferSets {
+        std::vector<std::tuple<vk::DescriptorSetLayout, uint32_t, vk::DescriptorSet>> sets = {};
+
+        auto get(this DynamicUniformBufferSets& self, DescriptorAllocator& descriptorAllocator, Buffer const& buffer, vk::DescriptorSetLayout layout, uint32_t range) -> vk::DescriptorSet;
+        void clear(this DynamicUniformBufferSets& self);
+    };
+}
@@ -5,16 +5,29 @@
 #include "Texture.hpp"
 #include "Surface.hpp"
 #include "Library.hpp"
+#include "ShaderArchive.hpp"
 #include "Drawable.hpp"
 #include "Instance.hpp"
 #include "Swapchain.hpp"
 #include "CommandQueue.hpp"
 #include "RenderPipelineState.hpp"
 #include "ComputePipelineState.hpp"
+#include "ThreadPool.hpp"
+#include "DescriptorAllocator.hpp"
+#include "UploadQueue.hpp"
+#include "TransientAllocator.hpp"
+#include "Heap.hpp"
+#include "Profiler.hpp"
 #include "ManagedObject.hpp"
 
+#include <fstream>
+#include <algorithm>
+#include <functional>
 #include <unordered_map>
 #include <spirv_reflect.h>
+#include <vulkan/vulkan_hash.hpp>
+
+#include "spdlog/spdlog.h"
 
 // todo: fill table with valid aspect
 const auto image_aspect_flags_table = std::unordered_map<vk::Format, vk::ImageAspectFlags> {
@@ -324,6 +337,14 @@ const auto image_aspect_flags_table = std::unordered_map<vk::Format, vk::ImageAs
 struct DescriptorSetLayoutCreateInfo {
     std::vector<vk::DescriptorSetLayoutBinding> bindings = {};
 
+    auto counts() const -> gfx::DescriptorCounts {
+        gfx::DescriptorCounts counts = {};
+        for (auto& binding : bindings) {
+            counts.add(binding.descriptorType, binding.descriptorCount);
+        }
+        return counts;
+    }
+
     void emplace(const vk::DescriptorSetLayoutBinding& other) {
         for (auto& binding : bindings) {
             if (binding.binding != other.binding) {
@@ -341,11 +362,112 @@ struct DescriptorSetLayoutCreateInfo {
         bindings.emplace_back(other);
     }
 };
+struct PipelineCacheFileHeader {
+    static constexpr uint32_t kMagic = 0x50434647; // 'GFCP'
+    static constexpr uint32_t kVersion = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+    uint64_t dataHash;
+};
+
+static auto fnv1a(std::span<const char> bytes) -> uint64_t {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (auto byte : bytes) {
+        hash ^= static_cast<uint8_t>(byte);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+auto gfx::DeviceObjectHash::operator()(vk::SamplerCreateInfo const& info) const -> size_t {
+    return std::hash<vk::SamplerCreateInfo>{}(info);
+}
+
+auto gfx::DeviceObjectHash::operator()(DescriptorSetLayoutKey const& key) const -> size_t {
+    size_t seed = 0;
+    for (auto& binding : key.bindings) {
+        VULKAN_HPP_HASH_COMBINE(seed, binding);
+    }
+    return seed;
+}
+
+auto gfx::DeviceObjectHash::operator()(PipelineLayoutKey const& key) const -> size_t {
+    size_t seed = 0;
+    for (auto& layout : key.setLayouts) {
+        VULKAN_HPP_HASH_COMBINE(seed, layout);
+    }
+    for (auto& range : key.pushConstantRanges) {
+        VULKAN_HPP_HASH_COMBINE(seed, range);
+    }
+    return seed;
+}
+
+static auto hashDepthStencilStateDescription(gfx::DepthStencilStateDescription const& description) -> size_t {
+    size_t seed = 0;
+    VULKAN_HPP_HASH_COMBINE(seed, description.isDepthTestEnabled);
+    VULKAN_HPP_HASH_COMBINE(seed, description.isDepthWriteEnabled);
+    VULKAN_HPP_HASH_COMBINE(seed, description.depthCompareFunction);
+    VULKAN_HPP_HASH_COMBINE(seed, description.depth_bounds_test_enable);
+    VULKAN_HPP_HASH_COMBINE(seed, description.stencil_test_enable);
+    VULKAN_HPP_HASH_COMBINE(seed, description.frontFaceStencil);
+    VULKAN_HPP_HASH_COMBINE(seed, description.backFaceStencil);
+    VULKAN_HPP_HASH_COMBINE(seed, description.min_depth_bounds);
+    VULKAN_HPP_HASH_COMBINE(seed, description.max_depth_bounds);
+    return seed;
+}
+
+static auto memoryCategoryName(gfx::MemoryCategory category) -> std::string_view {
+    switch (category) {
+        case gfx::MemoryCategory::eBuffer: {
+            return "buffer";
+        }
+        case gfx::MemoryCategory::eStaging: {
+            return "staging";
+        }
+        case gfx::MemoryCategory::eTexture: {
+            return "texture";
+        }
+        case gfx::MemoryCategory::eHeap: {
+            return "heap";
+        }
+    }
+    return "unknown";
+}
+
 gfx::Device::Device(rc<Adapter> adapter, vk::DeviceCreateInfo const& create_info)
 : adapter(std::move(adapter))
 , handle(this->adapter->handle.createDevice(create_info, nullptr, this->adapter->instance->dispatcher))
 , dispatcher(this->adapter->instance->dispatcher.vkGetDeviceProcAddr, this->handle)
-, allocator() {
+, allocator()
+, enabledExtensions(create_info.ppEnabledExtensionNames, create_info.ppEnabledExtensionNames + create_info.enabledExtensionCount)
+, queueFamilyIndices()
+, queueMutex()
+, pipelineCache()
+, pipelineCacheHits(0)
+, pipelineCacheMisses(0)
+, pipelineCompileTime(0)
+, pipelineVariantsAvoided(0)
+, pipelineVariantStatistics(false)
+, dynamicState()
+, graphicsPipelineLibrary(false)
+, uniformBufferStandardLayout(false)
+, imageCubeArray(create_info.pEnabledFeatures != nullptr && create_info.pEnabledFeatures->imageCubeArray)
+, inheritedQueries(create_info.pEnabledFeatures != nullptr && create_info.pEnabledFeatures->inheritedQueries)
+, limits(this->adapter->handle.getProperties(this->adapter->instance->dispatcher).limits)
+, pipelineCompiler()
+, allocationMutex()
+, allocations()
+, objectCacheMutex()
+, samplerCache()
+, depthStencilStateCache()
+, descriptorSetLayoutCache()
+, pipelineLayoutCache() {
     VmaVulkanFunctions functions = {};
     functions.vkGetDeviceProcAddr   = this->adapter->instance->dispatcher.vkGetDeviceProcAddr;
     functions.vkGetInstanceProcAddr = this->adapter->instance->dispatcher.vkGetInstanceProcAddr;
@@ -356,10 +478,76 @@ gfx::Device::Device(rc<Adapter> adapter, vk::DeviceCreateInfo const& create_info
     allocator_create_info.pVulkanFunctions = &functions;
     allocator_create_info.instance = this->adapter->instance->handle;
     allocator_create_info.vulkanApiVersion = VK_API_VERSION_1_2;
+    if (this->hasExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+        // without it the budget is an estimate from the heap sizes and our own allocations
+        allocator_create_info.flags |= VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+    }
     vk::resultCheck(static_cast<vk::Result>(vmaCreateAllocator(&allocator_create_info, &allocator)), "Failed to create allocator");
+
+    for (auto& queue_create_info : std::span(create_info.pQueueCreateInfos, create_info.queueCreateInfoCount)) {
+        queueFamilyIndices.emplace_back(queue_create_info.queueFamilyIndex);
+    }
+
+    // an optional feature is used only when both its extension and its feature struct were enabled
+    for (auto next = static_cast<vk::BaseInStructure const*>(create_info.pNext); next != nullptr; next = next->pNext) {
+        switch (next->sType) {
+            case vk::StructureType::ePhysicalDeviceExtendedDynamicStateFeaturesEXT: {
+                auto features = reinterpret_cast<vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT const*>(next);
+                dynamicState.extendedDynamicState = this->hasExtension(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME) && features->extendedDynamicState;
+                break;
+            }
+            case vk::StructureType::ePhysicalDeviceExtendedDynamicState2FeaturesEXT: {
+                auto features = reinterpret_cast<vk::PhysicalDeviceExtendedDynamicState2FeaturesEXT const*>(next);
+                dynamicState.extendedDynamicState2 = this->hasExtension(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME) && features->extendedDynamicState2;
+                break;
+            }
+            case vk::StructureType::ePhysicalDeviceExtendedDynamicState3FeaturesEXT: {
+                auto features = reinterpret_cast<vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT const*>(next);
+                dynamicState.depthClampEnable = this->hasExtension(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME) && features->extendedDynamicState3DepthClampEnable;
+                dynamicState.polygonMode = this->hasExtension(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME) && features->extendedDynamicState3PolygonMode;
+                break;
+            }
+            case vk::StructureType::ePhysicalDeviceGraphicsPipelineLibraryFeaturesEXT: {
+                auto features = reinterpret_cast<vk::PhysicalDeviceGraphicsPipelineLibraryFeaturesEXT const*>(next);
+                graphicsPipelineLibrary = this->hasExtension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) && features->graphicsPipelineLibrary;
+                break;
+            }
+            case vk::StructureType::ePhysicalDeviceFeatures2: {
+                auto features = reinterpret_cast<vk::PhysicalDeviceFeatures2 const*>(next);
+                imageCubeArray = features->features.imageCubeArray;
+                inheritedQueries = features->features.inheritedQueries;
+                break;
+            }
+            case vk::StructureType::ePhysicalDeviceUniformBufferStandardLayoutFeatures: {
+                auto features = reinterpret_cast<vk::PhysicalDeviceUniformBufferStandardLayoutFeatures const*>(next);
+                uniformBufferStandardLayout = features->uniformBufferStandardLayout;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    vk::PipelineCacheCreateInfo pipeline_cache_create_info = {};
+    vk::resultCheck(this->handle.createPipelineCache(&pipeline_cache_create_info, nullptr, &pipelineCache, this->dispatcher), "Failed to create pipeline cache");
+
+    pipelineCompiler = rc<ThreadPool>::init(std::max(std::thread::hardware_concurrency(), 2U) - 1U);
 }
 
 gfx::Device::~Device() {
+    pipelineCompiler = {};
+    for (auto& [_, sampler] : samplerCache) {
+        this->handle.destroySampler(sampler, nullptr, this->dispatcher);
+    }
+    for (auto& [_, layout] : pipelineLayoutCache) {
+        this->handle.destroyPipelineLayout(layout, nullptr, this->dispatcher);
+    }
+    for (auto& [_, layout] : descriptorSetLayoutCache) {
+        this->handle.destroyDescriptorSetLayout(layout, nullptr, this->dispatcher);
+    }
+    this->handle.destroyPipelineCache(pipelineCache, nullptr, this->dispatcher);
+    // every buffer, texture and heap holds the device, whatever is still tracked here was leaked
+    this->reportLiveAllocations();
     vmaDestroyAllocator(allocator);
     this->handle.destroy(nullptr, this->dispatcher);
 }
@@ -368,54 +556,434 @@ void gfx::Device::waitIdle(this Device& self) {
     self.handle.waitIdle(self.dispatcher);
 }
 
-auto gfx::Device::newTexture(this Device& self, TextureDescription const& description) -> rc<Texture> {
-    auto aspect = image_aspect_flags_table.at(description.format);
+auto gfx::Device::hasExtension(this Device const& self, std::string const& name) -> bool {
+    return self.enabledExtensions.contains(name);
+}
+
+auto gfx::Device::transferQueueFamilyIndex(this Device const& self) -> uint32_t {
+    auto properties = self.adapter->handle.getQueueFamilyProperties(self.adapter->instance->dispatcher);
+
+    // a family without graphics and compute is usually backed by a dedicated DMA engine
+    for (auto index : self.queueFamilyIndices) {
+        auto flags = properties[index].queueFlags;
+        if ((flags & vk::QueueFlagBits::eTransfer) && !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute))) {
+            return index;
+        }
+    }
+    return 0;
+}
+
+// also enough for the std140 and std430 base alignment of a block, whatever the device reports
+auto gfx::Device::uniformBufferOffsetAlignment(this Device const& self) -> vk::DeviceSize {
+    return std::max(self.limits.minUniformBufferOffsetAlignment, vk::DeviceSize(16));
+}
+
+auto gfx::Device::loadPipelineCache(this Device& self, std::filesystem::path const& path) -> bool {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::vector<char> bytes = {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    if (bytes.size() < sizeof(PipelineCacheFileHeader)) {
+        spdlog::warn("Pipeline cache '{}' is truncated", path.string());
+        return false;
+    }
+
+    PipelineCacheFileHeader header = {};
+    std::memcpy(&header, bytes.data(), sizeof(PipelineCacheFileHeader));
+
+    auto data = std::span(bytes).subspan(sizeof(PipelineCacheFileHeader));
+    auto properties = self.adapter->handle.getProperties(self.adapter->instance->dispatcher);
+
+    if (header.magic != PipelineCacheFileHeader::kMagic || header.version != PipelineCacheFileHeader::kVersion) {
+        spdlog::warn("Pipeline cache '{}' has unknown format", path.string());
+        return false;
+    }
+    if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID || header.driverVersion != properties.driverVersion) {
+        spdlog::info("Pipeline cache '{}' was created by a different device or driver", path.string());
+        return false;
+    }
+    if (std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE) != 0) {
+        spdlog::info("Pipeline cache '{}' has incompatible UUID", path.string());
+        return false;
+    }
+    if (header.dataSize != data.size() || header.dataHash != fnv1a(data)) {
+        spdlog::warn("Pipeline cache '{}' is corrupted", path.string());
+        return false;
+    }
+
+    vk::PipelineCacheCreateInfo pipeline_cache_create_info = {};
+    pipeline_cache_create_info.setInitialDataSize(data.size());
+    pipeline_cache_create_info.setPInitialData(data.data());
+
+    vk::PipelineCache loaded_cache = {};
+    vk::resultCheck(self.handle.createPipelineCache(&pipeline_cache_create_info, nullptr, &loaded_cache, self.dispatcher), "Failed to create pipeline cache");
+    vk::resultCheck(self.handle.mergePipelineCaches(self.pipelineCache, 1, &loaded_cache, self.dispatcher), "Failed to merge pipeline caches");
+    self.handle.destroyPipelineCache(loaded_cache, nullptr, self.dispatcher);
+    return true;
+}
+
+void gfx::Device::savePipelineCache(this Device& self, std::filesystem::path const& path) {
+    auto data = self.handle.getPipelineCacheData(self.pipelineCache, self.dispatcher);
+    auto properties = self.adapter->handle.getProperties(self.adapter->instance->dispatcher);
+
+    PipelineCacheFileHeader header = {};
+    header.magic = PipelineCacheFileHeader::kMagic;
+    header.version = PipelineCacheFileHeader::kVersion;
+    header.vendorID = properties.vendorID;
+    header.deviceID = properties.deviceID;
+    header.driverVersion = properties.driverVersion;
+    std::memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE);
+    header.dataSize = data.size();
+    header.dataHash = fnv1a(std::span(reinterpret_cast<const char*>(data.data()), data.size()));
+
+    // write next to the destination and rename, so an interrupted save never leaves a truncated cache behind
+    auto temporary = std::filesystem::path(path).concat(".tmp");
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            spdlog::warn("Failed to write pipeline cache '{}'", path.string());
+            return;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(PipelineCacheFileHeader));
+        file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    }
+
+    std::error_code error_code = {};
+    std::filesystem::rename(temporary, path, error_code);
+    if (error_code) {
+        spdlog::warn("Failed to write pipeline cache '{}': {}", path.string(), error_code.message());
+    }
+}
+
+auto gfx::Device::pipelineCacheStatistics(this Device const& self) -> PipelineCacheStatistics {
+    PipelineCacheStatistics statistics = {};
+    statistics.hits = self.pipelineCacheHits.load();
+    statistics.misses = self.pipelineCacheMisses.load();
+    statistics.compileTime = std::chrono::nanoseconds(self.pipelineCompileTime.load());
+    statistics.variantsAvoided = self.pipelineVariantsAvoided.load();
+    return statistics;
+}
+
+auto gfx::Device::memoryStatistics(this Device& self) -> MemoryStatistics {
+    MemoryStatistics statistics = {};
+
+    VkPhysicalDeviceMemoryProperties const* memory_properties = nullptr;
+    vmaGetMemoryProperties(self.allocator, &memory_properties);
+
+    std::vector<VmaBudget> budgets(memory_properties->memoryHeapCount);
+    vmaGetHeapBudgets(self.allocator, budgets.data());
+
+    for (uint32_t i = 0; i < memory_properties->memoryHeapCount; ++i) {
+        statistics.heaps.emplace_back(MemoryHeapStatistics{
+            .flags = vk::MemoryHeapFlags(memory_properties->memoryHeaps[i].flags),
+            .budget = budgets[i].budget,
+            .usage = budgets[i].usage,
+            .blockBytes = budgets[i].statistics.blockBytes,
+            .allocationBytes = budgets[i].statistics.allocationBytes
+        });
+    }
+
+    {
+        std::lock_guard lock(self.allocationMutex);
+        for (auto& [_, record] : self.allocations) {
+            auto it = std::ranges::find_if(statistics.categories, [&record](MemoryCategoryStatistics const& category) {
+                return category.category == record.category && category.label == record.label;
+            });
+            if (it == statistics.categories.end()) {
+                it = statistics.categories.emplace(statistics.categories.end(), MemoryCategoryStatistics{
+                    .category = record.category,
+                    .label = record.label
+                });
+            }
+            it->allocationCount += 1;
+            it->bytes += record.size;
+        }
+    }
+    std::ranges::sort(statistics.categories, std::ranges::greater{}, &MemoryCategoryStatistics::bytes);
+
+    char* json = nullptr;
+    vmaBuildStatsString(self.allocator, &json, VK_TRUE);
+    statistics.json = json;
+    vmaFreeStatsString(self.allocator, json);
+
+    return statistics;
+}
+
+void gfx::Device::reportLiveAllocations(this Device& self) {
+#ifndef NDEBUG
+    std::lock_guard lock(self.allocationMutex);
+    for (auto& [_, record] : self.allocations) {
+        spdlog::warn("Live {} allocation '{}' of {} bytes", memoryCategoryName(record.category), record.label, record.size);
+    }
+#endif
+}
+
+void gfx::Device::_trackAllocation(this Device& self, VmaAllocation allocation, MemoryCategory category) {
+    VmaAllocationInfo allocation_info = {};
+    vmaGetAllocationInfo(self.allocator, allocation, &allocation_info);
+
+    std::lock_guard lock(self.allocationMutex);
+    self.allocations.insert_or_assign(allocation, MemoryAllocationRecord{
+        .category = category,
+        .size = allocation_info.size
+    });
+}
+
+void gfx::Device::_untrackAllocation(this Device& self, VmaAllocation allocation) {
+    std::lock_guard lock(self.allocationMutex);
+    self.allocations.erase(allocation);
+}
+
+void gfx::Device::_labelAllocation(this Device& self, VmaAllocation allocation, std::string const& label) {
+    // the name also shows up in the detailed map of memoryStatistics
+    vmaSetAllocationName(self.allocator, allocation, label.c_str());
+
+    std::lock_guard lock(self.allocationMutex);
+    if (auto it = self.allocations.find(allocation); it != self.allocations.end()) {
+        it->second.label = label;
+    }
+}
+
+void gfx::Device::_recordPipelineCompilation(this Device& self, vk::PipelineCreationFeedback const& feedback, std::chrono::steady_clock::duration elapsed) {
+    self.pipelineCompileTime += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    if (feedback.flags & vk::PipelineCreationFeedbackFlagBits::eApplicationPipelineCacheHit) {
+        self.pipelineCacheHits += 1;
+    } else {
+        self.pipelineCacheMisses += 1;
+    }
+}
+
+auto gfx::Device::createGraphicsPipeline(this Device& self, vk::GraphicsPipelineCreateInfo const& create_info) -> vk::Pipeline {
+    auto pipeline_create_info = create_info;
+
+    // without VK_EXT_pipeline_creation_feedback every compilation is counted as a miss
+    std::vector<vk::PipelineCreationFeedback> stage_feedbacks(pipeline_create_info.stageCount);
+    vk::PipelineCreationFeedback pipeline_feedback = {};
+    vk::PipelineCreationFeedbackCreateInfo feedback_create_info = {};
+    if (self.hasExtension(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME)) {
+        feedback_create_info.setPNext(pipeline_create_info.pNext);
+        feedback_create_info.setPPipelineCreationFeedback(&pipeline_feedback);
+        feedback_create_info.setPipelineStageCreationFeedbacks(stage_feedbacks);
+        pipeline_create_info.setPNext(&feedback_create_info);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    vk::Pipeline pipeline;
+    vk::resultCheck(self.handle.createGraphicsPipelines(self.pipelineCache, 1, &pipeline_create_info, nullptr, &pipeline, self.dispatcher), "Failed to create graphics pipeline");
+
+    self._recordPipelineCompilation(pipeline_feedback, std::chrono::steady_clock::now() - start);
+    return pipeline;
+}
+
+auto gfx::Device::createComputePipeline(this Device& self, vk::ComputePipelineCreateInfo const& create_info) -> vk::Pipeline {
+    auto pipeline_create_info = create_info;
+
+    vk::PipelineCreationFeedback stage_feedback = {};
+    vk::PipelineCreationFeedback pipeline_feedback = {};
+    vk::PipelineCreationFeedbackCreateInfo feedback_create_info = {};
+    if (self.hasExtension(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME)) {
+        feedback_create_info.setPNext(pipeline_create_info.pNext);
+        feedback_create_info.setPPipelineCreationFeedback(&pipeline_feedback);
+        feedback_create_info.setPipelineStageCreationFeedbackCount(1);
+        feedback_create_info.setPPipelineStageCreationFeedbacks(&stage_feedback);
+        pipeline_create_info.setPNext(&feedback_create_info);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    vk::Pipeline pipeline;
+    vk::resultCheck(self.handle.createComputePipelines(self.pipelineCache, 1, &pipeline_create_info, nullptr, &pipeline, self.dispatcher), "Failed to create compute pipeline");
+
+    self._recordPipelineCompilation(pipeline_feedback, std::chrono::steady_clock::now() - start);
+    return pipeline;
+}
+
+static void validateTextureDescription(gfx::Device const& device, gfx::TextureDescription const& description) {
+    if (description.cube) {
+        if (description.type != vk::ImageType::e2D || description.width != description.height) {
+            throw std::runtime_error("Cube textures must be 2D with square faces");
+        }
+        if (description.arrayLayerCount == 0 || description.arrayLayerCount % 6 != 0) {
+            throw std::runtime_error("Cube textures must have six layers per cube");
+        }
+        if (description.arrayLayerCount > 6 && !device.imageCubeArray) {
+            throw std::runtime_error("Cube array textures require the imageCubeArray feature");
+        }
+    }
+    if (description.type == vk::ImageType::e3D && description.arrayLayerCount != 1) {
+        throw std::runtime_error("3D textures can not have array layers");
+    }
+}
+
+static auto textureImageCreateInfo(gfx::Device const& device, gfx::TextureDescription const& description) -> vk::ImageCreateInfo {
+    validateTextureDescription(device, description);
 
     vk::ImageCreateInfo image_create_info = {};
-    image_create_info.setImageType(vk::ImageType::e2D);
+    if (description.cube) {
+        image_create_info.setFlags(vk::ImageCreateFlagBits::eCubeCompatible);
+    }
+    image_create_info.setImageType(description.type);
     image_create_info.setFormat(description.format);
-    image_create_info.setExtent(vk::Extent3D(description.width, description.height, 1));
-    image_create_info.setMipLevels(1);
-    image_create_info.setArrayLayers(1);
+    image_create_info.setExtent(vk::Extent3D(description.width, description.height, description.depth));
+    image_create_info.setMipLevels(description.mipLevelCount);
+    image_create_info.setArrayLayers(description.arrayLayerCount);
     image_create_info.setUsage(description.usage);
+    if (device.queueFamilyIndices.size() > 1) {
+        image_create_info.setSharingMode(vk::SharingMode::eConcurrent);
+        image_create_info.setQueueFamilyIndices(device.queueFamilyIndices);
+    }
+    return image_create_info;
+}
+
+static auto textureViewType(gfx::TextureDescription const& description) -> vk::ImageViewType {
+    switch (description.type) {
+        case vk::ImageType::e1D: {
+            return description.arrayLayerCount > 1 ? vk::ImageViewType::e1DArray : vk::ImageViewType::e1D;
+        }
+        case vk::ImageType::e3D: {
+            return vk::ImageViewType::e3D;
+        }
+        default: {
+            if (description.cube) {
+                return description.arrayLayerCount > 6 ? vk::ImageViewType::eCubeArray : vk::ImageViewType::eCube;
+            }
+            return description.arrayLayerCount > 1 ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D;
+        }
+    }
+}
+
+auto gfx::Device::newTexture(this Device& self, TextureDescription const& description) -> rc<Texture> {
+    auto image_create_info = textureImageCreateInfo(self, description);
 
     VmaAllocationCreateInfo allocation_create_info = {};
     allocation_create_info.usage = VMA_MEMORY_USAGE_AUTO;
 
     VkImage image;
     VmaAllocation allocation;
-    vmaCreateImage(self.allocator, reinterpret_cast<const VkImageCreateInfo*>(&image_create_info), &allocation_create_info, reinterpret_cast<VkImage*>(&image), &allocation, nullptr);
+    vk::resultCheck(static_cast<vk::Result>(vmaCreateImage(self.allocator, reinterpret_cast<const VkImageCreateInfo*>(&image_create_info), &allocation_create_info, reinterpret_cast<VkImage*>(&image), &allocation, nullptr)), "Failed to create image");
+    self._trackAllocation(allocation, MemoryCategory::eTexture);
+
+    return self._newTexture(description, image, allocation);
+}
+
+auto gfx::Device::newTexture(this Device& self, TextureDescription const& description, rc<Heap> const& heap, vk::DeviceSize offset) -> rc<Texture> {
+    auto image_create_info = textureImageCreateInfo(self, description);
+
+    vk::Image image = {};
+    vk::resultCheck(self.handle.createImage(&image_create_info, nullptr, &image, self.dispatcher), "Failed to create image");
+    vk::resultCheck(static_cast<vk::Result>(vmaBindImageMemory2(self.allocator, heap->allocation, offset, image, nullptr)), "Failed to bind image memory");
+
+    auto texture = self._newTexture(description, image, nullptr);
+    texture->heap = heap;
+    return texture;
+}
+
+auto gfx::Device::textureMemoryRequirements(this Device& self, TextureDescription const& description) -> vk::MemoryRequirements {
+    auto image_create_info = textureImageCreateInfo(self, description);
+
+    vk::Image image = {};
+    vk::resultCheck(self.handle.createImage(&image_create_info, nullptr, &image, self.dispatcher), "Failed to create image");
+    auto requirements = self.handle.getImageMemoryRequirements(image, self.dispatcher);
+    self.handle.destroyImage(image, nullptr, self.dispatcher);
+    return requirements;
+}
+
+auto gfx::Device::newHeap(this Device& self, vk::MemoryRequirements const& requirements) -> rc<Heap> {
+    VmaAllocationCreateInfo allocation_create_info = {};
+    allocation_create_info.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+    auto memory_requirements = static_cast<VkMemoryRequirements>(requirements);
+
+    VmaAllocation allocation;
+    vk::resultCheck(static_cast<vk::Result>(vmaAllocateMemory(self.allocator, &memory_requirements, &allocation_create_info, &allocation, nullptr)), "Failed to allocate heap memory");
+    self._trackAllocation(allocation, MemoryCategory::eHeap);
+    return rc<Heap>::init(self.shared_from_this(), allocation, requirements.size);
+}
+
+auto gfx::Device::_newTexture(this Device& self, TextureDescription const& description, vk::Image image, VmaAllocation allocation) -> rc<Texture> {
+    auto aspect = image_aspect_flags_table.at(description.format);
+    auto subresource = vk::ImageSubresourceRange(aspect, 0, description.mipLevelCount, 0, description.arrayLayerCount);
 
     vk::ImageViewCreateInfo view_create_info = {};
     view_create_info.setImage(image);
-    view_create_info.setViewType(vk::ImageViewType::e2D),
+    view_create_info.setViewType(textureViewType(description)),
     view_create_info.setFormat(description.format);
     view_create_info.setComponents(description.mapping),
-    view_create_info.setSubresourceRange(vk::ImageSubresourceRange(aspect, 0, 1, 0, 1));
+    view_create_info.setSubresourceRange(subresource);
 
-    return rc<Texture>(new Texture(
+    auto texture = rc<Texture>(new Texture(
         self.shared_from_this(),
         image,
         description.format,
         vk::Extent3D(
             description.width,
             description.height,
-            1
+            description.depth
         ),
         self.handle.createImageView(view_create_info, VK_NULL_HANDLE, self.dispatcher),
-        vk::ImageSubresourceRange(aspect, 0, 1, 0, 1),
+        subresource,
         allocation
     ));
+    texture->type = description.type;
+    texture->cube = description.cube;
+    return texture;
 }
 
 auto gfx::Device::newSampler(this Device& self, vk::SamplerCreateInfo const& info) -> rc<Sampler> {
     return rc<Sampler>(new Sampler(self.shared_from_this(), info));
 }
 
+auto gfx::Device::_internSampler(this Device& self, vk::SamplerCreateInfo const& create_info) -> vk::Sampler {
+    std::lock_guard lock(self.objectCacheMutex);
+    auto [it, inserted] = self.samplerCache.try_emplace(create_info);
+    if (inserted) {
+        it->second = self.handle.createSampler(create_info, nullptr, self.dispatcher);
+    }
+    return it->second;
+}
+
+auto gfx::Device::_internDescriptorSetLayout(this Device& self, DescriptorSetLayoutKey key) -> vk::DescriptorSetLayout {
+    // reflection lists bindings in declaration order, which should not make two sets different
+    std::ranges::sort(key.bindings, {}, &vk::DescriptorSetLayoutBinding::binding);
+
+    std::lock_guard lock(self.objectCacheMutex);
+    if (auto it = self.descriptorSetLayoutCache.find(key); it != self.descriptorSetLayoutCache.end()) {
+        return it->second;
+    }
+
+    vk::DescriptorSetLayoutCreateInfo create_info = {};
+    create_info.setBindings(key.bindings);
+    auto layout = self.handle.createDescriptorSetLayout(create_info, nullptr, self.dispatcher);
+    self.descriptorSetLayoutCache.emplace(std::move(key), layout);
+    return layout;
+}
+
+auto gfx::Device::_internPipelineLayout(this Device& self, PipelineLayoutKey key) -> vk::PipelineLayout {
+    std::lock_guard lock(self.objectCacheMutex);
+    if (auto it = self.pipelineLayoutCache.find(key); it != self.pipelineLayoutCache.end()) {
+        return it->second;
+    }
+
+    vk::PipelineLayoutCreateInfo create_info = {};
+    create_info.setSetLayouts(key.setLayouts);
+    create_info.setPushConstantRanges(key.pushConstantRanges);
+    auto layout = self.handle.createPipelineLayout(create_info, nullptr, self.dispatcher);
+    self.pipelineLayoutCache.emplace(std::move(key), layout);
+    return layout;
+}
+
 auto gfx::Device::newBuffer(this Device& self, vk::BufferUsageFlags usage, uint64_t size, StorageMode storage, VmaAllocationCreateFlags options) -> rc<Buffer> {
     vk::BufferCreateInfo buffer_create_info = {};
     buffer_create_info.setSize(static_cast<vk::DeviceSize>(size));
     buffer_create_info.setUsage(usage);
+    if (self.queueFamilyIndices.size() > 1) {
+        // resources are written by the upload queue and read by the graphics queue without ownership transfers
+        buffer_create_info.setSharingMode(vk::SharingMode::eConcurrent);
+        buffer_create_info.setQueueFamilyIndices(self.queueFamilyIndices);
+    }
 
     VmaAllocationCreateInfo allocation_create_info = {};
     allocation_create_info.flags = options;
@@ -453,12 +1021,19 @@ auto gfx::Device::newBuffer(this Device& self, vk::BufferUsageFlags usage, uint6
 
     VkBuffer buffer;
     VmaAllocation allocation;
-    vmaCreateBuffer(self.allocator, reinterpret_cast<const VkBufferCreateInfo*>(&buffer_create_info), &allocation_create_info, &buffer, &allocation, nullptr);
+    vk::resultCheck(static_cast<vk::Result>(vmaCreateBuffer(self.allocator, reinterpret_cast<const VkBufferCreateInfo*>(&buffer_create_info), &allocation_create_info, &buffer, &allocation, nullptr)), "Failed to create buffer");
+
+    auto staging = storage != StorageMode::ePrivate && storage != StorageMode::eLazy && usage == vk::BufferUsageFlagBits::eTransferSrc;
+    self._trackAllocation(allocation, staging ? MemoryCategory::eStaging : MemoryCategory::eBuffer);
     return rc<Buffer>(new Buffer(self.shared_from_this(), buffer, allocation));
 }
 
 auto gfx::Device::newBuffer(this Device& self, vk::BufferUsageFlags usage, const void* pointer, uint64_t size, StorageMode storage, VmaAllocationCreateFlags options) -> rc<Buffer> {
-    // todo: use transfer operation if buffer is not mappable
+    // private and lazy memory is not mappable, such buffers are filled with UploadQueue::newBuffer
+    if (storage == StorageMode::ePrivate || storage == StorageMode::eLazy) {
+        throw std::runtime_error("Buffer with private storage can not be initialized from memory, use UploadQueue::newBuffer");
+    }
+
     auto buffer = self.newBuffer(usage, size, storage, options);
     std::memcpy(buffer->contents(), pointer, size);
     buffer->didModifyRange(0, size);
@@ -469,10 +1044,47 @@ auto gfx::Device::newLibrary(this Device& self, std::span<char const> bytes) ->
     vk::ShaderModuleCreateInfo create_info = {};
     create_info.setCodeSize(bytes.size());
     create_info.setPCode(reinterpret_cast<const uint32_t *>(bytes.data()));
-    return rc<Library>(new Library(self.shared_from_this(), create_info));
+
+    auto code = std::span(create_info.pCode, create_info.codeSize / sizeof(uint32_t));
+    return rc<Library>(new Library(self.shared_from_this(), create_info, ShaderReflection::reflect(code)));
+}
+
+auto gfx::Device::newLibraryFromArchive(this Device& self, rc<ShaderArchive> const& archive, std::string_view name) -> rc<Library> {
+    auto module = archive->findModule(name);
+    if (!module) {
+        throw std::runtime_error("Shader archive '" + archive->path.string() + "' has no module '" + std::string(name) + "'");
+    }
+
+    // the reflection was done when the archive was built, only the shader module is created here
+    auto code = archive->code(*module);
+    vk::ShaderModuleCreateInfo create_info = {};
+    create_info.setCodeSize(code.size_bytes());
+    create_info.setPCode(code.data());
+    return rc<Library>(new Library(self.shared_from_this(), create_info, archive->reflection(*module)));
 }
 
 auto gfx::Device::newDepthStencilState(this Device& self, DepthStencilStateDescription const& description) -> rc<DepthStencilState> {
+    auto matches = [&description](DepthStencilState const& state) {
+        return state.isDepthTestEnabled == description.isDepthTestEnabled
+            && state.isDepthWriteEnabled == description.isDepthWriteEnabled
+            && state.depthCompareFunction == description.depthCompareFunction
+            && state.isDepthBoundsTestEnabled == description.depth_bounds_test_enable
+            && state.isStencilTestEnabled == description.stencil_test_enable
+            && state.frontFaceStencil == description.frontFaceStencil
+            && state.backFaceStencil == description.backFaceStencil
+            && state.minDepthBounds == description.min_depth_bounds
+            && state.maxDepthBounds == description.max_depth_bounds;
+    };
+
+    // equal descriptions share a state, and with it the pipeline variants keyed by its id
+    std::lock_guard lock(self.objectCacheMutex);
+    auto& states = self.depthStencilStateCache[hashDepthStencilStateDescription(description)];
+    for (auto& state : states) {
+        if (matches(*state)) {
+            return state;
+        }
+    }
+
     auto depth_stencil_state = rc<DepthStencilState>(new DepthStencilState());
     depth_stencil_state->isDepthTestEnabled = description.isDepthTestEnabled;
     depth_stencil_state->isDepthWriteEnabled = description.isDepthWriteEnabled;
@@ -483,58 +1095,108 @@ auto gfx::Device::newDepthStencilState(this Device& self, DepthStencilStateDescr
     depth_stencil_state->backFaceStencil = description.backFaceStencil;
     depth_stencil_state->minDepthBounds = description.min_depth_bounds;
     depth_stencil_state->maxDepthBounds = description.max_depth_bounds;
+    states.emplace_back(depth_stencil_state);
     return depth_stencil_state;
 }
 
 auto gfx::Device::newRenderPipelineState(this Device& self, rc<RenderPipelineStateDescription> const& description) -> rc<RenderPipelineState> {
     std::vector<vk::PushConstantRange> push_constant_ranges = {};
     std::vector<DescriptorSetLayoutCreateInfo> descriptor_sets = {};
+    vk::ShaderStageFlags spill_stages = {};
+    uint32_t spill_size = 0;
 
     auto func = [&](gfx::Function* impl) {
-        for (auto& pcb : std::span(impl->library->spvReflectShaderModule.push_constant_blocks, impl->library->spvReflectShaderModule.push_constant_block_count)) {
+        // a block that does not fit the device limit is spilled to a uniform buffer, see below
+        auto push_constant_size = impl->library->reflection.pushConstantSize();
+        if (push_constant_size > self.limits.maxPushConstantsSize) {
+            spill_stages |= impl->stage;
+            spill_size = std::max(spill_size, push_constant_size);
+        }
+
+        for (auto& pcb : impl->library->reflection.pushConstantBlocks) {
+            if (push_constant_size > self.limits.maxPushConstantsSize) {
+                break;
+            }
+
             vk::PushConstantRange push_constant_range = {};
             push_constant_range.setSize(pcb.size);
             push_constant_range.setOffset(pcb.offset);
-            push_constant_range.setStageFlags(vk::ShaderStageFlags(impl->entry_point->shader_stage));
+            push_constant_range.setStageFlags(impl->stage);
             push_constant_ranges.emplace_back(push_constant_range);
         }
 
-        for (auto& sds : std::span(impl->library->spvReflectShaderModule.descriptor_sets, impl->library->spvReflectShaderModule.descriptor_set_count)) {
-            if (sds.set >= descriptor_sets.size()) {
-                descriptor_sets.resize(sds.set + 1);
+        for (auto& sb : impl->library->reflection.bindings) {
+            if (sb.set >= descriptor_sets.size()) {
+                descriptor_sets.resize(sb.set + 1);
             }
 
-            for (auto& sb : std::span(sds.bindings, sds.binding_count)) {
-                vk::DescriptorSetLayoutBinding binding = {};
-                binding.setBinding(sb->binding);
-                binding.setDescriptorType(vk::DescriptorType(sb->descriptor_type));
-                binding.setDescriptorCount(sb->count);
-                binding.setStageFlags(vk::ShaderStageFlags(impl->entry_point->shader_stage));
-                binding.setPImmutableSamplers(nullptr);
-
-                descriptor_sets[sds.set].emplace(binding);
+            auto descriptor_type = sb.descriptorType;
+            if (descriptor_type == vk::DescriptorType::eUniformBuffer && (description->getDynamicUniformBufferSets() & (1U << sb.set)) != 0) {
+                descriptor_type = vk::DescriptorType::eUniformBufferDynamic;
             }
+
+            vk::DescriptorSetLayoutBinding binding = {};
+            binding.setBinding(sb.binding);
+            binding.setDescriptorType(descriptor_type);
+            binding.setDescriptorCount(sb.descriptorCount);
+            binding.setStageFlags(impl->stage);
+            binding.setPImmutableSamplers(nullptr);
+
+            descriptor_sets[sb.set].emplace(binding);
         }
     };
 
     func(&*description->getVertexFunction());
     func(&*description->getFragmentFunction());
 
+    // the spilled block moves to binding 0 of a set after every reflected one
+    uint32_t spill_set = static_cast<uint32_t>(descriptor_sets.size());
+    if (spill_stages) {
+        if (spill_size > self.limits.maxUniformBufferRange) {
+            throw std::runtime_error("Push constant block of " + std::to_string(spill_size) + " bytes exceeds maxUniformBufferRange");
+        }
+        // the rewritten block keeps the std430 strides of the push constants, which uniform blocks only allow with the feature
+        if (!self.uniformBufferStandardLayout) {
+            throw std::runtime_error("Push constant block of " + std::to_string(spill_size) + " bytes exceeds maxPushConstantsSize and spilling it requires uniformBufferStandardLayout");
+        }
+
+        vk::DescriptorSetLayoutBinding binding = {};
+        binding.setBinding(0);
+        binding.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic);
+        binding.setDescriptorCount(1);
+        binding.setStageFlags(spill_stages);
+        descriptor_sets.emplace_back().emplace(binding);
+    }
+
     auto state = rc<RenderPipelineState>(new RenderPipelineState(self.shared_from_this(), description));
-    vk::PipelineCacheCreateInfo pipeline_cache_info = {};
-    vk::resultCheck(self.handle.createPipelineCache(&pipeline_cache_info, nullptr, &state->pipelineCache, self.dispatcher), "Failed to create pipeline cache");
+    state->pushConstantSpillStages = spill_stages;
+    state->pushConstantSpillSet = spill_set;
+    state->pushConstantSpillSize = spill_size;
+
+    auto module = [&](gfx::Function* impl) {
+        if (impl->stage & spill_stages) {
+            return impl->library->_spilledModule(spill_set);
+        }
+        return impl->library->handle;
+    };
+    state->vertexModule = module(&*description->getVertexFunction());
+    state->fragmentModule = module(&*description->getFragmentFunction());
 
     state->descriptorSetLayouts.resize(descriptor_sets.size());
+    state->descriptorSetCounts.resize(descriptor_sets.size());
     for (uint32_t i = 0; i < state->descriptorSetLayouts.size(); ++i) {
-        vk::DescriptorSetLayoutCreateInfo layout_create_info = {};
-        layout_create_info.setBindings(descriptor_sets[i].bindings);
-        state->descriptorSetLayouts[i] = self.handle.createDescriptorSetLayout(layout_create_info, nullptr, self.dispatcher);
+        state->descriptorSetLayouts[i] = self._internDescriptorSetLayout(DescriptorSetLayoutKey{descriptor_sets[i].bindings});
+        state->descriptorSetCounts[i] = descriptor_sets[i].counts();
+
+        auto& bindings = descriptor_sets[i].bindings;
+        auto dynamic = (description->getDynamicUniformBufferSets() & (1U << i)) != 0 && !(spill_stages && i == spill_set);
+        if (dynamic && bindings.size() == 1 && bindings[0].binding == 0 && bindings[0].descriptorType == vk::DescriptorType::eUniformBufferDynamic && bindings[0].descriptorCount == 1) {
+            state->uniformBufferSets |= 1U << i;
+        }
     }
 
-    vk::PipelineLayoutCreateInfo pipeline_layout_create_info = {};
-    pipeline_layout_create_info.setSetLayouts(state->descriptorSetLayouts);
-    pipeline_layout_create_info.setPushConstantRanges(push_constant_ranges);
-    state->pipelineLayout = self.handle.createPipelineLayout(pipeline_layout_create_info, nullptr, self.dispatcher);
+    // pipelines with equal layouts can keep descriptor sets bound across a pipeline switch
+    state->pipelineLayout = self._internPipelineLayout(PipelineLayoutKey{state->descriptorSetLayouts, push_constant_ranges});
 
     return state;
 }
@@ -543,49 +1205,44 @@ auto gfx::Device::newComputePipelineState(this Device& self, rc<Function> const&
     std::vector<vk::PushConstantRange> push_constant_ranges = {};
     std::vector<DescriptorSetLayoutCreateInfo> descriptor_sets = {};
 
-    for (auto& pcb : std::span(function->library->spvReflectShaderModule.push_constant_blocks, function->library->spvReflectShaderModule.push_constant_block_count)) {
+    for (auto& pcb : function->library->reflection.pushConstantBlocks) {
         vk::PushConstantRange push_constant_range = {};
         push_constant_range.setSize(pcb.size);
         push_constant_range.setOffset(pcb.offset);
-        push_constant_range.setStageFlags(vk::ShaderStageFlags(function->entry_point->shader_stage));
+        push_constant_range.setStageFlags(function->stage);
         push_constant_ranges.emplace_back(push_constant_range);
     }
 
-    for (auto& sds : std::span(function->library->spvReflectShaderModule.descriptor_sets, function->library->spvReflectShaderModule.descriptor_set_count)) {
-        if (sds.set >= descriptor_sets.size()) {
-            descriptor_sets.resize(sds.set + 1);
+    for (auto& sb : function->library->reflection.bindings) {
+        if (sb.set >= descriptor_sets.size()) {
+            descriptor_sets.resize(sb.set + 1);
         }
 
-        for (auto& sb : std::span(sds.bindings, sds.binding_count)) {
-            vk::DescriptorSetLayoutBinding binding = {};
-            binding.setBinding(sb->binding);
-            binding.setDescriptorType(vk::DescriptorType(sb->descriptor_type));
-            binding.setDescriptorCount(sb->count);
-            binding.setStageFlags(vk::ShaderStageFlags(function->entry_point->shader_stage));
-            binding.setPImmutableSamplers(nullptr);
+        vk::DescriptorSetLayoutBinding binding = {};
+        binding.setBinding(sb.binding);
+        binding.setDescriptorType(sb.descriptorType);
+        binding.setDescriptorCount(sb.descriptorCount);
+        binding.setStageFlags(function->stage);
+        binding.setPImmutableSamplers(nullptr);
 
-            descriptor_sets[sds.set].emplace(binding);
-        }
+        descriptor_sets[sb.set].emplace(binding);
     }
 
     auto state = rc<ComputePipelineState>(new ComputePipelineState(self.shared_from_this()));
     state->descriptor_set_layouts.resize(descriptor_sets.size());
+    state->descriptor_set_counts.resize(descriptor_sets.size());
     for (uint32_t i = 0; i < descriptor_sets.size(); ++i) {
-        vk::DescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {};
-        descriptor_set_layout_create_info.setBindings(descriptor_sets[i].bindings);
-
-        state->descriptor_set_layouts[i] = self.handle.createDescriptorSetLayout(descriptor_set_layout_create_info, nullptr, self.dispatcher);
+        state->descriptor_set_layouts[i] = self._internDescriptorSetLayout(DescriptorSetLayoutKey{descriptor_sets[i].bindings});
+        state->descriptor_set_counts[i] = descriptor_sets[i].counts();
     }
 
-    vk::PipelineLayoutCreateInfo pipeline_layout_create_info = {};
-    pipeline_layout_create_info.setSetLayouts(state->descriptor_set_layouts);
-    pipeline_layout_create_info.setPushConstantRanges(push_constant_ranges);
-    state->pipeline_layout = self.handle.createPipelineLayout(pipeline_layout_create_info, nullptr, self.dispatcher);
+    state->pipeline_layout = self._internPipelineLayout(PipelineLayoutKey{state->descriptor_set_layouts, push_constant_ranges});
 
     vk::PipelineShaderStageCreateInfo shader_stage_create_info = {};
     shader_stage_create_info.setStage(vk::ShaderStageFlagBits::eCompute);
     shader_stage_create_info.setModule(function->library->handle);
     shader_stage_create_info.setPName(function->name.c_str());
+    shader_stage_create_info.setPSpecializationInfo(function->getSpecializationInfo());
 
     vk::ComputePipelineCreateInfo pipeline_create_info = {};
     pipeline_create_info.setStage(shader_stage_create_info);
@@ -593,19 +1250,38 @@ auto gfx::Device::newComputePipelineState(this Device& self, rc<Function> const&
     pipeline_create_info.setBasePipelineHandle(nullptr);
     pipeline_create_info.setBasePipelineIndex(0);
 
-    vk::resultCheck(self.handle.createComputePipelines({}, 1, &pipeline_create_info, nullptr, &state->pipeline, self.dispatcher), "Failed to create compute pipeline");
+    state->pipeline = self.createComputePipeline(pipeline_create_info);
     return state;
 }
 
 auto gfx::Device::newCommandQueue(this Device& self) -> rc<CommandQueue> {
+    // the first queue the device was created with does graphics, compute and present
+    auto queue_family_index = self.queueFamilyIndices.front();
+
     vk::CommandPoolCreateInfo create_info = {};
     create_info.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer);
-    create_info.setQueueFamilyIndex(0);
+    create_info.setQueueFamilyIndex(queue_family_index);
 
     vk::CommandPool command_pool = self.handle.createCommandPool(create_info, nullptr, self.dispatcher);
-    return rc<CommandQueue>(new CommandQueue(self.shared_from_this(), command_pool));
+    return rc<CommandQueue>(new CommandQueue(self.shared_from_this(), command_pool, queue_family_index));
+}
+
+auto gfx::Device::newUploadQueue(this Device& self, uint64_t stagingSize) -> rc<UploadQueue> {
+    return rc<UploadQueue>::init(self.shared_from_this(), stagingSize);
+}
+
+auto gfx::Device::newTransientAllocator(this Device& self, uint32_t frameCount) -> rc<TransientAllocator> {
+    return rc<TransientAllocator>::init(self.shared_from_this(), frameCount);
+}
+
+auto gfx::Device::newProfiler(this Device& self, ProfilerConfiguration const& config) -> rc<Profiler> {
+    return rc<Profiler>::init(self.shared_from_this(), config);
 }
 
 auto gfx::Device::createSwapchain(this Device& self, rc<Surface> const& surface) -> rc<Swapchain> {
     return rc<Swapchain>(new Swapchain(self.shared_from_this(), surface));
+}
+
+auto gfx::Device::createOffscreenSwapchain(this Device& self, vk::Extent2D extent) -> rc<Swapchain> {
+    return rc<Swapchain>(new Swapchain(self.shared_from_this(), extent));
 }
\ No newline at end of file
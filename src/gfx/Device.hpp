@@ -3,6 +3,13 @@
 #include "Instance.hpp"
 #include "ManagedObject.hpp"
 
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+
 #if defined(__clang__)
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wnullability-completeness"
@@ -16,18 +23,25 @@
 
 namespace gfx {
     struct Buffer;
+    struct Heap;
     struct Texture;
+    struct ThreadPool;
     struct Surface;
     struct Sampler;
     struct Library;
+    struct ShaderArchive;
     struct Function;
     struct Drawable;
     struct Swapchain;
+    struct Profiler;
+    struct UploadQueue;
+    struct TransientAllocator;
     struct CommandQueue;
     struct TextureDescription;
     struct DepthStencilState;
     struct RenderPipelineState;
     struct ComputePipelineState;
+    struct ProfilerConfiguration;
     struct DepthStencilStateDescription;
     struct RenderPipelineStateDescription;
 
@@ -38,25 +52,150 @@ namespace gfx {
         eLazy,
     };
 
+    enum class MemoryCategory {
+        eBuffer,
+        eStaging,   // host visible buffers that are only copied from
+        eTexture,
+        eHeap,      // placed textures are accounted to the heap they live in
+    };
+
+    struct MemoryHeapStatistics {
+        vk::MemoryHeapFlags         flags           = {};
+        vk::DeviceSize              budget          = {}; // how much the process can use before the driver starts to evict or fail
+        vk::DeviceSize              usage           = {}; // everything the process uses, allocations of other libraries included
+        vk::DeviceSize              blockBytes      = {}; // device memory allocated by the device allocator
+        vk::DeviceSize              allocationBytes = {}; // the part of the blocks handed out to resources
+    };
+
+    struct MemoryCategoryStatistics {
+        MemoryCategory              category        = {};
+        std::string                 label           = {}; // set with setLabel, empty for unnamed resources
+        uint64_t                    allocationCount = {};
+        vk::DeviceSize              bytes           = {};
+    };
+
+    struct MemoryStatistics {
+        std::vector<MemoryHeapStatistics>       heaps       = {};
+        std::vector<MemoryCategoryStatistics>   categories  = {}; // largest first
+        std::string                             json        = {}; // detailed map of the device allocator
+    };
+
+    struct MemoryAllocationRecord {
+        MemoryCategory              category        = {};
+        std::string                 label           = {};
+        vk::DeviceSize              size            = {};
+    };
+
+    struct PipelineCacheStatistics {
+        uint64_t                    hits            = {};
+        uint64_t                    misses          = {};
+        std::chrono::nanoseconds    compileTime     = {};
+        uint64_t                    variantsAvoided = {}; // rasterizer and depth stencil variants served by dynamic state, with pipelineVariantStatistics
+    };
+
+    // Pipeline state that is set while recording instead of being baked into every variant. Viewport,
+    // scissor, line width and depth bias factors are always dynamic, the rest depends on which of the
+    // extended dynamic state extensions and features the device was created with.
+    struct DynamicStateFeatures {
+        bool extendedDynamicState       = {}; // cull mode, front face, depth and stencil tests
+        bool extendedDynamicState2      = {}; // depth bias and rasterizer discard enables
+        bool depthClampEnable           = {};
+        bool polygonMode                = {};
+    };
+
+    // Keys of the layouts a Device interns, equal keys share a single layout.
+    struct DescriptorSetLayoutKey {
+        std::vector<vk::DescriptorSetLayoutBinding> bindings = {}; // sorted by binding
+
+        auto operator==(DescriptorSetLayoutKey const& other) const -> bool = default;
+    };
+
+    struct PipelineLayoutKey {
+        std::vector<vk::DescriptorSetLayout>    setLayouts          = {};
+        std::vector<vk::PushConstantRange>      pushConstantRanges  = {};
+
+        auto operator==(PipelineLayoutKey const& other) const -> bool = default;
+    };
+
+    struct DeviceObjectHash {
+        auto operator()(vk::SamplerCreateInfo const& info) const -> size_t;
+        auto operator()(DescriptorSetLayoutKey const& key) const -> size_t;
+        auto operator()(PipelineLayoutKey const& key) const -> size_t;
+    };
+
     struct Device : public ManagedObject {
-        rc<Adapter>                 adapter;
-        vk::Device                  handle;
-        vk::raii::DeviceDispatcher  dispatcher;
-        VmaAllocator                allocator;
+        rc<Adapter>                         adapter;
+        vk::Device                          handle;
+        vk::raii::DeviceDispatcher          dispatcher;
+        VmaAllocator                        allocator;
+        std::unordered_set<std::string>     enabledExtensions;
+        std::vector<uint32_t>               queueFamilyIndices;
+        std::mutex                          queueMutex;
+        vk::PipelineCache                   pipelineCache;
+        std::atomic_uint64_t                pipelineCacheHits;
+        std::atomic_uint64_t                pipelineCacheMisses;
+        std::atomic_uint64_t                pipelineCompileTime;
+        std::atomic_uint64_t                pipelineVariantsAvoided;
+        bool                                pipelineVariantStatistics; // count variantsAvoided, costs a locked lookup per dirty draw
+        DynamicStateFeatures                dynamicState;
+        bool                                graphicsPipelineLibrary; // pipelines are linked from separately compiled parts
+        bool                                uniformBufferStandardLayout; // uniform buffers may use the std430 layout of push constants
+        bool                                imageCubeArray; // cube array views may be created
+        bool                                inheritedQueries; // secondary command buffers may execute inside an active query
+        vk::PhysicalDeviceLimits            limits;
+        rc<ThreadPool>                      pipelineCompiler;
+        std::mutex                          allocationMutex;
+        std::unordered_map<VmaAllocation, MemoryAllocationRecord> allocations; // live allocations of buffers, textures and heaps
+
+        // immutable objects shared by everyone asking for an equal one, they live as long as the device
+        std::mutex                                                                              objectCacheMutex;
+        std::unordered_map<vk::SamplerCreateInfo, vk::Sampler, DeviceObjectHash>                samplerCache;
+        std::unordered_map<size_t, std::vector<rc<DepthStencilState>>>                          depthStencilStateCache;
+        std::unordered_map<DescriptorSetLayoutKey, vk::DescriptorSetLayout, DeviceObjectHash>   descriptorSetLayoutCache;
+        std::unordered_map<PipelineLayoutKey, vk::PipelineLayout, DeviceObjectHash>             pipelineLayoutCache;
 
         explicit Device(rc<Adapter> adapter, vk::DeviceCreateInfo const& create_info);
         ~Device() override;
 
         void waitIdle(this Device& self);
+        auto hasExtension(this Device const& self, std::string const& name) -> bool;
+        auto transferQueueFamilyIndex(this Device const& self) -> uint32_t;
+        auto uniformBufferOffsetAlignment(this Device const& self) -> vk::DeviceSize;
+        auto loadPipelineCache(this Device& self, std::filesystem::path const& path) -> bool;
+        void savePipelineCache(this Device& self, std::filesystem::path const& path);
+        auto pipelineCacheStatistics(this Device const& self) -> PipelineCacheStatistics;
+        auto memoryStatistics(this Device& self) -> MemoryStatistics;
+        // Warns about every allocation still alive, in debug builds only. The destructor reports what
+        // leaked; unlike the leak report that was asked for, it may also be called earlier to list
+        // what is alive at some point of the teardown.
+        void reportLiveAllocations(this Device& self);
+        void _trackAllocation(this Device& self, VmaAllocation allocation, MemoryCategory category);
+        void _untrackAllocation(this Device& self, VmaAllocation allocation);
+        void _labelAllocation(this Device& self, VmaAllocation allocation, std::string const& label);
+        auto createGraphicsPipeline(this Device& self, vk::GraphicsPipelineCreateInfo const& create_info) -> vk::Pipeline;
+        auto createComputePipeline(this Device& self, vk::ComputePipelineCreateInfo const& create_info) -> vk::Pipeline;
+        void _recordPipelineCompilation(this Device& self, vk::PipelineCreationFeedback const& feedback, std::chrono::steady_clock::duration elapsed);
         auto newTexture(this Device& self, const TextureDescription& description) -> rc<Texture>;
+        auto newTexture(this Device& self, const TextureDescription& description, rc<Heap> const& heap, vk::DeviceSize offset) -> rc<Texture>;
+        auto textureMemoryRequirements(this Device& self, const TextureDescription& description) -> vk::MemoryRequirements;
+        auto newHeap(this Device& self, vk::MemoryRequirements const& requirements) -> rc<Heap>;
+        auto _newTexture(this Device& self, const TextureDescription& description, vk::Image image, VmaAllocation allocation) -> rc<Texture>;
         auto newSampler(this Device& self, const vk::SamplerCreateInfo& info) -> rc<Sampler>;
+        auto _internSampler(this Device& self, vk::SamplerCreateInfo const& create_info) -> vk::Sampler;
+        auto _internDescriptorSetLayout(this Device& self, DescriptorSetLayoutKey key) -> vk::DescriptorSetLayout;
+        auto _internPipelineLayout(this Device& self, PipelineLayoutKey key) -> vk::PipelineLayout;
         auto newBuffer(this Device& self, vk::BufferUsageFlags usage, uint64_t size, StorageMode storage, VmaAllocationCreateFlags options = 0) -> rc<Buffer>;
         auto newBuffer(this Device& self, vk::BufferUsageFlags usage, const void* pointer, uint64_t size, StorageMode storage, VmaAllocationCreateFlags options = 0) -> rc<Buffer>;
         auto newLibrary(this Device& self, std::span<char const> bytes) -> rc<Library>;
+        auto newLibraryFromArchive(this Device& self, rc<ShaderArchive> const& archive, std::string_view name) -> rc<Library>;
         auto newDepthStencilState(this Device& self, DepthStencilStateDescription const& description) -> rc<DepthStencilState>;
         auto newRenderPipelineState(this Device& self, rc<RenderPipelineStateDescription> const& description) -> rc<RenderPipelineState>;
         auto newComputePipelineState(this Device& self, rc<Function> const& function) -> rc<ComputePipelineState>;
         auto newCommandQueue(this Device& self) -> rc<CommandQueue>;
+        auto newUploadQueue(this Device& self, uint64_t stagingSize = 32 * 1024 * 1024) -> rc<UploadQueue>;
+        auto newTransientAllocator(this Device& self, uint32_t frameCount) -> rc<TransientAllocator>;
+        auto newProfiler(this Device& self, ProfilerConfiguration const& config) -> rc<Profiler>;
         auto createSwapchain(this Device& self, rc<Surface> const& surface) -> rc<Swapchain>;
+        auto createOffscreenSwapchain(this Device& self, vk::Extent2D extent) -> rc<Swapchain>;
     };
 }
\ No newline at end of file
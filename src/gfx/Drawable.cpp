@@ -3,4 +3,9 @@
 gfx::Drawable::Drawable(vk::SwapchainKHR swapchain, rc<Texture> texture, uint32_t drawableIndex)
     : swapchain(swapchain)
     , texture(std::move(texture))
-    , drawableIndex(drawableIndex) {}
+    , drawableIndex(drawableIndex)
+    , acquireSemaphore() {}
+
+auto gfx::Drawable::presentLayout() const -> vk::ImageLayout {
+    return swapchain ? vk::ImageLayout::ePresentSrcKHR : vk::ImageLayout::eTransferSrcOptimal;
+}
@@ -7,7 +7,11 @@ namespace gfx {
         rc<Texture>      texture;
         uint32_t         drawableIndex;
         vk::SwapchainKHR swapchain;
+        vk::Semaphore    acquireSemaphore;  // signaled when the image is ready, until a command buffer waits on it
 
         explicit Drawable(vk::SwapchainKHR swapchain, rc<Texture> texture, uint32_t drawableIndex);
+
+        // the layout the image has to be in once the frame is done, offscreen drawables can not use ePresentSrcKHR without VK_KHR_swapchain
+        auto presentLayout() const -> vk::ImageLayout;
     };
 }
\ No newline at end of file
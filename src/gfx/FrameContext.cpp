@@ -0,0 +1,43 @@
+#include "FrameContext.hpp"
+#include "CommandQueue.hpp"
+#include "CommandBuffer.hpp"
+#include "TransientAllocator.hpp"
+
+#include <algorithm>
+
+gfx::FrameContext::FrameContext(rc<Device> device, rc<CommandBuffer> commandBuffer, rc<TransientAllocator> transientAllocator)
+: device(std::move(device))
+, commandBuffer(std::move(commandBuffer))
+, transientAllocator(std::move(transientAllocator)) {}
+
+void gfx::FrameContext::reset(this FrameContext& self) {
+    self.commandBuffer->waitUntilCompleted();
+}
+
+gfx::FrameContextRing::FrameContextRing(rc<CommandQueue> const& queue, uint32_t framesInFlight)
+: device(queue->device)
+, transientAllocator(queue->device->newTransientAllocator(std::max(framesInFlight, 1U)))
+, frameContexts()
+, frameIndex(0) {
+    frameContexts.reserve(std::max(framesInFlight, 1U));
+    for (uint32_t i = 0; i < std::max(framesInFlight, 1U); ++i) {
+        frameContexts.emplace_back(rc<FrameContext>::init(device, queue->newCommandBuffer(), transientAllocator));
+    }
+}
+
+auto gfx::FrameContextRing::nextFrameContext(this FrameContextRing& self) -> rc<FrameContext> {
+    auto frameContext = self.frameContexts[self.frameIndex % self.frameContexts.size()];
+    self.frameIndex += 1;
+
+    // only the frame being reused has to be finished, the others may still be in flight. The
+    // allocator cycles through as many partitions, so its next one was last used by that frame
+    frameContext->reset();
+    self.transientAllocator->nextFrame();
+    return frameContext;
+}
+
+void gfx::FrameContextRing::waitUntilCompleted(this FrameContextRing& self) {
+    for (auto& frameContext : self.frameContexts) {
+        frameContext->commandBuffer->waitUntilCompleted();
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Device.hpp"
+#include "ManagedObject.hpp"
+
+namespace gfx {
+    struct CommandQueue;
+    struct CommandBuffer;
+    struct TransientAllocator;
+
+    // Everything the CPU touches while recording a single frame. A frame context is reused only
+    // after the queue semaphore has reached the value of the submit of its command buffer.
+    struct FrameContext : public ManagedObject {
+        rc<Device>                      device;
+        rc<CommandBuffer>               commandBuffer;
+        rc<TransientAllocator>          transientAllocator; // shared by the ring, on the partition of this frame while it is recorded
+
+        explicit FrameContext(rc<Device> device, rc<CommandBuffer> commandBuffer, rc<TransientAllocator> transientAllocator);
+
+        void reset(this FrameContext& self);
+    };
+
+    struct FrameContextRing : public ManagedObject {
+        rc<Device>                      device;
+        rc<TransientAllocator>          transientAllocator;
+        std::vector<rc<FrameContext>>   frameContexts;
+        uint64_t                        frameIndex;
+
+        explicit FrameContextRing(rc<CommandQueue> const& queue, uint32_t framesInFlight);
+
+        auto nextFrameContext(this FrameContextRing& self) -> rc<FrameContext>;
+        void waitUntilCompleted(this FrameContextRing& self);
+    };
+}
@@ -1,6 +1,36 @@
 #include "Function.hpp"
 
-gfx::Function::Function(rc<Library> library, std::string name, SpvReflectEntryPoint* entry_point)
+#include <cstring>
+#include <algorithm>
+
+void gfx::FunctionConstantValues::setConstantValue(this FunctionConstantValues& self, uint32_t index, void const* value, size_t size) {
+    auto entry = std::ranges::find(self.entries, index, &vk::SpecializationMapEntry::constantID);
+    if (entry != self.entries.end() && entry->size == size) {
+        std::memcpy(self.data.data() + entry->offset, value, size);
+        return;
+    }
+
+    // a value of another size is appended, the old bytes are left unused
+    if (entry == self.entries.end()) {
+        entry = self.entries.emplace(self.entries.end(), vk::SpecializationMapEntry{.constantID = index});
+    }
+    entry->offset = static_cast<uint32_t>(self.data.size());
+    entry->size = size;
+    self.data.resize(self.data.size() + size);
+    std::memcpy(self.data.data() + entry->offset, value, size);
+}
+
+gfx::Function::Function(rc<Library> library, std::string name, vk::ShaderStageFlagBits stage, FunctionConstantValues constantValues)
     : library(std::move(library))
     , name(std::move(name))
-    , entry_point(entry_point) {}
\ No newline at end of file
+    , stage(stage)
+    , constantValues(std::move(constantValues))
+    , specializationInfo() {
+    specializationInfo.setMapEntries(this->constantValues.entries);
+    specializationInfo.setDataSize(this->constantValues.data.size());
+    specializationInfo.setPData(this->constantValues.data.data());
+}
+
+auto gfx::Function::getSpecializationInfo(this Function const& self) -> vk::SpecializationInfo const* {
+    return self.constantValues.entries.empty() ? nullptr : &self.specializationInfo;
+}
@@ -1,16 +1,43 @@
 #pragma once
 
 #include "Library.hpp"
-#include "spirv_reflect.h"
 
 #include <string>
+#include <vector>
+#include <cstddef>
+#include <type_traits>
 
 namespace gfx {
+    // Values for the specialization constants of a function, by constant_id. They are copied into the
+    // function when it is created, so one set of values can specialize several functions.
+    struct FunctionConstantValues {
+        std::vector<vk::SpecializationMapEntry> entries = {};
+        std::vector<std::byte>                  data    = {};
+
+        void setConstantValue(this FunctionConstantValues& self, uint32_t index, void const* value, size_t size);
+
+        template<typename T>
+        void setConstantValue(this FunctionConstantValues& self, uint32_t index, T value) {
+            static_assert(std::is_arithmetic_v<T>, "specialization constants are scalars");
+            if constexpr (std::is_same_v<T, bool>) {
+                // a bool constant is a 32-bit VkBool32 in SPIR-V
+                auto boolean = static_cast<vk::Bool32>(value ? VK_TRUE : VK_FALSE);
+                self.setConstantValue(index, &boolean, sizeof(boolean));
+            } else {
+                self.setConstantValue(index, &value, sizeof(T));
+            }
+        }
+    };
+
     struct Function final : public ManagedObject {
-        rc<Library>  library;
+        rc<Library>             library;
         std::string             name;
-        SpvReflectEntryPoint*   entry_point;
+        vk::ShaderStageFlagBits stage;
+        FunctionConstantValues  constantValues;
+        vk::SpecializationInfo  specializationInfo; // points into constantValues
+
+        explicit Function(rc<Library> library, std::string name, vk::ShaderStageFlagBits stage, FunctionConstantValues constantValues);
 
-        explicit Function(rc<Library> library, std::string name, SpvReflectEntryPoint* entry_point);
+        auto getSpecializationInfo(this Function const& self) -> vk::SpecializationInfo const*;
     };
-}
\ No newline at end of file
+}
@@ -3,6 +3,7 @@
 #include "Instance.hpp"
 #include "Adapter.hpp"
 #include "Surface.hpp"
+#include "Heap.hpp"
 #include "Buffer.hpp"
 #include "Device.hpp"
 #include "Object.hpp"
@@ -11,8 +12,20 @@
 #include "Sampler.hpp"
 #include "Drawable.hpp"
 #include "Function.hpp"
+#include "Profiler.hpp"
 #include "Swapchain.hpp"
+#include "ThreadPool.hpp"
+#include "StagingRing.hpp"
+#include "RenderGraph.hpp"
+#include "UploadQueue.hpp"
+#include "UniformRing.hpp"
+#include "FrameContext.hpp"
 #include "CommandQueue.hpp"
+#include "ShaderArchive.hpp"
 #include "CommandBuffer.hpp"
+#include "PipelineStateKey.hpp"
+#include "TransientAllocator.hpp"
+#include "ShaderReflection.hpp"
+#include "DescriptorAllocator.hpp"
 #include "RenderPipelineState.hpp"
 #include "ComputePipelineState.hpp"
\ No newline at end of file
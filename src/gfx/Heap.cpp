@@ -0,0 +1,11 @@
+#include "Heap.hpp"
+
+gfx::Heap::Heap(rc<Device> device, VmaAllocation allocation, vk::DeviceSize size)
+: device(std::move(device))
+, allocation(allocation)
+, size(size) {}
+
+gfx::Heap::~Heap() {
+    device->_untrackAllocation(allocation);
+    vmaFreeMemory(device->allocator, allocation);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Device.hpp"
+#include "ManagedObject.hpp"
+
+namespace gfx {
+    // A block of device memory that textures are placed into at explicit offsets, textures whose
+    // lifetimes do not overlap may share the same range.
+    struct Heap : public ManagedObject {
+        rc<Device>      device;
+        VmaAllocation   allocation;
+        vk::DeviceSize  size;
+
+        explicit Heap(rc<Device> device, VmaAllocation allocation, vk::DeviceSize size);
+        ~Heap() override;
+    };
+}
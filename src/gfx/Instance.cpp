@@ -7,6 +7,8 @@
 
 #include "spdlog/spdlog.h"
 
+#include <algorithm>
+
 static VKAPI_ATTR auto VKAPI_CALL debug_utils_messenger_callback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData, void *pUserData) -> VkBool32 {
     if (messageSeverity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT) {
         spdlog::debug("{}", pCallbackData->pMessage);
@@ -47,12 +49,28 @@ auto gfx::createInstance(InstanceConfiguration const& desc) -> rc<Instance> {
     };
 
     auto extensions = std::vector<const char*> {
-        "VK_KHR_surface",
         "VK_EXT_debug_utils",
-        "VK_MVK_macos_surface",
         "VK_KHR_portability_enumeration",
         "VK_KHR_get_physical_device_properties2"
     };
+    if (!desc.headless) {
+        extensions.emplace_back("VK_KHR_surface");
+        extensions.emplace_back("VK_MVK_macos_surface");
+    }
+
+    // drop what the loader does not know about, so that the same binary runs on drivers without a window system
+    auto available_layers = vk::enumerateInstanceLayerProperties(context->dispatcher);
+    std::erase_if(layers, [&](const char* layer) {
+        return std::ranges::none_of(available_layers, [layer](vk::LayerProperties const& properties) {
+            return std::string_view(properties.layerName.data()) == layer;
+        });
+    });
+    auto available_extensions = vk::enumerateInstanceExtensionProperties(nullptr, context->dispatcher);
+    std::erase_if(extensions, [&](const char* extension) {
+        return std::ranges::none_of(available_extensions, [extension](vk::ExtensionProperties const& properties) {
+            return std::string_view(properties.extensionName.data()) == extension;
+        });
+    });
 
     auto create_info = vk::InstanceCreateInfo()
         .setFlags(vk::InstanceCreateFlagBits::eEnumeratePortabilityKHR)
@@ -13,8 +13,9 @@ namespace gfx {
     struct Adapter;
 
     struct InstanceConfiguration {
-        std::string name    = {};
-        uint32_t    version = 0;
+        std::string name     = {};
+        uint32_t    version  = 0;
+        bool        headless = false;
     };
 
     struct Context : public ManagedObject {
@@ -2,21 +2,119 @@
 #include "Library.hpp"
 #include "Function.hpp"
 
-gfx::Library::Library(rc<Device> device, vk::ShaderModuleCreateInfo const& create_info) : device(std::move(device)) {
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+// Turns the push constant block of a SPIR-V module into a uniform block at (set, binding). Pointer
+// types and variables in the PushConstant storage class move to Uniform; the block keeps its Block
+// decoration and explicit offsets, so the bytes written by the application do not change.
+static auto spillPushConstants(std::span<uint32_t const> code, uint32_t set, uint32_t binding) -> std::vector<uint32_t> {
+    constexpr uint32_t kHeaderSize = 5;
+    constexpr uint32_t kOpTypePointer = 32;
+    constexpr uint32_t kOpVariable = 59;
+    constexpr uint32_t kOpDecorate = 71;
+    constexpr uint32_t kOpMemberDecorate = 72;
+    constexpr uint32_t kStorageClassUniform = 2;
+    constexpr uint32_t kStorageClassPushConstant = 9;
+    constexpr uint32_t kDecorationBinding = 33;
+    constexpr uint32_t kDecorationDescriptorSet = 34;
+
+    if (code.size() < kHeaderSize) {
+        throw std::runtime_error("Invalid SPIR-V module");
+    }
+
+    std::vector<uint32_t> result(code.begin(), code.end());
+    std::vector<uint32_t> variables = {};
+    size_t annotations = 0;
+    for (size_t i = kHeaderSize; i < result.size();) {
+        auto count = result[i] >> 16;
+        auto opcode = result[i] & 0xFFFF;
+        if (count == 0 || i + count > result.size()) {
+            throw std::runtime_error("Invalid SPIR-V module");
+        }
+        if ((opcode == kOpDecorate || opcode == kOpMemberDecorate) && annotations == 0) {
+            annotations = i;
+        }
+        if (opcode == kOpTypePointer && result[i + 2] == kStorageClassPushConstant) {
+            result[i + 2] = kStorageClassUniform;
+        }
+        if (opcode == kOpVariable && result[i + 3] == kStorageClassPushConstant) {
+            result[i + 3] = kStorageClassUniform;
+            variables.emplace_back(result[i + 2]);
+        }
+        i += count;
+    }
+    if (annotations == 0) {
+        throw std::runtime_error("Invalid SPIR-V module");
+    }
+
+    // any position in the annotation section is valid, the front is simplest
+    std::vector<uint32_t> decorations = {};
+    for (auto variable : variables) {
+        decorations.insert(decorations.end(), {4 << 16 | kOpDecorate, variable, kDecorationDescriptorSet, set});
+        decorations.insert(decorations.end(), {4 << 16 | kOpDecorate, variable, kDecorationBinding, binding});
+    }
+    result.insert(result.begin() + static_cast<ptrdiff_t>(annotations), decorations.begin(), decorations.end());
+    return result;
+}
+
+gfx::Library::Library(rc<Device> device, vk::ShaderModuleCreateInfo const& create_info, ShaderReflection reflection)
+: device(std::move(device))
+, reflection(std::move(reflection))
+, code()
+, spillMutex()
+, spilledModules() {
     this->handle = this->device->handle.createShaderModule(create_info, VK_NULL_HANDLE, this->device->dispatcher);
-    spvReflectCreateShaderModule(create_info.codeSize, create_info.pCode, &this->spvReflectShaderModule);
+    if (this->reflection.pushConstantSize() > this->device->limits.maxPushConstantsSize) {
+        code.assign(create_info.pCode, create_info.pCode + create_info.codeSize / sizeof(uint32_t));
+    }
 }
 
 gfx::Library::~Library() {
+    for (auto& [_, module] : spilledModules) {
+        device->handle.destroyShaderModule(module, nullptr, device->dispatcher);
+    }
     device->handle.destroyShaderModule(handle, nullptr, device->dispatcher);
-    spvReflectDestroyShaderModule(&spvReflectShaderModule);
 }
 
 auto gfx::Library::newFunction(this Library& self, std::string name) -> rc<Function> {
-    for (auto& sep : std::span(self.spvReflectShaderModule.entry_points, self.spvReflectShaderModule.entry_point_count)) {
-        if (name == sep.name) {
-            return rc<Function>(new Function(self.shared_from_this(), std::move(name), &sep));
-        }
+    return self.newFunction(std::move(name), FunctionConstantValues{});
+}
+
+auto gfx::Library::newFunction(this Library& self, std::string name, FunctionConstantValues const& constantValues) -> rc<Function> {
+    if (auto entry_point = self.reflection.findEntryPoint(name)) {
+        return rc<Function>(new Function(self.shared_from_this(), std::move(name), entry_point->stage, constantValues));
     }
     return {};
 }
+
+auto gfx::Library::_spilledModule(this Library& self, uint32_t set) -> vk::ShaderModule {
+    std::lock_guard lock(self.spillMutex);
+    auto it = std::ranges::find(self.spilledModules, set, &std::pair<uint32_t, vk::ShaderModule>::first);
+    if (it != self.spilledModules.end()) {
+        return it->second;
+    }
+
+    auto code = spillPushConstants(self.code, set, 0);
+
+    // the pipeline layout was built from the reflection of the original module, the rewrite has to
+    // keep its bindings and only turn the push constants into a uniform buffer at binding 0 of the set
+    auto expected = self.reflection.bindings;
+    expected.emplace_back(ShaderBinding{.set = set, .binding = 0, .descriptorType = vk::DescriptorType::eUniformBuffer, .descriptorCount = 1});
+    auto spilled = ShaderReflection::reflect(code);
+    auto matches = spilled.pushConstantBlocks.empty() && spilled.bindings.size() == expected.size() && std::ranges::all_of(spilled.bindings, [&expected](ShaderBinding const& binding) {
+        return std::ranges::any_of(expected, [&binding](ShaderBinding const& other) {
+            return binding.set == other.set && binding.binding == other.binding && binding.descriptorType == other.descriptorType && binding.descriptorCount == other.descriptorCount;
+        });
+    });
+    if (!matches) {
+        throw std::runtime_error("Spilling push constants to set " + std::to_string(set) + " changed the interface of the shader module");
+    }
+
+    vk::ShaderModuleCreateInfo create_info = {};
+    create_info.setCode(code);
+    auto module = self.device->handle.createShaderModule(create_info, VK_NULL_HANDLE, self.device->dispatcher);
+    self.spilledModules.emplace_back(set, module);
+    return module;
+}
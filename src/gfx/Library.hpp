@@ -1,21 +1,32 @@
 #pragma once
 
 #include "Device.hpp"
+#include "ShaderReflection.hpp"
 
-#include <spirv_reflect.h>
+#include <mutex>
 
 namespace gfx {
     struct Device;
     struct Function;
+    struct FunctionConstantValues;
 
     struct Library : public ManagedObject {
         rc<Device> device;
         vk::ShaderModule handle;
-        SpvReflectShaderModule spvReflectShaderModule;
+        ShaderReflection reflection;
 
-        explicit Library(rc<Device> device, vk::ShaderModuleCreateInfo const& create_info);
+        // push constants that do not fit the device limit are rewritten into a uniform buffer, the
+        // code is kept for that and the rewritten modules are shared by every pipeline using one set
+        std::vector<uint32_t> code;
+        std::mutex spillMutex;
+        std::vector<std::pair<uint32_t, vk::ShaderModule>> spilledModules;
+
+        explicit Library(rc<Device> device, vk::ShaderModuleCreateInfo const& create_info, ShaderReflection reflection);
         ~Library() override;
 
         auto newFunction(this Library& self, std::string name) -> rc<Function>;
+        auto newFunction(this Library& self, std::string name, FunctionConstantValues const& constantValues) -> rc<Function>;
+
+        auto _spilledModule(this Library& self, uint32_t set) -> vk::ShaderModule;
     };
-}
\ No newline at end of file
+}
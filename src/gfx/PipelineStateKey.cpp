@@ -0,0 +1,99 @@
+#include "PipelineStateKey.hpp"
+
+#include <bit>
+#include <utility>
+#include <algorithm>
+
+// every bit of the key affects every bit of the hash, the low bits pick the slot
+static auto mix(uint64_t value) -> uint64_t {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+auto gfx::PipelineStateKey::hash() const -> uint64_t {
+    auto seed = mix(words[0]);
+    seed = mix(seed ^ words[1]);
+    seed = mix(seed ^ words[2]);
+    return seed;
+}
+
+auto gfx::PipelineMap::find(this PipelineMap& self, PipelineStateKey const& key) -> vk::Pipeline* {
+    auto slot = self._findSlot(key);
+    return slot != nullptr ? &slot->pipeline : nullptr;
+}
+
+auto gfx::PipelineMap::emplace(this PipelineMap& self, PipelineStateKey const& key, vk::Pipeline pipeline) -> std::pair<vk::Pipeline*, bool> {
+    if (auto found = self.find(key)) {
+        return {found, false};
+    }
+
+    // at most 3/4 of the slots are in use, so probing always reaches an empty slot
+    if ((self.used + 1) * 4 > self.slots.size() * 3) {
+        self._rehash(std::max(size_t(16), std::bit_ceil((self.count + 1) * 2)));
+    }
+
+    auto mask = self.slots.size() - 1;
+    for (auto index = key.hash() & mask;; index = (index + 1) & mask) {
+        auto& slot = self.slots[index];
+        if (slot.state == SlotState::eOccupied) {
+            continue;
+        }
+        if (slot.state == SlotState::eEmpty) {
+            self.used += 1;
+        }
+        slot.key = key;
+        slot.pipeline = pipeline;
+        slot.state = SlotState::eOccupied;
+        self.count += 1;
+        return {&slot.pipeline, true};
+    }
+}
+
+auto gfx::PipelineMap::erase(this PipelineMap& self, PipelineStateKey const& key) -> bool {
+    auto slot = self._findSlot(key);
+    if (slot == nullptr) {
+        return false;
+    }
+
+    slot->state = SlotState::eRemoved;
+    slot->pipeline = VK_NULL_HANDLE;
+    self.count -= 1;
+    return true;
+}
+
+auto gfx::PipelineMap::size(this PipelineMap const& self) -> size_t {
+    return self.count;
+}
+
+auto gfx::PipelineMap::_findSlot(this PipelineMap& self, PipelineStateKey const& key) -> Slot* {
+    if (self.slots.empty()) {
+        return nullptr;
+    }
+
+    auto mask = self.slots.size() - 1;
+    for (auto index = key.hash() & mask;; index = (index + 1) & mask) {
+        auto& slot = self.slots[index];
+        if (slot.state == SlotState::eEmpty) {
+            return nullptr;
+        }
+        if (slot.state == SlotState::eOccupied && slot.key == key) {
+            return &slot;
+        }
+    }
+}
+
+void gfx::PipelineMap::_rehash(this PipelineMap& self, size_t capacity) {
+    auto slots = std::exchange(self.slots, std::vector<Slot>(capacity));
+    self.count = 0;
+    self.used = 0;
+
+    for (auto& slot : slots) {
+        if (slot.state == SlotState::eOccupied) {
+            self.emplace(slot.key, slot.pipeline);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace gfx {
+    // The rasterizer and depth stencil state of a pipeline variant packed into three words. Floats are
+    // stored by their bits and the depth stencil state by an id that is never reused, so two keys are
+    // equal exactly when the variants they describe are.
+    struct PipelineStateKey {
+        std::array<uint64_t, 3> words = {};
+
+        auto operator==(PipelineStateKey const& other) const -> bool = default;
+        auto hash() const -> uint64_t;
+    };
+
+    // Open addressing with linear probing, keys and values inline in a single array. Lookups are a
+    // hash and usually a single comparison; removed entries leave tombstones until the next rehash.
+    struct PipelineMap {
+        enum class SlotState : uint8_t {
+            eEmpty,
+            eOccupied,
+            eRemoved
+        };
+
+        struct Slot {
+            PipelineStateKey    key         = {};
+            vk::Pipeline        pipeline    = {};
+            SlotState           state       = SlotState::eEmpty;
+        };
+
+        std::vector<Slot>   slots   = {};
+        size_t              count   = {};
+        size_t              used    = {}; // occupied and removed slots, what decides when to grow
+
+        auto find(this PipelineMap& self, PipelineStateKey const& key) -> vk::Pipeline*;
+        auto emplace(this PipelineMap& self, PipelineStateKey const& key, vk::Pipeline pipeline) -> std::pair<vk::Pipeline*, bool>;
+        auto erase(this PipelineMap& self, PipelineStateKey const& key) -> bool;
+        auto size(this PipelineMap const& self) -> size_t;
+
+        template<typename Fn>
+        void forEach(this PipelineMap const& self, Fn&& fn) {
+            for (auto& slot : self.slots) {
+                if (slot.state == SlotState::eOccupied) {
+                    fn(slot.key, slot.pipeline);
+                }
+            }
+        }
+
+        auto _findSlot(this PipelineMap& self, PipelineStateKey const& key) -> Slot*;
+        void _rehash(this PipelineMap& self, size_t capacity);
+    };
+}
@@ -0,0 +1,240 @@
+#include "Adapter.hpp"
+#include "Profiler.hpp"
+
+#include "spdlog/spdlog.h"
+
+#include <fstream>
+
+gfx::QueryRecorder::QueryRecorder(rc<Device> device, rc<Profiler> profiler)
+: device(std::move(device))
+, profiler(std::move(profiler))
+, timestampPool()
+, statisticsPool()
+, scopes()
+, stack()
+, timestampCount(0)
+, statisticsCount(0)
+, submission(0)
+, statisticsActive(false)
+, pending(false) {
+    auto& config = this->profiler->config;
+
+    vk::QueryPoolCreateInfo timestamp_create_info = {};
+    timestamp_create_info.setQueryType(vk::QueryType::eTimestamp);
+    timestamp_create_info.setQueryCount(config.maxScopes * 2);
+    vk::resultCheck(this->device->handle.createQueryPool(&timestamp_create_info, nullptr, &timestampPool, this->device->dispatcher), "Failed to create query pool");
+
+    if (config.pipelineStatistics) {
+        vk::QueryPoolCreateInfo statistics_create_info = {};
+        statistics_create_info.setQueryType(vk::QueryType::ePipelineStatistics);
+        statistics_create_info.setQueryCount(config.maxScopes);
+        statistics_create_info.setPipelineStatistics(profilerPipelineStatisticFlags());
+        vk::resultCheck(this->device->handle.createQueryPool(&statistics_create_info, nullptr, &statisticsPool, this->device->dispatcher), "Failed to create query pool");
+    }
+}
+
+gfx::QueryRecorder::~QueryRecorder() {
+    device->handle.destroyQueryPool(timestampPool, nullptr, device->dispatcher);
+    device->handle.destroyQueryPool(statisticsPool, nullptr, device->dispatcher);
+}
+
+void gfx::QueryRecorder::begin(this QueryRecorder& self, vk::CommandBuffer commandBuffer) {
+    // results of the previous submission are lost if nobody waited for it
+    self.resolve();
+
+    self.scopes.clear();
+    self.stack.clear();
+    self.timestampCount = 0;
+    self.statisticsCount = 0;
+    self.statisticsActive = false;
+    self.submission = self.profiler->submissions.fetch_add(1);
+
+    commandBuffer.resetQueryPool(self.timestampPool, 0, self.profiler->config.maxScopes * 2, self.device->dispatcher);
+    if (self.statisticsPool) {
+        commandBuffer.resetQueryPool(self.statisticsPool, 0, self.profiler->config.maxScopes, self.device->dispatcher);
+    }
+}
+
+void gfx::QueryRecorder::pushScope(this QueryRecorder& self, vk::CommandBuffer commandBuffer, std::string const& name) {
+    ProfileScope scope = {};
+    scope.name = name;
+    scope.depth = static_cast<uint32_t>(self.stack.size());
+
+    if (self.timestampCount + 2 <= self.profiler->config.maxScopes * 2) {
+        scope.timed = true;
+        scope.query = self.timestampCount;
+        self.timestampCount += 2;
+
+        commandBuffer.writeTimestamp2(vk::PipelineStageFlagBits2::eTopOfPipe, self.timestampPool, scope.query, self.device->dispatcher);
+    }
+
+    // only one statistics query may be active at a time, nested scopes are covered by the outermost one
+    if (scope.timed && self.statisticsPool && !self.statisticsActive) {
+        scope.hasStatistics = true;
+        scope.statisticsQuery = self.statisticsCount;
+        self.statisticsCount += 1;
+        self.statisticsActive = true;
+
+        commandBuffer.beginQuery(self.statisticsPool, scope.statisticsQuery, {}, self.device->dispatcher);
+    }
+
+    self.stack.emplace_back(static_cast<uint32_t>(self.scopes.size()));
+    self.scopes.emplace_back(std::move(scope));
+}
+
+void gfx::QueryRecorder::popScope(this QueryRecorder& self, vk::CommandBuffer commandBuffer) {
+    if (self.stack.empty()) {
+        throw std::runtime_error("popScope without a matching pushScope");
+    }
+
+    auto& scope = self.scopes[self.stack.back()];
+    self.stack.pop_back();
+
+    if (scope.hasStatistics) {
+        commandBuffer.endQuery(self.statisticsPool, scope.statisticsQuery, self.device->dispatcher);
+        self.statisticsActive = false;
+    }
+    if (scope.timed) {
+        commandBuffer.writeTimestamp2(vk::PipelineStageFlagBits2::eBottomOfPipe, self.timestampPool, scope.query + 1, self.device->dispatcher);
+    }
+    scope.closed = true;
+    self.pending = true;
+}
+
+void gfx::QueryRecorder::end(this QueryRecorder& self, vk::CommandBuffer commandBuffer) {
+    // a scope left open would leave its end timestamp unwritten and make the whole pool unreadable
+    if (!self.stack.empty()) {
+        spdlog::warn("{} profiler scopes are still open at the end of the command buffer", self.stack.size());
+    }
+    while (!self.stack.empty()) {
+        self.popScope(commandBuffer);
+    }
+}
+
+void gfx::QueryRecorder::resolve(this QueryRecorder& self) {
+    if (!self.pending) {
+        return;
+    }
+    self.pending = false;
+
+    std::vector<uint64_t> timestamps(self.timestampCount);
+    if (!timestamps.empty()) {
+        // no wait flag, results that are not available yet are dropped instead of stalling the caller
+        auto result = self.device->handle.getQueryPoolResults(self.timestampPool, 0, self.timestampCount, timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), vk::QueryResultFlagBits::e64, self.device->dispatcher);
+        if (result != vk::Result::eSuccess) {
+            spdlog::warn("Timestamp queries of submission {} are not available yet, dropping them", self.submission);
+            return;
+        }
+    }
+
+    std::vector<PipelineStatistics> statistics(self.statisticsCount);
+    if (!statistics.empty()) {
+        auto result = self.device->handle.getQueryPoolResults(self.statisticsPool, 0, self.statisticsCount, statistics.size() * sizeof(PipelineStatistics), statistics.data(), sizeof(PipelineStatistics), vk::QueryResultFlagBits::e64, self.device->dispatcher);
+        if (result != vk::Result::eSuccess) {
+            statistics.clear();
+        }
+    }
+
+    self.profiler->_append(timestamps, statistics, self.scopes, self.submission);
+}
+
+gfx::Profiler::Profiler(rc<Device> device, ProfilerConfiguration const& config)
+: device(std::move(device))
+, config(config)
+, timestampPeriod()
+, timestampMask(~uint64_t(0))
+, origin()
+, submissions(0)
+, mutex()
+, samples() {
+    auto& instance = this->device->adapter->instance;
+    auto properties = this->device->adapter->handle.getProperties(instance->dispatcher);
+    timestampPeriod = static_cast<double>(properties.limits.timestampPeriod);
+}
+
+// timestamps are written on the queue the profiler is attached to, their width depends on its family
+void gfx::Profiler::_attach(this Profiler& self, uint32_t queueFamilyIndex) {
+    auto& instance = self.device->adapter->instance;
+    auto queue_families = self.device->adapter->handle.getQueueFamilyProperties(instance->dispatcher);
+
+    auto valid_bits = queue_families.at(queueFamilyIndex).timestampValidBits;
+    if (valid_bits == 0) {
+        throw std::runtime_error("Timestamp queries are not supported by the queue family " + std::to_string(queueFamilyIndex));
+    }
+    self.timestampMask = valid_bits == 64 ? ~uint64_t(0) : (uint64_t(1) << valid_bits) - 1;
+}
+
+auto gfx::Profiler::newQueryRecorder(this Profiler& self) -> rc<QueryRecorder> {
+    return rc<QueryRecorder>::init(self.device, self.shared_from_this());
+}
+
+auto gfx::Profiler::copySamples(this Profiler& self) -> std::vector<ProfileSample> {
+    std::lock_guard lock(self.mutex);
+    return {self.samples.begin(), self.samples.end()};
+}
+
+void gfx::Profiler::writeChromeTrace(this Profiler& self, std::filesystem::path const& path) {
+    auto samples = self.copySamples();
+
+    // complete events on a single track nest by time, which is how the trace viewers draw the scope stack
+    std::string json = "{\"traceEvents\": [\n";
+    for (size_t i = 0; i < samples.size(); ++i) {
+        auto& sample = samples[i];
+
+        std::string args = fmt::format(R"("submission": {}, "depth": {})", sample.submission, sample.depth);
+        if (sample.statistics) {
+            for (size_t j = 0; j < kProfilerPipelineStatistics.size(); ++j) {
+                args += fmt::format(R"(, "{}": {})", vk::to_string(kProfilerPipelineStatistics[j]), (*sample.statistics)[j]);
+            }
+        }
+
+        std::string name = {};
+        for (auto c : sample.name) {
+            if (c == '"' || c == '\\') {
+                name += '\\';
+            }
+            name += c;
+        }
+
+        json += fmt::format(R"(  {{"name": "{}", "cat": "gpu", "ph": "X", "pid": 0, "tid": 0, "ts": {:.3f}, "dur": {:.3f}, "args": {{{}}}}}{})", name, sample.begin * 1000.0, sample.duration * 1000.0, args, i + 1 == samples.size() ? "\n" : ",\n");
+    }
+    json += "], \"displayTimeUnit\": \"ms\"}\n";
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Failed to open " + path.string());
+    }
+    file.write(json.data(), static_cast<std::streamsize>(json.size()));
+}
+
+void gfx::Profiler::_append(this Profiler& self, std::span<uint64_t const> timestamps, std::span<PipelineStatistics const> statistics, std::span<ProfileScope const> scopes, uint64_t submission) {
+    std::lock_guard lock(self.mutex);
+
+    for (auto& scope : scopes) {
+        if (!scope.timed || !scope.closed) {
+            continue;
+        }
+
+        auto begin = timestamps[scope.query] & self.timestampMask;
+        auto end = timestamps[scope.query + 1] & self.timestampMask;
+        if (!self.origin) {
+            self.origin = begin;
+        }
+
+        ProfileSample sample = {};
+        sample.name = scope.name;
+        sample.depth = scope.depth;
+        sample.submission = submission;
+        sample.begin = static_cast<double>(static_cast<int64_t>(begin - *self.origin)) * self.timestampPeriod / 1'000'000.0;
+        // the counter may have wrapped between the two timestamps
+        sample.duration = static_cast<double>((end - begin) & self.timestampMask) * self.timestampPeriod / 1'000'000.0;
+        if (scope.hasStatistics && scope.statisticsQuery < statistics.size()) {
+            sample.statistics = statistics[scope.statisticsQuery];
+        }
+        self.samples.emplace_back(std::move(sample));
+    }
+
+    while (self.samples.size() > self.config.maxSamples) {
+        self.samples.pop_front();
+    }
+}
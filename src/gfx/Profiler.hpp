@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Device.hpp"
+#include "ManagedObject.hpp"
+
+#include <span>
+#include <array>
+#include <deque>
+#include <atomic>
+#include <optional>
+
+namespace gfx {
+    struct Profiler;
+
+    // The statistics gathered for each scope, in the order they are reported.
+    inline constexpr std::array kProfilerPipelineStatistics = {
+        vk::QueryPipelineStatisticFlagBits::eInputAssemblyVertices,
+        vk::QueryPipelineStatisticFlagBits::eInputAssemblyPrimitives,
+        vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations,
+        vk::QueryPipelineStatisticFlagBits::eClippingInvocations,
+        vk::QueryPipelineStatisticFlagBits::eClippingPrimitives,
+        vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations,
+        vk::QueryPipelineStatisticFlagBits::eComputeShaderInvocations,
+    };
+
+    using PipelineStatistics = std::array<uint64_t, kProfilerPipelineStatistics.size()>;
+
+    inline auto profilerPipelineStatisticFlags() -> vk::QueryPipelineStatisticFlags {
+        vk::QueryPipelineStatisticFlags flags = {};
+        for (auto statistic : kProfilerPipelineStatistics) {
+            flags |= statistic;
+        }
+        return flags;
+    }
+
+    struct ProfilerConfiguration {
+        uint32_t    maxScopes           = 256;          // per command buffer, deeper or later scopes are not timed
+        bool        pipelineStatistics  = false;        // requires the pipelineStatisticsQuery feature, and inheritedQueries around parallel render encoders
+        size_t      maxSamples          = 64 * 1024;    // history kept for export, the oldest samples are dropped first
+    };
+
+    struct ProfileSample {
+        std::string                         name        = {};
+        uint32_t                            depth       = {};
+        uint64_t                            submission  = {};
+        double                              begin       = {}; // milliseconds since the first timestamp the profiler has seen
+        double                              duration    = {}; // milliseconds
+        std::optional<PipelineStatistics>   statistics  = {};
+    };
+
+    struct ProfileScope {
+        std::string name            = {};
+        uint32_t    depth           = {};
+        uint32_t    query           = {};
+        uint32_t    statisticsQuery = {};
+        bool        timed           = {};
+        bool        closed          = {};
+        bool        hasStatistics   = {};
+    };
+
+    // Query pools of a single command buffer. Scopes are written while recording and read back once
+    // the command buffer has been waited on, so reading never stalls the GPU.
+    struct QueryRecorder : public ManagedObject {
+        rc<Device>                  device;
+        rc<Profiler>                profiler;
+        vk::QueryPool               timestampPool;
+        vk::QueryPool               statisticsPool;
+        std::vector<ProfileScope>   scopes;
+        std::vector<uint32_t>       stack;
+        uint32_t                    timestampCount;
+        uint32_t                    statisticsCount;
+        uint64_t                    submission;
+        bool                        statisticsActive;
+        bool                        pending;
+
+        explicit QueryRecorder(rc<Device> device, rc<Profiler> profiler);
+        ~QueryRecorder() override;
+
+        void begin(this QueryRecorder& self, vk::CommandBuffer commandBuffer);
+        void pushScope(this QueryRecorder& self, vk::CommandBuffer commandBuffer, std::string const& name);
+        void popScope(this QueryRecorder& self, vk::CommandBuffer commandBuffer);
+        void end(this QueryRecorder& self, vk::CommandBuffer commandBuffer);
+        void resolve(this QueryRecorder& self);
+    };
+
+    // Collects the resolved scopes of every command buffer recorded while it is attached to a command queue.
+    struct Profiler : public ManagedObject {
+        rc<Device>                  device;
+        ProfilerConfiguration       config;
+        double                      timestampPeriod;
+        uint64_t                    timestampMask;
+        std::optional<uint64_t>     origin;
+        std::atomic_uint64_t        submissions;
+        std::mutex                  mutex;
+        std::deque<ProfileSample>   samples;
+
+        explicit Profiler(rc<Device> device, ProfilerConfiguration const& config);
+
+        auto newQueryRecorder(this Profiler& self) -> rc<QueryRecorder>;
+        auto copySamples(this Profiler& self) -> std::vector<ProfileSample>;
+        void writeChromeTrace(this Profiler& self, std::filesystem::path const& path);
+        void _attach(this Profiler& self, uint32_t queueFamilyIndex);
+        void _append(this Profiler& self, std::span<uint64_t const> timestamps, std::span<PipelineStatistics const> statistics, std::span<ProfileScope const> scopes, uint64_t submission);
+    };
+}
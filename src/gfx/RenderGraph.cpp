@@ -0,0 +1,651 @@
+#include "Heap.hpp"
+#include "Buffer.hpp"
+#include "RenderGraph.hpp"
+#include "CommandBuffer.hpp"
+
+#include <ranges>
+#include <algorithm>
+
+static constexpr auto kWriteAccessMask =
+    vk::AccessFlagBits2::eShaderWrite |
+    vk::AccessFlagBits2::eShaderStorageWrite |
+    vk::AccessFlagBits2::eColorAttachmentWrite |
+    vk::AccessFlagBits2::eDepthStencilAttachmentWrite |
+    vk::AccessFlagBits2::eTransferWrite |
+    vk::AccessFlagBits2::eHostWrite |
+    vk::AccessFlagBits2::eMemoryWrite;
+
+static auto shaderStages(gfx::RenderGraphPassType type) -> vk::PipelineStageFlags2 {
+    switch (type) {
+        case gfx::RenderGraphPassType::eRender: {
+            return vk::PipelineStageFlagBits2::eVertexShader | vk::PipelineStageFlagBits2::eFragmentShader;
+        }
+        case gfx::RenderGraphPassType::eCompute: {
+            return vk::PipelineStageFlagBits2::eComputeShader;
+        }
+        case gfx::RenderGraphPassType::eTransfer: {
+            throw std::runtime_error("Transfer passes can not access resources from shaders");
+        }
+    }
+    return {};
+}
+
+static auto textureState(gfx::TextureUsage usage, gfx::RenderGraphPassType type) -> gfx::RenderGraphResourceState {
+    switch (usage) {
+        case gfx::TextureUsage::eColorAttachment: {
+            return {vk::PipelineStageFlagBits2::eColorAttachmentOutput, vk::AccessFlagBits2::eColorAttachmentRead | vk::AccessFlagBits2::eColorAttachmentWrite, vk::ImageLayout::eColorAttachmentOptimal};
+        }
+        case gfx::TextureUsage::eDepthStencilAttachment: {
+            return {vk::PipelineStageFlagBits2::eEarlyFragmentTests | vk::PipelineStageFlagBits2::eLateFragmentTests, vk::AccessFlagBits2::eDepthStencilAttachmentRead | vk::AccessFlagBits2::eDepthStencilAttachmentWrite, vk::ImageLayout::eDepthStencilAttachmentOptimal};
+        }
+        case gfx::TextureUsage::eDepthStencilRead: {
+            return {vk::PipelineStageFlagBits2::eEarlyFragmentTests | vk::PipelineStageFlagBits2::eLateFragmentTests | shaderStages(type), vk::AccessFlagBits2::eDepthStencilAttachmentRead | vk::AccessFlagBits2::eShaderSampledRead, vk::ImageLayout::eDepthStencilReadOnlyOptimal};
+        }
+        case gfx::TextureUsage::eSampled: {
+            return {shaderStages(type), vk::AccessFlagBits2::eShaderSampledRead, vk::ImageLayout::eShaderReadOnlyOptimal};
+        }
+        case gfx::TextureUsage::eStorageRead: {
+            return {shaderStages(type), vk::AccessFlagBits2::eShaderStorageRead, vk::ImageLayout::eGeneral};
+        }
+        case gfx::TextureUsage::eStorageWrite: {
+            return {shaderStages(type), vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite, vk::ImageLayout::eGeneral};
+        }
+        case gfx::TextureUsage::eTransferSrc: {
+            return {vk::PipelineStageFlagBits2::eAllTransfer, vk::AccessFlagBits2::eTransferRead, vk::ImageLayout::eTransferSrcOptimal};
+        }
+        case gfx::TextureUsage::eTransferDst: {
+            return {vk::PipelineStageFlagBits2::eAllTransfer, vk::AccessFlagBits2::eTransferWrite, vk::ImageLayout::eTransferDstOptimal};
+        }
+    }
+    return {};
+}
+
+static auto textureUsageFlags(gfx::TextureUsage usage) -> vk::ImageUsageFlags {
+    switch (usage) {
+        case gfx::TextureUsage::eColorAttachment: {
+            return vk::ImageUsageFlagBits::eColorAttachment;
+        }
+        case gfx::TextureUsage::eDepthStencilAttachment:
+        case gfx::TextureUsage::eDepthStencilRead: {
+            return vk::ImageUsageFlagBits::eDepthStencilAttachment;
+        }
+        case gfx::TextureUsage::eSampled: {
+            return vk::ImageUsageFlagBits::eSampled;
+        }
+        case gfx::TextureUsage::eStorageRead:
+        case gfx::TextureUsage::eStorageWrite: {
+            return vk::ImageUsageFlagBits::eStorage;
+        }
+        case gfx::TextureUsage::eTransferSrc: {
+            return vk::ImageUsageFlagBits::eTransferSrc;
+        }
+        case gfx::TextureUsage::eTransferDst: {
+            return vk::ImageUsageFlagBits::eTransferDst;
+        }
+    }
+    return {};
+}
+
+static auto bufferState(gfx::BufferUsage usage, gfx::RenderGraphPassType type) -> gfx::RenderGraphResourceState {
+    switch (usage) {
+        case gfx::BufferUsage::eVertex: {
+            return {vk::PipelineStageFlagBits2::eVertexAttributeInput, vk::AccessFlagBits2::eVertexAttributeRead};
+        }
+        case gfx::BufferUsage::eIndex: {
+            return {vk::PipelineStageFlagBits2::eIndexInput, vk::AccessFlagBits2::eIndexRead};
+        }
+        case gfx::BufferUsage::eIndirect: {
+            return {vk::PipelineStageFlagBits2::eDrawIndirect, vk::AccessFlagBits2::eIndirectCommandRead};
+        }
+        case gfx::BufferUsage::eUniform: {
+            return {shaderStages(type), vk::AccessFlagBits2::eUniformRead};
+        }
+        case gfx::BufferUsage::eStorageRead: {
+            return {shaderStages(type), vk::AccessFlagBits2::eShaderStorageRead};
+        }
+        case gfx::BufferUsage::eStorageWrite: {
+            return {shaderStages(type), vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite};
+        }
+        case gfx::BufferUsage::eTransferSrc: {
+            return {vk::PipelineStageFlagBits2::eAllTransfer, vk::AccessFlagBits2::eTransferRead};
+        }
+        case gfx::BufferUsage::eTransferDst: {
+            return {vk::PipelineStageFlagBits2::eAllTransfer, vk::AccessFlagBits2::eTransferWrite};
+        }
+    }
+    return {};
+}
+
+static auto sameDescription(gfx::TextureDescription const& a, gfx::TextureDescription const& b) -> bool {
+    return a.type == b.type
+        && a.width == b.width
+        && a.height == b.height
+        && a.depth == b.depth
+        && a.mipLevelCount == b.mipLevelCount
+        && a.arrayLayerCount == b.arrayLayerCount
+        && a.cube == b.cube
+        && a.format == b.format
+        && a.usage == b.usage
+        && a.mapping == b.mapping;
+}
+
+auto gfx::RenderGraphContext::texture(this RenderGraphContext const& self, RenderGraphTexture handle) -> rc<Texture> const& {
+    return self.graph.textures.at(handle.index).texture;
+}
+
+auto gfx::RenderGraphContext::buffer(this RenderGraphContext const& self, RenderGraphBuffer handle) -> rc<Buffer> const& {
+    return self.graph.buffers.at(handle.index).buffer;
+}
+
+auto gfx::RenderGraphPass::read(this RenderGraphPass& self, RenderGraphTexture handle, TextureUsage usage) -> RenderGraphPass& {
+    self._access(handle.index, true, false, textureState(usage, self.type));
+    return self;
+}
+
+auto gfx::RenderGraphPass::read(this RenderGraphPass& self, RenderGraphBuffer handle, BufferUsage usage) -> RenderGraphPass& {
+    self._access(handle.index, false, false, bufferState(usage, self.type));
+    return self;
+}
+
+auto gfx::RenderGraphPass::write(this RenderGraphPass& self, RenderGraphTexture handle, TextureUsage usage) -> RenderGraphPass& {
+    self._access(handle.index, true, true, textureState(usage, self.type));
+    return self;
+}
+
+auto gfx::RenderGraphPass::write(this RenderGraphPass& self, RenderGraphBuffer handle, BufferUsage usage) -> RenderGraphPass& {
+    self._access(handle.index, false, true, bufferState(usage, self.type));
+    return self;
+}
+
+auto gfx::RenderGraphPass::setSideEffect(this RenderGraphPass& self) -> RenderGraphPass& {
+    self.sideEffect = true;
+    return self;
+}
+
+auto gfx::RenderGraphPass::execute(this RenderGraphPass& self, std::function<void(RenderGraphContext&)> callback) -> RenderGraphPass& {
+    self.callback = std::move(callback);
+    return self;
+}
+
+// a resource accessed more than once by the same pass is synchronized once for the union of its accesses
+void gfx::RenderGraphPass::_access(this RenderGraphPass& self, uint32_t resource, bool isTexture, bool isWrite, RenderGraphResourceState const& state) {
+    for (auto& access : self.accesses) {
+        if (access.resource != resource || access.isTexture != isTexture) {
+            continue;
+        }
+        if (access.state.layout != state.layout) {
+            throw std::runtime_error("Pass " + self.name + " uses a texture in two different layouts");
+        }
+        access.state.stages |= state.stages;
+        access.state.access |= state.access;
+        access.isRead |= !isWrite;
+        access.isWrite |= isWrite;
+        return;
+    }
+
+    self.accesses.emplace_back(RenderGraphAccess{
+        .resource = resource,
+        .isTexture = isTexture,
+        .isRead = !isWrite,
+        .isWrite = isWrite,
+        .state = state
+    });
+}
+
+gfx::RenderGraph::RenderGraph(rc<Device> device, uint32_t framesInFlight)
+: device(std::move(device))
+, framesInFlight(std::max(framesInFlight, 1U))
+, passes()
+, textures()
+, buffers()
+, finalBarriers()
+, allocation()
+, retired()
+, requirementsCache()
+, compileIndex(0)
+, compiled(false) {}
+
+void gfx::RenderGraph::reset(this RenderGraph& self) {
+    self.passes.clear();
+    self.textures.clear();
+    self.buffers.clear();
+    self.finalBarriers.clear();
+    self.compiled = false;
+}
+
+auto gfx::RenderGraph::importTexture(this RenderGraph& self, std::string const& name, rc<Texture> const& texture, vk::ImageLayout initialLayout, vk::ImageLayout finalLayout, vk::PipelineStageFlags2 initialStages, vk::AccessFlags2 initialAccess) -> RenderGraphTexture {
+    RenderGraphTextureResource resource = {};
+    resource.name = name;
+    resource.description.type = texture->type;
+    resource.description.width = texture->extent.width;
+    resource.description.height = texture->extent.height;
+    resource.description.depth = texture->extent.depth;
+    resource.description.mipLevelCount = texture->subresource.levelCount;
+    resource.description.arrayLayerCount = texture->subresource.layerCount;
+    resource.description.cube = texture->cube;
+    resource.description.format = texture->format;
+    resource.texture = texture;
+    resource.imported = true;
+    resource.finalLayout = finalLayout;
+    resource.initialState = RenderGraphResourceState{initialStages, initialAccess, initialLayout};
+
+    self.textures.emplace_back(std::move(resource));
+    return RenderGraphTexture{static_cast<uint32_t>(self.textures.size() - 1)};
+}
+
+auto gfx::RenderGraph::importBuffer(this RenderGraph& self, std::string const& name, rc<Buffer> const& buffer, vk::PipelineStageFlags2 initialStages, vk::AccessFlags2 initialAccess, bool exported) -> RenderGraphBuffer {
+    self.buffers.emplace_back(RenderGraphBufferResource{
+        .name = name,
+        .buffer = buffer,
+        .initialState = RenderGraphResourceState{initialStages, initialAccess},
+        .exported = exported
+    });
+    return RenderGraphBuffer{static_cast<uint32_t>(self.buffers.size() - 1)};
+}
+
+auto gfx::RenderGraph::createTexture(this RenderGraph& self, std::string const& name, TextureDescription const& description) -> RenderGraphTexture {
+    RenderGraphTextureResource resource = {};
+    resource.name = name;
+    resource.description = description;
+
+    self.textures.emplace_back(std::move(resource));
+    return RenderGraphTexture{static_cast<uint32_t>(self.textures.size() - 1)};
+}
+
+auto gfx::RenderGraph::addPass(this RenderGraph& self, std::string const& name, RenderGraphPassType type) -> RenderGraphPass& {
+    self.compiled = false;
+
+    auto& pass = self.passes.emplace_back();
+    pass.name = name;
+    pass.type = type;
+    return pass;
+}
+
+void gfx::RenderGraph::compile(this RenderGraph& self) {
+    // passes may have been added since the last compile, start over from the declarations
+    self.finalBarriers.clear();
+    for (auto& texture : self.textures) {
+        texture.used = false;
+        texture.firstPass = 0;
+        texture.lastPass = 0;
+        texture.aliases.clear();
+    }
+
+    self._cull();
+    self._allocate();
+    self._schedule();
+
+    self.compileIndex += 1;
+    self.compiled = true;
+}
+
+void gfx::RenderGraph::execute(this RenderGraph& self, rc<CommandBuffer> const& commandBuffer) {
+    if (!self.compiled) {
+        self.compile();
+    }
+
+    auto submitBarriers = [&](std::span<vk::ImageMemoryBarrier2 const> imageBarriers, std::span<vk::BufferMemoryBarrier2 const> bufferBarriers) {
+        if (imageBarriers.empty() && bufferBarriers.empty()) {
+            return;
+        }
+
+        vk::DependencyInfo dependency_info = {};
+        dependency_info.setImageMemoryBarriers(imageBarriers);
+        dependency_info.setBufferMemoryBarriers(bufferBarriers);
+        commandBuffer->handle.pipelineBarrier2(dependency_info, self.device->dispatcher);
+    };
+
+    RenderGraphContext context{self, commandBuffer};
+    for (auto& pass : self.passes) {
+        if (pass.culled) {
+            continue;
+        }
+
+        submitBarriers(pass.imageBarriers, pass.bufferBarriers);
+        if (pass.callback) {
+            commandBuffer->pushDebugGroup(pass.name);
+            pass.callback(context);
+            commandBuffer->popDebugGroup();
+        }
+    }
+    submitBarriers(self.finalBarriers, {});
+}
+
+// walks the passes backwards, a pass survives if it has side effects or writes something a surviving pass or the outside world reads
+void gfx::RenderGraph::_cull(this RenderGraph& self) {
+    std::vector<bool> texture_needed(self.textures.size());
+    for (size_t i = 0; i < self.textures.size(); ++i) {
+        texture_needed[i] = self.textures[i].imported;
+    }
+    std::vector<bool> buffer_needed(self.buffers.size());
+    for (size_t i = 0; i < self.buffers.size(); ++i) {
+        buffer_needed[i] = self.buffers[i].exported;
+    }
+
+    for (auto& pass : std::views::reverse(self.passes)) {
+        bool keep = pass.sideEffect;
+        for (auto& access : pass.accesses) {
+            if (access.isWrite && (access.isTexture ? texture_needed[access.resource] : buffer_needed[access.resource])) {
+                keep = true;
+            }
+        }
+        pass.culled = !keep;
+        if (!keep) {
+            continue;
+        }
+
+        // a transient that is overwritten without being read does not need its earlier contents
+        for (auto& access : pass.accesses) {
+            if (!access.isWrite || access.isRead) {
+                continue;
+            }
+            if (access.isTexture && !self.textures[access.resource].imported) {
+                texture_needed[access.resource] = false;
+            }
+            if (!access.isTexture && !self.buffers[access.resource].exported) {
+                buffer_needed[access.resource] = false;
+            }
+        }
+        for (auto& access : pass.accesses) {
+            if (access.isRead) {
+                (access.isTexture ? texture_needed : buffer_needed)[access.resource] = true;
+            }
+        }
+    }
+}
+
+void gfx::RenderGraph::_allocate(this RenderGraph& self) {
+    auto usageFlags = std::vector<vk::ImageUsageFlags>(self.textures.size());
+    for (uint32_t i = 0; i < self.passes.size(); ++i) {
+        auto& pass = self.passes[i];
+        if (pass.culled) {
+            continue;
+        }
+        for (auto& access : pass.accesses) {
+            if (!access.isTexture) {
+                continue;
+            }
+
+            auto& texture = self.textures[access.resource];
+            if (!texture.used) {
+                texture.used = true;
+                texture.firstPass = i;
+            }
+            texture.lastPass = i;
+
+            // the usage flags of transients are whatever the passes do with them
+            if (access.state.layout == vk::ImageLayout::eColorAttachmentOptimal) {
+                usageFlags[access.resource] |= textureUsageFlags(TextureUsage::eColorAttachment);
+            } else if (access.state.layout == vk::ImageLayout::eDepthStencilAttachmentOptimal || access.state.layout == vk::ImageLayout::eDepthStencilReadOnlyOptimal) {
+                usageFlags[access.resource] |= textureUsageFlags(TextureUsage::eDepthStencilAttachment);
+            } else if (access.state.layout == vk::ImageLayout::eShaderReadOnlyOptimal) {
+                usageFlags[access.resource] |= textureUsageFlags(TextureUsage::eSampled);
+            } else if (access.state.layout == vk::ImageLayout::eGeneral) {
+                usageFlags[access.resource] |= textureUsageFlags(TextureUsage::eStorageWrite);
+            } else if (access.state.layout == vk::ImageLayout::eTransferSrcOptimal) {
+                usageFlags[access.resource] |= textureUsageFlags(TextureUsage::eTransferSrc);
+            } else if (access.state.layout == vk::ImageLayout::eTransferDstOptimal) {
+                usageFlags[access.resource] |= textureUsageFlags(TextureUsage::eTransferDst);
+            }
+            if (access.state.layout == vk::ImageLayout::eDepthStencilReadOnlyOptimal && (access.state.access & vk::AccessFlagBits2::eShaderSampledRead)) {
+                usageFlags[access.resource] |= textureUsageFlags(TextureUsage::eSampled);
+            }
+        }
+    }
+
+    std::vector<uint32_t> transients = {};
+    for (uint32_t i = 0; i < self.textures.size(); ++i) {
+        auto& texture = self.textures[i];
+        if (texture.imported || !texture.used) {
+            continue;
+        }
+        texture.description.usage |= usageFlags[i];
+
+        auto cached = std::ranges::find_if(self.requirementsCache, [&](auto const& entry) {
+            return sameDescription(entry.first, texture.description);
+        });
+        if (cached == self.requirementsCache.end()) {
+            self.requirementsCache.emplace_back(texture.description, self.device->textureMemoryRequirements(texture.description));
+            cached = std::prev(self.requirementsCache.end());
+        }
+        texture.requirements = cached->second;
+        transients.emplace_back(i);
+    }
+
+    // largest first, each texture goes to the lowest offset that does not overlap a texture alive at the same time
+    auto order = transients;
+    std::ranges::stable_sort(order, [&](uint32_t a, uint32_t b) {
+        return self.textures[a].requirements.size > self.textures[b].requirements.size;
+    });
+
+    vk::MemoryRequirements heap_requirements = {};
+    heap_requirements.memoryTypeBits = ~0U;
+    heap_requirements.alignment = 1;
+
+    std::vector<uint32_t> placed = {};
+    for (auto index : order) {
+        auto& texture = self.textures[index];
+        auto alignment = texture.requirements.alignment;
+        auto alignUp = [alignment](vk::DeviceSize offset) {
+            return (offset + alignment - 1) / alignment * alignment;
+        };
+        auto livesWith = [&](RenderGraphTextureResource const& other) {
+            return other.firstPass <= texture.lastPass && texture.firstPass <= other.lastPass;
+        };
+
+        std::vector<vk::DeviceSize> candidates = {0};
+        for (auto other_index : placed) {
+            auto& other = self.textures[other_index];
+            if (livesWith(other)) {
+                candidates.emplace_back(alignUp(other.offset + other.requirements.size));
+            }
+        }
+        std::ranges::sort(candidates);
+
+        for (auto offset : candidates) {
+            auto fits = std::ranges::none_of(placed, [&](uint32_t other_index) {
+                auto& other = self.textures[other_index];
+                return livesWith(other) && offset < other.offset + other.requirements.size && other.offset < offset + texture.requirements.size;
+            });
+            if (fits) {
+                texture.offset = offset;
+                break;
+            }
+        }
+
+        heap_requirements.size = std::max(heap_requirements.size, texture.offset + texture.requirements.size);
+        heap_requirements.alignment = std::max(heap_requirements.alignment, alignment);
+        heap_requirements.memoryTypeBits &= texture.requirements.memoryTypeBits;
+        placed.emplace_back(index);
+    }
+
+    for (auto index : transients) {
+        auto& texture = self.textures[index];
+        texture.aliases.clear();
+        for (auto other_index : transients) {
+            auto& other = self.textures[other_index];
+            if (other.lastPass < texture.firstPass && texture.offset < other.offset + other.requirements.size && other.offset < texture.offset + texture.requirements.size) {
+                texture.aliases.emplace_back(other_index);
+            }
+        }
+    }
+
+    std::vector<std::pair<TextureDescription, vk::DeviceSize>> placements = {};
+    for (auto index : transients) {
+        placements.emplace_back(self.textures[index].description, self.textures[index].offset);
+    }
+
+    auto unchanged = placements.size() == self.allocation.placements.size() && std::ranges::equal(placements, self.allocation.placements, [](auto const& a, auto const& b) {
+        return sameDescription(a.first, b.first) && a.second == b.second;
+    });
+
+    if (!unchanged) {
+        // frames that are still in flight may be using the old textures
+        if (self.allocation.heap) {
+            self.allocation.retiredAt = self.compileIndex;
+            self.retired.emplace_back(std::move(self.allocation));
+        }
+        self.allocation = {};
+        self.allocation.placements = std::move(placements);
+
+        if (!transients.empty()) {
+            if (heap_requirements.memoryTypeBits == 0) {
+                throw std::runtime_error("Transient textures of the render graph have no memory type in common");
+            }
+            self.allocation.heap = self.device->newHeap(heap_requirements);
+            for (auto index : transients) {
+                self.allocation.textures.emplace_back(self.device->newTexture(self.textures[index].description, self.allocation.heap, self.textures[index].offset));
+            }
+        }
+    }
+
+    for (size_t i = 0; i < transients.size(); ++i) {
+        self.textures[transients[i]].texture = self.allocation.textures[i];
+    }
+
+    while (!self.retired.empty() && self.compileIndex >= self.retired.front().retiredAt + self.framesInFlight) {
+        self.retired.pop_front();
+    }
+}
+
+void gfx::RenderGraph::_schedule(this RenderGraph& self) {
+    struct Tracker {
+        vk::ImageLayout         layout          = vk::ImageLayout::eUndefined;
+        vk::PipelineStageFlags2 writeStages     = {};   // stages of the last write, or of the last barrier that transitioned the layout
+        vk::AccessFlags2        writeAccess     = {};
+        vk::PipelineStageFlags2 readStages      = {};   // stages that read since then
+        vk::PipelineStageFlags2 visibleStages   = {};   // stages the last write was already made visible to
+        vk::AccessFlags2        visibleAccess   = {};
+    };
+
+    auto initial = [](RenderGraphResourceState const& state) {
+        return Tracker{
+            .layout = state.layout,
+            .writeStages = state.stages,
+            .writeAccess = state.access
+        };
+    };
+
+    std::vector<Tracker> texture_trackers(self.textures.size());
+    for (size_t i = 0; i < self.textures.size(); ++i) {
+        texture_trackers[i] = initial(self.textures[i].initialState);
+    }
+    std::vector<Tracker> buffer_trackers(self.buffers.size());
+    for (size_t i = 0; i < self.buffers.size(); ++i) {
+        buffer_trackers[i] = initial(self.buffers[i].initialState);
+    }
+
+    for (uint32_t i = 0; i < self.passes.size(); ++i) {
+        auto& pass = self.passes[i];
+        pass.imageBarriers.clear();
+        pass.bufferBarriers.clear();
+        if (pass.culled) {
+            continue;
+        }
+
+        for (auto& access : pass.accesses) {
+            auto& tracker = access.isTexture ? texture_trackers[access.resource] : buffer_trackers[access.resource];
+
+            // memory of a transient is handed over from whatever lived there before, the previous frame included
+            if (access.isTexture && !self.textures[access.resource].imported && self.textures[access.resource].firstPass == i) {
+                tracker = Tracker{};
+                for (auto alias : self.textures[access.resource].aliases) {
+                    tracker.writeStages |= texture_trackers[alias].writeStages | texture_trackers[alias].readStages;
+                    tracker.writeAccess |= texture_trackers[alias].writeAccess;
+                }
+                if (self.textures[access.resource].aliases.empty()) {
+                    tracker.writeStages = vk::PipelineStageFlagBits2::eAllCommands;
+                }
+            }
+
+            auto& state = access.state;
+            auto layout_change = access.isTexture && tracker.layout != state.layout;
+
+            bool needs_barrier = false;
+            vk::PipelineStageFlags2 src_stages = {};
+            vk::AccessFlags2 src_access = {};
+            if (access.isWrite || layout_change) {
+                src_stages = tracker.writeStages | tracker.readStages;
+                src_access = tracker.writeAccess;
+                needs_barrier = layout_change || static_cast<bool>(src_stages);
+            } else if (tracker.writeStages && ((state.stages & ~tracker.visibleStages) || (state.access & ~tracker.visibleAccess))) {
+                src_stages = tracker.writeStages;
+                src_access = tracker.writeAccess;
+                needs_barrier = true;
+            }
+
+            if (needs_barrier) {
+                if (access.isTexture) {
+                    auto& texture = self.textures[access.resource].texture;
+
+                    vk::ImageMemoryBarrier2 barrier = {};
+                    barrier.setSrcStageMask(src_stages);
+                    barrier.setSrcAccessMask(src_access);
+                    barrier.setDstStageMask(state.stages);
+                    barrier.setDstAccessMask(state.access);
+                    barrier.setOldLayout(tracker.layout);
+                    barrier.setNewLayout(state.layout);
+                    barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+                    barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+                    barrier.setImage(texture->image);
+                    barrier.setSubresourceRange(texture->subresource);
+                    pass.imageBarriers.emplace_back(barrier);
+                } else {
+                    vk::BufferMemoryBarrier2 barrier = {};
+                    barrier.setSrcStageMask(src_stages);
+                    barrier.setSrcAccessMask(src_access);
+                    barrier.setDstStageMask(state.stages);
+                    barrier.setDstAccessMask(state.access);
+                    barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+                    barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+                    barrier.setBuffer(self.buffers[access.resource].buffer->handle);
+                    barrier.setOffset(0);
+                    barrier.setSize(VK_WHOLE_SIZE);
+                    pass.bufferBarriers.emplace_back(barrier);
+                }
+            }
+
+            if (access.isWrite) {
+                tracker.writeStages = state.stages;
+                tracker.writeAccess = state.access & kWriteAccessMask;
+                tracker.readStages = {};
+                tracker.visibleStages = {};
+                tracker.visibleAccess = {};
+            } else if (layout_change) {
+                // later readers chain through the stages that waited for the transition
+                tracker.writeStages = state.stages;
+                tracker.readStages = state.stages;
+                tracker.visibleStages = state.stages;
+                tracker.visibleAccess = state.access;
+            } else {
+                tracker.readStages |= state.stages;
+                if (needs_barrier) {
+                    tracker.visibleStages |= state.stages;
+                    tracker.visibleAccess |= state.access;
+                }
+            }
+            tracker.layout = state.layout;
+        }
+    }
+
+    for (size_t i = 0; i < self.textures.size(); ++i) {
+        auto& texture = self.textures[i];
+        auto& tracker = texture_trackers[i];
+        if (!texture.imported || !texture.used || texture.finalLayout == vk::ImageLayout::eUndefined || texture.finalLayout == tracker.layout) {
+            continue;
+        }
+
+        vk::ImageMemoryBarrier2 barrier = {};
+        barrier.setSrcStageMask(tracker.writeStages | tracker.readStages);
+        barrier.setSrcAccessMask(tracker.writeAccess);
+        barrier.setDstStageMask(vk::PipelineStageFlagBits2::eAllCommands);
+        barrier.setDstAccessMask(vk::AccessFlagBits2::eMemoryRead | vk::AccessFlagBits2::eMemoryWrite);
+        barrier.setOldLayout(tracker.layout);
+        barrier.setNewLayout(texture.finalLayout);
+        barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+        barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+        barrier.setImage(texture.texture->image);
+        barrier.setSubresourceRange(texture.texture->subresource);
+        self.finalBarriers.emplace_back(barrier);
+    }
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "Device.hpp"
+#include "Texture.hpp"
+#include "ManagedObject.hpp"
+
+#include <deque>
+#include <functional>
+
+namespace gfx {
+    struct Heap;
+    struct Buffer;
+    struct RenderGraph;
+    struct CommandBuffer;
+
+    enum class RenderGraphPassType {
+        eRender,
+        eCompute,
+        eTransfer
+    };
+
+    enum class TextureUsage {
+        eColorAttachment,
+        eDepthStencilAttachment,
+        eDepthStencilRead,
+        eSampled,
+        eStorageRead,
+        eStorageWrite,
+        eTransferSrc,
+        eTransferDst
+    };
+
+    enum class BufferUsage {
+        eVertex,
+        eIndex,
+        eIndirect,
+        eUniform,
+        eStorageRead,
+        eStorageWrite,
+        eTransferSrc,
+        eTransferDst
+    };
+
+    struct RenderGraphTexture {
+        uint32_t index = std::numeric_limits<uint32_t>::max();
+    };
+
+    struct RenderGraphBuffer {
+        uint32_t index = std::numeric_limits<uint32_t>::max();
+    };
+
+    // Where a resource is, and what touched it last, from the point of view of the barriers.
+    struct RenderGraphResourceState {
+        vk::PipelineStageFlags2 stages  = {};
+        vk::AccessFlags2        access  = {};
+        vk::ImageLayout         layout  = vk::ImageLayout::eUndefined;
+    };
+
+    struct RenderGraphAccess {
+        uint32_t                    resource    = {};
+        bool                        isTexture   = {};
+        bool                        isRead      = {};
+        bool                        isWrite     = {};
+        RenderGraphResourceState    state       = {};
+    };
+
+    struct RenderGraphContext {
+        RenderGraph&        graph;
+        rc<CommandBuffer>   commandBuffer;
+
+        auto texture(this RenderGraphContext const& self, RenderGraphTexture handle) -> rc<Texture> const&;
+        auto buffer(this RenderGraphContext const& self, RenderGraphBuffer handle) -> rc<Buffer> const&;
+    };
+
+    struct RenderGraphPass {
+        std::string                                 name            = {};
+        RenderGraphPassType                         type            = {};
+        std::vector<RenderGraphAccess>              accesses        = {};
+        std::function<void(RenderGraphContext&)>    callback        = {};
+        bool                                        sideEffect      = {};
+        bool                                        culled          = {};
+        std::vector<vk::ImageMemoryBarrier2>        imageBarriers   = {};
+        std::vector<vk::BufferMemoryBarrier2>       bufferBarriers  = {};
+
+        auto read(this RenderGraphPass& self, RenderGraphTexture handle, TextureUsage usage) -> RenderGraphPass&;
+        auto read(this RenderGraphPass& self, RenderGraphBuffer handle, BufferUsage usage) -> RenderGraphPass&;
+        auto write(this RenderGraphPass& self, RenderGraphTexture handle, TextureUsage usage) -> RenderGraphPass&;
+        auto write(this RenderGraphPass& self, RenderGraphBuffer handle, BufferUsage usage) -> RenderGraphPass&;
+        auto setSideEffect(this RenderGraphPass& self) -> RenderGraphPass&;
+        auto execute(this RenderGraphPass& self, std::function<void(RenderGraphContext&)> callback) -> RenderGraphPass&;
+
+        void _access(this RenderGraphPass& self, uint32_t resource, bool isTexture, bool isWrite, RenderGraphResourceState const& state);
+    };
+
+    struct RenderGraphTextureResource {
+        std::string                 name            = {};
+        TextureDescription          description     = {};
+        rc<Texture>                 texture         = {};
+        bool                        imported        = {};
+        vk::ImageLayout             finalLayout     = vk::ImageLayout::eUndefined;
+        RenderGraphResourceState    initialState    = {};
+        uint32_t                    firstPass       = {};
+        uint32_t                    lastPass        = {};
+        vk::DeviceSize              offset          = {};
+        vk::MemoryRequirements      requirements    = {};
+        std::vector<uint32_t>       aliases         = {}; // transients that occupied the same memory earlier in the frame
+        bool                        used            = {};
+    };
+
+    struct RenderGraphBufferResource {
+        std::string                 name            = {};
+        rc<Buffer>                  buffer          = {};
+        RenderGraphResourceState    initialState    = {};
+        bool                        exported        = true;    // read after the graph; scratch buffers pass false
+    };
+
+    // Placement of the transient textures of a compiled graph, reused while the graph keeps its shape.
+    struct RenderGraphAllocation {
+        std::vector<std::pair<TextureDescription, vk::DeviceSize>>  placements  = {};
+        rc<Heap>                                                    heap        = {};
+        std::vector<rc<Texture>>                                    textures    = {};
+        uint64_t                                                    retiredAt   = {};
+    };
+
+    // A frame graph layered on CommandBuffer. Passes are declared every frame together with the textures
+    // and buffers they read and write; compile() culls passes whose results are never used, derives
+    // one batched pipelineBarrier2 per pass from the declared accesses, and places transient textures
+    // whose lifetimes do not overlap at the same offsets of a shared heap.
+    struct RenderGraph : public ManagedObject {
+        rc<Device>                              device;
+        uint32_t                                framesInFlight;
+        std::deque<RenderGraphPass>             passes;
+        std::vector<RenderGraphTextureResource> textures;
+        std::vector<RenderGraphBufferResource>  buffers;
+        std::vector<vk::ImageMemoryBarrier2>    finalBarriers;
+        RenderGraphAllocation                   allocation;
+        std::deque<RenderGraphAllocation>       retired;
+        std::vector<std::pair<TextureDescription, vk::MemoryRequirements>> requirementsCache;
+        uint64_t                                compileIndex;
+        bool                                    compiled;
+
+        explicit RenderGraph(rc<Device> device, uint32_t framesInFlight);
+
+        void reset(this RenderGraph& self);
+        auto importTexture(this RenderGraph& self, std::string const& name, rc<Texture> const& texture, vk::ImageLayout initialLayout, vk::ImageLayout finalLayout, vk::PipelineStageFlags2 initialStages = vk::PipelineStageFlagBits2::eAllCommands, vk::AccessFlags2 initialAccess = vk::AccessFlagBits2::eMemoryWrite) -> RenderGraphTexture;
+        auto importBuffer(this RenderGraph& self, std::string const& name, rc<Buffer> const& buffer, vk::PipelineStageFlags2 initialStages = vk::PipelineStageFlagBits2::eAllCommands, vk::AccessFlags2 initialAccess = vk::AccessFlagBits2::eMemoryWrite, bool exported = true) -> RenderGraphBuffer;
+        auto createTexture(this RenderGraph& self, std::string const& name, TextureDescription const& description) -> RenderGraphTexture;
+        auto addPass(this RenderGraph& self, std::string const& name, RenderGraphPassType type) -> RenderGraphPass&;
+        void compile(this RenderGraph& self);
+        void execute(this RenderGraph& self, rc<CommandBuffer> const& commandBuffer);
+
+        void _cull(this RenderGraph& self);
+        void _allocate(this RenderGraph& self);
+        void _schedule(this RenderGraph& self);
+    };
+}
@@ -1,5 +1,13 @@
+#include "ThreadPool.hpp"
+#include "CommandQueue.hpp"
 #include "RenderPipelineState.hpp"
 
+#include "spdlog/spdlog.h"
+
+#include <bit>
+#include <utility>
+#include <algorithm>
+
 auto gfx::RenderPipelineColorBlendAttachmentStateArray::operator[](size_t i) -> vk::PipelineColorBlendAttachmentState& {
     if (elements.size() >= i) {
         elements.resize(i + 1, vk::PipelineColorBlendAttachmentState{
@@ -20,19 +28,499 @@ auto gfx::RenderPipelineColorAttachmentFormatArray::operator[](size_t i) -> vk::
     return elements[i];
 }
 
+auto gfx::PipelineVariantKey::packed() const -> PipelineStateKey {
+    auto polygon_mode = static_cast<uint64_t>(polygonMode);
+    if (polygonMode == vk::PolygonMode::eFillRectangleNV) {
+        polygon_mode = 3;
+    }
+
+    PipelineStateKey key = {};
+    key.words[0] =
+        static_cast<uint64_t>(depthStencilState ? depthStencilState->id : 0) |
+        polygon_mode << 32 |
+        static_cast<uint64_t>(static_cast<uint32_t>(cullMode)) << 34 |
+        static_cast<uint64_t>(frontFace) << 36 |
+        static_cast<uint64_t>(depthClampEnable) << 37 |
+        static_cast<uint64_t>(rasterizerDiscardEnable) << 38 |
+        static_cast<uint64_t>(depthBiasEnable) << 39;
+    key.words[1] = static_cast<uint64_t>(std::bit_cast<uint32_t>(lineWidth)) | static_cast<uint64_t>(std::bit_cast<uint32_t>(depthBiasConstantFactor)) << 32;
+    key.words[2] = static_cast<uint64_t>(std::bit_cast<uint32_t>(depthBiasClamp)) | static_cast<uint64_t>(std::bit_cast<uint32_t>(depthBiasSlopeFactor)) << 32;
+    return key;
+}
+
+auto gfx::PipelineVariantKey::packed(DynamicStateFeatures const& dynamicState) const -> PipelineStateKey {
+    auto key = packed();
+
+    // line width and depth bias factors are always dynamic
+    key.words[1] = 0;
+    key.words[2] = 0;
+
+    uint64_t mask = 0;
+    if (dynamicState.extendedDynamicState) {
+        mask |= 0xFFFFFFFFULL | 0x3ULL << 34 | 0x1ULL << 36;
+    }
+    if (dynamicState.polygonMode) {
+        mask |= 0x3ULL << 32;
+    }
+    if (dynamicState.depthClampEnable) {
+        mask |= 0x1ULL << 37;
+    }
+    if (dynamicState.extendedDynamicState2) {
+        mask |= 0x1ULL << 38 | 0x1ULL << 39;
+    }
+    key.words[0] &= ~mask;
+    return key;
+}
+
 gfx::RenderPipelineState::RenderPipelineState(rc<Device> device, rc<RenderPipelineStateDescription> description)
 : device(std::move(device))
 , description(std::move(description)) {}
 
 gfx::RenderPipelineState::~RenderPipelineState() {
-    for (auto& layout : descriptorSetLayouts) {
-        device->handle.destroyDescriptorSetLayout(layout, nullptr, device->dispatcher);
+    // background compilations reference this object, let them finish first
+    {
+        std::unique_lock lock(mutex);
+        condition.wait(lock, [this] {
+            bool compiling = false;
+            pipelines.forEach([&](PipelineStateKey const&, vk::Pipeline pipeline) {
+                compiling |= !pipeline;
+            });
+            return !compiling && optimizing == 0;
+        });
     }
 
-    device->handle.destroyPipelineLayout(pipelineLayout, nullptr, device->dispatcher);
-    device->handle.destroyPipelineCache(pipelineCache, nullptr, device->dispatcher);
-
-    for (auto [_, pipeline] : pipelines) {
+    // layouts are interned by the device
+    pipelines.forEach([this](PipelineStateKey const&, vk::Pipeline pipeline) {
         device->handle.destroyPipeline(pipeline, nullptr, device->dispatcher);
+    });
+    for (auto& retired : retiredPipelines) {
+        device->handle.destroyPipeline(retired.pipeline, nullptr, device->dispatcher);
+    }
+    for (auto& parts : libraries) {
+        parts.forEach([this](PipelineStateKey const&, vk::Pipeline library) {
+            device->handle.destroyPipeline(library, nullptr, device->dispatcher);
+        });
+    }
+}
+
+void gfx::RenderPipelineState::prewarm(this RenderPipelineState& self, std::span<const PipelineVariantKey> keys) {
+    // keys differing only in dynamic state collapse into a single compilation
+    for (auto& key : keys) {
+        self._compileAsync(key);
+    }
+}
+
+auto gfx::RenderPipelineState::_newPipeline(this RenderPipelineState& self, PipelineVariantKey const& key) -> vk::Pipeline {
+    auto renderPipelineStateDescription = self.description;
+    vk::GraphicsPipelineCreateInfo graphicsPipelineCreateInfo = {};
+
+    vk::PipelineViewportStateCreateInfo pipelineViewportStateCreateInfo = {};
+    pipelineViewportStateCreateInfo.setViewportCount(1);
+    pipelineViewportStateCreateInfo.setScissorCount(1);
+    graphicsPipelineCreateInfo.setPViewportState(&pipelineViewportStateCreateInfo);
+
+    vk::PipelineRenderingCreateInfo pipelineRenderingCreateInfo = {};
+    pipelineRenderingCreateInfo.setViewMask(renderPipelineStateDescription->getViewMask());
+    pipelineRenderingCreateInfo.setColorAttachmentFormats(renderPipelineStateDescription->colorAttachmentFormats().elements);
+    pipelineRenderingCreateInfo.setDepthAttachmentFormat(renderPipelineStateDescription->getDepthAttachmentFormat());
+    pipelineRenderingCreateInfo.setStencilAttachmentFormat(renderPipelineStateDescription->getStencilAttachmentFormat());
+    graphicsPipelineCreateInfo.setPNext(&pipelineRenderingCreateInfo);
+
+    vk::PipelineInputAssemblyStateCreateInfo pipelineInputAssemblyStateCreateInfo = {};
+    pipelineInputAssemblyStateCreateInfo.setTopology(renderPipelineStateDescription->getInputPrimitiveTopology());
+    pipelineInputAssemblyStateCreateInfo.setPrimitiveRestartEnable(renderPipelineStateDescription->getPrimitiveRestartEnable());
+    graphicsPipelineCreateInfo.setPInputAssemblyState(&pipelineInputAssemblyStateCreateInfo);
+
+    vk::PipelineRasterizationStateCreateInfo rasterization_state = {};
+    rasterization_state.setDepthClampEnable(key.depthClampEnable);
+    rasterization_state.setRasterizerDiscardEnable(key.rasterizerDiscardEnable);
+    rasterization_state.setPolygonMode(key.polygonMode);
+    rasterization_state.setLineWidth(key.lineWidth);
+    rasterization_state.setCullMode(key.cullMode);
+    rasterization_state.setFrontFace(key.frontFace);
+    rasterization_state.setDepthBiasEnable(key.depthBiasEnable);
+    rasterization_state.setDepthBiasConstantFactor(key.depthBiasConstantFactor);
+    rasterization_state.setDepthBiasClamp(key.depthBiasClamp);
+    rasterization_state.setDepthBiasSlopeFactor(key.depthBiasSlopeFactor);
+
+    auto& dynamic_state = self.device->dynamicState;
+
+    vk::PipelineTessellationStateCreateInfo tessellation_state = {};
+    if (auto tesselationState = renderPipelineStateDescription->getTessellationState()) {
+        tessellation_state.setPatchControlPoints(tesselationState->patch_control_points);
+    }
+
+    auto rasterization_samples = [&renderPipelineStateDescription] {
+        switch (renderPipelineStateDescription->getRasterSampleCount()) {
+            case 1: return vk::SampleCountFlagBits::e1;
+            case 2: return vk::SampleCountFlagBits::e2;
+            case 4: return vk::SampleCountFlagBits::e4;
+            case 8: return vk::SampleCountFlagBits::e8;
+            case 16: return vk::SampleCountFlagBits::e16;
+            case 32: return vk::SampleCountFlagBits::e32;
+            case 64: return vk::SampleCountFlagBits::e64;
+            default: return vk::SampleCountFlagBits{};
+        }
+    }();
+
+    vk::PipelineMultisampleStateCreateInfo pipelineMultisampleStateCreateInfo = {};
+    pipelineMultisampleStateCreateInfo.setRasterizationSamples(rasterization_samples);
+    if (auto multisampleState = renderPipelineStateDescription->getMultisampleState()) {
+        pipelineMultisampleStateCreateInfo.setSampleShadingEnable(multisampleState->sample_shading_enable);
+        pipelineMultisampleStateCreateInfo.setMinSampleShading(multisampleState->min_sample_shading);
+        pipelineMultisampleStateCreateInfo.setPSampleMask(multisampleState->sample_mask);
+    }
+    pipelineMultisampleStateCreateInfo.setAlphaToCoverageEnable(renderPipelineStateDescription->getIsAlphaToCoverageEnabled());
+    pipelineMultisampleStateCreateInfo.setAlphaToOneEnable(renderPipelineStateDescription->getIsAlphaToOneEnabled());
+    graphicsPipelineCreateInfo.setPMultisampleState(&pipelineMultisampleStateCreateInfo);
+
+    vk::PipelineDepthStencilStateCreateInfo pipelineDepthStencilStateCreateInfo = {};
+
+    auto dynamicStates = std::vector{
+        vk::DynamicState::eViewport,
+        vk::DynamicState::eScissor,
+        vk::DynamicState::eLineWidth,
+        vk::DynamicState::eDepthBias
+    };
+    if (dynamic_state.extendedDynamicState) {
+        dynamicStates.insert(dynamicStates.end(), {
+            vk::DynamicState::eCullModeEXT,
+            vk::DynamicState::eFrontFaceEXT,
+            vk::DynamicState::eDepthTestEnableEXT,
+            vk::DynamicState::eDepthWriteEnableEXT,
+            vk::DynamicState::eDepthCompareOpEXT,
+            vk::DynamicState::eDepthBoundsTestEnableEXT,
+            vk::DynamicState::eDepthBounds,
+            vk::DynamicState::eStencilTestEnableEXT,
+            vk::DynamicState::eStencilOpEXT,
+            vk::DynamicState::eStencilCompareMask,
+            vk::DynamicState::eStencilWriteMask,
+            vk::DynamicState::eStencilReference
+        });
+    }
+    if (dynamic_state.extendedDynamicState2) {
+        dynamicStates.insert(dynamicStates.end(), {
+            vk::DynamicState::eDepthBiasEnableEXT,
+            vk::DynamicState::eRasterizerDiscardEnableEXT
+        });
+    }
+    if (dynamic_state.depthClampEnable) {
+        dynamicStates.emplace_back(vk::DynamicState::eDepthClampEnableEXT);
+    }
+    if (dynamic_state.polygonMode) {
+        dynamicStates.emplace_back(vk::DynamicState::ePolygonModeEXT);
+    }
+
+    vk::PipelineDynamicStateCreateInfo pipelineDynamicStateCreateInfo = {};
+    pipelineDynamicStateCreateInfo.setDynamicStates(dynamicStates);
+    graphicsPipelineCreateInfo.setPDynamicState(&pipelineDynamicStateCreateInfo);
+
+    std::vector<vk::PipelineShaderStageCreateInfo> pipelineShaderStageCreateInfos = {};
+    if (auto vertexFunction = renderPipelineStateDescription->getVertexFunction()) {
+        vk::PipelineShaderStageCreateInfo pipelineShaderStageCreateInfo = {};
+        pipelineShaderStageCreateInfo.setStage(vk::ShaderStageFlagBits::eVertex);
+        pipelineShaderStageCreateInfo.setModule(self.vertexModule);
+        pipelineShaderStageCreateInfo.setPName(vertexFunction->name.c_str());
+        pipelineShaderStageCreateInfo.setPSpecializationInfo(vertexFunction->getSpecializationInfo());
+        pipelineShaderStageCreateInfos.emplace_back(pipelineShaderStageCreateInfo);
+    }
+    if (auto fragmentFunction = renderPipelineStateDescription->getFragmentFunction()) {
+        vk::PipelineShaderStageCreateInfo pipelineShaderStageCreateInfo = {};
+        pipelineShaderStageCreateInfo.setStage(vk::ShaderStageFlagBits::eFragment);
+        pipelineShaderStageCreateInfo.setModule(self.fragmentModule);
+        pipelineShaderStageCreateInfo.setPName(fragmentFunction->name.c_str());
+        pipelineShaderStageCreateInfo.setPSpecializationInfo(fragmentFunction->getSpecializationInfo());
+        pipelineShaderStageCreateInfos.emplace_back(pipelineShaderStageCreateInfo);
+    }
+    graphicsPipelineCreateInfo.setStages(pipelineShaderStageCreateInfos);
+
+    vk::PipelineVertexInputStateCreateInfo pipelineVertexInputStateCreateInfo = {};
+    if (auto vertexInputState = renderPipelineStateDescription->getVertexInputState()) {
+        pipelineVertexInputStateCreateInfo.setVertexBindingDescriptions(vertexInputState->bindings);
+        pipelineVertexInputStateCreateInfo.setVertexAttributeDescriptions(vertexInputState->attributes);
+    }
+    graphicsPipelineCreateInfo.setPVertexInputState(&pipelineVertexInputStateCreateInfo);
+
+    vk::PipelineColorBlendStateCreateInfo pipelineColorBlendStateCreateInfo = {};
+    pipelineColorBlendStateCreateInfo.setAttachments(renderPipelineStateDescription->colorBlendAttachments().elements);
+    graphicsPipelineCreateInfo.setPColorBlendState(&pipelineColorBlendStateCreateInfo);
+
+    graphicsPipelineCreateInfo.setPRasterizationState(&rasterization_state);
+    graphicsPipelineCreateInfo.setPTessellationState(&tessellation_state);
+
+    if (dynamic_state.extendedDynamicState) {
+        // every field is dynamic, but the state itself is still required with a depth or stencil attachment
+        graphicsPipelineCreateInfo.setPDepthStencilState(&pipelineDepthStencilStateCreateInfo);
+    } else if (key.depthStencilState) {
+        pipelineDepthStencilStateCreateInfo.setDepthTestEnable(key.depthStencilState->isDepthTestEnabled);
+        pipelineDepthStencilStateCreateInfo.setDepthWriteEnable(key.depthStencilState->isDepthWriteEnabled);
+        pipelineDepthStencilStateCreateInfo.setDepthCompareOp(key.depthStencilState->depthCompareFunction);
+        pipelineDepthStencilStateCreateInfo.setDepthBoundsTestEnable(key.depthStencilState->isDepthBoundsTestEnabled);
+        pipelineDepthStencilStateCreateInfo.setMinDepthBounds(key.depthStencilState->minDepthBounds);
+        pipelineDepthStencilStateCreateInfo.setMaxDepthBounds(key.depthStencilState->maxDepthBounds);
+        pipelineDepthStencilStateCreateInfo.setStencilTestEnable(key.depthStencilState->isStencilTestEnabled);
+        pipelineDepthStencilStateCreateInfo.setFront(key.depthStencilState->frontFaceStencil);
+        pipelineDepthStencilStateCreateInfo.setBack(key.depthStencilState->backFaceStencil);
+
+        graphicsPipelineCreateInfo.setPDepthStencilState(&pipelineDepthStencilStateCreateInfo);
+    }
+
+    graphicsPipelineCreateInfo.setLayout(self.pipelineLayout);
+    graphicsPipelineCreateInfo.setRenderPass(nullptr);
+    graphicsPipelineCreateInfo.setSubpass(0);
+    graphicsPipelineCreateInfo.setBasePipelineHandle(nullptr);
+    graphicsPipelineCreateInfo.setBasePipelineIndex(0);
+
+    if (self.device->graphicsPipelineLibrary) {
+        return self._linkPipeline(key, graphicsPipelineCreateInfo);
+    }
+    return self.device->createGraphicsPipeline(graphicsPipelineCreateInfo);
+}
+
+auto gfx::RenderPipelineState::_linkPipeline(this RenderPipelineState& self, PipelineVariantKey const& key, vk::GraphicsPipelineCreateInfo const& create_info) -> vk::Pipeline {
+    auto packed = key.packed(self.device->dynamicState);
+
+    // the depth stencil state belongs to the fragment shader part, the rest of the key to pre-rasterization
+    auto pre_rasterization = packed;
+    pre_rasterization.words[0] &= ~0xFFFFFFFFULL;
+
+    PipelineStateKey fragment_shader = {};
+    fragment_shader.words[0] = packed.words[0] & 0xFFFFFFFFULL;
+
+    auto libraries = std::array{
+        self._getLibrary(PipelineLibraryPart::eVertexInput, {}, create_info),
+        self._getLibrary(PipelineLibraryPart::ePreRasterization, pre_rasterization, create_info),
+        self._getLibrary(PipelineLibraryPart::eFragmentShader, fragment_shader, create_info),
+        self._getLibrary(PipelineLibraryPart::eFragmentOutput, {}, create_info)
+    };
+
+    vk::PipelineLibraryCreateInfoKHR library_create_info = {};
+    library_create_info.setLibraries(libraries);
+
+    // without link time optimization this is the fast link, cheap enough to do at draw time
+    vk::GraphicsPipelineCreateInfo link_create_info = {};
+    link_create_info.setPNext(&library_create_info);
+    link_create_info.setLayout(self.pipelineLayout);
+    auto pipeline = self.device->createGraphicsPipeline(link_create_info);
+
+    if (self.description->getIsLinkTimeOptimizationEnabled()) {
+        self._optimizeAsync(packed, libraries);
+    }
+    return pipeline;
+}
+
+auto gfx::RenderPipelineState::_getLibrary(this RenderPipelineState& self, PipelineLibraryPart part, PipelineStateKey const& key, vk::GraphicsPipelineCreateInfo const& create_info) -> vk::Pipeline {
+    static constexpr auto kPartFlags = std::array{
+        vk::GraphicsPipelineLibraryFlagBitsEXT::eVertexInputInterface,
+        vk::GraphicsPipelineLibraryFlagBitsEXT::ePreRasterizationShaders,
+        vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentShader,
+        vk::GraphicsPipelineLibraryFlagBitsEXT::eFragmentOutputInterface
+    };
+
+    // parts are shared by many variants and rarely missing, compiling them under the lock keeps it simple
+    std::lock_guard lock(self.libraryMutex);
+    auto& parts = self.libraries[static_cast<size_t>(part)];
+    if (auto found = parts.find(key)) {
+        return *found;
+    }
+
+    // the state of the other parts is ignored, but their shader stages are not
+    std::vector<vk::PipelineShaderStageCreateInfo> stages = {};
+    for (auto& stage : std::span(create_info.pStages, create_info.stageCount)) {
+        auto fragment = stage.stage == vk::ShaderStageFlagBits::eFragment;
+        if ((part == PipelineLibraryPart::ePreRasterization && !fragment) || (part == PipelineLibraryPart::eFragmentShader && fragment)) {
+            stages.emplace_back(stage);
+        }
+    }
+
+    vk::GraphicsPipelineLibraryCreateInfoEXT library_create_info = {};
+    library_create_info.setPNext(create_info.pNext);
+    library_create_info.setFlags(kPartFlags[static_cast<size_t>(part)]);
+
+    auto part_create_info = create_info;
+    part_create_info.setPNext(&library_create_info);
+    part_create_info.setFlags(create_info.flags | vk::PipelineCreateFlagBits::eLibraryKHR | vk::PipelineCreateFlagBits::eRetainLinkTimeOptimizationInfoEXT);
+    part_create_info.setStages(stages);
+
+    auto library = self.device->createGraphicsPipeline(part_create_info);
+    parts.emplace(key, library);
+    return library;
+}
+
+void gfx::RenderPipelineState::_optimizeAsync(this RenderPipelineState& self, PipelineStateKey const& key, std::array<vk::Pipeline, 4> const& libraries) {
+    {
+        std::lock_guard lock(self.mutex);
+        self.optimizing += 1;
+    }
+
+    self.device->pipelineCompiler->enqueue([&self, key, libraries] {
+        vk::Pipeline optimized = VK_NULL_HANDLE;
+        try {
+            vk::PipelineLibraryCreateInfoKHR library_create_info = {};
+            library_create_info.setLibraries(libraries);
+
+            vk::GraphicsPipelineCreateInfo create_info = {};
+            create_info.setPNext(&library_create_info);
+            create_info.setFlags(vk::PipelineCreateFlagBits::eLinkTimeOptimizationEXT);
+            create_info.setLayout(self.pipelineLayout);
+            optimized = self.device->createGraphicsPipeline(create_info);
+        } catch (std::exception const& e) {
+            spdlog::error("Failed to optimize pipeline variant: {}", e.what());
+        }
+
+        // whoever fast linked the variant may not have published it yet
+        std::unique_lock lock(self.mutex);
+        vk::Pipeline* found = nullptr;
+        self.condition.wait(lock, [&] {
+            found = self.pipelines.find(key);
+            return found == nullptr || *found;
+        });
+
+        // command buffers recorded with the fast linked pipeline may still be in flight
+        if (optimized && found) {
+            self.retiredPipelines.emplace_back(RetiredPipeline{
+                .pipeline = std::exchange(*found, optimized),
+                .sealed = self.recording == 0,
+                .values = self.submittedValues
+            });
+            self._destroyRetiredPipelines();
+        } else if (optimized) {
+            self.device->handle.destroyPipeline(optimized, nullptr, self.device->dispatcher);
+        }
+        self.optimizing -= 1;
+        self.condition.notify_all();
+    });
+}
+
+auto gfx::RenderPipelineState::_getPipeline(this RenderPipelineState& self, PipelineVariantKey const& key) -> vk::Pipeline {
+    auto packed = key.packed(self.device->dynamicState);
+
+    std::unique_lock lock(self.mutex);
+    while (true) {
+        auto found = self.pipelines.find(packed);
+        if (found == nullptr) {
+            break;
+        }
+        if (*found) {
+            return *found;
+        }
+        self.condition.wait(lock);
+    }
+
+    // nobody is compiling this variant, do it on the calling thread
+    self.pipelines.emplace(packed, VK_NULL_HANDLE);
+    lock.unlock();
+
+    vk::Pipeline pipeline;
+    try {
+        pipeline = self._newPipeline(key);
+    } catch (...) {
+        lock.lock();
+        self.pipelines.erase(packed);
+        self.condition.notify_all();
+        throw;
+    }
+
+    lock.lock();
+    *self.pipelines.find(packed) = pipeline;
+    self.condition.notify_all();
+    return pipeline;
+}
+
+void gfx::RenderPipelineState::_recordVariant(this RenderPipelineState& self, PipelineVariantKey const& key) {
+    auto baked = key.packed();
+    auto packed = key.packed(self.device->dynamicState);
+
+    // a new variant whose pipeline already exists is one that did not have to be compiled
+    std::lock_guard lock(self.mutex);
+    if (self.variants.emplace(baked, VK_NULL_HANDLE).second && self.pipelines.find(packed) != nullptr) {
+        self.device->pipelineVariantsAvoided += 1;
+    }
+}
+
+auto gfx::RenderPipelineState::_getPipelineIfReady(this RenderPipelineState& self, PipelineVariantKey const& key) -> vk::Pipeline {
+    {
+        std::lock_guard lock(self.mutex);
+        if (auto found = self.pipelines.find(key.packed(self.device->dynamicState))) {
+            return *found;
+        }
+    }
+    self._compileAsync(key);
+    return VK_NULL_HANDLE;
+}
+
+void gfx::RenderPipelineState::_compileAsync(this RenderPipelineState& self, PipelineVariantKey const& key) {
+    auto packed = key.packed(self.device->dynamicState);
+    {
+        std::lock_guard lock(self.mutex);
+        if (!self.pipelines.emplace(packed, VK_NULL_HANDLE).second) {
+            return;
+        }
+    }
+
+    self.device->pipelineCompiler->enqueue([&self, key, packed] {
+        vk::Pipeline pipeline = VK_NULL_HANDLE;
+        try {
+            pipeline = self._newPipeline(key);
+        } catch (std::exception const& e) {
+            spdlog::error("Failed to compile pipeline variant: {}", e.what());
+        }
+
+        std::lock_guard lock(self.mutex);
+        if (pipeline) {
+            *self.pipelines.find(packed) = pipeline;
+        } else {
+            self.pipelines.erase(packed);
+        }
+        self.condition.notify_all();
+    });
+}
+
+// called by a command buffer the first time it binds one of the pipelines
+void gfx::RenderPipelineState::_beginUse(this RenderPipelineState& self) {
+    std::lock_guard lock(self.mutex);
+    self.recording += 1;
+}
+
+// called when that command buffer is submitted with the value, or with 0 when it is dropped unsubmitted
+void gfx::RenderPipelineState::_endUse(this RenderPipelineState& self, rc<CommandQueue> const& queue, uint64_t value) {
+    std::lock_guard lock(self.mutex);
+    self.recording -= 1;
+
+    auto update = [&queue, value](TimelineValues& values) {
+        auto found = std::ranges::find(values, queue->timeline, &TimelineValues::value_type::first);
+        if (found == values.end()) {
+            values.emplace_back(queue->timeline, value);
+        } else {
+            found->second = std::max(found->second, value);
+        }
+    };
+    if (value != 0) {
+        update(self.submittedValues);
+    }
+
+    // the command buffer may have bound a pipeline retired while it was recording
+    for (auto& retired : self.retiredPipelines) {
+        if (!retired.sealed && value != 0) {
+            update(retired.values);
+        }
+        retired.sealed |= self.recording == 0;
     }
-}
\ No newline at end of file
+    self._destroyRetiredPipelines();
+}
+
+// called with the mutex held
+void gfx::RenderPipelineState::_destroyRetiredPipelines(this RenderPipelineState& self) {
+    std::erase_if(self.retiredPipelines, [&self](RetiredPipeline const& retired) {
+        if (!retired.sealed) {
+            return false;
+        }
+        for (auto& [timeline, value] : retired.values) {
+            if (timeline->completedValue() < value) {
+                return false;
+            }
+        }
+        self.device->handle.destroyPipeline(retired.pipeline, nullptr, self.device->dispatcher);
+        return true;
+    });
+}
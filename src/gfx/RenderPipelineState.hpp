@@ -2,12 +2,24 @@
 
 #include "Device.hpp"
 #include "Function.hpp"
-
-#include <map>
+#include "PipelineStateKey.hpp"
+#include "DescriptorAllocator.hpp"
+
+#include <array>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <span>
 #include <optional>
+#include <condition_variable>
 
 namespace gfx {
+    struct CommandQueue;
+    struct CommandQueueTimeline;
+
+    using TimelineValues = std::vector<std::pair<std::shared_ptr<CommandQueueTimeline>, uint64_t>>;
     struct CommandBuffer;
+    struct PipelineVariantKey;
     struct RenderCommandEncoder;
 
     struct RenderPipelineColorBlendAttachmentStateArray {
@@ -68,6 +80,8 @@ namespace gfx {
         uint32_t                                        _rasterSampleCount;
         bool                                            _isAlphaToCoverageEnabled;
         bool                                            _isAlphaToOneEnabled;
+        bool                                            _isLinkTimeOptimizationEnabled;
+        uint32_t                                        _dynamicUniformBufferSets;
 
     private:
         RenderPipelineStateDescription() {
@@ -86,6 +100,8 @@ namespace gfx {
             this->_rasterSampleCount           = 1;
             this->_isAlphaToCoverageEnabled    = {};
             this->_isAlphaToOneEnabled         = {};
+            this->_isLinkTimeOptimizationEnabled = true;
+            this->_dynamicUniformBufferSets    = {};
         }
 
     public:
@@ -190,13 +206,33 @@ namespace gfx {
         void setIsAlphaToOneEnabled(this Self& self, bool isAlphaToOneEnabled) {
             self._isAlphaToOneEnabled = isAlphaToOneEnabled;
         }
+
+        // with graphics pipeline libraries, whether a fast linked variant is replaced by an optimized
+        // one compiled in the background
+        auto getIsLinkTimeOptimizationEnabled(this Self& self) -> bool {
+            return self._isLinkTimeOptimizationEnabled;
+        }
+        void setIsLinkTimeOptimizationEnabled(this Self& self, bool isLinkTimeOptimizationEnabled) {
+            self._isLinkTimeOptimizationEnabled = isLinkTimeOptimizationEnabled;
+        }
+
+        // a bit per descriptor set whose uniform buffers take a dynamic offset, so a set holding a single
+        // uniform buffer can be bound from a transient slice with RenderCommandEncoder::bindUniformBuffer
+        auto getDynamicUniformBufferSets(this Self& self) -> uint32_t {
+            return self._dynamicUniformBufferSets;
+        }
+        void setDynamicUniformBufferSets(this Self& self, uint32_t dynamicUniformBufferSets) {
+            self._dynamicUniformBufferSets = dynamicUniformBufferSets;
+        }
     };
 
     class DepthStencilState : public ManagedObject {
         friend Device;
+        friend PipelineVariantKey;
         friend RenderCommandEncoder;
 
     private:
+        uint32_t            id                      = _nextId(); // identifies the state in pipeline keys, unlike its address it is never reused
         bool                isDepthTestEnabled      = {};
         bool                isDepthWriteEnabled     = {};
         vk::CompareOp       depthCompareFunction    = {};
@@ -206,6 +242,45 @@ namespace gfx {
         vk::StencilOpState  backFaceStencil         = {};
         float               minDepthBounds          = {};
         float               maxDepthBounds          = {};
+
+        static auto _nextId() -> uint32_t {
+            static std::atomic_uint32_t next = 1;
+            return next.fetch_add(1);
+        }
+    };
+
+    struct PipelineVariantKey {
+        rc<DepthStencilState>   depthStencilState       = {};
+        bool                    depthClampEnable        = false;
+        bool                    rasterizerDiscardEnable = false;
+        vk::PolygonMode         polygonMode             = vk::PolygonMode::eFill;
+        float                   lineWidth               = 1.0F;
+        vk::CullModeFlagBits    cullMode                = vk::CullModeFlagBits::eNone;
+        vk::FrontFace           frontFace               = vk::FrontFace::eClockwise;
+        bool                    depthBiasEnable         = false;
+        float                   depthBiasConstantFactor = 0.0F;
+        float                   depthBiasClamp          = 0.0F;
+        float                   depthBiasSlopeFactor    = 0.0F;
+
+        auto packed() const -> PipelineStateKey;
+        auto packed(DynamicStateFeatures const& dynamicState) const -> PipelineStateKey; // without the state set while recording
+    };
+
+    // The parts a pipeline is linked from with VK_EXT_graphics_pipeline_library.
+    enum class PipelineLibraryPart : uint32_t {
+        eVertexInput,
+        ePreRasterization,
+        eFragmentShader,
+        eFragmentOutput
+    };
+
+    // A fast linked pipeline replaced by its optimized version. Once no command buffer that may have
+    // bound it is recording any more it is sealed, and destroyed when every queue reached its value.
+    // Values are kept per queue timeline, a retired pipeline does not keep the queues alive.
+    struct RetiredPipeline {
+        vk::Pipeline    pipeline    = {};
+        bool            sealed      = {};
+        TimelineValues  values      = {};
     };
 
     class RenderPipelineState : public ManagedObject {
@@ -216,13 +291,51 @@ namespace gfx {
     private:
         rc<Device>                           device                 = {};
         rc<RenderPipelineStateDescription>   description            = {};
-        vk::PipelineCache                    pipelineCache          = {};
-        vk::PipelineLayout                   pipelineLayout         = {};
-        std::map<std::size_t, vk::Pipeline>  pipelines              = {};
-        std::vector<vk::DescriptorSetLayout> descriptorSetLayouts   = {};
+        vk::PipelineLayout                   pipelineLayout         = {}; // owned by the device
+        std::vector<vk::DescriptorSetLayout> descriptorSetLayouts   = {}; // owned by the device
+        std::vector<DescriptorCounts>        descriptorSetCounts    = {};
+        uint32_t                             uniformBufferSets      = {}; // dynamic sets of a single uniform buffer at binding 0, for bindUniformBuffer
+        vk::ShaderModule                     vertexModule           = {}; // owned by the library, rewritten when push constants are spilled
+        vk::ShaderModule                     fragmentModule         = {};
+
+        // stages whose push constant block exceeds maxPushConstantsSize read it from a dynamic uniform
+        // buffer at binding 0 of the last set, streamed by the encoder at every draw that changed it
+        vk::ShaderStageFlags                 pushConstantSpillStages = {};
+        uint32_t                             pushConstantSpillSet   = {};
+        uint32_t                             pushConstantSpillSize  = {};
+
+        // a null pipeline marks a variant that is being compiled on another thread
+        std::mutex                           mutex                  = {};
+        std::condition_variable              condition              = {};
+        PipelineMap                          pipelines              = {};
+        PipelineMap                          variants               = {}; // every fully baked variant drawn with, to count what dynamic state saved
+        uint32_t                             optimizing             = {}; // background link time optimizations still running
+        std::vector<RetiredPipeline>         retiredPipelines       = {}; // fast linked variants replaced while command buffers may still use them
+        uint32_t                             recording              = {}; // command buffers that bound a pipeline and were not submitted yet
+        TimelineValues                       submittedValues        = {}; // last submit per queue of a command buffer that bound a pipeline
+
+        // graphics pipeline library parts, indexed by PipelineLibraryPart. Vertex input and fragment
+        // output only depend on the description and are stored under an empty key
+        std::mutex                           libraryMutex           = {};
+        std::array<PipelineMap, 4>           libraries              = {};
 
     public:
         explicit RenderPipelineState(rc<Device> device, rc<RenderPipelineStateDescription> description);
         ~RenderPipelineState() override;
+
+        void prewarm(this RenderPipelineState& self, std::span<const PipelineVariantKey> keys);
+
+    private:
+        auto _newPipeline(this RenderPipelineState& self, PipelineVariantKey const& key) -> vk::Pipeline;
+        auto _linkPipeline(this RenderPipelineState& self, PipelineVariantKey const& key, vk::GraphicsPipelineCreateInfo const& create_info) -> vk::Pipeline;
+        auto _getLibrary(this RenderPipelineState& self, PipelineLibraryPart part, PipelineStateKey const& key, vk::GraphicsPipelineCreateInfo const& create_info) -> vk::Pipeline;
+        void _optimizeAsync(this RenderPipelineState& self, PipelineStateKey const& key, std::array<vk::Pipeline, 4> const& libraries);
+        auto _getPipeline(this RenderPipelineState& self, PipelineVariantKey const& key) -> vk::Pipeline;
+        void _recordVariant(this RenderPipelineState& self, PipelineVariantKey const& key);
+        auto _getPipelineIfReady(this RenderPipelineState& self, PipelineVariantKey const& key) -> vk::Pipeline;
+        void _compileAsync(this RenderPipelineState& self, PipelineVariantKey const& key);
+        void _beginUse(this RenderPipelineState& self);
+        void _endUse(this RenderPipelineState& self, rc<CommandQueue> const& queue, uint64_t value);
+        void _destroyRetiredPipelines(this RenderPipelineState& self);
     };
 }
\ No newline at end of file
@@ -1,14 +1,26 @@
 #include "Sampler.hpp"
 
-gfx::Sampler::Sampler(rc<Device> device, vk::SamplerCreateInfo const& create_info) : device(std::move(device)) {
-    this->handle = this->device->handle.createSampler(create_info, VK_NULL_HANDLE, this->device->dispatcher);
+gfx::Sampler::Sampler(rc<Device> device, vk::SamplerCreateInfo const& create_info) : device(std::move(device)), handle(), interned(create_info.pNext == nullptr) {
+    // an extension chain is compared by address only, such samplers are not shared
+    if (this->interned) {
+        this->handle = this->device->_internSampler(create_info);
+    } else {
+        this->handle = this->device->handle.createSampler(create_info, VK_NULL_HANDLE, this->device->dispatcher);
+    }
 }
 
 gfx::Sampler::~Sampler() {
-    this->device->handle.destroySampler(this->handle, VK_NULL_HANDLE, this->device->dispatcher);
+    if (!this->interned) {
+        this->device->handle.destroySampler(this->handle, VK_NULL_HANDLE, this->device->dispatcher);
+    }
 }
 
+// an interned handle is shared by every sampler with an equal description, naming it would rename all of them
 void gfx::Sampler::setLabel(this Sampler& self, std::string const& name) {
+    if (self.interned) {
+        return;
+    }
+
     vk::DebugMarkerObjectNameInfoEXT info = {};
     info.setObjectType(vk::DebugReportObjectTypeEXT::eSampler);
     info.setObject(uint64_t(VkSampler(self.handle)));
@@ -6,6 +6,7 @@ namespace gfx {
     struct Sampler : public ManagedObject {
         rc<Device>  device;
         vk::Sampler handle;
+        bool        interned; // the handle is shared through the device and outlives this object
 
         explicit Sampler(rc<Device> device, vk::SamplerCreateInfo const& create_info);
         ~Sampler() override;
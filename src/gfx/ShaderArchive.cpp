@@ -0,0 +1,323 @@
+#include "ShaderArchive.hpp"
+
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define GFX_SHADER_ARCHIVE_MMAP 1
+#endif
+
+// the reflection of a module, every array is laid out as written so reading it back is a copy
+struct ReflectionHeader {
+    uint32_t entryPointCount;
+    uint32_t bindingCount;
+    uint32_t pushConstantBlockCount;
+    uint32_t vertexInputCount;
+};
+
+struct EntryPointRecord {
+    uint32_t nameOffset; // from the end of the arrays
+    uint32_t nameSize;
+    uint32_t stage;
+    uint32_t reserved;
+};
+
+struct BindingRecord {
+    uint32_t set;
+    uint32_t binding;
+    uint32_t descriptorType;
+    uint32_t descriptorCount;
+};
+
+struct PushConstantBlockRecord {
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct VertexInputRecord {
+    uint32_t location;
+    uint32_t format;
+};
+
+template<typename T>
+static void append(std::vector<std::byte>& bytes, T const& value) {
+    auto offset = bytes.size();
+    bytes.resize(offset + sizeof(T));
+    std::memcpy(bytes.data() + offset, &value, sizeof(T));
+}
+
+template<typename T>
+static auto read(std::span<std::byte const> bytes, size_t offset) -> T {
+    if (offset + sizeof(T) > bytes.size()) {
+        throw std::runtime_error("Invalid shader archive");
+    }
+    T value;
+    std::memcpy(&value, bytes.data() + offset, sizeof(T));
+    return value;
+}
+
+static void align(std::vector<std::byte>& bytes, size_t alignment) {
+    bytes.resize((bytes.size() + alignment - 1) / alignment * alignment);
+}
+
+static auto serialize(gfx::ShaderReflection const& reflection) -> std::vector<std::byte> {
+    std::vector<std::byte> bytes = {};
+    append(bytes, ReflectionHeader{
+        .entryPointCount = static_cast<uint32_t>(reflection.entryPoints.size()),
+        .bindingCount = static_cast<uint32_t>(reflection.bindings.size()),
+        .pushConstantBlockCount = static_cast<uint32_t>(reflection.pushConstantBlocks.size()),
+        .vertexInputCount = static_cast<uint32_t>(reflection.vertexInputs.size())
+    });
+
+    uint32_t name_offset = 0;
+    for (auto& entry_point : reflection.entryPoints) {
+        append(bytes, EntryPointRecord{
+            .nameOffset = name_offset,
+            .nameSize = static_cast<uint32_t>(entry_point.name.size()),
+            .stage = static_cast<uint32_t>(entry_point.stage)
+        });
+        name_offset += static_cast<uint32_t>(entry_point.name.size());
+    }
+    for (auto& binding : reflection.bindings) {
+        append(bytes, BindingRecord{
+            .set = binding.set,
+            .binding = binding.binding,
+            .descriptorType = static_cast<uint32_t>(binding.descriptorType),
+            .descriptorCount = binding.descriptorCount
+        });
+    }
+    for (auto& block : reflection.pushConstantBlocks) {
+        append(bytes, PushConstantBlockRecord{.offset = block.offset, .size = block.size});
+    }
+    for (auto& input : reflection.vertexInputs) {
+        append(bytes, VertexInputRecord{.location = input.location, .format = static_cast<uint32_t>(input.format)});
+    }
+    for (auto& entry_point : reflection.entryPoints) {
+        auto names = std::as_bytes(std::span(entry_point.name));
+        bytes.insert(bytes.end(), names.begin(), names.end());
+    }
+    return bytes;
+}
+
+static auto deserialize(std::span<std::byte const> bytes) -> gfx::ShaderReflection {
+    auto header = read<ReflectionHeader>(bytes, 0);
+    auto offset = sizeof(ReflectionHeader);
+    auto names = offset
+        + header.entryPointCount * sizeof(EntryPointRecord)
+        + header.bindingCount * sizeof(BindingRecord)
+        + header.pushConstantBlockCount * sizeof(PushConstantBlockRecord)
+        + header.vertexInputCount * sizeof(VertexInputRecord);
+    if (names > bytes.size()) {
+        throw std::runtime_error("Invalid shader archive");
+    }
+
+    gfx::ShaderReflection reflection = {};
+    reflection.entryPoints.reserve(header.entryPointCount);
+    for (uint32_t i = 0; i < header.entryPointCount; ++i, offset += sizeof(EntryPointRecord)) {
+        auto record = read<EntryPointRecord>(bytes, offset);
+        if (names + record.nameOffset + record.nameSize > bytes.size()) {
+            throw std::runtime_error("Invalid shader archive");
+        }
+        reflection.entryPoints.emplace_back(gfx::ShaderEntryPoint{
+            .name = std::string(reinterpret_cast<char const*>(bytes.data() + names + record.nameOffset), record.nameSize),
+            .stage = static_cast<vk::ShaderStageFlagBits>(record.stage)
+        });
+    }
+    reflection.bindings.reserve(header.bindingCount);
+    for (uint32_t i = 0; i < header.bindingCount; ++i, offset += sizeof(BindingRecord)) {
+        auto record = read<BindingRecord>(bytes, offset);
+        reflection.bindings.emplace_back(gfx::ShaderBinding{
+            .set = record.set,
+            .binding = record.binding,
+            .descriptorType = static_cast<vk::DescriptorType>(record.descriptorType),
+            .descriptorCount = record.descriptorCount
+        });
+    }
+    reflection.pushConstantBlocks.reserve(header.pushConstantBlockCount);
+    for (uint32_t i = 0; i < header.pushConstantBlockCount; ++i, offset += sizeof(PushConstantBlockRecord)) {
+        auto record = read<PushConstantBlockRecord>(bytes, offset);
+        reflection.pushConstantBlocks.emplace_back(gfx::ShaderPushConstantBlock{.offset = record.offset, .size = record.size});
+    }
+    reflection.vertexInputs.reserve(header.vertexInputCount);
+    for (uint32_t i = 0; i < header.vertexInputCount; ++i, offset += sizeof(VertexInputRecord)) {
+        auto record = read<VertexInputRecord>(bytes, offset);
+        reflection.vertexInputs.emplace_back(gfx::ShaderVertexInput{.location = record.location, .format = static_cast<vk::Format>(record.format)});
+    }
+    return reflection;
+}
+
+gfx::ShaderArchive::ShaderArchive(std::filesystem::path path)
+: path(std::move(path))
+, bytes(nullptr)
+, size(0)
+, storage() {
+#if GFX_SHADER_ARCHIVE_MMAP
+    auto fd = ::open(this->path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw std::runtime_error("Failed to open shader archive '" + this->path.string() + "'");
+    }
+    struct stat status = {};
+    if (::fstat(fd, &status) == 0 && status.st_size > 0) {
+        auto mapping = ::mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            bytes = static_cast<std::byte const*>(mapping);
+            size = static_cast<size_t>(status.st_size);
+        }
+    }
+    ::close(fd);
+#endif
+    if (bytes == nullptr) {
+        std::ifstream file(this->path, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open shader archive '" + this->path.string() + "'");
+        }
+        file.seekg(0, std::ios::end);
+        storage.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0, std::ios::beg);
+        file.read(reinterpret_cast<char*>(storage.data()), static_cast<std::streamsize>(storage.size()));
+        bytes = storage.data();
+        size = storage.size();
+    }
+
+    auto header = read<Header>(std::span(bytes, size), 0);
+    if (header.magic != kMagic || header.version != kVersion) {
+        throw std::runtime_error("Invalid shader archive '" + this->path.string() + "'");
+    }
+}
+
+gfx::ShaderArchive::~ShaderArchive() {
+#if GFX_SHADER_ARCHIVE_MMAP
+    if (storage.empty() && bytes != nullptr) {
+        ::munmap(const_cast<std::byte*>(bytes), size);
+    }
+#endif
+}
+
+auto gfx::ShaderArchive::moduleCount(this ShaderArchive const& self) -> uint32_t {
+    return read<Header>(std::span(self.bytes, self.size), 0).moduleCount;
+}
+
+auto gfx::ShaderArchive::findModule(this ShaderArchive const& self, std::string_view name) -> std::optional<ModuleRecord> {
+    auto module_name = [&self](ModuleRecord const& record) {
+        auto range = self._range(record.nameOffset, record.nameSize);
+        return std::string_view(reinterpret_cast<char const*>(range.data()), range.size());
+    };
+
+    // binary search over the sorted records
+    uint32_t first = 0;
+    uint32_t count = self.moduleCount();
+    while (count > 0) {
+        auto step = count / 2;
+        auto record = self._record(first + step);
+        if (module_name(record) < name) {
+            first += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    if (first < self.moduleCount()) {
+        auto record = self._record(first);
+        if (module_name(record) == name) {
+            return record;
+        }
+    }
+    return std::nullopt;
+}
+
+auto gfx::ShaderArchive::code(this ShaderArchive const& self, ModuleRecord const& module) -> std::span<uint32_t const> {
+    // code is 4 byte aligned in the file, and the mapping is page aligned
+    auto range = self._range(module.codeOffset, module.codeSize);
+    return std::span(reinterpret_cast<uint32_t const*>(range.data()), range.size() / sizeof(uint32_t));
+}
+
+auto gfx::ShaderArchive::reflection(this ShaderArchive const& self, ModuleRecord const& module) -> ShaderReflection {
+    return deserialize(self._range(module.reflectionOffset, module.reflectionSize));
+}
+
+auto gfx::ShaderArchive::hash(std::span<uint32_t const> code) -> uint64_t {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (auto byte : std::as_bytes(code)) {
+        hash ^= static_cast<uint8_t>(byte);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+void gfx::ShaderArchive::write(std::filesystem::path const& path, std::span<Module const> modules) {
+    std::vector<Module const*> sorted = {};
+    for (auto& module : modules) {
+        sorted.emplace_back(&module);
+    }
+    std::ranges::sort(sorted, {}, [](Module const* module) { return std::string_view(module->name); });
+
+    std::vector<std::byte> bytes = {};
+    append(bytes, Header{
+        .magic = kMagic,
+        .version = kVersion,
+        .moduleCount = static_cast<uint32_t>(sorted.size())
+    });
+
+    auto records_offset = bytes.size();
+    bytes.resize(records_offset + sorted.size() * sizeof(ModuleRecord));
+
+    std::vector<ModuleRecord> records = {};
+    for (auto module : sorted) {
+        ModuleRecord record = {};
+        record.hash = hash(module->code);
+
+        record.nameOffset = bytes.size();
+        record.nameSize = module->name.size();
+        auto name = std::as_bytes(std::span(module->name));
+        bytes.insert(bytes.end(), name.begin(), name.end());
+
+        // modules with the same code share it, e.g. one shader archived under two names
+        auto same = std::ranges::find_if(records, [&](ModuleRecord const& other) {
+            return other.hash == record.hash && other.codeSize == module->code.size() * sizeof(uint32_t)
+                && std::memcmp(bytes.data() + other.codeOffset, module->code.data(), other.codeSize) == 0;
+        });
+        if (same != records.end()) {
+            record.codeOffset = same->codeOffset;
+            record.codeSize = same->codeSize;
+        } else {
+            align(bytes, alignof(uint32_t));
+            record.codeOffset = bytes.size();
+            record.codeSize = module->code.size() * sizeof(uint32_t);
+            auto code = std::as_bytes(std::span(module->code));
+            bytes.insert(bytes.end(), code.begin(), code.end());
+        }
+
+        align(bytes, alignof(uint32_t));
+        auto reflection = serialize(module->reflection);
+        record.reflectionOffset = bytes.size();
+        record.reflectionSize = reflection.size();
+        bytes.insert(bytes.end(), reflection.begin(), reflection.end());
+
+        records.emplace_back(record);
+    }
+    std::memcpy(bytes.data() + records_offset, records.data(), records.size() * sizeof(ModuleRecord));
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to write shader archive '" + path.string() + "'");
+    }
+    file.write(reinterpret_cast<char const*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+}
+
+auto gfx::ShaderArchive::_record(this ShaderArchive const& self, uint32_t index) -> ModuleRecord {
+    return read<ModuleRecord>(std::span(self.bytes, self.size), sizeof(Header) + index * sizeof(ModuleRecord));
+}
+
+auto gfx::ShaderArchive::_range(this ShaderArchive const& self, uint64_t offset, uint64_t size) -> std::span<std::byte const> {
+    if (offset > self.size || size > self.size - offset) {
+        throw std::runtime_error("Invalid shader archive '" + self.path.string() + "'");
+    }
+    return std::span(self.bytes + offset, size);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "ManagedObject.hpp"
+#include "ShaderReflection.hpp"
+
+#include <span>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <optional>
+#include <filesystem>
+
+namespace gfx {
+    // Many SPIR-V modules packed into one file together with their reflection and a hash of their code.
+    // The shader-archiver tool writes it at build time from target_compile_shaders, and opening it maps
+    // the file into memory, so creating a library from it neither reads files nor parses SPIR-V.
+    struct ShaderArchive : public ManagedObject {
+        static constexpr uint32_t kMagic = 0x41534647; // 'GFSA'
+        static constexpr uint32_t kVersion = 1;
+
+        struct Header {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t moduleCount;
+            uint32_t reserved;
+        };
+
+        // offsets are from the start of the file, the records are sorted by name
+        struct ModuleRecord {
+            uint64_t nameOffset;
+            uint64_t nameSize;
+            uint64_t codeOffset;
+            uint64_t codeSize;
+            uint64_t reflectionOffset;
+            uint64_t reflectionSize;
+            uint64_t hash;
+        };
+
+        struct Module {
+            std::string             name        = {};
+            std::vector<uint32_t>   code        = {};
+            ShaderReflection        reflection  = {};
+        };
+
+        std::filesystem::path   path;
+        std::byte const*        bytes;
+        size_t                  size;
+        std::vector<std::byte>  storage; // the file contents when it can not be mapped
+
+        explicit ShaderArchive(std::filesystem::path path);
+        ~ShaderArchive() override;
+
+        auto moduleCount(this ShaderArchive const& self) -> uint32_t;
+        auto findModule(this ShaderArchive const& self, std::string_view name) -> std::optional<ModuleRecord>;
+        auto code(this ShaderArchive const& self, ModuleRecord const& module) -> std::span<uint32_t const>;
+        auto reflection(this ShaderArchive const& self, ModuleRecord const& module) -> ShaderReflection;
+
+        static auto hash(std::span<uint32_t const> code) -> uint64_t;
+        static void write(std::filesystem::path const& path, std::span<Module const> modules);
+
+        auto _record(this ShaderArchive const& self, uint32_t index) -> ModuleRecord;
+        auto _range(this ShaderArchive const& self, uint64_t offset, uint64_t size) -> std::span<std::byte const>;
+    };
+}
@@ -0,0 +1,69 @@
+#include "ShaderReflection.hpp"
+
+#include <spirv_reflect.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+auto gfx::ShaderReflection::reflect(std::span<uint32_t const> code) -> ShaderReflection {
+    SpvReflectShaderModule module = {};
+    if (spvReflectCreateShaderModule(code.size_bytes(), code.data(), &module) != SPV_REFLECT_RESULT_SUCCESS) {
+        throw std::runtime_error("Failed to reflect shader module");
+    }
+
+    ShaderReflection reflection = {};
+    for (auto& entry_point : std::span(module.entry_points, module.entry_point_count)) {
+        reflection.entryPoints.emplace_back(ShaderEntryPoint{
+            .name = entry_point.name,
+            .stage = static_cast<vk::ShaderStageFlagBits>(entry_point.shader_stage)
+        });
+    }
+
+    for (auto& descriptor_set : std::span(module.descriptor_sets, module.descriptor_set_count)) {
+        for (auto binding : std::span(descriptor_set.bindings, descriptor_set.binding_count)) {
+            reflection.bindings.emplace_back(ShaderBinding{
+                .set = descriptor_set.set,
+                .binding = binding->binding,
+                .descriptorType = static_cast<vk::DescriptorType>(binding->descriptor_type),
+                .descriptorCount = binding->count
+            });
+        }
+    }
+
+    for (auto& block : std::span(module.push_constant_blocks, module.push_constant_block_count)) {
+        reflection.pushConstantBlocks.emplace_back(ShaderPushConstantBlock{
+            .offset = block.offset,
+            .size = block.size
+        });
+    }
+
+    if (module.shader_stage == SPV_REFLECT_SHADER_STAGE_VERTEX_BIT) {
+        for (auto variable : std::span(module.input_variables, module.input_variable_count)) {
+            if (variable->decoration_flags & SPV_REFLECT_DECORATION_BUILT_IN) {
+                continue;
+            }
+            // SpvReflectFormat mirrors VkFormat
+            reflection.vertexInputs.emplace_back(ShaderVertexInput{
+                .location = variable->location,
+                .format = static_cast<vk::Format>(variable->format)
+            });
+        }
+        std::ranges::sort(reflection.vertexInputs, {}, &ShaderVertexInput::location);
+    }
+
+    spvReflectDestroyShaderModule(&module);
+    return reflection;
+}
+
+auto gfx::ShaderReflection::findEntryPoint(this ShaderReflection const& self, std::string_view name) -> ShaderEntryPoint const* {
+    auto it = std::ranges::find(self.entryPoints, name, &ShaderEntryPoint::name);
+    return it != self.entryPoints.end() ? &*it : nullptr;
+}
+
+auto gfx::ShaderReflection::pushConstantSize(this ShaderReflection const& self) -> uint32_t {
+    uint32_t size = 0;
+    for (auto& block : self.pushConstantBlocks) {
+        size = std::max(size, block.offset + block.size);
+    }
+    return size;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+
+#include <span>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace gfx {
+    struct ShaderEntryPoint {
+        std::string             name    = {};
+        vk::ShaderStageFlagBits stage   = {};
+    };
+
+    struct ShaderBinding {
+        uint32_t                set             = {};
+        uint32_t                binding         = {};
+        vk::DescriptorType      descriptorType  = {};
+        uint32_t                descriptorCount = {};
+    };
+
+    struct ShaderPushConstantBlock {
+        uint32_t                offset  = {};
+        uint32_t                size    = {};
+    };
+
+    struct ShaderVertexInput {
+        uint32_t                location    = {};
+        vk::Format              format      = {};
+    };
+
+    // What pipeline creation needs to know about a shader module. It is reflected from the SPIR-V when a
+    // library is created from bytes, or read back from a ShaderArchive where it was reflected at build time.
+    struct ShaderReflection {
+        std::vector<ShaderEntryPoint>           entryPoints         = {};
+        std::vector<ShaderBinding>              bindings            = {};
+        std::vector<ShaderPushConstantBlock>    pushConstantBlocks  = {};
+        std::vector<ShaderVertexInput>          vertexInputs        = {}; // user inputs of a vertex entry point, by location
+
+        static auto reflect(std::span<uint32_t const> code) -> ShaderReflection;
+
+        auto findEntryPoint(this ShaderReflection const& self, std::string_view name) -> ShaderEntryPoint const*;
+        auto pushConstantSize(this ShaderReflection const& self) -> uint32_t; // end of the last push constant block
+    };
+}
@@ -0,0 +1,29 @@
+#include "StagingRing.hpp"
+
+#include <algorithm>
+
+auto gfx::StagingRing::allocate(this StagingRing& self, uint64_t size, uint64_t alignment) -> std::optional<uint64_t> {
+    if (size > self.capacity) {
+        return std::nullopt;
+    }
+
+    auto offset = (self.head + alignment - 1) & ~(alignment - 1);
+    if (offset % self.capacity + size > self.capacity) {
+        offset += self.capacity - offset % self.capacity;
+    }
+    if (offset + size - self.tail > self.capacity) {
+        return std::nullopt;
+    }
+    self.head = offset + size;
+    return offset;
+}
+
+void gfx::StagingRing::release(this StagingRing& self, uint64_t end) {
+    self.tail = std::max(self.tail, end);
+}
+
+void gfx::StagingRing::reset(this StagingRing& self) {
+    // an idle ring with a misaligned head could otherwise never fit an allocation that has to wrap
+    self.head = 0;
+    self.tail = 0;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+
+namespace gfx {
+    // Offsets into a ring of `capacity` bytes. Head and tail grow monotonically, the position in the
+    // ring is the offset modulo the capacity, and an allocation never wraps around the end of the
+    // ring. The owner releases allocations in order by moving the tail to the end of the last one
+    // the GPU no longer reads, and resets the ring once nothing refers to it anymore.
+    struct StagingRing {
+        uint64_t capacity   = {};
+        uint64_t head       = {};
+        uint64_t tail       = {};
+
+        auto allocate(this StagingRing& self, uint64_t size, uint64_t alignment) -> std::optional<uint64_t>;
+        void release(this StagingRing& self, uint64_t end);
+        void reset(this StagingRing& self);
+    };
+}
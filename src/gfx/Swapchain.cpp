@@ -2,9 +2,47 @@
 #include "Drawable.hpp"
 #include "Swapchain.hpp"
 
-gfx::Swapchain::Swapchain(rc<Device> device, rc<Surface> surface) : device(std::move(device)), surface(std::move(surface)) {}
+#include "spdlog/spdlog.h"
+
+#include <chrono>
+#include <algorithm>
+
+gfx::Swapchain::Swapchain(rc<Device> device, rc<Surface> surface)
+: device(std::move(device))
+, surface(std::move(surface))
+, offscreenExtent()
+, offscreenIndex(0)
+, config()
+, presentMode(vk::PresentModeKHR::eFifo)
+, imageSemaphores()
+, freeSemaphores()
+, lastAcquireTime(0.0)
+, totalAcquireTime(0.0)
+, acquireCount(0) {}
+
+gfx::Swapchain::Swapchain(rc<Device> device, vk::Extent2D extent)
+: device(std::move(device))
+, surface()
+, offscreenExtent(extent)
+, offscreenIndex(0)
+, config()
+, presentMode(vk::PresentModeKHR::eFifo)
+, imageSemaphores()
+, freeSemaphores()
+, lastAcquireTime(0.0)
+, totalAcquireTime(0.0)
+, acquireCount(0) {}
+
 gfx::Swapchain::~Swapchain() {
-    device->handle.destroySwapchainKHR(handle, nullptr, device->dispatcher);
+    for (auto semaphore : imageSemaphores) {
+        device->handle.destroySemaphore(semaphore, nullptr, device->dispatcher);
+    }
+    for (auto semaphore : freeSemaphores) {
+        device->handle.destroySemaphore(semaphore, nullptr, device->dispatcher);
+    }
+    if (handle) {
+        device->handle.destroySwapchainKHR(handle, nullptr, device->dispatcher);
+    }
 }
 
 auto gfx::Swapchain::drawableSize(this Swapchain const& self) -> vk::Extent2D {
@@ -13,27 +51,71 @@ auto gfx::Swapchain::drawableSize(this Swapchain const& self) -> vk::Extent2D {
 }
 
 auto gfx::Swapchain::nextDrawable(this Swapchain& self) -> rc<Drawable> {
-    auto fence = self.device->handle.createFenceUnique(vk::FenceCreateInfo(), nullptr, self.device->dispatcher);
+    // the frame that last rendered into an offscreen drawable was retired before its frame context came around again
+    if (!self.surface) {
+        auto& drawable = self.drawables[self.offscreenIndex];
+        self.offscreenIndex = (self.offscreenIndex + 1) % static_cast<uint32_t>(self.drawables.size());
+        return drawable;
+    }
+
+    using milliseconds = std::chrono::duration<double, std::chrono::milliseconds::period>;
+
+    auto semaphore = self._acquireSemaphore();
+    auto start = std::chrono::steady_clock::now();
 
     uint32_t image_index;
     auto result = self.device->handle.acquireNextImageKHR(
         self.handle,
         std::numeric_limits<uint64_t>::max(),
+        semaphore,
         nullptr,
-        *fence,
         &image_index,
         self.device->dispatcher
     );
-    if (result != vk::Result::eErrorOutOfDateKHR && result != vk::Result::eSuboptimalKHR && result != vk::Result::eSuccess) {
+
+    // the semaphore is left unsignaled when nothing was acquired, and the old images may still be in use by frames in flight
+    if (result == vk::Result::eErrorOutOfDateKHR) {
+        self.freeSemaphores.emplace_back(semaphore);
+        self.device->waitIdle();
+        self.configure(self.config);
+        return self.nextDrawable();
+    }
+    if (result != vk::Result::eSuboptimalKHR && result != vk::Result::eSuccess) {
         throw std::runtime_error("failed to acquire swapchain image");
     }
-    vk::resultCheck(self.device->handle.waitForFences(1, &*fence, true, std::numeric_limits<uint64_t>::max(), self.device->dispatcher), "waitForFences");
-    return self.drawables[uint64_t(image_index)];
+
+    self.lastAcquireTime = milliseconds(std::chrono::steady_clock::now() - start).count();
+    self.totalAcquireTime += self.lastAcquireTime;
+    self.acquireCount += 1;
+
+    // the previous semaphore of this image was waited on by the frame that rendered into it before it could be acquired again
+    if (self.imageSemaphores[image_index]) {
+        self.freeSemaphores.emplace_back(self.imageSemaphores[image_index]);
+    }
+    self.imageSemaphores[image_index] = semaphore;
+
+    auto& drawable = self.drawables[image_index];
+    drawable->acquireSemaphore = semaphore;
+    return drawable;
 }
 
 void gfx::Swapchain::configure(this Swapchain& self, const SurfaceConfiguration& config) {
+    if (!self.surface) {
+        self._configureOffscreen(config);
+        return;
+    }
+
+    self.config = config;
+    self.presentMode = self._choosePresentMode(config.present_mode);
+
     auto capabilities = self.device->adapter->getSurfaceCapabilities(self.surface);
 
+    auto image_count = std::max(config.image_count, config.max_frame_latency + 1);
+    image_count = std::max(image_count, capabilities.minImageCount);
+    if (capabilities.maxImageCount != 0) {
+        image_count = std::min(image_count, capabilities.maxImageCount);
+    }
+
     std::vector<uint32_t> queue_family_indices = {};
 //    if (mGraphicsQueueFamilyIndex != mPresentQueueFamilyIndex) {
 //        queue_family_indices.emplace_back(mGraphicsQueueFamilyIndex);
@@ -42,7 +124,7 @@ void gfx::Swapchain::configure(this Swapchain& self, const SurfaceConfiguration&
 
     vk::SwapchainCreateInfoKHR swapchain_create_info = {};
     swapchain_create_info.setSurface(self.surface->handle);
-    swapchain_create_info.setMinImageCount(config.image_count);
+    swapchain_create_info.setMinImageCount(image_count);
     swapchain_create_info.setImageFormat(config.format);
     swapchain_create_info.setImageColorSpace(config.color_space);
     swapchain_create_info.setImageExtent(capabilities.currentExtent);
@@ -56,7 +138,7 @@ void gfx::Swapchain::configure(this Swapchain& self, const SurfaceConfiguration&
     }
     swapchain_create_info.setPreTransform(capabilities.currentTransform);
     swapchain_create_info.setCompositeAlpha(vk::CompositeAlphaFlagBitsKHR::eOpaque);
-    swapchain_create_info.setPresentMode(config.present_mode);
+    swapchain_create_info.setPresentMode(self.presentMode);
     swapchain_create_info.setClipped(config.clipped);
     swapchain_create_info.setOldSwapchain(self.handle);
 
@@ -68,6 +150,14 @@ void gfx::Swapchain::configure(this Swapchain& self, const SurfaceConfiguration&
         self.device->handle.destroySwapchainKHR(old_swapchain, nullptr, self.device->dispatcher);
     }
 
+    // configure is only called while no frame is in flight, every semaphore is unsignaled and can be reused
+    for (auto semaphore : self.imageSemaphores) {
+        if (semaphore) {
+            self.freeSemaphores.emplace_back(semaphore);
+        }
+    }
+    self.imageSemaphores.assign(images.size(), VK_NULL_HANDLE);
+
     self.drawables.resize(images.size());
     for (size_t i = 0; i < images.size(); ++i) {
         vk::ImageViewCreateInfo view_create_info = {};
@@ -91,4 +181,57 @@ void gfx::Swapchain::configure(this Swapchain& self, const SurfaceConfiguration&
         );
         self.drawables[i] = rc<Drawable>::init(self.handle, std::move(texture), uint32_t(i));
     }
-}
\ No newline at end of file
+}
+
+void gfx::Swapchain::_configureOffscreen(this Swapchain& self, const SurfaceConfiguration& config) {
+    self.config = config;
+
+    TextureDescription description = {};
+    description.width = self.offscreenExtent.width;
+    description.height = self.offscreenExtent.height;
+    description.format = config.format;
+    description.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eSampled;
+
+    // paced like a surface swapchain, so that headless runs measure what windowed runs do
+    self.drawables.resize(std::max({config.image_count, config.max_frame_latency + 1, 1U}));
+    for (uint32_t i = 0; i < self.drawables.size(); ++i) {
+        self.drawables[i] = rc<Drawable>::init(VK_NULL_HANDLE, self.device->newTexture(description), i);
+    }
+    self.offscreenIndex = 0;
+}
+
+// mailbox keeps the latency of immediate without tearing, FIFO is the only mode every surface supports
+auto gfx::Swapchain::_choosePresentMode(this Swapchain& self, vk::PresentModeKHR preferred) -> vk::PresentModeKHR {
+    auto supported = self.device->adapter->getSurfacePresentModes(self.surface);
+
+    // the low latency modes stand in for each other before giving up on latency altogether
+    std::vector<vk::PresentModeKHR> candidates = {preferred};
+    if (preferred == vk::PresentModeKHR::eMailbox || preferred == vk::PresentModeKHR::eImmediate) {
+        candidates.emplace_back(preferred == vk::PresentModeKHR::eMailbox ? vk::PresentModeKHR::eImmediate : vk::PresentModeKHR::eMailbox);
+        candidates.emplace_back(vk::PresentModeKHR::eFifoRelaxed);
+    }
+    candidates.emplace_back(vk::PresentModeKHR::eFifo);
+
+    for (auto mode : candidates) {
+        if (std::ranges::find(supported, mode) != supported.end()) {
+            if (mode != preferred) {
+                spdlog::info("Present mode {} is not supported, using {}", vk::to_string(preferred), vk::to_string(mode));
+            }
+            return mode;
+        }
+    }
+    return vk::PresentModeKHR::eFifo;
+}
+
+auto gfx::Swapchain::_acquireSemaphore(this Swapchain& self) -> vk::Semaphore {
+    if (!self.freeSemaphores.empty()) {
+        auto semaphore = self.freeSemaphores.back();
+        self.freeSemaphores.pop_back();
+        return semaphore;
+    }
+
+    vk::Semaphore semaphore;
+    vk::SemaphoreCreateInfo semaphore_create_info = {};
+    vk::resultCheck(self.device->handle.createSemaphore(&semaphore_create_info, nullptr, &semaphore, self.device->dispatcher), "Failed to create semaphore");
+    return semaphore;
+}
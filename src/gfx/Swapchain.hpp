@@ -7,25 +7,46 @@ namespace gfx {
     struct Drawable;
 
     struct SurfaceConfiguration {
-        vk::Format          format       = {};
-        vk::ColorSpaceKHR   color_space  = {};
-        uint32_t            image_count  = {};
-        vk::PresentModeKHR  present_mode = {};
-        bool                clipped      = {};
+        vk::Format          format              = {};
+        vk::ColorSpaceKHR   color_space         = {};
+        uint32_t            image_count         = {};
+        vk::PresentModeKHR  present_mode        = {}; // preferred, see Swapchain::_choosePresentMode for the fallbacks
+        bool                clipped             = {};
+        uint32_t            max_frame_latency   = {}; // frames the CPU may run ahead, the swapchain keeps one more image so acquiring never waits
     };
 
+    // A swapchain without a surface is offscreen: its drawables are plain textures handed out in
+    // turn and presenting them does nothing, which lets the same frame code run without a display.
+    //
+    // Images are acquired with a binary semaphore that the command buffer rendering into the drawable
+    // waits on (CommandBuffer::waitForDrawable), so the CPU only blocks in acquire when every image is
+    // still owned by the presentation engine. The time spent there is recorded for the frame statistics.
     struct Swapchain : public ManagedObject {
         rc<Device>                  device;
         rc<Surface>                 surface;
         vk::SwapchainKHR            handle;
         std::vector<rc<Drawable>>   drawables;
+        vk::Extent2D                offscreenExtent;
+        uint32_t                    offscreenIndex;
+        SurfaceConfiguration        config;
+        vk::PresentModeKHR          presentMode;
+        std::vector<vk::Semaphore>  imageSemaphores;    // the semaphore the image was last acquired with
+        std::vector<vk::Semaphore>  freeSemaphores;
+        double                      lastAcquireTime;    // milliseconds
+        double                      totalAcquireTime;   // milliseconds
+        uint64_t                    acquireCount;
 
         explicit Swapchain(rc<Device> device, rc<Surface> surface);
+        explicit Swapchain(rc<Device> device, vk::Extent2D extent);
         ~Swapchain() override;
 
         auto nextDrawable(this Swapchain& self) -> rc<Drawable>;
         auto drawableSize(this Swapchain const& self) -> vk::Extent2D;
 
         void configure(this Swapchain& self, const SurfaceConfiguration& config);
+
+        void _configureOffscreen(this Swapchain& self, const SurfaceConfiguration& config);
+        auto _choosePresentMode(this Swapchain& self, vk::PresentModeKHR preferred) -> vk::PresentModeKHR;
+        auto _acquireSemaphore(this Swapchain& self) -> vk::Semaphore;
     };
 }
\ No newline at end of file
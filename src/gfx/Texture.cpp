@@ -1,45 +1,31 @@
 #include "Device.hpp"
-#include "Buffer.hpp"
+#include "Heap.hpp"
 #include "Texture.hpp"
-#include "CommandQueue.hpp"
-#include "CommandBuffer.hpp"
-#include "ComputePipelineState.hpp"
 
-gfx::Texture::Texture(rc<Device> device, vk::Image image, vk::Format format, vk::Extent3D extent, vk::ImageView image_view, vk::ImageSubresourceRange subresource, VmaAllocation allocation) : device(std::move(device)), image(image), format(format), extent(extent), image_view(image_view), subresource(subresource), allocation(allocation) {}
+#include <algorithm>
+#include <stdexcept>
+
+gfx::Texture::Texture(rc<Device> device, vk::Image image, vk::Format format, vk::Extent3D extent, vk::ImageView image_view, vk::ImageSubresourceRange subresource, VmaAllocation allocation) : device(std::move(device)), image(image), format(format), extent(extent), image_view(image_view), subresource(subresource), type(vk::ImageType::e2D), cube(false), allocation(allocation), heap(), parent() {}
 gfx::Texture::~Texture() {
     device->handle.destroyImageView(image_view, VK_NULL_HANDLE, device->dispatcher);
     if (allocation) {
+        device->_untrackAllocation(allocation);
         vmaDestroyImage(device->allocator, image, allocation);
+    } else if (heap) {
+        device->handle.destroyImage(image, VK_NULL_HANDLE, device->dispatcher);
     }
 }
 
-void gfx::Texture::replaceRegion(this Texture& self, const void* data, uint64_t size) {
-    auto storageBuffer = self.device->newBuffer(vk::BufferUsageFlagBits::eTransferSrc, data, size, StorageMode::eShared, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
-
-    vk::BufferImageCopy buffer_image_copy = {};
-    buffer_image_copy.setImageExtent(self.extent);
-    buffer_image_copy.imageSubresource.setAspectMask(self.subresource.aspectMask);
-    buffer_image_copy.imageSubresource.setLayerCount(1);
-
-    auto commandQueue = self.device->newCommandQueue();
-    auto commandBuffer = commandQueue->newCommandBuffer();
-
-    commandBuffer->begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-    commandBuffer->setImageLayout(self.shared_from_this(), vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, vk::PipelineStageFlagBits2::eHost, vk::PipelineStageFlagBits2::eTransfer, {}, vk::AccessFlagBits2::eTransferWrite);
-    commandBuffer->handle.copyBufferToImage(storageBuffer->handle, self.image, vk::ImageLayout::eTransferDstOptimal, 1, &buffer_image_copy, self.device->dispatcher);
-    commandBuffer->setImageLayout(self.shared_from_this(), vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlagBits2::eTransfer, vk::PipelineStageFlagBits2::eFragmentShader, vk::AccessFlagBits2::eTransferWrite, vk::AccessFlagBits2::eShaderRead);
-    commandBuffer->end();
-    commandBuffer->submit();
-    commandBuffer->waitUntilCompleted();
-}
-
+// a view only names its own image view, the image keeps the name of the texture it belongs to
 void gfx::Texture::setLabel(this Texture& self, std::string const& name) {
-    vk::DebugMarkerObjectNameInfoEXT image_info = {};
-    image_info.setObjectType(vk::DebugReportObjectTypeEXT::eImage);
-    image_info.setObject(uint64_t(static_cast<VkImage>(self.image)));
-    image_info.setPObjectName(name.c_str());
+    if (!self.parent) {
+        vk::DebugMarkerObjectNameInfoEXT image_info = {};
+        image_info.setObjectType(vk::DebugReportObjectTypeEXT::eImage);
+        image_info.setObject(uint64_t(static_cast<VkImage>(self.image)));
+        image_info.setPObjectName(name.c_str());
 
-    self.device->handle.debugMarkerSetObjectNameEXT(image_info, self.device->dispatcher);
+        self.device->handle.debugMarkerSetObjectNameEXT(image_info, self.device->dispatcher);
+    }
 
     vk::DebugMarkerObjectNameInfoEXT view_info = {};
     view_info.setObjectType(vk::DebugReportObjectTypeEXT::eImageView);
@@ -47,5 +33,57 @@ void gfx::Texture::setLabel(this Texture& self, std::string const& name) {
     view_info.setPObjectName(name.c_str());
 
     self.device->handle.debugMarkerSetObjectNameEXT(view_info, self.device->dispatcher);
+
+    if (self.allocation) {
+        self.device->_labelAllocation(self.allocation, name);
+    }
 }
 
+auto gfx::Texture::newTextureView(this Texture& self, vk::ImageViewType type, uint32_t baseMipLevel, uint32_t mipLevelCount, uint32_t baseArrayLayer, uint32_t arrayLayerCount) -> rc<Texture> {
+    if (baseMipLevel + mipLevelCount > self.subresource.levelCount || baseArrayLayer + arrayLayerCount > self.subresource.layerCount) {
+        throw std::runtime_error("Texture view range is out of bounds");
+    }
+    if (type == vk::ImageViewType::eCube || type == vk::ImageViewType::eCubeArray) {
+        if (!self.cube || arrayLayerCount == 0 || arrayLayerCount % 6 != 0 || (type == vk::ImageViewType::eCube && arrayLayerCount != 6)) {
+            throw std::runtime_error("Cube views need a cube compatible texture and six layers per cube");
+        }
+        if (type == vk::ImageViewType::eCubeArray && !self.device->imageCubeArray) {
+            throw std::runtime_error("Cube array views require the imageCubeArray feature");
+        }
+    }
+
+    // levels and layers are relative to the range this texture covers, so views of views work too
+    auto subresource = self.subresource;
+    subresource.setBaseMipLevel(self.subresource.baseMipLevel + baseMipLevel);
+    subresource.setLevelCount(mipLevelCount);
+    subresource.setBaseArrayLayer(self.subresource.baseArrayLayer + baseArrayLayer);
+    subresource.setLayerCount(arrayLayerCount);
+
+    vk::ImageViewCreateInfo view_create_info = {};
+    view_create_info.setImage(self.image);
+    view_create_info.setViewType(type);
+    view_create_info.setFormat(self.format);
+    view_create_info.setSubresourceRange(subresource);
+
+    auto texture = rc<Texture>::init(
+        self.device,
+        self.image,
+        self.format,
+        self.mipExtent(baseMipLevel),
+        self.device->handle.createImageView(view_create_info, VK_NULL_HANDLE, self.device->dispatcher),
+        subresource,
+        nullptr
+    );
+    texture->type = self.type;
+    texture->cube = self.cube;
+    texture->parent = self.parent ? self.parent : self.shared_from_this();
+    return texture;
+}
+
+auto gfx::Texture::mipExtent(this Texture const& self, uint32_t mipLevel) -> vk::Extent3D {
+    return vk::Extent3D(
+        std::max(1U, self.extent.width >> mipLevel),
+        std::max(1U, self.extent.height >> mipLevel),
+        std::max(1U, self.extent.depth >> mipLevel)
+    );
+}
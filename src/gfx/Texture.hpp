@@ -3,12 +3,19 @@
 #include "Device.hpp"
 
 namespace gfx {
+    struct Heap;
+
     struct TextureDescription {
-        uint32_t                width   = {};
-        uint32_t                height  = {};
-        vk::Format              format  = {};
-        vk::ImageUsageFlags     usage   = {};
-        vk::ComponentMapping    mapping = {};
+        vk::ImageType           type            = vk::ImageType::e2D;
+        uint32_t                width           = {};
+        uint32_t                height          = {};
+        uint32_t                depth           = 1;
+        uint32_t                mipLevelCount   = 1;
+        uint32_t                arrayLayerCount = 1;
+        bool                    cube            = false; // 2D only, every six layers are the faces of a cube
+        vk::Format              format          = {};
+        vk::ImageUsageFlags     usage           = {};
+        vk::ComponentMapping    mapping         = {};
     };
 
     struct Texture : public ManagedObject {
@@ -18,12 +25,17 @@ namespace gfx {
         vk::Extent3D                extent;
         vk::ImageView               image_view;
         vk::ImageSubresourceRange   subresource;
+        vk::ImageType               type;       // of the image, views share it with their parent
+        bool                        cube;       // the image is cube compatible
         VmaAllocation               allocation;
+        rc<Heap>                    heap;       // placed textures own their image but not its memory
+        rc<Texture>                 parent;     // views own neither, subresource is the range of the parent they cover
 
         explicit Texture(rc<Device> device, vk::Image image, vk::Format format, vk::Extent3D extent, vk::ImageView image_view, vk::ImageSubresourceRange subresource, VmaAllocation allocation);
         ~Texture() override;
 
-        void replaceRegion(this Texture& self, const void* data, uint64_t size);
         void setLabel(this Texture& self, std::string const& name);
+        auto newTextureView(this Texture& self, vk::ImageViewType type, uint32_t baseMipLevel, uint32_t mipLevelCount, uint32_t baseArrayLayer, uint32_t arrayLayerCount) -> rc<Texture>;
+        auto mipExtent(this Texture const& self, uint32_t mipLevel) -> vk::Extent3D;
     };
 }
\ No newline at end of file
@@ -0,0 +1,51 @@
+#include "ThreadPool.hpp"
+
+#include "spdlog/spdlog.h"
+
+gfx::ThreadPool::ThreadPool(uint32_t threadCount) : stopping(false) {
+    threads.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        threads.emplace_back([this] { _run(); });
+    }
+}
+
+gfx::ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void gfx::ThreadPool::enqueue(this ThreadPool& self, std::function<void()> task) {
+    {
+        std::lock_guard lock(self.mutex);
+        self.tasks.emplace_back(std::move(task));
+    }
+    self.condition.notify_one();
+}
+
+void gfx::ThreadPool::_run(this ThreadPool& self) {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(self.mutex);
+            self.condition.wait(lock, [&self] { return self.stopping || !self.tasks.empty(); });
+            if (self.tasks.empty()) {
+                return;
+            }
+            task = std::move(self.tasks.front());
+            self.tasks.pop_front();
+        }
+
+        try {
+            task();
+        } catch (std::exception const& e) {
+            spdlog::error("Thread pool task failed: {}", e.what());
+        }
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "ManagedObject.hpp"
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace gfx {
+    struct ThreadPool : public ManagedObject {
+        std::mutex                          mutex;
+        std::condition_variable             condition;
+        std::deque<std::function<void()>>   tasks;
+        std::vector<std::thread>            threads;
+        bool                                stopping;
+
+        explicit ThreadPool(uint32_t threadCount);
+        ~ThreadPool() override;
+
+        void enqueue(this ThreadPool& self, std::function<void()> task);
+        void _run(this ThreadPool& self);
+    };
+}
@@ -0,0 +1,106 @@
+#include "Buffer.hpp"
+#include "TransientAllocator.hpp"
+#include "DescriptorAllocator.hpp"
+
+#include <bit>
+#include <algorithm>
+#include <stdexcept>
+
+// everything a transient slice may be bound as
+static constexpr auto kTransientBufferUsage = vk::BufferUsageFlagBits::eVertexBuffer
+    | vk::BufferUsageFlagBits::eIndexBuffer
+    | vk::BufferUsageFlagBits::eUniformBuffer
+    | vk::BufferUsageFlagBits::eStorageBuffer
+    | vk::BufferUsageFlagBits::eIndirectBuffer;
+
+auto gfx::TransientSlice::descriptorInfo() const -> vk::DescriptorBufferInfo {
+    return vk::DescriptorBufferInfo{
+        .buffer = buffer->handle,
+        .offset = offset,
+        .range = size
+    };
+}
+
+gfx::TransientAllocator::TransientAllocator(rc<Device> device, uint32_t frameCount)
+: device(std::move(device))
+, mutex()
+, frames(std::max(frameCount, 1U))
+, frameIndex(0) {
+    for (auto& frame : frames) {
+        frame.descriptorAllocator = rc<DescriptorAllocator>::init(this->device);
+    }
+}
+
+void gfx::TransientAllocator::nextFrame(this TransientAllocator& self) {
+    std::lock_guard lock(self.mutex);
+    self.frameIndex += 1;
+
+    auto& frame = self.frames[self.frameIndex % self.frames.size()];
+    if (frame.chunks.size() > 1) {
+        // the frame overflowed, one chunk that fits all of it avoids growing again next time
+        frame.chunks.clear();
+        frame.chunks.emplace_back(self._newChunk(std::max(kChunkSize, std::bit_ceil(frame.used))));
+    }
+    for (auto& chunk : frame.chunks) {
+        chunk.descriptorSets.clear();
+    }
+    frame.descriptorAllocator->reset();
+    frame.current = 0;
+    frame.offset = 0;
+    frame.used = 0;
+}
+
+auto gfx::TransientAllocator::allocate(this TransientAllocator& self, vk::DeviceSize size, vk::DeviceSize alignment) -> TransientSlice {
+    std::lock_guard lock(self.mutex);
+
+    auto& frame = self.frames[self.frameIndex % self.frames.size()];
+    auto offset = (frame.offset + alignment - 1) / alignment * alignment;
+    while (frame.current < frame.chunks.size() && offset + size > frame.chunks[frame.current].size) {
+        frame.current += 1;
+        offset = 0;
+    }
+    if (frame.current == frame.chunks.size()) {
+        frame.chunks.emplace_back(self._newChunk(std::max(kChunkSize, std::bit_ceil(size))));
+    }
+
+    auto& chunk = frame.chunks[frame.current];
+    frame.used += offset - std::min(offset, frame.offset) + size;
+    frame.offset = offset + size;
+
+    return TransientSlice{
+        .buffer = chunk.buffer,
+        .offset = offset,
+        .size = size,
+        .contents = chunk.contents + offset
+    };
+}
+
+auto gfx::TransientAllocator::allocateUniform(this TransientAllocator& self, vk::DeviceSize size) -> TransientSlice {
+    return self.allocate(size, self.device->uniformBufferOffsetAlignment());
+}
+
+auto gfx::TransientAllocator::allocateStorage(this TransientAllocator& self, vk::DeviceSize size) -> TransientSlice {
+    return self.allocate(size, std::max(self.device->limits.minStorageBufferOffsetAlignment, vk::DeviceSize(16)));
+}
+
+auto gfx::TransientAllocator::uniformDescriptorSet(this TransientAllocator& self, TransientSlice const& slice, vk::DescriptorSetLayout layout) -> vk::DescriptorSet {
+    std::lock_guard lock(self.mutex);
+
+    auto& frame = self.frames[self.frameIndex % self.frames.size()];
+    auto chunk = std::ranges::find(frame.chunks, slice.buffer, &TransientAllocatorChunk::buffer);
+    if (chunk == frame.chunks.end()) {
+        throw std::runtime_error("Transient slice does not belong to the current frame");
+    }
+
+    return chunk->descriptorSets.get(*frame.descriptorAllocator, *chunk->buffer, layout, static_cast<uint32_t>(slice.size));
+}
+
+auto gfx::TransientAllocator::_newChunk(this TransientAllocator& self, vk::DeviceSize size) -> TransientAllocatorChunk {
+    auto buffer = self.device->newBuffer(kTransientBufferUsage, size, StorageMode::eShared);
+    auto contents = static_cast<std::byte*>(buffer->contents());
+    return TransientAllocatorChunk{
+        .buffer = std::move(buffer),
+        .size = size,
+        .contents = contents
+    };
+}
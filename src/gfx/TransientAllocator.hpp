@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Device.hpp"
+#include "ManagedObject.hpp"
+#include "DescriptorAllocator.hpp"
+
+#include <span>
+#include <mutex>
+#include <cstring>
+
+namespace gfx {
+    struct Buffer;
+
+    // A piece of a transient buffer, mapped for the whole frame it was allocated in.
+    struct TransientSlice {
+        rc<Buffer>      buffer      = {};
+        vk::DeviceSize  offset      = {};
+        vk::DeviceSize  size        = {};
+        std::byte*      contents    = {};
+
+        auto descriptorInfo() const -> vk::DescriptorBufferInfo;
+    };
+
+    struct TransientAllocatorChunk {
+        rc<Buffer>                  buffer          = {};
+        vk::DeviceSize              size            = {};
+        std::byte*                  contents        = {};
+        DynamicUniformBufferSets    descriptorSets  = {};
+    };
+
+    struct TransientAllocatorFrame {
+        std::vector<TransientAllocatorChunk>    chunks              = {};
+        size_t                                  current             = {};
+        vk::DeviceSize                          offset              = {};
+        vk::DeviceSize                          used                = {}; // bytes handed out, with alignment
+        rc<DescriptorAllocator>                 descriptorAllocator = {};
+    };
+
+    // Per-frame vertex, index, uniform and storage data bumped out of persistently mapped buffers. The
+    // allocator is split into one partition per frame in flight; nextFrame() moves on to the partition
+    // of the oldest frame, which the caller must have waited for, as FrameContextRing does. A partition
+    // that overflowed its chunk grows by another one and, at its next use, is merged into a single
+    // chunk sized to what the frame needed.
+    struct TransientAllocator : public ManagedObject {
+        static constexpr vk::DeviceSize kChunkSize = 1024 * 1024;
+
+        rc<Device>                              device;
+        std::mutex                              mutex;
+        std::vector<TransientAllocatorFrame>    frames;
+        uint64_t                                frameIndex;
+
+        explicit TransientAllocator(rc<Device> device, uint32_t frameCount);
+
+        void nextFrame(this TransientAllocator& self);
+        auto allocate(this TransientAllocator& self, vk::DeviceSize size, vk::DeviceSize alignment = 16) -> TransientSlice;
+        auto allocateUniform(this TransientAllocator& self, vk::DeviceSize size) -> TransientSlice;
+        auto allocateStorage(this TransientAllocator& self, vk::DeviceSize size) -> TransientSlice;
+
+        template<typename T>
+        auto allocate(this TransientAllocator& self, std::span<T const> data, vk::DeviceSize alignment = 16) -> TransientSlice {
+            auto slice = self.allocate(data.size_bytes(), std::max(vk::DeviceSize(alignof(T)), alignment));
+            std::memcpy(slice.contents, data.data(), data.size_bytes());
+            return slice;
+        }
+
+        // a set with a single dynamic uniform buffer at binding 0 reading the chunk of the slice
+        auto uniformDescriptorSet(this TransientAllocator& self, TransientSlice const& slice, vk::DescriptorSetLayout layout) -> vk::DescriptorSet;
+
+        auto _newChunk(this TransientAllocator& self, vk::DeviceSize size) -> TransientAllocatorChunk;
+    };
+}
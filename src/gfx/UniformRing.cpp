@@ -0,0 +1,49 @@
+#include "Buffer.hpp"
+#include "UniformRing.hpp"
+#include "DescriptorAllocator.hpp"
+
+#include <bit>
+#include <cstring>
+#include <algorithm>
+
+gfx::UniformRing::UniformRing(rc<Device> device)
+: device(std::move(device))
+, chunks()
+, current(0)
+, offset(0) {}
+
+void gfx::UniformRing::reset(this UniformRing& self) {
+    // the descriptor sets came from the descriptor allocator of the command buffer, reset with it
+    for (auto& chunk : self.chunks) {
+        chunk.descriptorSets.clear();
+    }
+    self.current = 0;
+    self.offset = 0;
+}
+
+auto gfx::UniformRing::allocate(this UniformRing& self, DescriptorAllocator& descriptorAllocator, vk::DescriptorSetLayout layout, std::span<std::byte const> data) -> UniformRingAllocation {
+    auto alignment = self.device->uniformBufferOffsetAlignment();
+    auto offset = (self.offset + alignment - 1) / alignment * alignment;
+
+    // move on to the next chunk, or start one, when the data does not fit
+    while (self.current < self.chunks.size() && offset + data.size() > self.chunks[self.current].size) {
+        self.current += 1;
+        offset = 0;
+    }
+    if (self.current == self.chunks.size()) {
+        auto size = std::max(kChunkSize, std::bit_ceil(uint64_t(data.size())));
+        self.chunks.emplace_back(UniformRingChunk{
+            .buffer = self.device->newBuffer(vk::BufferUsageFlagBits::eUniformBuffer, size, StorageMode::eShared),
+            .size = size
+        });
+    }
+
+    auto& chunk = self.chunks[self.current];
+    std::memcpy(static_cast<std::byte*>(chunk.buffer->contents()) + offset, data.data(), data.size());
+    self.offset = offset + data.size();
+
+    return UniformRingAllocation{
+        .descriptorSet = chunk.descriptorSets.get(descriptorAllocator, *chunk.buffer, layout, static_cast<uint32_t>(data.size())),
+        .dynamicOffset = static_cast<uint32_t>(offset)
+    };
+}
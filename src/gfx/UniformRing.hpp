@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Device.hpp"
+#include "ManagedObject.hpp"
+#include "DescriptorAllocator.hpp"
+
+#include <span>
+#include <cstddef>
+
+namespace gfx {
+    struct Buffer;
+
+    struct UniformRingChunk {
+        rc<Buffer>                  buffer          = {};
+        uint64_t                    size            = {};
+        DynamicUniformBufferSets    descriptorSets  = {};
+    };
+
+    struct UniformRingAllocation {
+        vk::DescriptorSet   descriptorSet   = {};
+        uint32_t            dynamicOffset   = {};
+    };
+
+    // Uniform data streamed while recording a command buffer, e.g. spilled push constants. Data is
+    // bumped into host visible chunks and reached through one dynamic uniform buffer descriptor per
+    // chunk and layout, so a draw pays for a copy and a dynamic offset. Reset with the command buffer.
+    struct UniformRing : public ManagedObject {
+        static constexpr uint64_t kChunkSize = 256 * 1024;
+
+        rc<Device>                      device;
+        std::vector<UniformRingChunk>   chunks;
+        size_t                          current;
+        uint64_t                        offset;
+
+        explicit UniformRing(rc<Device> device);
+
+        void reset(this UniformRing& self);
+        auto allocate(this UniformRing& self, DescriptorAllocator& descriptorAllocator, vk::DescriptorSetLayout layout, std::span<std::byte const> data) -> UniformRingAllocation;
+    };
+}
@@ -0,0 +1,244 @@
+#include "Buffer.hpp"
+#include "Texture.hpp"
+#include "UploadQueue.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+static constexpr uint64_t kStagingAlignment = 16;
+
+static void transitionImageLayout(gfx::Device& device, vk::CommandBuffer commandBuffer, gfx::Texture& texture, vk::ImageSubresourceRange const& range, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, vk::PipelineStageFlags2 srcStageMask, vk::PipelineStageFlags2 dstStageMask, vk::AccessFlags2 srcAccessMask, vk::AccessFlags2 dstAccessMask) {
+    vk::ImageMemoryBarrier2 barrier = {};
+    barrier.setSrcStageMask(srcStageMask);
+    barrier.setSrcAccessMask(srcAccessMask);
+    barrier.setDstStageMask(dstStageMask);
+    barrier.setDstAccessMask(dstAccessMask);
+    barrier.setOldLayout(oldLayout);
+    barrier.setNewLayout(newLayout);
+    barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+    barrier.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+    barrier.setImage(texture.image);
+    barrier.setSubresourceRange(range);
+
+    vk::DependencyInfo dependency_info = {};
+    dependency_info.setImageMemoryBarrierCount(1);
+    dependency_info.setPImageMemoryBarriers(&barrier);
+
+    commandBuffer.pipelineBarrier2(dependency_info, device.dispatcher);
+}
+
+gfx::UploadQueue::UploadQueue(rc<Device> device, uint64_t stagingSize)
+: device(std::move(device))
+, queueFamilyIndex(this->device->transferQueueFamilyIndex())
+, queue(this->device->handle.getQueue(queueFamilyIndex, 0, this->device->dispatcher))
+, commandPool()
+, semaphore()
+, stagingBuffer(this->device->newBuffer(vk::BufferUsageFlagBits::eTransferSrc, stagingSize, StorageMode::eShared))
+, staging(StagingRing{.capacity = stagingSize})
+, submittedValue(0)
+, recording()
+, inFlight()
+, available()
+, mutex() {
+    vk::CommandPoolCreateInfo pool_create_info = {};
+    pool_create_info.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient);
+    pool_create_info.setQueueFamilyIndex(queueFamilyIndex);
+    vk::resultCheck(this->device->handle.createCommandPool(&pool_create_info, nullptr, &commandPool, this->device->dispatcher), "Failed to create command pool");
+
+    vk::SemaphoreTypeCreateInfo semaphore_type_create_info = {};
+    semaphore_type_create_info.setSemaphoreType(vk::SemaphoreType::eTimeline);
+    semaphore_type_create_info.setInitialValue(0);
+
+    vk::SemaphoreCreateInfo semaphore_create_info = {};
+    semaphore_create_info.setPNext(&semaphore_type_create_info);
+    vk::resultCheck(this->device->handle.createSemaphore(&semaphore_create_info, nullptr, &semaphore, this->device->dispatcher), "Failed to create semaphore");
+}
+
+gfx::UploadQueue::~UploadQueue() {
+    waitUntilCompleted(submittedValue);
+
+    device->handle.destroySemaphore(semaphore, nullptr, device->dispatcher);
+    device->handle.destroyCommandPool(commandPool, nullptr, device->dispatcher);
+}
+
+auto gfx::UploadQueue::newBuffer(this UploadQueue& self, vk::BufferUsageFlags usage, const void* pointer, uint64_t size) -> rc<Buffer> {
+    auto buffer = self.device->newBuffer(usage | vk::BufferUsageFlagBits::eTransferDst, size, StorageMode::ePrivate);
+    self.replaceRegion(buffer, 0, pointer, size);
+    return buffer;
+}
+
+void gfx::UploadQueue::replaceRegion(this UploadQueue& self, rc<Buffer> const& buffer, uint64_t offset, const void* pointer, uint64_t size) {
+    std::lock_guard lock(self.mutex);
+
+    auto [source, source_offset] = self._stage(pointer, size);
+
+    vk::BufferCopy buffer_copy = {};
+    buffer_copy.setSrcOffset(source_offset);
+    buffer_copy.setDstOffset(offset);
+    buffer_copy.setSize(size);
+
+    self._commandBuffer().copyBuffer(source, buffer->handle, 1, &buffer_copy, self.device->dispatcher);
+    self.recording.retainedBuffers.emplace_back(buffer);
+}
+
+void gfx::UploadQueue::replaceRegion(this UploadQueue& self, rc<Texture> const& texture, const void* pointer, uint64_t size) {
+    self.replaceRegion(texture, 0, 0, pointer, size);
+}
+
+void gfx::UploadQueue::replaceRegion(this UploadQueue& self, rc<Texture> const& texture, uint32_t mipLevel, uint32_t slice, const void* pointer, uint64_t size) {
+    if (mipLevel >= texture->subresource.levelCount || slice >= texture->subresource.layerCount) {
+        throw std::runtime_error("Texture region is out of bounds");
+    }
+
+    std::lock_guard lock(self.mutex);
+
+    auto [source, source_offset] = self._stage(pointer, size);
+
+    // the whole level of a single layer is replaced, so its previous contents can be discarded
+    vk::ImageSubresourceRange range = texture->subresource;
+    range.setBaseMipLevel(texture->subresource.baseMipLevel + mipLevel);
+    range.setLevelCount(1);
+    range.setBaseArrayLayer(texture->subresource.baseArrayLayer + slice);
+    range.setLayerCount(1);
+
+    vk::BufferImageCopy buffer_image_copy = {};
+    buffer_image_copy.setBufferOffset(source_offset);
+    buffer_image_copy.setImageExtent(texture->mipExtent(mipLevel));
+    buffer_image_copy.imageSubresource.setAspectMask(range.aspectMask);
+    buffer_image_copy.imageSubresource.setMipLevel(range.baseMipLevel);
+    buffer_image_copy.imageSubresource.setBaseArrayLayer(range.baseArrayLayer);
+    buffer_image_copy.imageSubresource.setLayerCount(1);
+
+    // the transfer queue may not support graphics stages, readers are synchronized by the timeline semaphore instead
+    auto commandBuffer = self._commandBuffer();
+    transitionImageLayout(*self.device, commandBuffer, *texture, range, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, vk::PipelineStageFlagBits2::eNone, vk::PipelineStageFlagBits2::eTransfer, {}, vk::AccessFlagBits2::eTransferWrite);
+    commandBuffer.copyBufferToImage(source, texture->image, vk::ImageLayout::eTransferDstOptimal, 1, &buffer_image_copy, self.device->dispatcher);
+    transitionImageLayout(*self.device, commandBuffer, *texture, range, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, vk::PipelineStageFlagBits2::eTransfer, vk::PipelineStageFlagBits2::eNone, vk::AccessFlagBits2::eTransferWrite, {});
+    self.recording.retainedTextures.emplace_back(texture);
+}
+
+auto gfx::UploadQueue::flush(this UploadQueue& self) -> uint64_t {
+    std::lock_guard lock(self.mutex);
+    return self._flush();
+}
+
+auto gfx::UploadQueue::completedValue(this UploadQueue& self) -> uint64_t {
+    return self.device->handle.getSemaphoreCounterValue(self.semaphore, self.device->dispatcher);
+}
+
+void gfx::UploadQueue::waitUntilCompleted(this UploadQueue& self, uint64_t value) {
+    vk::SemaphoreWaitInfo wait_info = {};
+    wait_info.setSemaphoreCount(1);
+    wait_info.setPSemaphores(&self.semaphore);
+    wait_info.setPValues(&value);
+    vk::resultCheck(self.device->handle.waitSemaphores(wait_info, std::numeric_limits<uint64_t>::max(), self.device->dispatcher), "Failed to wait for semaphore");
+}
+
+auto gfx::UploadQueue::_stage(this UploadQueue& self, const void* pointer, uint64_t size) -> std::pair<vk::Buffer, uint64_t> {
+    // too large for the ring, give it a staging buffer of its own that lives until the batch retires
+    if (size > self.staging.capacity) {
+        auto buffer = self.device->newBuffer(vk::BufferUsageFlagBits::eTransferSrc, pointer, size, StorageMode::eShared);
+        self._commandBuffer();
+        self.recording.retainedBuffers.emplace_back(buffer);
+        return {buffer->handle, 0};
+    }
+
+    std::optional<uint64_t> offset;
+    while (true) {
+        self._retire(false);
+
+        // no batch refers to the ring, start over at its beginning
+        if (!self.recording.commandBuffer && self.inFlight.empty()) {
+            self.staging.reset();
+        }
+
+        offset = self.staging.allocate(size, kStagingAlignment);
+        if (offset.has_value()) {
+            break;
+        }
+
+        // the ring is full, submit what was recorded so far and wait for the oldest batch
+        self._flush();
+        self._retire(true);
+    }
+
+    self._commandBuffer();
+    self.recording.stagingEnd = self.staging.head;
+
+    auto position = *offset % self.staging.capacity;
+    std::memcpy(static_cast<char*>(self.stagingBuffer->contents()) + position, pointer, size);
+    return {self.stagingBuffer->handle, position};
+}
+
+auto gfx::UploadQueue::_commandBuffer(this UploadQueue& self) -> vk::CommandBuffer {
+    if (self.recording.commandBuffer) {
+        return self.recording.commandBuffer;
+    }
+
+    if (self.available.empty()) {
+        vk::CommandBufferAllocateInfo allocate_info = {};
+        allocate_info.setCommandPool(self.commandPool);
+        allocate_info.setLevel(vk::CommandBufferLevel::ePrimary);
+        allocate_info.setCommandBufferCount(1);
+        vk::resultCheck(self.device->handle.allocateCommandBuffers(&allocate_info, &self.recording.commandBuffer, self.device->dispatcher), "Failed to allocate command buffer");
+    } else {
+        self.recording.commandBuffer = self.available.back().commandBuffer;
+        self.available.pop_back();
+    }
+    self.recording.stagingEnd = self.staging.head;
+
+    vk::CommandBufferBeginInfo begin_info = {};
+    begin_info.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+    self.recording.commandBuffer.begin(begin_info, self.device->dispatcher);
+    return self.recording.commandBuffer;
+}
+
+auto gfx::UploadQueue::_flush(this UploadQueue& self) -> uint64_t {
+    if (!self.recording.commandBuffer) {
+        return self.submittedValue;
+    }
+
+    self.recording.commandBuffer.end(self.device->dispatcher);
+    self.recording.value = ++self.submittedValue;
+
+    vk::TimelineSemaphoreSubmitInfo timeline_submit_info = {};
+    timeline_submit_info.setSignalSemaphoreValueCount(1);
+    timeline_submit_info.setPSignalSemaphoreValues(&self.recording.value);
+
+    vk::SubmitInfo submit_info = {};
+    submit_info.setPNext(&timeline_submit_info);
+    submit_info.setCommandBufferCount(1);
+    submit_info.setPCommandBuffers(&self.recording.commandBuffer);
+    submit_info.setSignalSemaphoreCount(1);
+    submit_info.setPSignalSemaphores(&self.semaphore);
+
+    {
+        std::lock_guard queue_lock(self.device->queueMutex);
+        vk::resultCheck(self.queue.submit(1, &submit_info, VK_NULL_HANDLE, self.device->dispatcher), "Failed to submit upload batch");
+    }
+
+    self.inFlight.emplace_back(std::move(self.recording));
+    self.recording = {};
+    return self.submittedValue;
+}
+
+void gfx::UploadQueue::_retire(this UploadQueue& self, bool wait) {
+    if (self.inFlight.empty()) {
+        return;
+    }
+    if (wait) {
+        self.waitUntilCompleted(self.inFlight.front().value);
+    }
+
+    auto completed = self.completedValue();
+    while (!self.inFlight.empty() && self.inFlight.front().value <= completed) {
+        auto batch = std::move(self.inFlight.front());
+        self.inFlight.pop_front();
+
+        self.staging.release(batch.stagingEnd);
+        batch.commandBuffer.reset({}, self.device->dispatcher);
+        batch.retainedBuffers.clear();
+        batch.retainedTextures.clear();
+        self.available.emplace_back(std::move(batch));
+    }
+}
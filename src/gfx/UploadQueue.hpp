@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Device.hpp"
+#include "StagingRing.hpp"
+#include "ManagedObject.hpp"
+
+#include <deque>
+#include <mutex>
+
+namespace gfx {
+    struct UploadBatch {
+        vk::CommandBuffer           commandBuffer       = {};
+        uint64_t                    value               = {};
+        uint64_t                    stagingEnd          = {};
+        std::vector<rc<Buffer>>     retainedBuffers     = {}; // destinations and oversized staging buffers
+        std::vector<rc<Texture>>    retainedTextures    = {}; // destinations
+    };
+
+    // Copies CPU data into device local buffers and textures without blocking the caller. Copies
+    // are staged through a persistent ring buffer, recorded into a single batch and submitted to
+    // a transfer queue on flush(). Every submitted batch signals the next value of a timeline
+    // semaphore, command buffers which read uploaded resources wait for that value. Destinations
+    // are retained by the batch until its value completes, callers may drop them right away.
+    // Texture uploads replace a whole mip level of one array layer (a cube face, or the whole
+    // volume of a 3D texture) and leave it in eShaderReadOnlyOptimal.
+    struct UploadQueue : public ManagedObject {
+        rc<Device>                  device;
+        uint32_t                    queueFamilyIndex;
+        vk::Queue                   queue;
+        vk::CommandPool             commandPool;
+        vk::Semaphore               semaphore;
+        rc<Buffer>                  stagingBuffer;
+        StagingRing                 staging;
+        uint64_t                    submittedValue;
+        UploadBatch                 recording;
+        std::deque<UploadBatch>     inFlight;
+        std::vector<UploadBatch>    available;
+        std::mutex                  mutex;
+
+        explicit UploadQueue(rc<Device> device, uint64_t stagingSize);
+        ~UploadQueue() override;
+
+        auto newBuffer(this UploadQueue& self, vk::BufferUsageFlags usage, const void* pointer, uint64_t size) -> rc<Buffer>;
+        void replaceRegion(this UploadQueue& self, rc<Buffer> const& buffer, uint64_t offset, const void* pointer, uint64_t size);
+        void replaceRegion(this UploadQueue& self, rc<Texture> const& texture, const void* pointer, uint64_t size);
+        void replaceRegion(this UploadQueue& self, rc<Texture> const& texture, uint32_t mipLevel, uint32_t slice, const void* pointer, uint64_t size);
+        auto flush(this UploadQueue& self) -> uint64_t;
+        auto completedValue(this UploadQueue& self) -> uint64_t;
+        void waitUntilCompleted(this UploadQueue& self, uint64_t value);
+
+        auto _stage(this UploadQueue& self, const void* pointer, uint64_t size) -> std::pair<vk::Buffer, uint64_t>;
+        auto _commandBuffer(this UploadQueue& self) -> vk::CommandBuffer;
+        auto _flush(this UploadQueue& self) -> uint64_t;
+        void _retire(this UploadQueue& self, bool wait);
+    };
+}
@@ -0,0 +1,75 @@
+#include "gfx/StagingRing.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+// Offsets handed out by the staging ring of UploadQueue. No device is needed, the ring only
+// does the bookkeeping of where uploads are copied to.
+
+static constexpr uint64_t kMiB = 1024 * 1024;
+static constexpr uint64_t kAlignment = 16;
+
+static int failures = 0;
+
+static void check(bool condition, char const* message) {
+    if (!condition) {
+        std::fprintf(stderr, "FAILED: %s\n", message);
+        failures += 1;
+    }
+}
+
+// 20 MiB then 24 MiB in a 32 MiB ring: the second upload has to wrap, which only fits once the
+// ring is reset after the first one retired
+static void testWrapAfterIdle() {
+    gfx::StagingRing ring = {.capacity = 32 * kMiB};
+
+    auto first = ring.allocate(20 * kMiB, kAlignment);
+    check(first == 0, "first upload starts at the beginning of the ring");
+    ring.release(ring.head);
+
+    check(!ring.allocate(24 * kMiB, kAlignment).has_value(), "an upload that wraps does not fit before the reset");
+
+    ring.reset();
+    auto second = ring.allocate(24 * kMiB, kAlignment);
+    check(second == 0, "an idle ring starts over at its beginning");
+}
+
+static void testAlignment() {
+    gfx::StagingRing ring = {.capacity = 1 * kMiB};
+
+    check(ring.allocate(3, kAlignment) == 0, "first upload starts at the beginning of the ring");
+    check(ring.allocate(5, kAlignment) == kAlignment, "uploads are aligned");
+}
+
+static void testWrapWaitsForTail() {
+    gfx::StagingRing ring = {.capacity = 1024};
+
+    check(ring.allocate(512, kAlignment) == 0, "first half");
+    check(ring.allocate(384, kAlignment) == 512, "second part");
+    check(!ring.allocate(256, kAlignment).has_value(), "the wrapped upload overlaps the unreleased first half");
+
+    ring.release(512);
+    auto wrapped = ring.allocate(256, kAlignment);
+    check(wrapped == 1024, "the wrapped upload skips the end of the ring");
+    check(wrapped.has_value() && *wrapped % ring.capacity == 0, "the wrapped upload starts at the beginning of the ring");
+}
+
+static void testTooLarge() {
+    gfx::StagingRing ring = {.capacity = 1024};
+
+    check(!ring.allocate(2048, kAlignment).has_value(), "uploads larger than the ring never fit");
+    check(ring.head == 0, "a failed allocation does not move the head");
+}
+
+int main() {
+    testWrapAfterIdle();
+    testAlignment();
+    testWrapWaitsForTail();
+    testTooLarge();
+
+    if (failures != 0) {
+        return EXIT_FAILURE;
+    }
+    std::printf("staging ring: all checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,57 @@
+#include "gfx/ShaderArchive.hpp"
+
+#include <vector>
+#include <cstdio>
+#include <fstream>
+#include <exception>
+#include <string_view>
+
+// Packs compiled SPIR-V modules and their reflection into one archive, run by target_compile_shaders:
+//
+//     shader-archiver <output> <name>=<path.spv>...
+
+static auto readCode(std::filesystem::path const& path) -> std::vector<uint32_t> {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open '" + path.string() + "'");
+    }
+
+    auto size = static_cast<size_t>(file.tellg());
+    if (size % sizeof(uint32_t) != 0) {
+        throw std::runtime_error("'" + path.string() + "' is not a SPIR-V module");
+    }
+
+    std::vector<uint32_t> code(size / sizeof(uint32_t));
+    file.seekg(0, std::ios::beg);
+    file.read(reinterpret_cast<char*>(code.data()), static_cast<std::streamsize>(size));
+    return code;
+}
+
+auto main(int argc, char** argv) -> int {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: shader-archiver <output> <name>=<path.spv>...\n");
+        return 1;
+    }
+
+    try {
+        std::vector<gfx::ShaderArchive::Module> modules = {};
+        for (int i = 2; i < argc; ++i) {
+            auto argument = std::string_view(argv[i]);
+            auto separator = argument.find('=');
+            if (separator == std::string_view::npos) {
+                std::fprintf(stderr, "shader-archiver: expected <name>=<path.spv>, got '%s'\n", argv[i]);
+                return 1;
+            }
+
+            auto& module = modules.emplace_back();
+            module.name = std::string(argument.substr(0, separator));
+            module.code = readCode(std::filesystem::path(argument.substr(separator + 1)));
+            module.reflection = gfx::ShaderReflection::reflect(module.code);
+        }
+        gfx::ShaderArchive::write(argv[1], modules);
+    } catch (std::exception const& e) {
+        std::fprintf(stderr, "shader-archiver: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}